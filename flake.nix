@@ -19,6 +19,8 @@
             pkgs.qt6.qtsvg
             pkgs.wayland
             pkgs.libxkbcommon
+            pkgs.zstd
+            pkgs.libxcrypt
             pkgs.meson
             pkgs.ninja
             pkgs.pkg-config
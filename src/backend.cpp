@@ -0,0 +1,234 @@
+#include "backend.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace {
+
+// Two threads: jobs are short, and a scan should not wait behind another
+class BackendPool : public QThreadPool
+{
+public:
+    BackendPool()
+    {
+        setObjectName("backend");
+        setMaxThreadCount(2);
+    }
+};
+
+Q_GLOBAL_STATIC(BackendPool, backendPool)
+
+QString humanSize(qulonglong bytes)
+{
+    const double kb = 1024.0;
+    const double mb = kb * 1024.0;
+    const double gb = mb * 1024.0;
+    const double tb = gb * 1024.0;
+    if (bytes >= (qulonglong)tb) return QString::number(bytes / tb, 'f', 2) + " TB";
+    if (bytes >= (qulonglong)gb) return QString::number(bytes / gb, 'f', 2) + " GB";
+    if (bytes >= (qulonglong)mb) return QString::number(bytes / mb, 'f', 2) + " MB";
+    if (bytes >= (qulonglong)kb) return QString::number(bytes / kb, 'f', 2) + " KB";
+    return QString::number(bytes) + " B";
+}
+
+QString interfaceLabel(const QString &tran, const QString &name)
+{
+    QString t = tran.trimmed().toLower();
+    if (t == "sata" || t == "ata") return "SATA";
+    if (t == "nvme") return "NVMe";
+    if (t == "usb") return "USB";
+    if (t == "mmc") return "MMC";
+    if (t == "virtio") return "Virtio";
+    if (name.startsWith("nvme")) return "NVMe";
+    return t.isEmpty() ? "" : t.toUpper();
+}
+
+QString devicePath(const QJsonObject &o)
+{
+    const QString path = o.value("path").toString();
+    if (!path.isEmpty()) return path;
+    const QString name = o.value("name").toString();
+    return name.isEmpty() ? QString() : "/dev/" + name;
+}
+
+// "/dev/nvme0n1p2 — 953.87 GB • LABEL=… • UUID=0f4c1d3e… • crypto_LUKS • /boot"
+QString partitionLine(const QJsonObject &po)
+{
+    const qulonglong size = po.value("size").toVariant().toULongLong();
+    QString label = po.value("label").toString();
+    QString uuid = po.value("uuid").toString();
+    const QString fstype = po.value("fstype").toString();
+    // mountpoints may be an array; fallback to single mountpoint if present
+    QStringList mps;
+    const QJsonValue mpsVal = po.value("mountpoints");
+    if (mpsVal.isArray()) {
+        for (const QJsonValue &mv : mpsVal.toArray()) {
+            const QString s = mv.toString();
+            if (!s.isEmpty()) mps << s;
+        }
+    } else {
+        const QString mp = po.value("mountpoint").toString();
+        if (!mp.isEmpty()) mps << mp;
+    }
+    // Truncate long fields for compact tooltips
+    if (label.size() > 16) label = label.left(16) + "…";
+    if (uuid.size() > 8) uuid = uuid.left(8) + "…";
+
+    QString extra;
+    if (!label.isEmpty()) extra += QString(" • LABEL=%1").arg(label);
+    if (!uuid.isEmpty()) extra += QString(" • UUID=%1").arg(uuid);
+    if (!fstype.isEmpty()) extra += QString(" • %1").arg(fstype);
+    if (!mps.isEmpty()) extra += QString(" • %1").arg(mps.join(", "));
+    return QString("%1 — %2%3").arg(devicePath(po), humanSize(size), extra);
+}
+
+#ifdef NIXLY_DEBUG_CHECKS
+// Last time the GUI thread's event loop ran a timer
+std::atomic<qint64> heartbeatMs { 0 };
+// Set once the event loop is done; teardown may then block for as long as it needs
+std::atomic<bool> watchdogStopped { false };
+
+qint64 steadyMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+} // namespace
+
+void Backend::start(std::function<void()> job)
+{
+    backendPool()->start(std::move(job));
+}
+
+void Backend::assertOffGuiThread(const char *what)
+{
+#ifdef NIXLY_DEBUG_CHECKS
+    if (qApp && QThread::currentThread() == qApp->thread())
+        qFatal("%s ran on the GUI thread; hand it to Backend::run", what);
+#else
+    Q_UNUSED(what);
+#endif
+}
+
+Backend::DriveScan Backend::parseDrives(const QByteArray &lsblkJson)
+{
+    assertOffGuiThread("Backend::parseDrives");
+    DriveScan scan;
+    QJsonParseError jerr;
+    const QJsonDocument jd = QJsonDocument::fromJson(lsblkJson, &jerr);
+    if (jerr.error != QJsonParseError::NoError || !jd.isObject()) {
+        scan.error = jerr.errorString();
+        return scan;
+    }
+    for (const QJsonValue &v : jd.object().value("blockdevices").toArray()) {
+        const QJsonObject o = v.toObject();
+        if (o.value("type").toString() != "disk") continue;
+        Drive d;
+        d.path = devicePath(o);
+        const QString model = o.value("model").toString().trimmed();
+        const QString vendor = o.value("vendor").toString().trimmed();
+        // Compose vendor + model nicely
+        if (!vendor.isEmpty()) {
+            d.name = vendor;
+            if (!model.isEmpty() && !model.startsWith(vendor)) d.name += " " + model;
+        } else {
+            d.name = model;
+        }
+        if (d.name.trimmed().isEmpty()) d.name = "Unknown";
+        d.interface = interfaceLabel(o.value("tran").toString(), o.value("name").toString());
+        if (d.interface.isEmpty()) d.interface = "Unknown";
+        d.size = humanSize(o.value("size").toVariant().toULongLong());
+
+        QStringList partLines;
+        for (const QJsonValue &pv : o.value("children").toArray()) {
+            const QJsonObject po = pv.toObject();
+            if (po.value("type").toString() == "part") partLines << partitionLine(po);
+        }
+        if (!partLines.isEmpty()) {
+            d.partitionsHtml = QString("<div style='min-width:700px; font-size:14px; font-weight:600;'>Partitions on %1</div><div style='min-width:700px; font-size:14px;'>%2</div>")
+                                   .arg(d.path, partLines.join("<br>"));
+        } else {
+            d.partitionsHtml = QString("<div style='min-width:480px; font-size:14px; font-weight:600;'>No partitions found on %1</div>").arg(d.path);
+        }
+        scan.drives << d;
+    }
+    return scan;
+}
+
+Backend::GhLoginOutput Backend::scanGhLogin(const QString &output)
+{
+    assertOffGuiThread("Backend::scanGhLogin");
+    static const QRegularExpression direct("([A-Za-z0-9]{4}-[A-Za-z0-9]{4})", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression oneTime("one[- ]?time code\\s*:\\s*([A-Za-z0-9\\-]{4,})", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression labelled("code\\s*:\\s*([A-Za-z0-9\\-]{4,})", QRegularExpression::CaseInsensitiveOption);
+
+    GhLoginOutput result;
+    result.asksGitCredentials = output.contains("Authenticate Git with your GitHub credentials", Qt::CaseInsensitive);
+    result.asksEnter = output.contains("Press Enter", Qt::CaseInsensitive);
+    // A bare XXXX-XXXX first, then "one-time code: <code>", then "code: <code>"
+    for (const QRegularExpression *re : { &direct, &oneTime, &labelled }) {
+        const QRegularExpressionMatch m = re->match(output);
+        if (m.hasMatch()) {
+            result.deviceCode = m.captured(1).toUpper();
+            break;
+        }
+    }
+    return result;
+}
+
+Backend::CloneResult Backend::classifyClone(int exitCode, const QString &out, const QString &err)
+{
+    assertOffGuiThread("Backend::classifyClone");
+    CloneResult result;
+    result.ok = exitCode == 0;
+    if (result.ok) return result;
+    const QString combined = out + "\n" + err;
+    const QString lc = combined.toLower();
+    result.kept = (lc.contains("destination path") && lc.contains("already exists"))
+                  || lc.contains("not an empty directory");
+    if (!result.kept) result.message = combined.trimmed();
+    return result;
+}
+
+void Backend::startWatchdog()
+{
+#ifdef NIXLY_DEBUG_CHECKS
+    const int limitMs = qEnvironmentVariableIsSet("NIXLYINSTALL_WATCHDOG_MS")
+                            ? qEnvironmentVariableIntValue("NIXLYINSTALL_WATCHDOG_MS") : 500;
+    if (limitMs <= 0) return;
+    const int periodMs = qMax(10, limitMs / 5);
+    // Beats once the event loop runs; the watchdog waits for the first beat
+    QTimer *beat = new QTimer(qApp);
+    beat->setInterval(periodMs);
+    QObject::connect(beat, &QTimer::timeout, beat, []() { heartbeatMs.store(steadyMs(), std::memory_order_relaxed); });
+    beat->start();
+    QObject::connect(qApp, &QCoreApplication::aboutToQuit, beat, []() { watchdogStopped.store(true); });
+    std::thread([limitMs, periodMs]() {
+        while (!watchdogStopped.load()) {
+            const qint64 before = steadyMs();
+            std::this_thread::sleep_for(std::chrono::milliseconds(periodMs));
+            const qint64 now = steadyMs();
+            // Late ourselves: the whole process was stopped (a debugger, SIGSTOP)
+            if (now - before > periodMs + limitMs) {
+                heartbeatMs.store(now, std::memory_order_relaxed);
+                continue;
+            }
+            const qint64 last = heartbeatMs.load(std::memory_order_relaxed);
+            if (last && !watchdogStopped.load() && now - last > limitMs) {
+                qFatal("GUI thread blocked for %lld ms (limit %d ms, NIXLYINSTALL_WATCHDOG_MS); "
+                       "--trace=<file> shows what ran", now - last, limitMs);
+            }
+        }
+    }).detach();
+#endif
+}
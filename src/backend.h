@@ -0,0 +1,79 @@
+#pragma once
+
+#include <QCoreApplication>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <functional>
+
+#include "tracer.h"
+
+// What the installer makes of its helper processes' output (lsblk's JSON,
+// gh's login chatter, git's errors) is worked out here, on a pool of its
+// own, never on the GUI thread. Every job returns a plain result struct,
+// which a queued call hands back to the GUI thread. The GUI side only turns
+// it into widgets.
+//
+// Debug builds (meson's debug option, or -Ddebug_checks=enabled) check both
+// ends. The parsers abort when called on the GUI thread. A watchdog aborts
+// when the GUI thread has not returned to its event loop for
+// NIXLYINSTALL_WATCHDOG_MS (default 500; 0 turns it off).
+class Backend
+{
+public:
+    struct Drive {
+        QString path;                   // "/dev/nvme0n1"
+        QString name;                   // vendor and model; "Unknown"
+        QString interface;              // "NVMe", "SATA", ...; "Unknown"
+        QString size;                   // "953.87 GB"
+        QString partitionsHtml;         // hover text listing its partitions
+    };
+
+    struct DriveScan {
+        QList<Drive> drives;            // whole disks only
+        QString error;                  // lsblk's output did not parse
+    };
+
+    // One chunk of `gh auth login` output
+    struct GhLoginOutput {
+        bool asksGitCredentials = false;
+        bool asksEnter = false;
+        QString deviceCode;             // upper-cased "XXXX-XXXX"; empty if none
+    };
+
+    struct CloneResult {
+        bool ok = false;
+        bool kept = false;              // the checkout already existed
+        QString message;                // git's output on any other failure
+    };
+
+    // Blocking; for the backend pool only
+    static DriveScan parseDrives(const QByteArray &lsblkJson);
+    static GhLoginOutput scanGhLogin(const QString &output);
+    static CloneResult classifyClone(int exitCode, const QString &out, const QString &err);
+
+    // Runs `work` on the backend pool. `done` gets its result on the GUI
+    // thread, unless `context` has been deleted by then.
+    template <typename Work, typename Done>
+    static void run(QObject *context, const char *name, Work work, Done done)
+    {
+        QPointer<QObject> guard(context);
+        [[maybe_unused]] const quint64 parent = Tracer::current();
+        start([guard, name, parent, work = std::move(work), done = std::move(done)]() {
+            NIXLY_TRACE_SCOPE_CHILD("backend", name, parent);
+            auto result = work();
+            QMetaObject::invokeMethod(qApp, [guard, done, result = std::move(result)]() {
+                if (guard) done(result);
+            }, Qt::QueuedConnection);
+        });
+    }
+
+    // Call once the GUI's event loop is about to run; nothing outside debug builds
+    static void startWatchdog();
+    // Aborts in debug builds when called on the GUI thread
+    static void assertOffGuiThread(const char *what);
+
+private:
+    static void start(std::function<void()> job);
+};
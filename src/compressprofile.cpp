@@ -0,0 +1,214 @@
+#include "compressprofile.h"
+
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QPair>
+#include <QProcess>
+#include <QRandomGenerator>
+#include <QThread>
+
+#include <atomic>
+#include <cstdlib>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <zstd.h>
+
+namespace {
+
+constexpr qint64 kExtentBytes = 128 * 1024;     // btrfs compresses per 128 KiB
+constexpr qint64 kSectorBytes = 4096;
+constexpr qint64 kMaxBytesPerFile = 4LL << 20;
+// Compression has to beat the raw disk by this much to be worth the CPU
+constexpr double kMinGain = 1.05;
+
+qint64 roundUp(qint64 n, qint64 to)
+{
+    return (n + to - 1) / to * to;
+}
+
+struct Extent {
+    const char *data;
+    qint64 size;
+};
+
+// FNV-1a: the same for a path on every run and every machine, unlike qHash
+quint64 stableHash(const QString &s)
+{
+    quint64 h = 14695981039346656037ULL;
+    for (const char c : s.toUtf8()) {
+        h ^= quint8(c);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+} // namespace
+
+QString CompressionProfiler::Result::mountOption() const
+{
+    return chosenLevel > 0 ? QString("compress=zstd:%1").arg(chosenLevel) : QString();
+}
+
+QString CompressionProfiler::Result::summary() const
+{
+    if (levels.isEmpty()) return QString("Compression: not profiled");
+    QString s = chosenLevel > 0 ? QString("Compression: zstd:%1").arg(chosenLevel) : QString("Compression: off");
+    for (const LevelResult &l : levels) {
+        if (l.level != chosenLevel) continue;
+        s += QString(", ratio %1, %2 MB/s effective").arg(l.ratio, 0, 'f', 2).arg(l.effectiveMBps, 0, 'f', 0);
+    }
+    s += QString(" (disk %1 MB/s, %2 files, %3 MiB sampled)")
+             .arg(diskMBps, 0, 'f', 0).arg(sampledFiles).arg(sampledBytes >> 20);
+    return s;
+}
+
+QStringList CompressionProfiler::closureOf(const QString &storePath)
+{
+    QProcess p;
+    p.start("nix-store", { "--query", "--requisites", storePath });
+    if (!p.waitForFinished(60000) || p.exitCode() != 0) return {};
+    return QString::fromUtf8(p.readAllStandardOutput()).split('\n', Qt::SkipEmptyParts);
+}
+
+QStringList CompressionProfiler::sampleFiles(const QStringList &storePaths, qint64 budgetBytes)
+{
+    QList<QPair<QString, qint64>> all;
+    qint64 total = 0;
+    for (const QString &path : storePaths) {
+        QDirIterator it(path, QDir::Files | QDir::Hidden | QDir::NoSymLinks, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            it.next();
+            const qint64 size = qMin(it.fileInfo().size(), kMaxBytesPerFile);
+            if (size <= 0) continue;
+            all.append({ it.filePath(), size });
+            total += size;
+        }
+    }
+    // Every file has the same chance; the hash keeps the choice stable between runs
+    const double keep = total > budgetBytes ? double(budgetBytes) / total : 1.0;
+    QStringList files;
+    for (const auto &f : std::as_const(all)) {
+        if (keep < 1.0 && (stableHash(f.first) % 100000) >= quint64(keep * 100000)) continue;
+        files << f.first;
+    }
+    return files;
+}
+
+double CompressionProfiler::measureWriteBandwidth(const QString &dir, qint64 bytes, QString *error)
+{
+    const QByteArray path = QFile::encodeName(dir + "/.nixly-bandwidth");
+    int fd = ::open(path.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT | O_CLOEXEC, 0600);
+    if (fd < 0) fd = ::open(path.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        if (error) *error = QString("Could not create %1").arg(QString::fromLocal8Bit(path));
+        return 0.0;
+    }
+    // Random data, so nothing below us can compress or deduplicate it
+    constexpr size_t kBuffer = 4 << 20;
+    quint32 *buffer = static_cast<quint32*>(std::aligned_alloc(4096, kBuffer));
+    if (!buffer) {
+        ::close(fd);
+        ::unlink(path.constData());
+        return 0.0;
+    }
+    QRandomGenerator::global()->fillRange(buffer, kBuffer / sizeof(quint32));
+
+    QElapsedTimer timer;
+    timer.start();
+    qint64 written = 0;
+    while (written < bytes) {
+        const ssize_t n = ::write(fd, buffer, kBuffer);
+        if (n <= 0) break;
+        written += n;
+    }
+    ::fdatasync(fd);
+    const qint64 ms = timer.elapsed();
+    ::close(fd);
+    ::unlink(path.constData());
+    std::free(buffer);
+    if (written < bytes) {
+        if (error) *error = "Bandwidth test write failed";
+        return 0.0;
+    }
+    return ms > 0 ? written / 1e3 / ms : 0.0;
+}
+
+CompressionProfiler::Result CompressionProfiler::profile(const QStringList &files, const QList<int> &levels,
+                                                         double diskMBps, int threads,
+                                                         const std::function<bool()> &cancelled)
+{
+    Result result;
+    result.diskMBps = diskMBps;
+
+    // Read everything up front so only compression is timed
+    QList<QByteArray> contents;
+    for (const QString &path : files) {
+        QFile f(path);
+        if (!f.open(QIODevice::ReadOnly)) continue;
+        const QByteArray data = f.read(kMaxBytesPerFile);
+        if (data.isEmpty()) continue;
+        result.sampledBytes += data.size();
+        ++result.sampledFiles;
+        contents.append(data);
+    }
+    std::vector<Extent> extents;
+    for (const QByteArray &data : std::as_const(contents)) {
+        for (qint64 off = 0; off < data.size(); off += kExtentBytes)
+            extents.push_back({ data.constData() + off, qMin(kExtentBytes, qint64(data.size()) - off) });
+    }
+    if (extents.empty()) return result;
+
+    const int workers = threads > 0 ? threads : qMax(1, QThread::idealThreadCount());
+    for (int level : levels) {
+        if (cancelled && cancelled()) break;
+        std::atomic<size_t> next { 0 };
+        std::atomic<qint64> stored { 0 };
+        std::atomic<qint64> input { 0 };
+        QElapsedTimer timer;
+        timer.start();
+        std::vector<std::thread> pool;
+        for (int t = 0; t < workers; ++t) {
+            pool.emplace_back([&]() {
+                ZSTD_CCtx *cctx = ZSTD_createCCtx();
+                std::vector<char> out(ZSTD_compressBound(size_t(kExtentBytes)));
+                qint64 localStored = 0, localInput = 0;
+                for (size_t i = next++; i < extents.size(); i = next++) {
+                    const Extent &e = extents[i];
+                    const size_t n = ZSTD_compressCCtx(cctx, out.data(), out.size(), e.data, size_t(e.size), level);
+                    const qint64 raw = roundUp(e.size, kSectorBytes);
+                    // btrfs keeps the extent uncompressed unless that saves space
+                    const qint64 packed = ZSTD_isError(n) ? raw : roundUp(qint64(n), kSectorBytes);
+                    localStored += qMin(raw, packed);
+                    localInput += e.size;
+                }
+                ZSTD_freeCCtx(cctx);
+                stored += localStored;
+                input += localInput;
+            });
+        }
+        for (std::thread &t : pool) t.join();
+        const double secs = qMax(timer.nsecsElapsed() / 1e9, 1e-6);
+
+        LevelResult r;
+        r.level = level;
+        r.ratio = stored.load() > 0 ? double(input.load()) / stored.load() : 1.0;
+        r.inputMBps = input.load() / 1e6 / secs;
+        r.effectiveMBps = diskMBps > 0 ? qMin(r.inputMBps, diskMBps * r.ratio) : r.inputMBps;
+        result.levels.append(r);
+    }
+
+    // Fastest effective write; among near-ties, the better ratio saves space
+    double best = diskMBps * kMinGain;
+    for (const LevelResult &r : std::as_const(result.levels)) best = qMax(best, r.effectiveMBps);
+    double bestRatio = 0.0;
+    for (const LevelResult &r : std::as_const(result.levels)) {
+        if (r.effectiveMBps < diskMBps * kMinGain || r.effectiveMBps < best * 0.98 || r.ratio <= bestRatio) continue;
+        bestRatio = r.ratio;
+        result.chosenLevel = r.level;
+    }
+    return result;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+// Picks the btrfs zstd level for the target from the data actually being
+// installed. btrfs compresses 128 KiB extents independently and stores an
+// extent uncompressed when that is not smaller, so the profiler does the same
+// with sampled closure files at several levels on every core. The level that
+// maximises effective write speed, min(compression throughput, disk bandwidth
+// x ratio), wins; nothing wins when the disk outruns every level.
+class CompressionProfiler
+{
+public:
+    struct LevelResult {
+        int level = 0;
+        double ratio = 1.0;             // input bytes / bytes stored
+        double inputMBps = 0.0;         // all cores together
+        double effectiveMBps = 0.0;     // logical bytes per second reaching the disk
+    };
+
+    struct Result {
+        QList<LevelResult> levels;
+        double diskMBps = 0.0;
+        int chosenLevel = 0;            // 0: leave compression off
+        int sampledFiles = 0;
+        qint64 sampledBytes = 0;
+
+        // "compress=zstd:3", or empty
+        QString mountOption() const;
+        QString summary() const;
+    };
+
+    // btrfs accepts zstd:1 to zstd:15
+    static QList<int> defaultLevels() { return { 1, 2, 3, 5, 7, 9, 12, 15 }; }
+
+    // Store paths of the closure of `storePath` (nix-store -qR).
+    static QStringList closureOf(const QString &storePath);
+    // Regular files spread evenly over the closure, up to `budgetBytes` in total.
+    static QStringList sampleFiles(const QStringList &storePaths, qint64 budgetBytes = 64LL << 20);
+    // Sequential incompressible writes into `dir` (on the target filesystem), MB/s.
+    static double measureWriteBandwidth(const QString &dir, qint64 bytes = 256LL << 20, QString *error = nullptr);
+
+    // Blocking; run on a worker thread.
+    static Result profile(const QStringList &files, const QList<int> &levels, double diskMBps,
+                          int threads = 0, const std::function<bool()> &cancelled = {});
+};
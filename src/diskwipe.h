@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QString>
+#include <functional>
+
+// Erases a whole block device with the fastest method it supports:
+//
+//   secure discard  BLKSECDISCARD, eMMC/SD cards that can erase securely
+//   write zeroes    BLKZEROOUT where the device offloads it (NVMe, SCSI WRITE SAME)
+//   discard         BLKDISCARD, SSDs and loop devices on hole-punching filesystems
+//   zero fill       O_DIRECT writes from several threads, for everything else
+//
+// Each ioctl is tried in order and falls through on EOPNOTSUPP. Ranges are
+// issued in chunks so the wipe reports progress and can be cancelled.
+class DiskWiper
+{
+public:
+    enum class Method { SecureDiscard, WriteZeroes, Discard, ZeroFill };
+
+    struct Capabilities {
+        qint64 sizeBytes = 0;
+        int logicalBlockSize = 512;
+        qint64 discardMaxBytes = 0;     // 0: no discard
+        qint64 writeZeroesMaxBytes = 0; // 0: BLKZEROOUT would write zero pages itself
+        bool rotational = false;
+    };
+
+    struct Progress {
+        qint64 done = 0;
+        qint64 total = 0;
+        double bytesPerSec = 0.0;
+    };
+
+    // From sysfs only, so it works unprivileged for the UI's estimate.
+    static Capabilities probe(const QString &device);
+    // What wipe() will most likely end up doing, with a rough duration
+    static QString describe(const Capabilities &caps);
+    static QString methodName(Method method);
+
+    // Blocking; run on a worker thread. `progress` is called from that thread
+    // a few times a second; `cancelled` is polled between chunks.
+    bool wipe(const QString &device,
+              const std::function<bool()> &cancelled,
+              const std::function<void(const Progress&)> &progress,
+              QString *error);
+
+    Method usedMethod() const { return used_; }
+    qint64 elapsedMs() const { return elapsedMs_; }
+
+    // Zero-fill fallback tuning
+    int writerThreads = 4;
+    qint64 writeChunkBytes = 4 * 1024 * 1024;
+
+private:
+    // 1: done, 0: not supported by the device, -1: failed (error set)
+    int rangeIoctl(int fd, unsigned long request, const Capabilities &caps,
+                   const std::function<bool()> &cancelled,
+                   const std::function<void(const Progress&)> &progress, QString *error);
+    bool zeroFill(const QString &device, const Capabilities &caps,
+                  const std::function<bool()> &cancelled,
+                  const std::function<void(const Progress&)> &progress, QString *error);
+
+    Method used_ = Method::ZeroFill;
+    qint64 elapsedMs_ = 0;
+};
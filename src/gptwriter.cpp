@@ -0,0 +1,337 @@
+#include "gptwriter.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/blkpg.h>
+#include <linux/fs.h>
+#include <random>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t kEntryCount = 128;
+constexpr uint32_t kEntrySize = 128;
+constexpr uint32_t kHeaderSize = 92;
+
+// On-disk byte order: the first three fields little-endian, the rest as written
+using Guid = std::array<uint8_t, 16>;
+
+struct TablePartition {
+    Guid type {};
+    Guid guid {};
+    uint64_t first = 0;
+    uint64_t last = 0;
+    std::u16string name;
+};
+
+struct Table {
+    uint32_t sectorSize = 512;
+    uint64_t sectors = 0;
+    uint64_t entrySectors = 0;
+    uint64_t firstUsable = 0;
+    uint64_t lastUsable = 0;
+    Guid disk {};
+    std::vector<TablePartition> partitions;
+};
+
+uint32_t crc32(const uint8_t *data, size_t size)
+{
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> t {};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) c = table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+template <typename T>
+void put(uint8_t *p, T value)
+{
+    for (size_t i = 0; i < sizeof(T); ++i) p[i] = uint8_t(uint64_t(value) >> (8 * i));
+}
+
+// RFC 4122 bytes -> GPT's mixed-endian layout
+Guid mixedEndian(const uint8_t rfc[16])
+{
+    return { rfc[3], rfc[2], rfc[1], rfc[0], rfc[5], rfc[4], rfc[7], rfc[6],
+             rfc[8], rfc[9], rfc[10], rfc[11], rfc[12], rfc[13], rfc[14], rfc[15] };
+}
+
+bool parseGuid(const std::string &text, Guid *guid)
+{
+    uint8_t rfc[16];
+    int n = 0;
+    for (size_t i = 0; i < text.size() && n < 32; ++i) {
+        const char c = text[i];
+        if (c == '-') continue;
+        const int v = c >= '0' && c <= '9' ? c - '0' : (c | 0x20) >= 'a' && (c | 0x20) <= 'f' ? (c | 0x20) - 'a' + 10 : -1;
+        if (v < 0) return false;
+        if (n % 2 == 0) rfc[n / 2] = uint8_t(v << 4);
+        else rfc[n / 2] |= uint8_t(v);
+        ++n;
+    }
+    if (n != 32) return false;
+    *guid = mixedEndian(rfc);
+    return true;
+}
+
+Guid randomGuid()
+{
+    static std::random_device device;
+    uint8_t rfc[16];
+    for (int i = 0; i < 16; i += 4) put(rfc + i, uint32_t(device()));
+    rfc[6] = uint8_t((rfc[6] & 0x0F) | 0x40);   // version 4
+    rfc[8] = uint8_t((rfc[8] & 0x3F) | 0x80);   // RFC 4122 variant
+    return mixedEndian(rfc);
+}
+
+uint64_t alignUp(uint64_t lba, uint64_t align)
+{
+    return (lba + align - 1) / align * align;
+}
+
+// Places the partitions (sizes in bytes, 0 = rest) on aligned boundaries
+bool layoutTable(Table *t, const std::vector<uint64_t> &sizes, uint64_t alignBytes, std::string *error)
+{
+    t->entrySectors = (uint64_t(kEntryCount) * kEntrySize + t->sectorSize - 1) / t->sectorSize;
+    t->firstUsable = 2 + t->entrySectors;
+    if (t->sectors < 2 * t->firstUsable + 1) {
+        *error = "the drive is too small for a partition table";
+        return false;
+    }
+    t->lastUsable = t->sectors - 2 - t->entrySectors;
+    const uint64_t align = alignBytes >= t->sectorSize ? alignBytes / t->sectorSize : 1;
+    uint64_t next = alignUp(t->firstUsable, align);
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        TablePartition &p = t->partitions[i];
+        p.first = next;
+        if (sizes[i] == 0) {
+            // Whole alignment units up to the end
+            const uint64_t end = (t->lastUsable + 1) / align * align;
+            p.last = end > p.first ? end - 1 : 0;
+        } else {
+            p.last = p.first + alignUp((sizes[i] + t->sectorSize - 1) / t->sectorSize, align) - 1;
+        }
+        if (p.last < p.first || p.last > t->lastUsable) {
+            *error = "the drive is too small for the requested partitions";
+            return false;
+        }
+        next = alignUp(p.last + 1, align);
+    }
+    return true;
+}
+
+std::vector<uint8_t> entryArray(const Table &t)
+{
+    std::vector<uint8_t> entries(t.entrySectors * t.sectorSize, 0);
+    for (size_t i = 0; i < t.partitions.size(); ++i) {
+        const TablePartition &p = t.partitions[i];
+        uint8_t *e = entries.data() + i * kEntrySize;
+        memcpy(e, p.type.data(), 16);
+        memcpy(e + 16, p.guid.data(), 16);
+        put(e + 32, p.first);
+        put(e + 40, p.last);
+        put(e + 48, uint64_t(0));       // attributes
+        for (size_t c = 0; c < p.name.size() && c < 36; ++c) put(e + 56 + 2 * c, uint16_t(p.name[c]));
+    }
+    return entries;
+}
+
+std::vector<uint8_t> headerSector(const Table &t, bool backup, uint32_t entriesCrc)
+{
+    std::vector<uint8_t> h(t.sectorSize, 0);
+    memcpy(h.data(), "EFI PART", 8);
+    put(h.data() + 8, uint32_t(0x00010000));
+    put(h.data() + 12, kHeaderSize);
+    put(h.data() + 24, backup ? t.sectors - 1 : uint64_t(1));
+    put(h.data() + 32, backup ? uint64_t(1) : t.sectors - 1);
+    put(h.data() + 40, t.firstUsable);
+    put(h.data() + 48, t.lastUsable);
+    memcpy(h.data() + 56, t.disk.data(), 16);
+    put(h.data() + 72, backup ? t.lastUsable + 1 : uint64_t(2));
+    put(h.data() + 80, kEntryCount);
+    put(h.data() + 84, kEntrySize);
+    put(h.data() + 88, entriesCrc);
+    // Computed with its own field zero
+    put(h.data() + 16, crc32(h.data(), kHeaderSize));
+    return h;
+}
+
+std::vector<uint8_t> protectiveMbr(const Table &t)
+{
+    std::vector<uint8_t> m(t.sectorSize, 0);
+    uint8_t *e = m.data() + 446;
+    e[1] = 0x00; e[2] = 0x02; e[3] = 0x00;     // CHS of LBA 1
+    e[4] = 0xEE;
+    e[5] = 0xFF; e[6] = 0xFF; e[7] = 0xFF;     // CHS beyond addressing
+    put(e + 8, uint32_t(1));
+    put(e + 12, uint32_t(t.sectors - 1 > 0xFFFFFFFFu ? 0xFFFFFFFFu : t.sectors - 1));
+    m[510] = 0x55;
+    m[511] = 0xAA;
+    return m;
+}
+
+bool writeAll(int fd, const std::vector<uint8_t> &data, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < data.size()) {
+        const ssize_t n = ::pwrite(fd, data.data() + done, data.size() - done, off_t(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += size_t(n);
+    }
+    return true;
+}
+
+} // namespace
+
+bool GptWriter::write(const QString &device, QString *error)
+{
+    auto fail = [&](const QString &what) {
+        *error = QString("%1 %2: %3").arg(what, device, QString::fromLocal8Bit(strerror(errno)));
+        return false;
+    };
+    const int fd = ::open(QFile::encodeName(device).constData(), O_RDWR | O_EXCL | O_CLOEXEC);
+    if (fd < 0) return fail("Could not open");
+    // An image file has no kernel table to re-read; the tests write those
+    struct stat st {};
+    const bool image = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    uint64_t bytes = image ? uint64_t(st.st_size) : 0;
+    int sectorSize = image ? 512 : 0;
+    if (!image && (::ioctl(fd, BLKGETSIZE64, &bytes) != 0 || ::ioctl(fd, BLKSSZGET, &sectorSize) != 0 || sectorSize < 512)) {
+        fail("Could not query the size of");
+        ::close(fd);
+        return false;
+    }
+    sectorSize_ = sectorSize;
+
+    Table t;
+    t.sectorSize = uint32_t(sectorSize);
+    t.sectors = bytes / uint64_t(sectorSize);
+    t.disk = randomGuid();
+    std::vector<uint64_t> sizes;
+    for (const Partition &p : std::as_const(partitions)) {
+        TablePartition tp;
+        if (!parseGuid(p.type.toStdString(), &tp.type)) {
+            *error = "Invalid partition type " + p.type;
+            ::close(fd);
+            return false;
+        }
+        tp.guid = randomGuid();
+        tp.name = p.name.left(36).toStdU16String();
+        t.partitions.push_back(tp);
+        sizes.push_back(uint64_t(qMax<qint64>(0, p.sizeBytes)));
+    }
+    std::string layoutError;
+    if (!layoutTable(&t, sizes, uint64_t(alignBytes), &layoutError)) {
+        *error = QString::fromStdString(layoutError);
+        ::close(fd);
+        return false;
+    }
+    for (int i = 0; i < partitions.size(); ++i) {
+        partitions[i].firstLba = qint64(t.partitions[size_t(i)].first);
+        partitions[i].lastLba = qint64(t.partitions[size_t(i)].last);
+    }
+
+    const std::vector<uint8_t> entries = entryArray(t);
+    const uint32_t entriesCrc = crc32(entries.data(), size_t(kEntryCount) * kEntrySize);
+    std::vector<uint8_t> primary = protectiveMbr(t);
+    const std::vector<uint8_t> header = headerSector(t, false, entriesCrc);
+    primary.insert(primary.end(), header.begin(), header.end());
+    primary.insert(primary.end(), entries.begin(), entries.end());
+    std::vector<uint8_t> backup = entries;
+    const std::vector<uint8_t> backupHeader = headerSector(t, true, entriesCrc);
+    backup.insert(backup.end(), backupHeader.begin(), backupHeader.end());
+
+    if (!writeAll(fd, primary, 0) || !writeAll(fd, backup, (t.lastUsable + 1) * t.sectorSize) || ::fsync(fd) != 0) {
+        fail("Writing the partition table to");
+        ::close(fd);
+        return false;
+    }
+    const bool ok = image || reread(fd, error);
+    ::close(fd);
+    return ok;
+}
+
+bool GptWriter::reread(int fd, QString *error)
+{
+    if (::ioctl(fd, BLKRRPART) == 0) return true;
+    if (errno != EBUSY && errno != EINVAL) {
+        *error = QString("Re-reading the partition table failed: %1").arg(QString::fromLocal8Bit(strerror(errno)));
+        return false;
+    }
+    // Busy: swap ours in with BLKPG. That only works while none of the old
+    // partitions is open; one that is (mounted, swap, an open LUKS mapping)
+    // would keep its old extent and overlap the new layout.
+    for (int pno = 1; pno <= int(kEntryCount); ++pno) {
+        blkpg_partition part {};
+        part.pno = pno;
+        blkpg_ioctl_arg arg { BLKPG_DEL_PARTITION, 0, sizeof part, &part };
+        if (::ioctl(fd, BLKPG, &arg) == 0 || errno == ENXIO) continue;
+        if (errno == EBUSY)
+            *error = QString("Partition %1 of the drive is still in use (mounted, swap or an open LUKS volume); "
+                             "close it and try again").arg(pno);
+        else
+            *error = QString("Removing partition %1 failed: %2").arg(pno).arg(QString::fromLocal8Bit(strerror(errno)));
+        return false;
+    }
+    for (int i = 0; i < partitions.size(); ++i) {
+        blkpg_partition part {};
+        part.pno = i + 1;
+        part.start = partitions.at(i).firstLba * sectorSize_;
+        part.length = (partitions.at(i).lastLba - partitions.at(i).firstLba + 1) * sectorSize_;
+        blkpg_ioctl_arg arg { BLKPG_ADD_PARTITION, 0, sizeof part, &part };
+        if (::ioctl(fd, BLKPG, &arg) != 0) {
+            *error = QString("Adding partition %1 failed: %2").arg(i + 1).arg(QString::fromLocal8Bit(strerror(errno)));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool GptWriter::waitForNodes(const QStringList &nodes, const QDateTime &since, int timeoutMs, QString *error)
+{
+    // Without udev (a container) the nodes are all there is to wait for
+    const bool udev = QFileInfo::exists("/run/udev/control");
+    QElapsedTimer timer;
+    timer.start();
+    while (true) {
+        QStringList missing;
+        for (const QString &n : nodes) {
+            struct stat st {};
+            if (::stat(QFile::encodeName(n).constData(), &st) != 0 || !S_ISBLK(st.st_mode)) {
+                missing << n;
+                continue;
+            }
+            // udev rewrites its database entry once it has probed the device
+            const QFileInfo db(QString("/run/udev/data/b%1:%2").arg(major(st.st_rdev)).arg(minor(st.st_rdev)));
+            if (udev && (!db.exists() || db.lastModified() < since)) missing << n + " (udev)";
+        }
+        // Events still queued, such as the change our close of the disk caused
+        if (missing.isEmpty() && (!udev || !QFileInfo::exists("/run/udev/queue"))) return true;
+        if (timer.elapsed() > timeoutMs) {
+            *error = QString("Timed out waiting for %1").arg(missing.isEmpty() ? QString("the udev queue") : missing.join(", "));
+            return false;
+        }
+        QThread::msleep(10);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QDateTime>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+// Writes a GUID partition table in-process: the whole aligned layout is
+// computed in memory, then the protective MBR, primary header and entries go
+// out in one write and the backup entries and header in a second. The kernel
+// re-reads the table with a single BLKRRPART (BLKPG when the disk is busy),
+// and only the partition nodes we created are waited for, instead of a
+// round of sgdisk plus a udevadm settle over every device on the system.
+class GptWriter
+{
+public:
+    // Type GUIDs, as sgdisk's ef00 and 8309
+    static constexpr const char *EspType = "C12A7328-F81F-11D2-BA4B-00A0C93EC93B";
+    static constexpr const char *LinuxLuksType = "CA7D7CCB-63ED-4C53-861C-1742536059CC";
+
+    struct Partition {
+        QString name;                   // GPT partition label, up to 36 characters
+        QString type;                   // type GUID
+        qint64 sizeBytes = 0;           // 0: the rest of the disk (last partition only)
+        // Filled in by write()
+        qint64 firstLba = 0;
+        qint64 lastLba = 0;
+    };
+
+    QList<Partition> partitions;
+    qint64 alignBytes = 1024 * 1024;
+
+    // Blocking. Partitions are numbered from 1 in list order.
+    bool write(const QString &device, QString *error);
+    int sectorSize() const { return sectorSize_; }
+
+    // Until every node exists (devtmpfs creates them as the kernel adds the
+    // partitions) and udev has probed each since `since` with nothing left in
+    // its queue, so mkfs does not race its blkid. Polls every 10 ms.
+    static bool waitForNodes(const QStringList &nodes, const QDateTime &since, int timeoutMs, QString *error);
+
+private:
+    bool reread(int fd, QString *error);
+
+    int sectorSize_ = 512;
+};
@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""Writes the welcome page's pre-scaled logos from NixlyOS_logo.png.
+
+The installer shows the logo at 320 logical pixels. It embeds a 1x, 2x and
+3x copy in its Qt resources and picks one by device pixel ratio, so it never
+has to scale the 1024 px original at startup. This script is standard library
+only, so that it runs anywhere the repository is checked out. Run it again
+after the logo changes:
+
+    python3 src/images/scale_logo.py
+"""
+
+import os
+import struct
+import sys
+import zlib
+
+LOGICAL_SIZE = 320
+SCALES = (1, 2, 3)
+
+
+def read_png(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:8] != b'\x89PNG\r\n\x1a\n':
+        sys.exit('%s: not a PNG file' % path)
+    pos, idat = 8, []
+    while pos < len(data):
+        length, kind = struct.unpack('>I4s', data[pos:pos + 8])
+        body = data[pos + 8:pos + 8 + length]
+        pos += 12 + length
+        if kind == b'IHDR':
+            width, height, depth, color, _, _, interlace = struct.unpack('>IIBBBBB', body)
+            if depth != 8 or color != 6 or interlace:
+                sys.exit('%s: only 8-bit non-interlaced RGBA is supported' % path)
+        elif kind == b'IDAT':
+            idat.append(body)
+        elif kind == b'IEND':
+            break
+    raw = zlib.decompress(b''.join(idat))
+    stride = width * 4
+    rows, prev = [], bytearray(stride)
+    for y in range(height):
+        start = y * (stride + 1)
+        ftype, line = raw[start], bytearray(raw[start + 1:start + 1 + stride])
+        for x in range(stride):
+            a = line[x - 4] if x >= 4 else 0
+            b = prev[x]
+            c = prev[x - 4] if x >= 4 else 0
+            if ftype == 1:
+                line[x] = (line[x] + a) & 0xFF
+            elif ftype == 2:
+                line[x] = (line[x] + b) & 0xFF
+            elif ftype == 3:
+                line[x] = (line[x] + ((a + b) >> 1)) & 0xFF
+            elif ftype == 4:
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                pred = a if pa <= pb and pa <= pc else (b if pb <= pc else c)
+                line[x] = (line[x] + pred) & 0xFF
+        rows.append(line)
+        prev = line
+    return width, height, rows
+
+
+def write_png(path, width, height, rows):
+    def chunk(kind, body):
+        return struct.pack('>I', len(body)) + kind + body + struct.pack('>I', zlib.crc32(kind + body))
+
+    # Per row, the filter with the smallest sum of magnitudes, as libpng does
+    out, prev = bytearray(), bytearray(width * 4)
+    for line in rows:
+        candidates = []
+        for ftype in (0, 1, 2, 4):
+            f = bytearray(len(line))
+            for x in range(len(line)):
+                a = line[x - 4] if x >= 4 else 0
+                b = prev[x]
+                c = prev[x - 4] if x >= 4 else 0
+                if ftype == 0:
+                    pred = 0
+                elif ftype == 1:
+                    pred = a
+                elif ftype == 2:
+                    pred = b
+                else:
+                    p = a + b - c
+                    pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                    pred = a if pa <= pb and pa <= pc else (b if pb <= pc else c)
+                f[x] = (line[x] - pred) & 0xFF
+            candidates.append((sum(v if v < 128 else 256 - v for v in f), ftype, f))
+        _, ftype, f = min(candidates, key=lambda t: t[0])
+        out.append(ftype)
+        out += f
+        prev = line
+    header = struct.pack('>IIBBBBB', width, height, 8, 6, 0, 0, 0)
+    with open(path, 'wb') as f:
+        f.write(b'\x89PNG\r\n\x1a\n' + chunk(b'IHDR', header)
+                + chunk(b'IDAT', zlib.compress(bytes(out), 9)) + chunk(b'IEND', b''))
+
+
+def weights(src, dst):
+    """Area-average coverage of each source pixel for each destination pixel."""
+    scale = src / dst
+    table = []
+    for i in range(dst):
+        lo, hi = i * scale, (i + 1) * scale
+        taps, j = [], int(lo)
+        while j < hi and j < src:
+            cover = min(hi, j + 1) - max(lo, j)
+            if cover > 0:
+                taps.append((j, cover / scale))
+            j += 1
+        table.append(taps)
+    return table
+
+
+def downscale(width, height, rows, size):
+    # Premultiplied, so transparent pixels do not bleed their colour into edges
+    pre = []
+    for line in rows:
+        r = []
+        for x in range(0, len(line), 4):
+            a = line[x + 3] / 255.0
+            r.append((line[x] * a, line[x + 1] * a, line[x + 2] * a, float(line[x + 3])))
+        pre.append(r)
+    wx, wy = weights(width, size), weights(height, size)
+    horiz = []
+    for r in pre:
+        out = []
+        for taps in wx:
+            acc = [0.0, 0.0, 0.0, 0.0]
+            for j, w in taps:
+                p = r[j]
+                acc[0] += p[0] * w
+                acc[1] += p[1] * w
+                acc[2] += p[2] * w
+                acc[3] += p[3] * w
+            out.append(acc)
+        horiz.append(out)
+    result = []
+    for taps in wy:
+        line = bytearray()
+        for x in range(size):
+            acc = [0.0, 0.0, 0.0, 0.0]
+            for j, w in taps:
+                p = horiz[j][x]
+                acc[0] += p[0] * w
+                acc[1] += p[1] * w
+                acc[2] += p[2] * w
+                acc[3] += p[3] * w
+            alpha = acc[3]
+            if alpha <= 0.0:
+                line += b'\0\0\0\0'
+                continue
+            k = 255.0 / alpha
+            line += bytes(min(255, int(c * k + 0.5)) for c in acc[:3])
+            line.append(min(255, int(alpha + 0.5)))
+        result.append(line)
+    return result
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    width, height, rows = read_png(os.path.join(here, 'NixlyOS_logo.png'))
+    if width != height:
+        sys.exit('the logo is expected to be square')
+    for scale in SCALES:
+        size = LOGICAL_SIZE * scale
+        name = 'NixlyOS_logo_%d%s.png' % (LOGICAL_SIZE, '' if scale == 1 else '@%dx' % scale)
+        write_png(os.path.join(here, name), size, size, downscale(width, height, rows, size))
+        print('%s: %dx%d' % (name, size, size))
+
+
+if __name__ == '__main__':
+    main()
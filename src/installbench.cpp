@@ -0,0 +1,216 @@
+#include "installbench.h"
+
+#include "installengine.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QStandardPaths>
+
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int kSkipped = 77;            // meson's exit code for a skipped test
+
+QString option(const QStringList &args, const QString &name, const QString &fallback = QString())
+{
+    const QString prefix = name + "=";
+    for (const QString &a : args) {
+        if (a.startsWith(prefix)) return a.mid(prefix.size());
+    }
+    return fallback;
+}
+
+int skip(const QString &reason)
+{
+    printf("%s\n", QJsonDocument(QJsonObject { { "skipped", reason } }).toJson(QJsonDocument::Compact).constData());
+    return kSkipped;
+}
+
+struct Sample {
+    qint64 bytesWritten = 0;
+    qint64 userUs = 0;
+    qint64 sysUs = 0;
+};
+
+qint64 toUs(const timeval &tv)
+{
+    return qint64(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+Sample takeSample(const QString &device)
+{
+    Sample s;
+    // In-process steps show up as self, commands as children once reaped
+    rusage self {}, children {};
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    s.userUs = toUs(self.ru_utime) + toUs(children.ru_utime);
+    s.sysUs = toUs(self.ru_stime) + toUs(children.ru_stime);
+    if (!device.isEmpty()) {
+        // Field 7 of /sys/block/<dev>/stat: sectors written, always 512 bytes
+        QFile f(QString("/sys/block/%1/stat").arg(QFileInfo(device).fileName()));
+        if (f.open(QIODevice::ReadOnly)) {
+            const QList<QByteArray> fields = f.readAll().simplified().split(' ');
+            if (fields.size() > 6) s.bytesWritten = fields.at(6).toLongLong() * 512;
+        }
+    }
+    return s;
+}
+
+qint64 peakRssKiB(int who)
+{
+    rusage usage {};
+    getrusage(who, &usage);
+    return usage.ru_maxrss;
+}
+
+// The shell we run under, when it comes from a Nix store: small, always there
+QString defaultClosure()
+{
+    const QString bash = QFileInfo(QStandardPaths::findExecutable("bash")).canonicalFilePath();
+    if (!bash.startsWith("/nix/store/")) return QString();
+    return bash.section('/', 0, 3);
+}
+
+QStringList namespaceArgs()
+{
+    QStringList args;
+    if (geteuid() != 0) args << "--user" << "--map-root-user";
+    args << "--mount" << "--propagation" << "private";
+    return args;
+}
+
+// Runs the benchmark again inside fresh namespaces so its mounts never leak.
+// Returns -1 when namespaces are not available here.
+int reexecInNamespace(const QStringList &args)
+{
+    if (QProcess::execute("unshare", namespaceArgs() << "true") != 0) return -1;
+    QProcess p;
+    p.setProcessChannelMode(QProcess::ForwardedChannels);
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert("NIXLYINSTALL_BENCH_NS", "1");
+    p.setProcessEnvironment(env);
+    p.start("unshare", namespaceArgs() << "--" << QCoreApplication::applicationFilePath() << args);
+    if (!p.waitForStarted()) return -1;
+    p.waitForFinished(-1);
+    return p.exitStatus() == QProcess::NormalExit ? p.exitCode() : 1;
+}
+
+bool canOpen(const char *path)
+{
+    const int fd = ::open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) return false;
+    ::close(fd);
+    return true;
+}
+
+} // namespace
+
+int runInstallBenchmark(const QStringList &args)
+{
+    if (!qEnvironmentVariableIsSet("NIXLYINSTALL_BENCH_NS")) {
+        const int rc = reexecInNamespace(args);
+        if (rc >= 0) return rc;
+        if (geteuid() != 0) return skip("needs root or unprivileged user namespaces");
+    }
+
+    // A user namespace gets root's uid but not the kernel's loop and
+    // device-mapper control nodes; that is where unprivileged runs end.
+    if (!canOpen("/dev/loop-control")) return skip("/dev/loop-control is not accessible");
+    if (!canOpen("/dev/mapper/control")) return skip("/dev/mapper/control is not accessible");
+    // Everything the dry-run graph calls out to: wipefs for signatures,
+    // sgdisk to cross-check the table, blkid from store-reuse and the resume
+    // checks, nix for closures, nixos-generate-config for generate-config
+    for (const char *tool : { "losetup", "wipefs", "sgdisk", "blkid", "mkfs.fat", "cryptsetup", "mkfs.btrfs", "mount",
+                              "umount", "nix", "nix-store", "nixos-generate-config" }) {
+        if (QStandardPaths::findExecutable(tool).isEmpty()) return skip(QString("%1 is not installed").arg(tool));
+    }
+
+    InstallPlan plan;
+    plan.dryRun = true;
+    plan.dryRunDir = QDir::tempPath() + QString("/nixlyinstall-bench-%1").arg(QCoreApplication::applicationPid());
+    plan.dryRunImageMiB = option(args, "--bench-image-mib", "4096").toLongLong();
+    plan.mapperName = QString("nixly-bench-%1").arg(QCoreApplication::applicationPid());
+    plan.espSizeMiB = 256;
+    plan.maxParallel = 1;
+    plan.journalPath.clear();
+    plan.dryRunClosure = option(args, "--bench-closure", defaultClosure());
+    // Fixed, cheap key derivation: this measures the pipeline, not Argon2id
+    plan.luks.pbkdfMemoryKiB = 65536;
+    plan.luks.pbkdfParallel = 1;
+    plan.luks.pbkdfIterations = 4;
+    plan.luks.calibrated = true;
+    // Hashed and written as on a real install; the calibration lands in the results
+    plan.passwordHash = PasswordHasher::calibrate();
+    plan.userName = "nixly";
+    QString hashError;
+    plan.userPasswordHash = PasswordHasher::hash("nixly", plan.passwordHash, &hashError);
+    if (plan.userPasswordHash.isEmpty()) return skip(hashError);
+
+    InstallEngine engine;
+    engine.setPlan(plan);
+    engine.buildDefaultGraph();
+
+    QHash<QString, Sample> begin;
+    QJsonArray stages;
+    qint64 totalBytes = 0;
+    engine.onStepChanged = [&](const InstallStep &s) {
+        if (s.state == InstallStep::State::Running) {
+            if (!begin.contains(s.id)) begin.insert(s.id, takeSample(engine.plan().device));
+            return;
+        }
+        if (!s.isFinished() || !begin.contains(s.id)) return;
+        // Flush first so a stage's writes are not billed to the next one
+        ::sync();
+        const Sample a = begin.take(s.id);
+        const Sample b = takeSample(engine.plan().device);
+        totalBytes = qMax(totalBytes, b.bytesWritten);
+        stages.append(QJsonObject {
+            { "id", s.id },
+            { "state", installStepStateName(s.state) },
+            { "simulated", s.skipInDryRun },
+            { "startedMs", s.startedMs },
+            { "wallMs", s.state == InstallStep::State::Done ? s.elapsedMs : engine.elapsedMs() - s.startedMs },
+            { "bytesWritten", b.bytesWritten - a.bytesWritten },
+            { "cpuUserMs", (b.userUs - a.userUs) / 1000.0 },
+            { "cpuSysMs", (b.sysUs - a.sysUs) / 1000.0 } });
+    };
+    engine.onLog = [](const QString &stepId, const QString &line) {
+        fprintf(stderr, "[%s] %s\n", qPrintable(stepId), qPrintable(line));
+    };
+    engine.onFinished = [&](bool ok, const QString &error) {
+        QJsonObject result {
+            { "ok", ok },
+            { "imageMiB", engine.plan().dryRunImageMiB },
+            { "closure", engine.plan().dryRunClosure },
+            { "totalMs", engine.elapsedMs() },
+            { "bytesWritten", totalBytes },
+            { "peakRssKiB", peakRssKiB(RUSAGE_SELF) },
+            { "peakChildRssKiB", peakRssKiB(RUSAGE_CHILDREN) },
+            { "passwordHash", engine.plan().passwordHash.toJson() },
+            { "stages", stages } };
+        if (!ok) result.insert("error", error);
+        const QByteArray json = QJsonDocument(result).toJson();
+        printf("%s", json.constData());
+        const QString output = option(args, "--bench-output");
+        if (!output.isEmpty()) {
+            QFile f(output);
+            if (f.open(QIODevice::WriteOnly | QIODevice::Truncate)) f.write(json);
+        }
+        QDir(engine.plan().dryRunDir).removeRecursively();
+        QCoreApplication::exit(ok ? 0 : 1);
+    };
+    // Once the loop runs: a graph error reports (and exits) synchronously
+    QMetaObject::invokeMethod(&engine, [&engine]() { engine.start(); }, Qt::QueuedConnection);
+    return QCoreApplication::exec();
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <QStringList>
+
+// Headless benchmark of the install pipeline on a sparse loop device:
+// partition, encrypt, format, mount and copy a closure, then print one JSON
+// object with wall time, bytes written to the device and CPU time per stage.
+//
+//   nixlyinstall --bench-install [--bench-closure=/nix/store/...-bash-5.2]
+//                [--bench-image-mib=4096] [--bench-output=result.json]
+//
+// Steps run one at a time so bytes and CPU can be attributed to a stage.
+// Not root: re-executes itself under `unshare --user --map-root-user --mount`;
+// returns 77 (skipped, for meson) when loop devices or the tools are out of
+// reach.
+int runInstallBenchmark(const QStringList &args);
@@ -0,0 +1,1233 @@
+#include "installengine.h"
+
+#include "compressprofile.h"
+#include "diskwipe.h"
+#include "gptwriter.h"
+#include "memorybudget.h"
+#include "storecopy.h"
+#include "storeverify.h"
+#include "tracer.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QProcessEnvironment>
+#include <QStorageInfo>
+#include <QThread>
+#include <QTimer>
+
+namespace {
+
+// Written next to the generated hardware-configuration.nix; the system flake
+// imports it when present.
+QString renderInstallConfig(const InstallPlan &plan)
+{
+    QStringList lines;
+    lines << "# Generated by NixlyInstall. Hardware-specific choices made during installation."
+          << "{ lib, ... }:"
+          << "{"
+          << "  boot.loader.systemd-boot.enable = lib.mkDefault true;"
+          << "  boot.loader.efi.canTouchEfiVariables = lib.mkDefault true;";
+    if (plan.luks.calibrated) {
+        for (const QString &l : plan.luks.configLines()) lines << "  " + l;
+    }
+    if (!plan.rootFsOptions.isEmpty()) {
+        QStringList quoted;
+        for (const QString &o : plan.rootFsOptions) quoted << "\"" + o + "\"";
+        lines << QString("  fileSystems.\"/\".options = [ %1 ];").arg(quoted.join(' '));
+    }
+    if (!plan.userName.isEmpty()) {
+        lines << QString("  # Password: %1").arg(plan.passwordHash.summary())
+              << QString("  users.users.%1 = {").arg(plan.userName)
+              << "    isNormalUser = lib.mkDefault true;"
+              << "    extraGroups = [ \"wheel\" \"networkmanager\" ];"
+              << QString("    hashedPasswordFile = lib.mkForce \"%1\";").arg(plan.passwordFile())
+              << "  };";
+    }
+    for (const QString &l : plan.configLines) lines << "  " + l;
+    lines << "}" << "";
+    return lines.join('\n');
+}
+
+bool copyTree(const QString &from, const QString &to, const InstallStepContext &ctx, QString *error)
+{
+    QDir src(from);
+    if (!src.exists()) {
+        *error = QString("%1 does not exist").arg(from);
+        return false;
+    }
+    if (!QDir().mkpath(to)) {
+        *error = QString("Could not create %1").arg(to);
+        return false;
+    }
+    QDirIterator it(from, QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        if (ctx.isCancelled()) return false;
+        const QString path = it.next();
+        const QFileInfo fi = it.fileInfo();
+        const QString dest = to + "/" + src.relativeFilePath(path);
+        if (fi.isSymLink()) {
+            QFile::remove(dest);
+            QFile::link(fi.symLinkTarget(), dest);
+        } else if (fi.isDir()) {
+            QDir().mkpath(dest);
+        } else {
+            QFile::remove(dest);
+            if (!QFile::copy(path, dest)) {
+                *error = QString("Could not copy %1").arg(path);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Filesystem type as probed from the device itself, bypassing blkid's cache
+QString probeFsType(const QString &device)
+{
+    QProcess p;
+    p.start("blkid", { "-p", "-o", "value", "-s", "TYPE", device });
+    if (!p.waitForFinished(10000) || p.exitCode() != 0) return QString();
+    return QString::fromUtf8(p.readAllStandardOutput()).trimmed();
+}
+
+// Source device of whatever is mounted on `path` (the topmost mount), or empty
+QString mountSource(const QString &path)
+{
+    QFile f("/proc/self/mountinfo");
+    if (!f.open(QIODevice::ReadOnly)) return QString();
+    const QString target = QDir::cleanPath(path);
+    QString source;
+    // 36 35 98:0 /root /mnt rw,noatime shared:1 - btrfs /dev/mapper/cryptroot rw
+    for (const QByteArray &line : f.readAll().split('\n')) {
+        const QList<QByteArray> fields = line.split(' ');
+        const int sep = fields.indexOf("-");
+        if (fields.size() < 5 || sep < 0 || sep + 2 >= fields.size()) continue;
+        QString mountPoint = QString::fromUtf8(fields.at(4));
+        mountPoint.replace("\\040", " ");
+        if (mountPoint == target) source = QString::fromUtf8(fields.at(sep + 2));
+    }
+    return source;
+}
+
+} // namespace
+
+QString InstallPlan::partitionPath(int number) const
+{
+    if (!device.isEmpty() && device.back().isDigit())
+        return QString("%1p%2").arg(device).arg(number);
+    return QString("%1%2").arg(device).arg(number);
+}
+
+QString installStepStateName(InstallStep::State state)
+{
+    switch (state) {
+        case InstallStep::State::Pending: return "Pending";
+        case InstallStep::State::Running: return "Running";
+        case InstallStep::State::Done: return "Done";
+        case InstallStep::State::Failed: return "Failed";
+        case InstallStep::State::Skipped: return "Skipped";
+        case InstallStep::State::Cancelled: return "Cancelled";
+    }
+    return QString();
+}
+
+InstallEngine::InstallEngine(QObject *parent)
+    : QObject(parent),
+      cancelFlag_(std::make_shared<std::atomic_bool>(false)),
+      nixProgress_(std::make_shared<NixProgress>())
+{
+}
+
+InstallEngine::~InstallEngine()
+{
+    cancelFlag_->store(true);
+    for (QProcess *p : std::as_const(processes_)) {
+        p->disconnect();
+        p->kill();
+        p->waitForFinished(2000);
+    }
+    // Queued results from workers are dropped once we are gone
+    pool_.waitForDone();
+}
+
+void InstallEngine::addStep(const InstallStep &step)
+{
+    steps_.append(step);
+}
+
+void InstallEngine::insertStepAfter(const QString &after, const InstallStep &step)
+{
+    for (InstallStep &s : steps_) {
+        for (QString &d : s.deps) {
+            if (d == after) d = step.id;
+        }
+    }
+    InstallStep inserted = step;
+    if (!inserted.deps.contains(after)) inserted.deps << after;
+    steps_.append(inserted);
+}
+
+InstallStep *InstallEngine::step(const QString &id)
+{
+    for (InstallStep &s : steps_) {
+        if (s.id == id) return &s;
+    }
+    return nullptr;
+}
+
+void InstallEngine::buildDefaultGraph()
+{
+    steps_.clear();
+    finalizers_.clear();
+
+    QString rootDep;
+    if (plan_.dryRun) {
+        if (plan_.dryRunDir.isEmpty()) {
+            // Fixed, so a relaunch finds the image again and can resume
+            plan_.dryRunDir = QDir::tempPath() + "/nixlyinstall-dryrun";
+        }
+        plan_.mountRoot = plan_.dryRunDir + "/mnt";
+        // Stable per image, so a resumed dry run reuses the volume a killed
+        // run left open, while dry runs on other images keep out of its way
+        if (plan_.mapperName == InstallPlan().mapperName) {
+            plan_.mapperName = "nixly-dry-" + QCryptographicHash::hash(plan_.dryRunDir.toUtf8(), QCryptographicHash::Sha256).toHex().left(8);
+        }
+        if (plan_.luksPassphrase.isEmpty()) plan_.luksPassphrase = "nixly-dry-run";
+
+        InstallStep loop;
+        loop.id = "loop-attach";
+        loop.title = "Attach loop device";
+        loop.command = [this]() {
+            QDir().mkpath(plan_.dryRunDir);
+            const QString image = plan_.dryRunDir + "/disk.img";
+            QFile f(image);
+            // Sparse: resize() only sets the length
+            if (f.open(QIODevice::ReadWrite)) {
+                f.resize(plan_.dryRunImageMiB * 1024 * 1024);
+                f.close();
+            }
+            // Starting over: a killed run may have left its volume mounted and
+            // open, which would keep the partitions busy
+            const QString stale = plan_.resume ? QString() : QString(
+                "umount --recursive '%1' 2>/dev/null; cryptsetup close '%2' 2>/dev/null; ").arg(plan_.mountRoot, plan_.mapperName);
+            // Reuse the loop device a killed run left attached
+            return InstallCommand{ "sh", { "-c", stale + QString(
+                "losetup -j '%1' -O NAME -n | head -n 1 | grep . || losetup --find --show --partscan '%1'").arg(image) }, {} };
+        };
+        loop.onSuccess = [this](const QByteArray &out, QString *error) {
+            const QString dev = QString::fromUtf8(out).trimmed().section('\n', -1);
+            if (!dev.startsWith("/dev/loop")) {
+                *error = "losetup did not report a loop device";
+                return false;
+            }
+            plan_.device = dev;
+            return true;
+        };
+        addStep(loop);
+        rootDep = loop.id;
+
+        // Teardown once the graph is finished, whatever the outcome
+        finalizers_ << InstallCommand{ "umount", { "--recursive", plan_.mountRoot }, {} }
+                    << InstallCommand{ "cryptsetup", { "close", plan_.mapperName }, {} }
+                    << InstallCommand{ "sh", { "-c", QString("losetup -j '%1/disk.img' -O NAME -n | xargs -r losetup -d").arg(plan_.dryRunDir) }, {} };
+    }
+
+    // Swap must be off before anything unmounts the target
+    finalizers_.prepend(InstallCommand{ "sh", { "-c", QString("swapoff '%1' 2>/dev/null; rm -rf '%1' '%2/var/tmp/nixlyinstall'")
+                                                          .arg(plan_.swapFilePath(), plan_.mountRoot) }, {} });
+
+    // Last chance to read a store a previous installation left on the drive
+    InstallStep reuse;
+    reuse.id = "store-reuse";
+    reuse.title = "Reuse existing Nix store";
+    if (!rootDep.isEmpty()) reuse.deps << rootDep;
+    reuse.weight = 2;
+    reuse.work = [this](InstallStepContext &ctx) {
+        if (!ctx.plan.reuseExistingStore) return true;
+        const QString mountBase = ctx.plan.dryRun ? ctx.plan.dryRunDir + "/oldstore" : QString("/run/nixlyinstall/oldstore");
+        const StoreReuse::Found found = StoreReuse::find(ctx.plan.device, ctx.plan.luksPassphrase, mountBase,
+                                                         [&ctx](const QString &l) { ctx.log(l); });
+        if (!found.isValid()) {
+            ctx.log("No existing Nix store on the drive.");
+            return true;
+        }
+        ctx.log(QString("Found a Nix store on %1").arg(found.partition));
+        ctx.setProgress(0.1);
+
+        QString error;
+        QStringList wanted;
+        if (ctx.plan.dryRun) {
+            if (!ctx.plan.dryRunClosure.isEmpty()) wanted = CompressionProfiler::closureOf(ctx.plan.dryRunClosure);
+        } else if (!ctx.plan.systemPath.isEmpty() && QFileInfo::exists(ctx.plan.systemPath)) {
+            ctx.log("The system is already in the live store.");
+        } else {
+            wanted = StoreReuse::systemPaths(ctx.plan.flakeDir, ctx.plan.flakeHost, &error);
+        }
+        ctx.setProgress(0.3);
+        StoreReuse::Result result;
+        if (!wanted.isEmpty())
+            result = StoreReuse::import(found, wanted, ctx.plan.reuseStoreRoot(), [&ctx]() { return ctx.isCancelled(); }, &error);
+        result.source = found.partition;
+        StoreReuse::release(found);
+        // Whatever was not salvaged is downloaded as usual
+        if (!error.isEmpty()) ctx.log(error);
+        ctx.log(result.summary());
+        // Published on the engine thread, where the UI reads it
+        ctx.updatePlan = [this, result](InstallPlan &plan) {
+            storeReuse_ = result;
+            plan.reusedPaths = result.imported;
+        };
+        return !ctx.isCancelled();
+    };
+    // What a previous run imported must still be there; the old store it came
+    // from may already be wiped
+    reuse.verify = [](const InstallPlan &plan) {
+        const QString store = plan.reuseStoreRoot() + "/nix/store/";
+        for (const QString &path : plan.reusedPaths)
+            if (!QFileInfo::exists(store + QFileInfo(path).fileName())) return false;
+        return true;
+    };
+    addStep(reuse);
+
+    InstallStep wipe;
+    wipe.id = "wipe";
+    wipe.title = plan_.fullWipe ? "Erase drive" : "Wipe signatures";
+    wipe.deps << "store-reuse";
+    wipe.weight = 3;
+    wipe.work = [](InstallStepContext &ctx) {
+        if (ctx.plan.fullWipe) {
+            DiskWiper wiper;
+            QElapsedTimer sinceLog;
+            sinceLog.start();
+            const bool ok = wiper.wipe(ctx.plan.device, [&ctx]() { return ctx.isCancelled(); },
+                                       [&ctx, &sinceLog](const DiskWiper::Progress &p) {
+                ctx.setProgress(p.total > 0 ? double(p.done) / p.total : 0.0);
+                if (sinceLog.elapsed() < 5000) return;
+                sinceLog.restart();
+                ctx.log(QString("%1 of %2 GiB, %3 MiB/s").arg(p.done / double(1LL << 30), 0, 'f', 1)
+                            .arg(p.total / double(1LL << 30), 0, 'f', 1).arg(p.bytesPerSec / (1 << 20), 0, 'f', 0));
+            }, &ctx.error);
+            if (!ok) return false;
+            ctx.log(QString("Erased by %1 in %2 s").arg(DiskWiper::methodName(wiper.usedMethod()))
+                        .arg(wiper.elapsedMs() / 1000.0, 0, 'f', 1));
+        }
+        // Discarded blocks need not read back as zeros, so signatures go explicitly
+        QProcess wipefs;
+        wipefs.setProcessChannelMode(QProcess::MergedChannels);
+        wipefs.start("wipefs", { "--all", "--force", ctx.plan.device });
+        if (!wipefs.waitForFinished(60000) || wipefs.exitStatus() != QProcess::NormalExit || wipefs.exitCode() != 0) {
+            ctx.error = "wipefs failed: " + QString::fromUtf8(wipefs.readAll()).trimmed();
+            return false;
+        }
+        return true;
+    };
+    // Nothing to check; once journaled it must not run again over a new partition table
+    wipe.verify = [](const InstallPlan &) { return true; };
+    addStep(wipe);
+
+    InstallStep part;
+    part.id = "partition";
+    part.title = "Partition drive";
+    part.deps << "wipe";
+    part.work = [](InstallStepContext &ctx) {
+        GptWriter gpt;
+        gpt.partitions << GptWriter::Partition { "ESP", GptWriter::EspType, ctx.plan.espSizeMiB * 1024 * 1024 }
+                       << GptWriter::Partition { "cryptroot", GptWriter::LinuxLuksType, 0 };
+        const QDateTime written = QDateTime::currentDateTime();
+        if (!gpt.write(ctx.plan.device, &ctx.error)) return false;
+        for (int i = 0; i < gpt.partitions.size(); ++i) {
+            const GptWriter::Partition &p = gpt.partitions.at(i);
+            ctx.log(QString("%1: sectors %2-%3 (%4 MiB)").arg(ctx.plan.partitionPath(i + 1)).arg(p.firstLba).arg(p.lastLba)
+                        .arg((p.lastLba - p.firstLba + 1) * gpt.sectorSize() >> 20));
+        }
+        if (!GptWriter::waitForNodes({ ctx.plan.partitionPath(1), ctx.plan.partitionPath(2) }, written, 30000, &ctx.error))
+            return false;
+        // The loop device is scratch, so check our table with an independent reader
+        if (ctx.plan.dryRun) {
+            QProcess sgdisk;
+            sgdisk.setProcessChannelMode(QProcess::MergedChannels);
+            sgdisk.start("sgdisk", { "--verify", ctx.plan.device });
+            if (!sgdisk.waitForFinished(30000)) {
+                ctx.error = "sgdisk --verify did not run: " + sgdisk.errorString();
+                return false;
+            }
+            const QString out = QString::fromUtf8(sgdisk.readAll()).trimmed();
+            if (sgdisk.exitCode() != 0 || !out.contains("No problems found")) {
+                ctx.error = "sgdisk --verify: " + out;
+                return false;
+            }
+            ctx.log("sgdisk --verify: no problems found");
+        }
+        return true;
+    };
+    part.verify = [](const InstallPlan &plan) {
+        return QFileInfo::exists(plan.partitionPath(1)) && QFileInfo::exists(plan.partitionPath(2));
+    };
+    addStep(part);
+
+    InstallStep esp;
+    esp.id = "mkfs-esp";
+    esp.title = "Format EFI system partition";
+    esp.deps << "partition";
+    esp.command = [this]() {
+        return InstallCommand{ "mkfs.fat", { "-F", "32", "-n", "BOOT", plan_.partitionPath(1) }, {} };
+    };
+    esp.verify = [](const InstallPlan &plan) { return probeFsType(plan.partitionPath(1)) == "vfat"; };
+    addStep(esp);
+
+    // Independent of the disk, so it overlaps wiping and partitioning
+    InstallStep calibrate;
+    calibrate.id = "luks-calibrate";
+    calibrate.title = "Calibrate disk encryption";
+    calibrate.weight = 2;
+    calibrate.work = [](InstallStepContext &ctx) {
+        if (ctx.plan.luks.calibrated) {
+            ctx.log("Using " + ctx.plan.luks.summary());
+            return true;
+        }
+        QStringList log;
+        const LuksParams params = LuksCalibrator::calibrate(ctx.plan.luks.targetUnlockMs, &log);
+        for (const QString &l : log) ctx.log(l);
+        ctx.log("Chose " + params.summary());
+        ctx.updatePlan = [params](InstallPlan &plan) { plan.luks = params; };
+        return true;
+    };
+    addStep(calibrate);
+
+    InstallStep luksFormat;
+    luksFormat.id = "luks-format";
+    luksFormat.title = "Encrypt root partition";
+    luksFormat.deps << "partition" << "luks-calibrate";
+    luksFormat.weight = 3;
+    luksFormat.command = [this]() {
+        // --key-file=- takes stdin verbatim, so the passphrase has no trailing newline
+        return InstallCommand{ "cryptsetup", QStringList {
+            "luksFormat", "--type", "luks2", "--batch-mode", "--label", "cryptroot" }
+            << plan_.luks.formatArgs()
+            << "--key-file=-" << plan_.partitionPath(2), plan_.luksPassphrase };
+    };
+    luksFormat.verify = [](const InstallPlan &plan) {
+        QProcess p;
+        p.start("cryptsetup", { "isLuks", "--type", "luks2", plan.partitionPath(2) });
+        return p.waitForFinished(10000) && p.exitStatus() == QProcess::NormalExit && p.exitCode() == 0;
+    };
+    addStep(luksFormat);
+
+    InstallStep luksOpen;
+    luksOpen.id = "luks-open";
+    luksOpen.title = "Unlock root partition";
+    luksOpen.deps << "luks-format";
+    luksOpen.weight = 2;
+    luksOpen.command = [this]() {
+        return InstallCommand{ "cryptsetup", {
+            "open", "--type", "luks2", "--key-file=-", plan_.partitionPath(2), plan_.mapperName }, plan_.luksPassphrase };
+    };
+    luksOpen.verify = [](const InstallPlan &plan) { return QFileInfo::exists(plan.mapperPath()); };
+    luksOpen.reuseWithoutJournal = true;
+    addStep(luksOpen);
+
+    InstallStep mkfsRoot;
+    mkfsRoot.id = "mkfs-root";
+    mkfsRoot.title = "Format root filesystem";
+    mkfsRoot.deps << "luks-open";
+    mkfsRoot.command = [this]() {
+        return InstallCommand{ "mkfs.btrfs", { "-f", "-L", "nixos", plan_.mapperPath() }, {} };
+    };
+    mkfsRoot.verify = [](const InstallPlan &plan) { return probeFsType(plan.mapperPath()) == "btrfs"; };
+    addStep(mkfsRoot);
+
+    InstallStep mountRoot;
+    mountRoot.id = "mount-root";
+    mountRoot.title = "Mount root filesystem";
+    mountRoot.deps << "mkfs-root";
+    mountRoot.command = [this]() {
+        return InstallCommand{ "mount", { "--mkdir", plan_.mapperPath(), plan_.mountRoot }, {} };
+    };
+    mountRoot.verify = [](const InstallPlan &plan) { return mountSource(plan.mountRoot) == plan.mapperPath(); };
+    mountRoot.reuseWithoutJournal = true;
+    addStep(mountRoot);
+
+    InstallStep mountEsp;
+    mountEsp.id = "mount-esp";
+    mountEsp.title = "Mount EFI system partition";
+    mountEsp.deps << "mount-root" << "mkfs-esp";
+    mountEsp.command = [this]() {
+        return InstallCommand{ "mount", { "--mkdir", "-o", "umask=0077", plan_.partitionPath(1), plan_.mountRoot + "/boot" }, {} };
+    };
+    mountEsp.verify = [](const InstallPlan &plan) { return mountSource(plan.mountRoot + "/boot") == plan.partitionPath(1); };
+    mountEsp.reuseWithoutJournal = true;
+    addStep(mountEsp);
+
+    InstallStep copyRepo;
+    copyRepo.id = "copy-config";
+    copyRepo.title = "Copy system configuration";
+    copyRepo.deps << "mount-root";
+    copyRepo.work = [](InstallStepContext &ctx) {
+        if (ctx.plan.flakeDir.isEmpty() || !QFileInfo::exists(ctx.plan.flakeDir)) {
+            if (ctx.plan.dryRun) {
+                ctx.log("No cloned configuration; skipping copy in dry-run.");
+                return true;
+            }
+            ctx.error = "The system configuration has not been cloned.";
+            return false;
+        }
+        return copyTree(ctx.plan.flakeDir, ctx.plan.mountRoot + "/etc/nixos", ctx, &ctx.error);
+    };
+    addStep(copyRepo);
+
+    // Whatever the prefetch already put in the live store goes over with every
+    // core; build-system then only fetches what is missing. In dry-run this is
+    // the stand-in for nixos-install, exercising the target store with a real closure.
+    InstallStep closure;
+    closure.id = "copy-closure";
+    closure.title = "Copy system from the live store";
+    // After the compression remount, so the copy is compressed
+    closure.deps << "compress-profile";
+    closure.weight = 10;
+    closure.work = [](InstallStepContext &ctx) {
+        const QString source = ctx.plan.dryRun ? ctx.plan.dryRunClosure : ctx.plan.systemPath;
+        if (source.isEmpty() || !QFileInfo::exists(source)) {
+            ctx.log("The system is not in the live store; build-system fetches it.");
+            return true;
+        }
+        const QStringList paths = CompressionProfiler::closureOf(source);
+        if (paths.isEmpty()) {
+            ctx.error = "Could not query the closure of " + source;
+            return false;
+        }
+        StoreCopier copier;
+        if (ctx.plan.maxParallel > 0) copier.threads = ctx.plan.maxParallel;
+        const bool ok = copier.copy(paths, ctx.plan.mountRoot, [&ctx]() { return ctx.isCancelled(); },
+                                    [&ctx](const StoreCopier::Progress &p) {
+            ctx.setProgress(p.bytesTotal > 0 ? double(p.bytesDone) / p.bytesTotal : 0.0);
+        }, &ctx.error);
+        ctx.log(copier.stats().summary());
+        return ok;
+    };
+    addStep(closure);
+
+    InstallStep genConfig;
+    genConfig.id = "generate-config";
+    genConfig.title = "Generate hardware configuration";
+    genConfig.deps << "mount-esp" << "copy-config";
+    genConfig.command = [this]() {
+        // Keeps an existing configuration.nix; hardware-configuration.nix is always rewritten
+        return InstallCommand{ "nixos-generate-config", { "--root", plan_.mountRoot }, {} };
+    };
+    addStep(genConfig);
+
+    // Measured before the closure is written, so the remount covers all of it
+    InstallStep compress;
+    compress.id = "compress-profile";
+    compress.title = "Choose filesystem compression";
+    compress.deps << "mount-root";
+    compress.weight = 2;
+    compress.work = [](InstallStepContext &ctx) {
+        // The prefetched system when there is one, else the live system is the best guess
+        QString source = ctx.plan.systemPath;
+        if (source.isEmpty() || !QFileInfo::exists(source)) source = "/run/current-system";
+        const QStringList closure = CompressionProfiler::closureOf(source);
+        if (closure.isEmpty()) {
+            ctx.log("No closure to sample; leaving compression off.");
+            return true;
+        }
+        QString error;
+        const double diskMBps = CompressionProfiler::measureWriteBandwidth(ctx.plan.mountRoot, 256LL << 20, &error);
+        if (diskMBps <= 0.0) {
+            ctx.log(error + "; leaving compression off.");
+            return true;
+        }
+        ctx.setProgress(0.3);
+        const QStringList files = CompressionProfiler::sampleFiles(closure);
+        const CompressionProfiler::Result result = CompressionProfiler::profile(
+            files, CompressionProfiler::defaultLevels(), diskMBps, 0, [&ctx]() { return ctx.isCancelled(); });
+        for (const CompressionProfiler::LevelResult &l : result.levels) {
+            ctx.log(QString("zstd:%1  ratio %2  %3 MB/s compress  %4 MB/s effective")
+                        .arg(l.level).arg(l.ratio, 0, 'f', 2).arg(l.inputMBps, 0, 'f', 0).arg(l.effectiveMBps, 0, 'f', 0));
+        }
+        ctx.log(result.summary());
+        const QString option = result.mountOption();
+        if (option.isEmpty()) return true;
+        QProcess mount;
+        mount.setProcessChannelMode(QProcess::MergedChannels);
+        mount.start("mount", { "-o", "remount," + option, ctx.plan.mountRoot });
+        if (!mount.waitForFinished(30000) || mount.exitCode() != 0) {
+            ctx.error = "Remounting with " + option + " failed: " + QString::fromUtf8(mount.readAll()).trimmed();
+            return false;
+        }
+        ctx.updatePlan = [option](InstallPlan &plan) { plan.rootFsOptions = QStringList { option }; };
+        return true;
+    };
+    addStep(compress);
+
+    InstallStep writeConfig;
+    writeConfig.id = "write-config";
+    writeConfig.title = "Write installer settings";
+    writeConfig.deps << "generate-config" << "compress-profile";
+    writeConfig.work = [](InstallStepContext &ctx) {
+        const QString dir = ctx.plan.mountRoot + "/etc/nixos";
+        QFile f(dir + "/nixly-install.nix");
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            ctx.error = "Could not write " + f.fileName();
+            return false;
+        }
+        f.write(renderInstallConfig(ctx.plan).toUtf8());
+        f.close();
+        // Flakes only see files git knows about
+        if (QFileInfo::exists(dir + "/.git")) {
+            QProcess git;
+            git.start("git", { "-C", dir, "add", "--intent-to-add", "hardware-configuration.nix", "nixly-install.nix" });
+            git.waitForFinished(30000);
+        }
+        return true;
+    };
+    addStep(writeConfig);
+
+    // Only the hash reaches the target, readable by root alone; activation
+    // reads it from hashedPasswordFile
+    InstallStep account;
+    account.id = "user-account";
+    account.title = "Create user account";
+    account.deps << "mount-root";
+    account.work = [](InstallStepContext &ctx) {
+        if (ctx.plan.userName.isEmpty()) {
+            ctx.log("No user account requested.");
+            return true;
+        }
+        if (ctx.plan.userPasswordHash.isEmpty()) {
+            ctx.error = "No password hash for " + ctx.plan.userName;
+            return false;
+        }
+        const QString path = ctx.plan.mountRoot + ctx.plan.passwordFile();
+        const QString dir = QFileInfo(path).absolutePath();
+        // Both are created owner-only, never readable for a moment in between
+        const QFile::Permissions dirMode = QFileDevice::ReadOwner | QFileDevice::WriteOwner | QFileDevice::ExeOwner;
+        if (!QDir().mkpath(QFileInfo(dir).absolutePath())
+            || !(QDir().mkdir(dir, dirMode) || QFile::setPermissions(dir, dirMode))) {
+            ctx.error = "Could not create " + dir;
+            return false;
+        }
+        // A file left by an earlier run keeps its mode across open(); start over
+        QFile::remove(path);
+        QFile f(path);
+        if (!f.open(QIODevice::WriteOnly | QIODevice::NewOnly, QFileDevice::ReadOwner | QFileDevice::WriteOwner)
+            || f.write(ctx.plan.userPasswordHash + '\n') < 0) {
+            ctx.error = "Could not write " + path;
+            return false;
+        }
+        ctx.log(QString("%1: %2").arg(ctx.plan.userName, ctx.plan.passwordHash.summary()));
+        if (ctx.plan.passwordHash.calibrated)
+            ctx.log(QString("Hash cost calibrated in %1 ms").arg(ctx.plan.passwordHash.calibrationMs));
+        return true;
+    };
+    addStep(account);
+
+    // The live session's /tmp is RAM; give Nix scratch space (and swap when short) on the target
+    InstallStep memory;
+    memory.id = "memory-budget";
+    memory.title = "Plan memory for the build";
+    memory.deps << "mount-root";
+    memory.work = [](InstallStepContext &ctx) {
+        const MemoryBudget::Assessment a = MemoryBudget::assess(ctx.plan.systemPath);
+        ctx.log(a.summary());
+        const QString scratch = ctx.plan.mountRoot + "/var/tmp/nixlyinstall";
+        if (!QDir().mkpath(scratch)) {
+            ctx.error = "Could not create " + scratch;
+            return false;
+        }
+        const qint64 swap = a.swapBytes();
+        if (swap > 0) {
+            QString error;
+            // Never let swap crowd out the system itself
+            const qint64 free = QStorageInfo(ctx.plan.mountRoot).bytesAvailable();
+            if (free < swap + a.closureBytes * 2) {
+                ctx.log(QString("Not enough room on the target for %1 MiB of swap").arg(swap >> 20));
+            } else if (MemoryBudget::addSwapFile(ctx.plan.swapFilePath(), swap, &error)) {
+                ctx.log(QString("Added %1 MiB of swap at %2").arg(swap >> 20).arg(ctx.plan.swapFilePath()));
+            } else {
+                // Building without it may still fit; the options below help either way
+                ctx.log(error);
+            }
+        }
+        const QStringList options = MemoryBudget::nixOptions(a);
+        if (!options.isEmpty()) ctx.log("Constrained: nix " + options.join(' '));
+        ctx.updatePlan = [scratch, options](InstallPlan &plan) {
+            plan.scratchDir = scratch;
+            plan.nixOptions = options;
+        };
+        return true;
+    };
+    addStep(memory);
+
+    // Indexing a large cache takes a while; overlap it with disk preparation
+    InstallStep localCache;
+    localCache.id = "local-cache";
+    localCache.title = "Look for a binary cache on the boot medium";
+    localCache.work = [this](InstallStepContext &ctx) {
+        // Indexed into a cache of its own: the UI keeps reading the engine's
+        // until the step hands this one over on the engine thread
+        LocalBinaryCache cache;
+        if (!cache.detectAndLoad(ctx.plan.localCacheDir)) {
+            ctx.log("No binary cache on the boot medium; substituting from the network.");
+            return true;
+        }
+        ctx.log(QString("Using %1 (%2 paths%3)").arg(cache.dir()).arg(cache.pathCount())
+                    .arg(cache.isTrusted() ? QString() : QString(", signed paths only")));
+        ctx.updatePlan = [this, cache](InstallPlan &plan) {
+            localCache_ = cache;
+            plan.extraSubstituters.prepend(localCache_.substituterUrl());
+        };
+        return true;
+    };
+    addStep(localCache);
+
+    // Build the closure straight into the target store ourselves: nixos-install
+    // has no --log-format, and internal-json gives us paths, bytes and ETA.
+    InstallStep buildSystem;
+    buildSystem.id = "build-system";
+    buildSystem.title = "Build and fetch system";
+    buildSystem.deps << "write-config" << "local-cache" << "memory-budget" << "copy-closure";
+    buildSystem.weight = 55;
+    buildSystem.skipInDryRun = true;
+    auto nixProgress = nixProgress_;
+    buildSystem.command = [this, nixProgress]() {
+        nixProgress->reset();
+        // auto?trusted=1 is nixos-install's own fallback: paths already in the
+        // live store. Missing paths still come from the configured substituters.
+        const QStringList substituters = plan_.extraSubstituters + QStringList { "auto?trusted=1" };
+        QStringList args { "build", "--extra-experimental-features", "nix-command flakes",
+                           "--store", plan_.mountRoot, "--no-link", "--print-out-paths",
+                           "--log-format", "internal-json", "-v",
+                           "--option", "extra-substituters", substituters.join(' ') };
+        for (int i = 0; i + 1 < plan_.nixOptions.size(); i += 2) args << "--option" << plan_.nixOptions.at(i) << plan_.nixOptions.at(i + 1);
+        args << QString("%1/etc/nixos#nixosConfigurations.%2.config.system.build.toplevel").arg(plan_.mountRoot, plan_.flakeHost);
+        InstallCommand cmd { "nix", args, {} };
+        if (!plan_.scratchDir.isEmpty()) cmd.environment << "TMPDIR=" + plan_.scratchDir;
+        return cmd;
+    };
+    buildSystem.onLine = [this, nixProgress](const QString &line) {
+        if (line.startsWith("@nix ")) {
+            nixProgress->feedLine(line);
+            // "copying path '...' from '...'" is the text of CopyPath start events
+            localCache_.recordLine(line);
+        } else if (line.startsWith("/nix/store/") && !line.contains(' ')) {
+            plan_.systemPath = line;
+        }
+    };
+    buildSystem.liveProgress = [nixProgress]() { return nixProgress->snapshot().fraction(); };
+    addStep(buildSystem);
+
+    InstallStep nixosInstall;
+    nixosInstall.id = "nixos-install";
+    nixosInstall.title = "Install system";
+    nixosInstall.deps << "build-system" << "user-account";
+    nixosInstall.weight = 5;
+    nixosInstall.skipInDryRun = true;
+    nixosInstall.command = [this]() {
+        QStringList args { "--root", plan_.mountRoot, "--no-root-passwd", "--no-bootloader" };
+        // The closure is already in the target store; this only sets the profile and activates
+        if (!plan_.systemPath.isEmpty()) args << "--system" << plan_.systemPath;
+        else args << "--flake" << plan_.mountRoot + "/etc/nixos#" + plan_.flakeHost;
+        if (!plan_.extraSubstituters.isEmpty())
+            args << "--option" << "extra-substituters" << plan_.extraSubstituters.join(' ');
+        for (int i = 0; i + 1 < plan_.nixOptions.size(); i += 2) args << "--option" << plan_.nixOptions.at(i) << plan_.nixOptions.at(i + 1);
+        InstallCommand cmd { "nixos-install", args, {} };
+        if (!plan_.scratchDir.isEmpty()) cmd.environment << "TMPDIR=" + plan_.scratchDir;
+        return cmd;
+    };
+    nixosInstall.onLine = [this](const QString &line) { localCache_.recordLine(line); };
+    addStep(nixosInstall);
+
+    InstallStep bootloader;
+    bootloader.id = "bootloader";
+    bootloader.title = "Install bootloader";
+    bootloader.deps << "nixos-install";
+    bootloader.weight = 3;
+    bootloader.skipInDryRun = true;
+    bootloader.command = [this]() {
+        return InstallCommand{ "nixos-enter", { "--root", plan_.mountRoot, "-c",
+            "NIXOS_INSTALL_BOOTLOADER=1 /nix/var/nix/profiles/system/bin/switch-to-configuration boot" }, {} };
+    };
+    addStep(bootloader);
+
+    if (plan_.verifyStore) {
+        InstallStep verify;
+        verify.id = "verify-store";
+        verify.title = "Verify installed store";
+        verify.deps << "bootloader" << "copy-closure";
+        verify.weight = 5;
+        verify.work = [](InstallStepContext &ctx) {
+            // The installed system, or what a dry run copied
+            const QString system = ctx.plan.dryRun ? ctx.plan.dryRunClosure : ctx.plan.systemPath;
+            if (system.isEmpty()) {
+                ctx.log("Nothing to verify.");
+                return true;
+            }
+            StoreVerifier verifier;
+            StoreVerifier::Result result;
+            if (!verifier.verify(ctx.plan.mountRoot, { system }, [&ctx]() { return ctx.isCancelled(); },
+                                 [&ctx](qint64 done, qint64 total) { ctx.setProgress(total > 0 ? double(done) / total : 0.0); },
+                                 &result, &ctx.error)) {
+                return false;
+            }
+            ctx.log(result.summary());
+            for (const StoreVerifier::Mismatch &m : std::as_const(result.mismatches))
+                ctx.log(QString("%1: %2 (expected %3, got %4)").arg(m.path, m.reason, m.expected, m.actual));
+            if (!result.ok()) {
+                ctx.error = QString("%1 store paths do not match their recorded hash").arg(result.mismatches.size());
+                return false;
+            }
+            return true;
+        };
+        addStep(verify);
+    }
+}
+
+bool InstallEngine::validateGraph(QString *error) const
+{
+    QHash<QString, int> indegree;
+    QHash<QString, QStringList> dependents;
+    for (const InstallStep &s : steps_) {
+        if (indegree.contains(s.id)) {
+            *error = QString("Duplicate step %1").arg(s.id);
+            return false;
+        }
+        indegree.insert(s.id, s.deps.size());
+    }
+    for (const InstallStep &s : steps_) {
+        for (const QString &d : s.deps) {
+            if (!indegree.contains(d)) {
+                *error = QString("Step %1 depends on unknown step %2").arg(s.id, d);
+                return false;
+            }
+            dependents[d] << s.id;
+        }
+    }
+    // Kahn: every node must become ready exactly once
+    QStringList ready;
+    for (auto it = indegree.constBegin(); it != indegree.constEnd(); ++it) {
+        if (it.value() == 0) ready << it.key();
+    }
+    int visited = 0;
+    while (!ready.isEmpty()) {
+        const QString id = ready.takeLast();
+        ++visited;
+        for (const QString &n : dependents.value(id)) {
+            if (--indegree[n] == 0) ready << n;
+        }
+    }
+    if (visited != steps_.size()) {
+        *error = "The install graph has a cycle";
+        return false;
+    }
+    return true;
+}
+
+void InstallEngine::start()
+{
+    if (running_) return;
+    QString error;
+    if (!validateGraph(&error)) {
+        if (onFinished) onFinished(false, error);
+        return;
+    }
+    running_ = true;
+    failed_ = false;
+    firstError_.clear();
+    cancelFlag_->store(false);
+    runningCount_ = 0;
+    inputs_.clear();
+    localCache_ = LocalBinaryCache();
+    storeReuse_ = StoreReuse::Result();
+    plan_.reusedPaths.clear();
+    journal_.reset();
+    if (!plan_.journalPath.isEmpty()) {
+        journal_ = std::make_unique<InstallJournal>(plan_.journalPath);
+        const QString target = journalTarget();
+        if (plan_.resume && journal_->load() && journal_->target() == target) {
+            // The volume was formatted with these; the initrd config must match
+            const QJsonValue luks = journal_->state("luks");
+            if (luks.isObject()) plan_.luks = LuksParams::fromJson(luks.toObject());
+            for (const QJsonValue &path : journal_->state("reusedPaths").toArray()) plan_.reusedPaths << path.toString();
+            emitLog("journal", QString("Resuming; completed before: %1").arg(journal_->completedSteps().join(", ")));
+        } else {
+            plan_.resume = false;
+            journal_->reset(target);
+            if (!journal_->save()) emitLog("journal", "Could not write the install journal " + journal_->path());
+        }
+    }
+    const int parallel = plan_.maxParallel > 0 ? plan_.maxParallel : QThread::idealThreadCount();
+    pool_.setMaxThreadCount(qMax(1, parallel));
+    for (InstallStep &s : steps_) {
+        s.state = InstallStep::State::Pending;
+        s.progress = 0.0;
+        s.startedMs = -1;
+        s.elapsedMs = 0;
+        s.error.clear();
+    }
+    clock_.start();
+    schedule();
+}
+
+void InstallEngine::cancel()
+{
+    if (!running_ || cancelFlag_->load()) return;
+    cancelFlag_->store(true);
+    skipPending("Cancelled");
+    for (QProcess *p : std::as_const(processes_)) {
+        p->terminate();
+        QTimer::singleShot(3000, p, [p]() { p->kill(); });
+    }
+    if (runningCount_ == 0) schedule();
+}
+
+double InstallEngine::progress() const
+{
+    double total = 0.0, done = 0.0;
+    for (const InstallStep &s : steps_) {
+        total += s.weight;
+        if (s.state == InstallStep::State::Done) done += s.weight;
+        else if (s.state == InstallStep::State::Running) done += s.weight * qBound(0.0, s.progress, 1.0);
+    }
+    return total > 0.0 ? done / total : 0.0;
+}
+
+void InstallEngine::pollProgress()
+{
+    for (InstallStep &s : steps_) {
+        if (s.state != InstallStep::State::Running || !s.liveProgress) continue;
+        s.progress = s.liveProgress();
+    }
+}
+
+void InstallEngine::schedule()
+{
+    if (!running_) return;
+    const int parallel = plan_.maxParallel > 0 ? plan_.maxParallel : QThread::idealThreadCount();
+    if (!failed_ && !cancelFlag_->load()) {
+        for (InstallStep &s : steps_) {
+            if (runningCount_ >= parallel) break;
+            if (s.state != InstallStep::State::Pending) continue;
+            bool ready = true;
+            for (const QString &d : s.deps) {
+                const InstallStep *dep = step(d);
+                if (!dep || dep->state != InstallStep::State::Done) { ready = false; break; }
+            }
+            if (ready) launch(s);
+        }
+    }
+    if (runningCount_ > 0) return;
+
+    bool allDone = true;
+    for (const InstallStep &s : steps_) {
+        if (s.state != InstallStep::State::Done) { allDone = false; break; }
+    }
+    if (!allDone && !failed_ && !cancelFlag_->load()) return; // a simulated step queued the next pass
+
+    running_ = false;
+    const bool ok = allDone;
+    if (ok && journal_) journal_->discard();
+    const QString error = ok ? QString() : (cancelFlag_->load() && firstError_.isEmpty() ? QString("Installation cancelled") : firstError_);
+    emitLog("memory", MemoryBudget::peakSummary());
+    runFinalizers([this, ok, error]() {
+        if (onFinished) onFinished(ok, error);
+    });
+}
+
+void InstallEngine::launch(InstallStep &s)
+{
+    s.startedMs = clock_.elapsed();
+    s.traceSpan = NIXLY_TRACE_BEGIN("install", s.id);
+    if (plan_.dryRun && s.skipInDryRun) {
+        setState(s, InstallStep::State::Running);
+        emitLog(s.id, "Simulated in dry-run.");
+        s.progress = 1.0;
+        setState(s, InstallStep::State::Done);
+        NIXLY_TRACE_END("install", s.traceSpan, 0);
+        // Let the caller finish its pass before the next one
+        QMetaObject::invokeMethod(this, [this]() { schedule(); }, Qt::QueuedConnection);
+        return;
+    }
+    ++runningCount_;
+    setState(s, InstallStep::State::Running);
+    const InstallCommand cmd = (!s.work && s.command) ? s.command() : InstallCommand();
+    inputs_.insert(s.id, stepInputs(cmd));
+    if (plan_.resume && s.verify
+        && (s.reuseWithoutJournal || (journal_ && journal_->has(s.id, inputs_.value(s.id))))) {
+        launchVerified(s, cmd);
+        return;
+    }
+    if (s.work) launchWork(s);
+    else launchCommand(s, cmd);
+}
+
+void InstallEngine::launchVerified(InstallStep &s, const InstallCommand &cmd)
+{
+    const QString id = s.id;
+    const auto verify = s.verify;
+    const InstallPlan plan = plan_;
+    const quint64 span = s.traceSpan;
+    // Checks run blkid and cryptsetup; keep them off the engine thread
+    pool_.start([this, id, verify, plan, cmd, span]() {
+        NIXLY_TRACE_SCOPE_CHILD("install", "verify " + id, span);
+        const bool inPlace = verify(plan);
+        QMetaObject::invokeMethod(this, [this, id, inPlace, cmd]() {
+            InstallStep *st = step(id);
+            if (!st || st->state != InstallStep::State::Running) return;
+            if (inPlace) {
+                emitLog(id, "Already done by a previous run.");
+                finishStep(id, true, QString());
+            } else if (cancelFlag_->load()) {
+                finishStep(id, false, "Cancelled");
+            } else {
+                emitLog(id, "Not in place any more; running it again.");
+                if (st->work) launchWork(*st);
+                else launchCommand(*st, cmd);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+QString InstallEngine::stepInputs(const InstallCommand &cmd) const
+{
+    if (cmd.program.isEmpty()) return QString();
+    // A loop device that comes back under another number keeps its journal
+    QString inputs = (QStringList { cmd.program } + cmd.args).join(' ');
+    if (!plan_.device.isEmpty()) inputs.replace(plan_.device, "@disk");
+    return inputs;
+}
+
+void InstallEngine::journalStep(const InstallStep &s)
+{
+    if (!journal_) return;
+    journal_->record(s.id, inputs_.take(s.id), s.elapsedMs);
+    if (plan_.luks.calibrated) journal_->setState("luks", plan_.luks.toJson());
+    if (!plan_.systemPath.isEmpty()) journal_->setState("systemPath", plan_.systemPath);
+    if (!plan_.reusedPaths.isEmpty()) journal_->setState("reusedPaths", QJsonArray::fromStringList(plan_.reusedPaths));
+    // From here on the journal is also kept with the installed system
+    if (s.id == "mount-root") journal_->setMirror(plan_.mountRoot + "/var/lib/nixlyinstall/journal.json");
+    if (!journal_->save()) emitLog(s.id, "Could not write the install journal " + journal_->path());
+    if (onStepJournaled) onStepJournaled(s);
+}
+
+QString InstallEngine::journalTarget() const
+{
+    if (plan_.dryRun) return "image:" + plan_.dryRunDir + "/disk.img";
+    // A different disk at the same path must not pick up this journal
+    QFile f(QString("/sys/class/block/%1/size").arg(QFileInfo(plan_.device).fileName()));
+    const QByteArray sectors = f.open(QIODevice::ReadOnly) ? f.readAll().trimmed() : QByteArray();
+    return QString("%1:%2").arg(plan_.device, QString::fromLatin1(sectors));
+}
+
+QStringList InstallEngine::resumableSteps() const
+{
+    if (plan_.journalPath.isEmpty()) return {};
+    InstallJournal journal(plan_.journalPath);
+    if (!journal.load() || journal.target() != journalTarget()) return {};
+    return journal.completedSteps();
+}
+
+void InstallEngine::launchCommand(InstallStep &s, const InstallCommand &cmd)
+{
+    const QString id = s.id;
+    if (cmd.program.isEmpty()) {
+        QMetaObject::invokeMethod(this, [this, id]() { finishStep(id, false, "Step has no command"); }, Qt::QueuedConnection);
+        return;
+    }
+    emitLog(id, "$ " + cmd.program + " " + cmd.args.join(' '));
+
+    QProcess *p = new QProcess(this);
+    NIXLY_TRACE_CHILD_PROCESS(p, "install", s.traceSpan);
+    p->setProgram(cmd.program);
+    p->setArguments(cmd.args);
+    p->setProcessChannelMode(QProcess::MergedChannels);
+    if (!cmd.environment.isEmpty()) {
+        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+        for (const QString &e : cmd.environment) env.insert(e.section('=', 0, 0), e.section('=', 1));
+        p->setProcessEnvironment(env);
+    }
+    processes_.insert(id, p);
+    outputs_.remove(id);
+
+    auto lineBuf = std::make_shared<QByteArray>();
+    QObject::connect(p, &QProcess::readyReadStandardOutput, this, [this, p, id, lineBuf]() {
+        lineBuf->append(p->readAllStandardOutput());
+        QByteArray &kept = outputs_[id];
+        int nl;
+        while ((nl = lineBuf->indexOf('\n')) >= 0) {
+            const QByteArray raw = lineBuf->left(nl);
+            lineBuf->remove(0, nl + 1);
+            const QString line = QString::fromUtf8(raw).trimmed();
+            if (line.isEmpty()) continue;
+            InstallStep *st = step(id);
+            if (st && st->onLine) st->onLine(line);
+            if (line.startsWith("@nix ")) {
+                // Structured log: only Nix's own messages are worth showing
+                const QString msg = NixProgress::messageText(raw);
+                if (msg.isEmpty()) continue;
+                kept += msg.toUtf8() + '\n';
+                emitLog(id, msg);
+                continue;
+            }
+            kept += raw + '\n';
+            emitLog(id, line);
+        }
+        // Only onSuccess parsers need the whole output; errors only need the tail
+        InstallStep *owner = step(id);
+        if ((!owner || !owner->onSuccess) && kept.size() > 64 * 1024) kept = kept.right(16 * 1024);
+    });
+    QObject::connect(p, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
+                     [this, p, id, lineBuf](int exitCode, QProcess::ExitStatus es) {
+        processes_.remove(id);
+        p->deleteLater();
+        // Output without a trailing newline
+        const QByteArray out = outputs_.take(id) + *lineBuf;
+        if (es != QProcess::NormalExit || exitCode != 0) {
+            QString tail = QString::fromUtf8(out).trimmed().section('\n', -3);
+            if (tail.isEmpty()) tail = p->errorString();
+            finishStep(id, false, QString("%1 (exit %2)").arg(tail).arg(exitCode));
+            return;
+        }
+        InstallStep *st = step(id);
+        QString error;
+        if (st && st->onSuccess && !st->onSuccess(out, &error)) {
+            finishStep(id, false, error);
+            return;
+        }
+        finishStep(id, true, QString());
+    });
+    QObject::connect(p, &QProcess::errorOccurred, this, [this, p, id](QProcess::ProcessError err) {
+        if (err != QProcess::FailedToStart) return;
+        processes_.remove(id);
+        p->deleteLater();
+        finishStep(id, false, QString("Could not start %1: %2").arg(p->program(), p->errorString()));
+    });
+    if (!cmd.input.isNull()) {
+        const QByteArray input = cmd.input;
+        QObject::connect(p, &QProcess::started, this, [p, input]() {
+            p->write(input);
+            p->closeWriteChannel();
+        });
+    }
+    p->start();
+}
+
+void InstallEngine::launchWork(InstallStep &s)
+{
+    const QString id = s.id;
+    auto ctx = std::make_shared<InstallStepContext>();
+    ctx->plan = plan_;
+    ctx->cancelFlag = cancelFlag_;
+    ctx->progressFn = [this, id](double fraction) {
+        QMetaObject::invokeMethod(this, [this, id, fraction]() {
+            InstallStep *st = step(id);
+            if (!st || st->state != InstallStep::State::Running) return;
+            st->progress = fraction;
+            if (onStepChanged) onStepChanged(*st);
+        }, Qt::QueuedConnection);
+    };
+    ctx->logFn = [this, id](const QString &line) {
+        QMetaObject::invokeMethod(this, [this, id, line]() { emitLog(id, line); }, Qt::QueuedConnection);
+    };
+    auto work = s.work;
+    const quint64 span = s.traceSpan;
+    pool_.start([this, id, ctx, work, span]() {
+        NIXLY_TRACE_SCOPE_CHILD("install", "work " + id, span);
+        const bool ok = work(*ctx) && !ctx->isCancelled();
+        const QString error = ok ? QString() : (ctx->error.isEmpty() ? QString("Cancelled") : ctx->error);
+        QMetaObject::invokeMethod(this, [this, id, ok, error, ctx]() {
+            if (ok && ctx->updatePlan) ctx->updatePlan(plan_);
+            finishStep(id, ok, error);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void InstallEngine::finishStep(const QString &id, bool ok, const QString &error)
+{
+    InstallStep *s = step(id);
+    if (!s || s->state != InstallStep::State::Running) return;
+    --runningCount_;
+    s->elapsedMs = clock_.elapsed() - s->startedMs;
+    NIXLY_TRACE_END("install", s->traceSpan, ok ? 0 : 1);
+    if (ok) {
+        s->progress = 1.0;
+        journalStep(*s);
+        setState(*s, InstallStep::State::Done);
+    } else if (cancelFlag_->load()) {
+        setState(*s, InstallStep::State::Cancelled, error);
+    } else {
+        setState(*s, InstallStep::State::Failed, error);
+        emitLog(id, "Failed: " + error);
+        if (!failed_) {
+            failed_ = true;
+            firstError_ = QString("%1: %2").arg(s->title, error);
+            skipPending(QString("Blocked by failed step '%1'").arg(s->title));
+        }
+    }
+    schedule();
+}
+
+void InstallEngine::setState(InstallStep &s, InstallStep::State state, const QString &error)
+{
+    s.state = state;
+    if (!error.isEmpty()) s.error = error;
+    if (onStepChanged) onStepChanged(s);
+}
+
+void InstallEngine::skipPending(const QString &reason)
+{
+    for (InstallStep &s : steps_) {
+        if (s.state == InstallStep::State::Pending) {
+            setState(s, cancelFlag_->load() ? InstallStep::State::Cancelled : InstallStep::State::Skipped, reason);
+        }
+    }
+}
+
+void InstallEngine::runFinalizers(std::function<void()> done)
+{
+    if (finalizers_.isEmpty()) {
+        done();
+        return;
+    }
+    // Sequential and best-effort: each command runs whatever the previous exit code was
+    auto queue = std::make_shared<QList<InstallCommand>>(finalizers_);
+    auto next = std::make_shared<std::function<void()>>();
+    // Weak, or the step would own itself; the pending process's slots keep it alive
+    *next = [this, queue, weakNext = std::weak_ptr<std::function<void()>>(next), done]() {
+        if (queue->isEmpty()) {
+            done();
+            return;
+        }
+        const std::shared_ptr<std::function<void()>> next = weakNext.lock();
+        if (!next) return;
+        const InstallCommand cmd = queue->takeFirst();
+        QProcess *p = new QProcess(this);
+        NIXLY_TRACE_PROCESS(p, "teardown");
+        p->setProcessChannelMode(QProcess::MergedChannels);
+        QObject::connect(p, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
+                         [p, next](int, QProcess::ExitStatus) {
+            p->deleteLater();
+            (*next)();
+        });
+        QObject::connect(p, &QProcess::errorOccurred, this, [p, next](QProcess::ProcessError err) {
+            if (err != QProcess::FailedToStart) return;
+            p->deleteLater();
+            (*next)();
+        });
+        emitLog("teardown", "$ " + cmd.program + " " + cmd.args.join(' '));
+        p->start(cmd.program, cmd.args);
+    };
+    (*next)();
+}
+
+void InstallEngine::emitLog(const QString &id, const QString &line)
+{
+    if (onLog) onLog(id, line);
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QProcess>
+#include <QThreadPool>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "installjournal.h"
+#include "localcache.h"
+#include "luksparams.h"
+#include "nixprogress.h"
+#include "passwordhash.h"
+#include "storereuse.h"
+
+// Everything the engine needs to know about the machine being installed.
+struct InstallPlan
+{
+    QString device;                     // whole disk, e.g. /dev/nvme0n1 (a loop device in dry-run)
+    QString mountRoot = "/mnt";
+    QString mapperName = "cryptroot";
+    QString flakeDir;                   // cloned system repository (~/.nixlyos)
+    QString flakeHost = "nixlyos";      // nixosConfigurations.<flakeHost>
+    QByteArray luksPassphrase;
+    LuksParams luks;                    // calibrated by the luks-calibrate step unless preset
+    qint64 espSizeMiB = 1024;
+    bool fullWipe = false;              // erase the whole drive, not just its signatures; hours on a disk without discard
+    bool reuseExistingStore = true;     // import matching paths from a store on the drive before wiping
+    QStringList reusedPaths;            // imported by store-reuse, journaled for a resume
+    bool verifyStore = false;           // hash every installed path against its narHash at the end
+    int maxParallel = 0;                // 0 = QThread::idealThreadCount()
+    QStringList configLines;            // extra NixOS options for nixly-install.nix
+    QString userName;                   // account created on the target, empty for none
+    QByteArray userPasswordHash;        // crypt(3) string, hashed on the Settings page
+    PasswordHashParams passwordHash;    // how it was hashed, for the log
+    QStringList rootFsOptions;          // mount options for / (compression), set by compress-profile
+    QString localCacheDir;              // skips boot medium detection when set
+    QStringList extraSubstituters;      // passed to nix build and nixos-install
+    QString systemPath;                 // toplevel store path, set by build-system
+    QString scratchDir;                 // TMPDIR for Nix on the target, set by memory-budget
+    QStringList nixOptions;             // name, value pairs passed as --option, set by memory-budget
+
+    // Completed steps are journaled here (empty: no journal). With `resume`
+    // set, steps the journal recorded with the same inputs are verified and
+    // skipped instead of run again.
+    QString journalPath = InstallJournal::defaultPath();
+    bool resume = false;
+
+    // Dry-run installs into a sparse image attached as a loop device and
+    // skips the parts that need a real system closure.
+    bool dryRun = false;
+    qint64 dryRunImageMiB = 8192;
+    QString dryRunDir;                  // holds the image and the mount root
+    QString dryRunClosure;              // store path whose closure is copied into the target store
+
+    // /dev/sda -> /dev/sda1, /dev/nvme0n1 -> /dev/nvme0n1p1, /dev/loop3 -> /dev/loop3p1
+    QString partitionPath(int number) const;
+    QString mapperPath() const { return "/dev/mapper/" + mapperName; }
+    QString swapFilePath() const { return mountRoot + "/.nixly-swap"; }
+    // Where store-reuse imports to: the live store, or a scratch one in dry-run
+    QString reuseStoreRoot() const { return dryRun ? dryRunDir + "/reused" : QString(); }
+    // As seen from the installed system, for users.users.<name>.hashedPasswordFile
+    QString passwordFile() const { return "/etc/nixly/passwd/" + userName; }
+};
+
+struct InstallCommand
+{
+    QString program;
+    QStringList args;
+    QByteArray input;                   // written to stdin, then stdin is closed
+    QStringList environment;            // NAME=value added to the installer's environment
+};
+
+// Handed to in-process steps running on the engine's worker pool.
+class InstallStepContext
+{
+public:
+    InstallPlan plan;                   // snapshot taken when the step was launched
+    QString error;                      // set by the step before returning false
+    // Applied to the engine's plan on the engine thread once the step succeeded.
+    std::function<void(InstallPlan&)> updatePlan;
+
+    bool isCancelled() const { return cancelFlag && cancelFlag->load(); }
+    // Both are safe to call from the worker thread.
+    void setProgress(double fraction) const { if (progressFn) progressFn(fraction); }
+    void log(const QString &line) const { if (logFn) logFn(line); }
+
+    std::shared_ptr<std::atomic_bool> cancelFlag;
+    std::function<void(double)> progressFn;
+    std::function<void(const QString&)> logFn;
+};
+
+struct InstallStep
+{
+    enum class State { Pending, Running, Done, Failed, Skipped, Cancelled };
+
+    QString id;
+    QString title;
+    QStringList deps;
+    int weight = 1;                     // share of overall progress
+
+    // A step is either an external command (built right before launch so it
+    // sees plan changes made by earlier steps) ...
+    std::function<InstallCommand()> command;
+    // ... parsed on the engine thread once the command exited successfully,
+    std::function<bool(const QByteArray &output, QString *error)> onSuccess;
+    // ... or in-process work running on a worker thread.
+    std::function<bool(InstallStepContext&)> work;
+    // Every output line of a command step, on the engine thread. Nix
+    // internal-json lines ("@nix {...}") only go here, not to the log.
+    std::function<void(const QString &line)> onLine;
+    // Polled by pollProgress() while the step runs, for commands whose
+    // progress comes from their output.
+    std::function<double()> liveProgress;
+    // Dry-run marks the step done without running it.
+    bool skipInDryRun = false;
+    // Resuming: checks on a worker thread that the step's result is still in
+    // place (the partition exists, the volume is LUKS, ...). A journaled step
+    // is skipped when this passes; with reuseWithoutJournal, the check alone
+    // is enough (an unlocked volume or a mount left by a crashed run).
+    std::function<bool(const InstallPlan&)> verify;
+    bool reuseWithoutJournal = false;
+
+    State state = State::Pending;
+    double progress = 0.0;
+    qint64 startedMs = -1;              // relative to engine start
+    qint64 elapsedMs = 0;
+    QString error;
+    quint64 traceSpan = 0;              // see tracer.h
+
+    bool isFinished() const { return state != State::Pending && state != State::Running; }
+};
+
+QString installStepStateName(InstallStep::State state);
+
+// Runs the install as a dependency graph: a step starts as soon as all of its
+// dependencies are done, up to InstallPlan::maxParallel at a time. A failing
+// step stops anything new from being scheduled; its dependents are skipped.
+class InstallEngine : public QObject
+{
+public:
+    explicit InstallEngine(QObject *parent = nullptr);
+    ~InstallEngine() override;
+
+    void setPlan(const InstallPlan &plan) { plan_ = plan; }
+    const InstallPlan &plan() const { return plan_; }
+    InstallPlan &plan() { return plan_; }
+
+    // store-reuse -> wipe -> partition -> {ESP mkfs, LUKS format/open -> root mkfs} -> mount
+    // -> config, memory-budget, copy-closure -> build-system -> nixos-install -> bootloader
+    void buildDefaultGraph();
+    void addStep(const InstallStep &step);
+    // Inserts `step` right after `after`: everything that depended on `after`
+    // now depends on `step` instead.
+    void insertStepAfter(const QString &after, const InstallStep &step);
+    InstallStep *step(const QString &id);
+    const QList<InstallStep> &steps() const { return steps_; }
+
+    void start();
+    void cancel();
+    bool isRunning() const { return running_; }
+    bool isCancelled() const { return cancelFlag_->load(); }
+    qint64 elapsedMs() const { return clock_.isValid() ? clock_.elapsed() : 0; }
+    double progress() const;
+    // Identifies the disk the journal belongs to: device and size, or the
+    // image in dry-run. Call after buildDefaultGraph().
+    QString journalTarget() const;
+    // Steps a previous run completed on this target, oldest first.
+    QStringList resumableSteps() const;
+    // Refreshes liveProgress steps; the UI calls this on its own timer so
+    // progress costs nothing per output line.
+    void pollProgress();
+    // Aggregated Nix activity of the build-system step.
+    NixProgress::Snapshot nixProgress() const { return nixProgress_->snapshot(); }
+    // Binary cache found on the boot medium, with hit statistics once nixos-install ran.
+    const LocalBinaryCache &localCache() const { return localCache_; }
+    // Paths salvaged from a store already on the drive, once store-reuse ran.
+    const StoreReuse::Result &storeReuse() const { return storeReuse_; }
+
+    // Invoked on the thread that owns the engine.
+    std::function<void(const InstallStep&)> onStepChanged;
+    std::function<void(const QString &stepId, const QString &line)> onLog;
+    std::function<void(bool ok, const QString &error)> onFinished;
+    // Right after a step's completion reached the journal on disk
+    std::function<void(const InstallStep&)> onStepJournaled;
+
+private:
+    bool validateGraph(QString *error) const;
+    void schedule();
+    void launch(InstallStep &s);
+    void launchVerified(InstallStep &s, const InstallCommand &cmd);
+    void launchCommand(InstallStep &s, const InstallCommand &cmd);
+    void launchWork(InstallStep &s);
+    void finishStep(const QString &id, bool ok, const QString &error);
+    void journalStep(const InstallStep &s);
+    QString stepInputs(const InstallCommand &cmd) const;
+    void setState(InstallStep &s, InstallStep::State state, const QString &error = QString());
+    void skipPending(const QString &reason);
+    void runFinalizers(std::function<void()> done);
+    void emitLog(const QString &id, const QString &line);
+
+    InstallPlan plan_;
+    QList<InstallStep> steps_;
+    QHash<QString, QProcess*> processes_;
+    QHash<QString, QByteArray> outputs_;
+    QList<InstallCommand> finalizers_;  // best-effort teardown: swap, and the loop setup in dry-run
+    QThreadPool pool_;
+    QElapsedTimer clock_;
+    std::shared_ptr<std::atomic_bool> cancelFlag_;
+    // Only touched on the engine thread; the steps that fill them hand over
+    // a finished copy through updatePlan
+    LocalBinaryCache localCache_;
+    std::shared_ptr<NixProgress> nixProgress_;
+    StoreReuse::Result storeReuse_;
+    std::unique_ptr<InstallJournal> journal_;
+    QHash<QString, QString> inputs_;    // per running step, for the journal
+    int runningCount_ = 0;
+    bool running_ = false;
+    bool failed_ = false;
+    QString firstError_;
+};
@@ -0,0 +1,113 @@
+#include "installjournal.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSaveFile>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+static constexpr int kJournalVersion = 1;
+
+QString InstallJournal::defaultPath()
+{
+    return "/run/nixlyinstall/journal.json";
+}
+
+InstallJournal::InstallJournal(const QString &path)
+    : path_(path)
+{
+}
+
+bool InstallJournal::load()
+{
+    QFile f(path_);
+    if (!f.open(QIODevice::ReadOnly)) return false;
+    const QJsonObject root = QJsonDocument::fromJson(f.readAll()).object();
+    if (root.value("version").toInt() != kJournalVersion) return false;
+    target_ = root.value("target").toString();
+    state_ = root.value("state").toObject();
+    entries_.clear();
+    order_.clear();
+    for (const QJsonValue &v : root.value("steps").toArray()) {
+        const QJsonObject o = v.toObject();
+        Entry e;
+        e.inputs = o.value("inputs").toString();
+        e.elapsedMs = o.value("elapsedMs").toVariant().toLongLong();
+        e.completedAt = o.value("completedAt").toString();
+        const QString id = o.value("id").toString();
+        entries_.insert(id, e);
+        order_ << id;
+    }
+    return !target_.isEmpty();
+}
+
+bool InstallJournal::save() const
+{
+    QJsonArray steps;
+    for (const QString &id : order_) {
+        const Entry e = entries_.value(id);
+        steps.append(QJsonObject {
+            { "id", id }, { "inputs", e.inputs },
+            { "elapsedMs", e.elapsedMs }, { "completedAt", e.completedAt } });
+    }
+    const QJsonObject root {
+        { "version", kJournalVersion }, { "target", target_ },
+        { "state", state_ }, { "steps", steps } };
+    const QByteArray data = QJsonDocument(root).toJson();
+    bool ok = writeDurably(path_, data);
+    // The mirror is a record, not something resuming depends on
+    if (!mirror_.isEmpty()) writeDurably(mirror_, data);
+    return ok;
+}
+
+void InstallJournal::discard()
+{
+    QFile::remove(path_);
+}
+
+void InstallJournal::reset(const QString &target)
+{
+    target_ = target;
+    entries_.clear();
+    order_.clear();
+    state_ = QJsonObject();
+}
+
+void InstallJournal::record(const QString &stepId, const QString &inputs, qint64 elapsedMs)
+{
+    Entry e;
+    e.inputs = inputs;
+    e.elapsedMs = elapsedMs;
+    e.completedAt = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    if (!entries_.contains(stepId)) order_ << stepId;
+    entries_.insert(stepId, e);
+}
+
+bool InstallJournal::has(const QString &stepId, const QString &inputs) const
+{
+    const auto it = entries_.constFind(stepId);
+    return it != entries_.constEnd() && it->inputs == inputs;
+}
+
+bool InstallJournal::writeDurably(const QString &path, const QByteArray &data)
+{
+    const QString dir = QFileInfo(path).absolutePath();
+    if (!QDir().mkpath(dir)) return false;
+    // QSaveFile writes a temporary file, fsyncs it and renames it over `path`
+    QSaveFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) return false;
+    f.write(data);
+    if (!f.commit()) return false;
+    // ... and the rename itself is only durable once the directory is synced
+    const int fd = ::open(QFile::encodeName(dir).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+    return true;
+}
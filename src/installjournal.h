@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QHash>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QString>
+#include <QStringList>
+
+// Durable record of the install steps that completed, with the inputs each
+// ran with, so a relaunch after a failure or crash continues where the last
+// run stopped instead of repartitioning and re-encrypting.
+//
+// The primary copy lives in /run/nixlyinstall (tmpfs: it survives the
+// installer, not a reboot); once the target root is mounted every save is
+// mirrored to <root>/var/lib/nixlyinstall as a record of how the system was
+// installed. Each save replaces the file atomically and is fsynced. The
+// journal never contains the LUKS passphrase.
+class InstallJournal
+{
+public:
+    struct Entry {
+        QString inputs;                 // normalised command line of the step
+        qint64 elapsedMs = 0;
+        QString completedAt;            // ISO 8601, UTC
+    };
+
+    static QString defaultPath();
+    explicit InstallJournal(const QString &path = defaultPath());
+
+    // False when there is no journal or it cannot be parsed.
+    bool load();
+    bool save() const;
+    // Removes the primary copy; the mirror on the target is kept.
+    void discard();
+
+    // Starts a new journal for `target` (see InstallEngine::journalTarget()).
+    void reset(const QString &target);
+    QString target() const { return target_; }
+    bool isEmpty() const { return entries_.isEmpty(); }
+
+    void record(const QString &stepId, const QString &inputs, qint64 elapsedMs);
+    bool has(const QString &stepId, const QString &inputs) const;
+    QStringList completedSteps() const { return order_; }
+
+    // Plan values chosen during the run that a resumed run has to reuse
+    void setState(const QString &key, const QJsonValue &value) { state_.insert(key, value); }
+    QJsonValue state(const QString &key) const { return state_.value(key); }
+
+    void setMirror(const QString &path) { mirror_ = path; }
+    QString path() const { return path_; }
+
+private:
+    static bool writeDurably(const QString &path, const QByteArray &data);
+
+    QString path_;
+    QString mirror_;
+    QString target_;
+    QHash<QString, Entry> entries_;
+    QStringList order_;
+    QJsonObject state_;
+};
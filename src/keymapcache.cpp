@@ -0,0 +1,259 @@
+#include "keymapcache.h"
+#include "tracer.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFocusEvent>
+#include <QKeyEvent>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QPointer>
+#include <QXmlStreamReader>
+
+#include <algorithm>
+#include <xkbcommon/xkbcommon.h>
+
+namespace {
+
+QString cacheKey(const QString &layout, const QString &variant)
+{
+    return layout + '(' + variant + ')';
+}
+
+} // namespace
+
+QString KeyboardLayouts::xkbRoot()
+{
+    const QString env = qEnvironmentVariable("XKB_CONFIG_ROOT");
+    if (!env.isEmpty()) return env;
+    for (const QString &dir : { QString("/etc/X11/xkb"), QString("/run/current-system/sw/share/X11/xkb"),
+                                QString("/usr/share/X11/xkb") }) {
+        if (QFile::exists(dir + "/rules/evdev.xml")) return dir;
+    }
+    return QString();
+}
+
+QList<KeyboardLayouts::Layout> KeyboardLayouts::load(QString *error)
+{
+    QList<Layout> layouts;
+    QFile f(xkbRoot() + "/rules/evdev.xml");
+    if (!f.open(QIODevice::ReadOnly)) {
+        *error = "No xkeyboard-config rules/evdev.xml found";
+        return layouts;
+    }
+    // <layoutList><layout><configItem><name/><description/></configItem>
+    //   <variantList><variant><configItem>...</configItem></variant>...
+    QXmlStreamReader xml(&f);
+    bool inLayoutList = false, inVariant = false;
+    Layout layout;
+    Variant variant;
+    while (!xml.atEnd()) {
+        xml.readNext();
+        const QStringView name = xml.name();
+        if (xml.isStartElement()) {
+            if (name == u"layoutList") inLayoutList = true;
+            if (!inLayoutList) continue;
+            if (name == u"layout") {
+                layout = Layout();
+            } else if (name == u"variant") {
+                variant = Variant();
+                inVariant = true;
+            } else if (name == u"name" || name == u"description") {
+                const QString text = xml.readElementText();
+                QString &field = name == u"name" ? (inVariant ? variant.name : layout.name)
+                                                 : (inVariant ? variant.description : layout.description);
+                field = text;
+            }
+        } else if (xml.isEndElement() && inLayoutList) {
+            if (name == u"variant") {
+                layout.variants << variant;
+                inVariant = false;
+            } else if (name == u"layout") {
+                layouts << layout;
+            } else if (name == u"layoutList") {
+                break;
+            }
+        }
+    }
+    if (xml.hasError()) {
+        *error = "evdev.xml: " + xml.errorString();
+        return {};
+    }
+    std::sort(layouts.begin(), layouts.end(), [](const Layout &a, const Layout &b) {
+        return a.description.localeAwareCompare(b.description) < 0;
+    });
+    return layouts;
+}
+
+QStringList KeyboardLayouts::popular()
+{
+    return { "us", "de", "fr", "gb", "es", "it", "ru", "br", "pl", "jp",
+             "pt", "se", "no", "dk", "fi", "nl", "be", "ch", "cz", "sk",
+             "hu", "tr", "ua", "gr", "il", "ara", "ir", "in", "kr", "cn",
+             "latam", "ca", "ro", "bg", "hr", "si", "rs", "lt", "lv", "ee",
+             "is", "ie", "th", "vn", "by", "kz", "id", "ph", "at", "au" };
+}
+
+KeymapCache::KeymapCache(int capacity)
+    : capacity_(qMax(1, capacity))
+{
+    // Two compiles at most: one for the current selection, one finishing
+    // an older one
+    pool_.setMaxThreadCount(2);
+}
+
+KeymapCache::~KeymapCache()
+{
+    generation_ += 1;
+    pool_.waitForDone();
+}
+
+KeymapCache::Keymap KeymapCache::compile(const QString &layout, const QString &variant, QString *error)
+{
+    xkb_context *ctx = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    if (!ctx) {
+        *error = "xkb_context_new failed";
+        return nullptr;
+    }
+    const QByteArray root = KeyboardLayouts::xkbRoot().toLocal8Bit();
+    if (!root.isEmpty() && qEnvironmentVariableIsEmpty("XKB_CONFIG_ROOT")) xkb_context_include_path_append(ctx, root.constData());
+    const QByteArray l = layout.toUtf8(), v = variant.toUtf8();
+    xkb_rule_names names {};
+    names.rules = "evdev";
+    names.model = "pc105";
+    names.layout = l.constData();
+    names.variant = v.constData();
+    xkb_keymap *keymap = xkb_keymap_new_from_names(ctx, &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    // The keymap holds its own reference
+    xkb_context_unref(ctx);
+    if (!keymap) {
+        *error = QString("Could not compile keymap %1").arg(cacheKey(layout, variant));
+        return nullptr;
+    }
+    return Keymap(keymap, xkb_keymap_unref);
+}
+
+KeymapCache::Keymap KeymapCache::cached(const QString &layout, const QString &variant)
+{
+    const QString key = cacheKey(layout, variant);
+    QMutexLocker lock(&mutex_);
+    for (int i = 0; i < entries_.size(); ++i) {
+        if (entries_.at(i).first != key) continue;
+        entries_.move(i, 0);
+        ++stats_.hits;
+        return entries_.first().second;
+    }
+    return nullptr;
+}
+
+void KeymapCache::insert(const QString &key, const Keymap &keymap)
+{
+    QMutexLocker lock(&mutex_);
+    ++stats_.misses;
+    entries_.prepend({ key, keymap });
+    while (entries_.size() > capacity_) {
+        entries_.removeLast();
+        ++stats_.evictions;
+    }
+}
+
+KeymapCache::Stats KeymapCache::stats() const
+{
+    QMutexLocker lock(&mutex_);
+    return stats_;
+}
+
+void KeymapCache::request(const QString &layout, const QString &variant, QObject *context,
+                          std::function<void(Keymap, qint64, const QString &)> done)
+{
+    const quint64 generation = ++generation_;
+    if (Keymap hit = cached(layout, variant)) {
+        done(hit, 0, QString());
+        return;
+    }
+    QPointer<QObject> target(context);
+    pool_.start([this, layout, variant, generation, target, done]() {
+        // The user has already moved on
+        if (generation != generation_.load()) {
+            QMutexLocker lock(&mutex_);
+            ++stats_.skipped;
+            return;
+        }
+        NIXLY_TRACE_SCOPE("keymap", "compile " + cacheKey(layout, variant));
+        // Asked for twice in a row before the first compile finished
+        Keymap keymap = cached(layout, variant);
+        qint64 us = 0;
+        QString error;
+        if (!keymap) {
+            QElapsedTimer timer;
+            timer.start();
+            keymap = compile(layout, variant, &error);
+            us = timer.nsecsElapsed() / 1000;
+            if (keymap) insert(cacheKey(layout, variant), keymap);
+        }
+        if (!target) return;
+        QMetaObject::invokeMethod(target, [keymap, us, error, done]() { done(keymap, us, error); }, Qt::QueuedConnection);
+    });
+}
+
+KeymapTryField::KeymapTryField(QWidget *parent)
+    : QLineEdit(parent)
+{
+}
+
+KeymapTryField::~KeymapTryField()
+{
+    if (state_) xkb_state_unref(state_);
+}
+
+void KeymapTryField::setKeymap(const KeymapCache::Keymap &keymap)
+{
+    keymap_ = keymap;
+    resetState();
+}
+
+void KeymapTryField::resetState()
+{
+    if (state_) xkb_state_unref(state_);
+    state_ = keymap_ ? xkb_state_new(keymap_.get()) : nullptr;
+}
+
+void KeymapTryField::keyPressEvent(QKeyEvent *event)
+{
+    // nativeScanCode() is the XKB keycode (evdev + 8) on Wayland and X11
+    const xkb_keycode_t code = event->nativeScanCode();
+    const bool shortcut = event->modifiers() & (Qt::ControlModifier | Qt::MetaModifier);
+    switch (event->key()) {
+    case Qt::Key_Backspace: case Qt::Key_Delete: case Qt::Key_Left: case Qt::Key_Right:
+    case Qt::Key_Home: case Qt::Key_End: case Qt::Key_Return: case Qt::Key_Enter:
+    case Qt::Key_Tab: case Qt::Key_Backtab: case Qt::Key_Escape:
+        QLineEdit::keyPressEvent(event);
+        return;
+    default:
+        break;
+    }
+    if (!state_ || code == 0 || shortcut) {
+        QLineEdit::keyPressEvent(event);
+        return;
+    }
+    // Text first, then the state update, as xkbcommon expects
+    char utf8[64];
+    const int n = xkb_state_key_get_utf8(state_, code, utf8, sizeof utf8);
+    if (!event->isAutoRepeat()) xkb_state_update_key(state_, code, XKB_KEY_DOWN);
+    if (n > 0 && static_cast<unsigned char>(utf8[0]) >= 0x20) insert(QString::fromUtf8(utf8, qMin<int>(n, sizeof utf8 - 1)));
+    event->accept();
+}
+
+void KeymapTryField::keyReleaseEvent(QKeyEvent *event)
+{
+    const xkb_keycode_t code = event->nativeScanCode();
+    if (state_ && code != 0 && !event->isAutoRepeat()) xkb_state_update_key(state_, code, XKB_KEY_UP);
+    QLineEdit::keyReleaseEvent(event);
+}
+
+void KeymapTryField::focusOutEvent(QFocusEvent *event)
+{
+    // Releases of keys held while focus left never arrive
+    resetState();
+    QLineEdit::focusOutEvent(event);
+}
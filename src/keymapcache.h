@@ -0,0 +1,108 @@
+#pragma once
+
+#include <QLineEdit>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+struct xkb_keymap;
+struct xkb_state;
+
+// Layouts and variants as listed in xkeyboard-config's rules/evdev.xml, the
+// same list the compositor and services.xserver.xkb accept.
+class KeyboardLayouts
+{
+public:
+    struct Variant {
+        QString name;                   // "nodeadkeys"
+        QString description;            // "Norwegian (no dead keys)"
+    };
+
+    struct Layout {
+        QString name;                   // "no"
+        QString description;            // "Norwegian"
+        QList<Variant> variants;
+    };
+
+    // XKB_CONFIG_ROOT, else the first xkeyboard-config directory found
+    static QString xkbRoot();
+    // Blocking (a few hundred KiB of XML); sorted by description.
+    static QList<Layout> load(QString *error);
+    // The layouts most installs pick, most common first
+    static QStringList popular();
+};
+
+// Compiled xkbcommon keymaps, most recently used kept. Compiling one reads and
+// parses the whole keycodes/types/compat/symbols set for that layout and takes
+// tens of milliseconds, so it runs on a worker and a selection that is
+// already stale by the time its turn comes is skipped. Every keymap gets its
+// own xkb_context: keymaps share no mutable state and may be used on any
+// thread once handed over.
+class KeymapCache
+{
+public:
+    using Keymap = std::shared_ptr<xkb_keymap>;
+
+    struct Stats {
+        int hits = 0;
+        int misses = 0;
+        int evictions = 0;
+        int skipped = 0;                // stale requests never compiled
+    };
+
+    explicit KeymapCache(int capacity = 16);
+    ~KeymapCache();
+
+    // Null when not compiled yet; never blocks on a compile.
+    Keymap cached(const QString &layout, const QString &variant);
+
+    // `done` runs on `context`'s thread with the keymap (null on failure) and
+    // the compile time in microseconds (0 for a cache hit). Only the latest
+    // request is guaranteed to be compiled.
+    void request(const QString &layout, const QString &variant, QObject *context,
+                 std::function<void(Keymap keymap, qint64 compileUs, const QString &error)> done);
+
+    Stats stats() const;
+
+    // Blocking, uncached.
+    static Keymap compile(const QString &layout, const QString &variant, QString *error);
+
+private:
+    void insert(const QString &key, const Keymap &keymap);
+
+    int capacity_;
+    mutable QMutex mutex_;
+    QList<QPair<QString, Keymap>> entries_;     // front: most recently used
+    Stats stats_;
+    std::atomic<quint64> generation_ { 0 };
+    QThreadPool pool_;
+};
+
+// Shows what typing produces with a keymap other than the live session's:
+// the raw keycode of each key goes through an xkb_state of that keymap. Keys
+// without a keycode, editing keys and shortcuts behave as usual.
+class KeymapTryField : public QLineEdit
+{
+public:
+    explicit KeymapTryField(QWidget *parent = nullptr);
+    ~KeymapTryField() override;
+
+    void setKeymap(const KeymapCache::Keymap &keymap);
+
+protected:
+    void keyPressEvent(QKeyEvent *event) override;
+    void keyReleaseEvent(QKeyEvent *event) override;
+    void focusOutEvent(QFocusEvent *event) override;
+
+private:
+    void resetState();
+
+    KeymapCache::Keymap keymap_;
+    xkb_state *state_ = nullptr;
+};
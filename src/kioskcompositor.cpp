@@ -0,0 +1,422 @@
+#include "kioskcompositor.h"
+
+#include "pageregistry.h"
+#include "tracer.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPointer>
+#include <QProcess>
+#include <QRasterWindow>
+#include <QTemporaryDir>
+#include <QWheelEvent>
+#include <QtWaylandCompositor/QWaylandBufferRef>
+#include <QtWaylandCompositor/QWaylandClient>
+#include <QtWaylandCompositor/QWaylandCompositor>
+#include <QtWaylandCompositor/QWaylandOutput>
+#include <QtWaylandCompositor/QWaylandSeat>
+#include <QtWaylandCompositor/QWaylandSurface>
+#include <QtWaylandCompositor/QWaylandView>
+#include <QtWaylandCompositor/QWaylandXdgShell>
+
+#include <memory>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+class KioskCompositor;
+
+// The output: one fullscreen window, painted with QPainter
+class KioskWindow : public QRasterWindow
+{
+public:
+    KioskCompositor *compositor = nullptr;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+    void keyReleaseEvent(QKeyEvent *event) override;
+};
+
+struct Window {
+    std::unique_ptr<QWaylandView> view;
+    QPointer<QWaylandXdgSurface> xdg;
+    QPointer<QWaylandXdgToplevel> toplevel;     // either this
+    QPointer<QWaylandXdgPopup> popup;           // or this
+    QPoint origin;                              // of its window geometry, in output coordinates
+    bool shown = false;                         // a frame of it was drawn
+
+    QWaylandSurface *surface() const { return view->surface(); }
+    // Client-side shadows and borders fall outside the window geometry
+    QRect rect() const
+    {
+        const QPoint offset = xdg ? xdg->windowGeometry().topLeft() : QPoint();
+        return QRect(origin - offset, surface() ? surface()->destinationSize() : QSize());
+    }
+};
+
+// Stacks the installer and whatever it launches, newest on top, each
+// toplevel fullscreen; popups (menus, combo box lists, tooltips) sit at the
+// place their parent asked for. Input goes to the window under the pointer
+// and the keyboard to the topmost toplevel.
+class KioskCompositor : public QWaylandCompositor
+{
+public:
+    explicit KioskCompositor(KioskWindow *window) : window_(window)
+    {
+        window->compositor = this;
+    }
+
+    void start(const QByteArray &socketName)
+    {
+        setSocketName(socketName);
+        // Drawn with QPainter: offer clients nothing but wl_shm to draw into
+        setUseHardwareIntegrationExtension(false);
+        output_ = new QWaylandOutput(this, window_);
+        const QWaylandOutputMode mode(window_->size(), 60000);
+        output_->addMode(mode, true);
+        QWaylandCompositor::create();
+        output_->setCurrentMode(mode);
+
+        QWaylandXdgShell *shell = new QWaylandXdgShell(this);
+        QObject::connect(shell, &QWaylandXdgShell::toplevelCreated, this,
+                         [this](QWaylandXdgToplevel *toplevel, QWaylandXdgSurface *xdg) { addToplevel(toplevel, xdg); });
+        QObject::connect(shell, &QWaylandXdgShell::popupCreated, this,
+                         [this](QWaylandXdgPopup *popup, QWaylandXdgSurface *xdg) { addPopup(popup, xdg); });
+    }
+
+    void setInstallerPid(qint64 pid) { installerPid_ = pid; }
+
+    void resized(const QSize &size)
+    {
+        if (!output_) return;
+        const QWaylandOutputMode mode(size, 60000);
+        output_->addMode(mode);
+        output_->setCurrentMode(mode);
+        for (const auto &w : windows_) {
+            if (w->toplevel) w->toplevel->sendFullscreen(size);
+        }
+    }
+
+    void paint(QPainter &painter)
+    {
+        NIXLY_TRACE_SCOPE("kiosk", "paint");
+        painter.fillRect(QRect(QPoint(), window_->size()), QColor(26, 26, 26));
+        for (const auto &w : windows_) {
+            w->view->advance();
+            const QWaylandBufferRef buffer = w->view->currentBuffer();
+            if (!buffer.hasBuffer()) continue;
+            if (!buffer.isSharedMemory()) {
+                // A client that ignored the software rendering environment
+                if (!warnedGpuBuffer_)
+                    qWarning("Kiosk: pid %lld committed a GPU buffer, which is not shown",
+                             w->surface()->client() ? w->surface()->client()->processId() : -1);
+                warnedGpuBuffer_ = true;
+                continue;
+            }
+            painter.drawImage(w->rect(), buffer.image());
+            if (!w->shown) {
+                w->shown = true;
+                if (!installerShown_ && isInstaller(w->surface())) {
+                    installerShown_ = true;
+                    NIXLY_TRACE_INSTANT("kiosk", "installer first frame");
+                    qInfo("Kiosk: installer's first frame %lld ms after start", PageRegistry::msSinceProcessStart());
+                } else if (!isInstaller(w->surface())) {
+                    qInfo("Kiosk: first frame from pid %lld", w->surface()->client() ? w->surface()->client()->processId() : -1);
+                }
+            }
+        }
+        for (const auto &w : windows_) {
+            if (w->surface()) w->surface()->sendFrameCallbacks();
+        }
+    }
+
+    void mouseMove(QMouseEvent *event)
+    {
+        Window *w = grabbed_ ? grabbed_ : windowAt(event->position().toPoint());
+        const QPointF pos = event->position();
+        defaultSeat()->sendMouseMoveEvent(w ? w->view.get() : nullptr, w ? pos - w->rect().topLeft() : pos, pos);
+    }
+
+    void mousePress(QMouseEvent *event)
+    {
+        Window *w = windowAt(event->position().toPoint());
+        // A click outside the open menus closes them, as a desktop does
+        if (!w || !w->popup) dismissPopups();
+        if (w && w->toplevel) raise(w);
+        grabbed_ = w;
+        mouseMove(event);
+        defaultSeat()->sendMousePressEvent(event->button());
+    }
+
+    void mouseRelease(QMouseEvent *event)
+    {
+        defaultSeat()->sendMouseReleaseEvent(event->button());
+        if (event->buttons() == Qt::NoButton) grabbed_ = nullptr;
+    }
+
+    void wheel(QWheelEvent *event)
+    {
+        const QPoint delta = event->angleDelta();
+        if (delta.y()) defaultSeat()->sendMouseWheelEvent(Qt::Vertical, delta.y());
+        if (delta.x()) defaultSeat()->sendMouseWheelEvent(Qt::Horizontal, delta.x());
+    }
+
+    void key(QKeyEvent *event)
+    {
+        if (event->key() == Qt::Key_Tab && (event->modifiers() & Qt::AltModifier)) {
+            if (event->type() == QEvent::KeyPress) cycle();
+            return;
+        }
+        defaultSeat()->sendFullKeyEvent(event);
+    }
+
+private:
+    bool isInstaller(QWaylandSurface *surface) const
+    {
+        return surface && surface->client() && surface->client()->processId() == installerPid_;
+    }
+
+    Window *add(QWaylandXdgSurface *xdg)
+    {
+        auto w = std::make_unique<Window>();
+        w->xdg = xdg;
+        w->view = std::make_unique<QWaylandView>();
+        w->view->setSurface(xdg->surface());
+        w->view->setOutput(output_);
+        QWaylandSurface *surface = xdg->surface();
+        QObject::connect(surface, &QWaylandSurface::redraw, window_, [this]() { window_->update(); });
+        QObject::connect(surface, &QWaylandSurface::surfaceDestroyed, this, [this, surface]() { remove(surface); });
+        windows_.push_back(std::move(w));
+        return windows_.back().get();
+    }
+
+    void addToplevel(QWaylandXdgToplevel *toplevel, QWaylandXdgSurface *xdg)
+    {
+        Window *w = add(xdg);
+        w->toplevel = toplevel;
+        // Asking to leave fullscreen, maximize or minimize changes nothing here
+        toplevel->sendFullscreen(window_->size());
+        defaultSeat()->setKeyboardFocus(xdg->surface());
+        NIXLY_TRACE_INSTANT("kiosk", isInstaller(xdg->surface()) ? QString("installer window") : QString("client window"));
+        qInfo("Kiosk: %s window from pid %lld", isInstaller(xdg->surface()) ? "installer" : "client",
+              xdg->surface()->client() ? xdg->surface()->client()->processId() : -1);
+    }
+
+    void addPopup(QWaylandXdgPopup *popup, QWaylandXdgSurface *xdg)
+    {
+        QPoint parentOrigin;
+        for (const auto &w : windows_) {
+            if (w->xdg == popup->parentXdgSurface()) parentOrigin = w->origin;
+        }
+        Window *w = add(xdg);
+        w->popup = popup;
+        w->origin = parentOrigin + popup->unconstrainedPosition();
+        window_->update();
+    }
+
+    void remove(QWaylandSurface *surface)
+    {
+        for (auto it = windows_.begin(); it != windows_.end(); ++it) {
+            if ((*it)->surface() != surface) continue;
+            if (grabbed_ == it->get()) grabbed_ = nullptr;
+            windows_.erase(it);
+            break;
+        }
+        // The keyboard goes back to whatever is on top now, usually the installer
+        for (auto it = windows_.rbegin(); it != windows_.rend(); ++it) {
+            if ((*it)->toplevel) {
+                defaultSeat()->setKeyboardFocus((*it)->surface());
+                break;
+            }
+        }
+        window_->update();
+    }
+
+    void raise(Window *w)
+    {
+        for (auto it = windows_.begin(); it != windows_.end(); ++it) {
+            if (it->get() != w) continue;
+            std::unique_ptr<Window> keep = std::move(*it);
+            windows_.erase(it);
+            windows_.push_back(std::move(keep));
+            break;
+        }
+        defaultSeat()->setKeyboardFocus(w->surface());
+        window_->update();
+    }
+
+    // Alt+Tab: the lowest toplevel comes to the top
+    void cycle()
+    {
+        dismissPopups();
+        for (const auto &w : windows_) {
+            if (w->toplevel) {
+                if (w.get() != windows_.back().get()) raise(w.get());
+                return;
+            }
+        }
+    }
+
+    void dismissPopups()
+    {
+        for (const auto &w : windows_) {
+            if (w->popup) w->popup->sendPopupDone();
+        }
+    }
+
+    Window *windowAt(const QPoint &pos) const
+    {
+        for (auto it = windows_.rbegin(); it != windows_.rend(); ++it) {
+            if ((*it)->surface() && (*it)->surface()->hasContent() && (*it)->rect().contains(pos)) return it->get();
+        }
+        return nullptr;
+    }
+
+    KioskWindow *window_;
+    QWaylandOutput *output_ = nullptr;
+    std::vector<std::unique_ptr<Window>> windows_;      // bottom to top
+    Window *grabbed_ = nullptr;                         // under the pointer when a button went down
+    qint64 installerPid_ = 0;
+    bool installerShown_ = false;
+    bool warnedGpuBuffer_ = false;
+};
+
+void KioskWindow::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    compositor->paint(painter);
+}
+
+void KioskWindow::resizeEvent(QResizeEvent *)
+{
+    compositor->resized(size());
+}
+
+void KioskWindow::mouseMoveEvent(QMouseEvent *event) { compositor->mouseMove(event); }
+void KioskWindow::mousePressEvent(QMouseEvent *event) { compositor->mousePress(event); }
+void KioskWindow::mouseReleaseEvent(QMouseEvent *event) { compositor->mouseRelease(event); }
+void KioskWindow::wheelEvent(QWheelEvent *event) { compositor->wheel(event); }
+void KioskWindow::keyPressEvent(QKeyEvent *event) { compositor->key(event); }
+void KioskWindow::keyReleaseEvent(QKeyEvent *event) { compositor->key(event); }
+
+QString option(const QStringList &args, const QString &name)
+{
+    const QString prefix = name + "=";
+    for (const QString &a : args) {
+        if (a.startsWith(prefix)) return a.mid(prefix.size());
+    }
+    return QString();
+}
+
+// The installer's command line: ours without the kiosk options. Its spans
+// go to a trace file of their own next to the compositor's.
+QStringList installerArguments(const QStringList &args)
+{
+    QStringList out;
+    for (const QString &a : args) {
+        if (a == "--kiosk" || a.startsWith("--kiosk-")) continue;
+        if (a.startsWith("--trace=")) {
+            const QFileInfo trace(a.mid(8));
+            out << QString("--trace=%1/%2-installer%3").arg(trace.path(), trace.completeBaseName(),
+                                                             trace.suffix().isEmpty() ? QString() : "." + trace.suffix());
+            continue;
+        }
+        out << a;
+    }
+    return out;
+}
+
+} // namespace
+
+int runKiosk(int &argc, char **argv)
+{
+    QStringList args;
+    for (int i = 1; i < argc; ++i) args << QString::fromLocal8Bit(argv[i]);
+
+    // On a bare console the compositor owns the display through KMS; inside a
+    // session it is just a window there
+    QString platform = option(args, "--kiosk-platform");
+    if (platform.isEmpty()) {
+        if (qEnvironmentVariableIsSet("WAYLAND_DISPLAY")) platform = "wayland";
+        else if (qEnvironmentVariableIsSet("DISPLAY")) platform = "xcb";
+        else platform = "eglfs";
+    }
+    const bool nested = platform != "eglfs";
+    qputenv("QT_QPA_PLATFORM", platform.toLocal8Bit());
+
+    // Our socket lives here. A console without a login session may not have one
+    std::unique_ptr<QTemporaryDir> runtimeDir;
+    if (qEnvironmentVariableIsEmpty("XDG_RUNTIME_DIR")) {
+        runtimeDir = std::make_unique<QTemporaryDir>();
+        if (!runtimeDir->isValid()) {
+            qCritical("Kiosk: no XDG_RUNTIME_DIR and no temporary directory: %s", qPrintable(runtimeDir->errorString()));
+            return 1;
+        }
+        qputenv("XDG_RUNTIME_DIR", QFile::encodeName(runtimeDir->path()));
+    }
+
+    QGuiApplication app(argc, argv);
+    KioskWindow window;
+    KioskCompositor compositor(&window);
+    // Shown first: the output takes the window's size
+    if (nested) {
+        window.resize(1280, 800);
+        window.show();
+    } else {
+        window.showFullScreen();
+    }
+    const QByteArray socketName = "nixly-kiosk-" + QByteArray::number(getpid());
+    compositor.start(socketName);
+    if (!compositor.isCreated()) {
+        qCritical("Kiosk: could not create the Wayland display %s", socketName.constData());
+        return 1;
+    }
+    qInfo("Kiosk: compositor on %s, socket %s, up %lld ms after start", qPrintable(platform), socketName.constData(),
+          PageRegistry::msSinceProcessStart());
+
+    QProcess installer;
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert("WAYLAND_DISPLAY", QString::fromLatin1(socketName));
+    env.insert("XDG_RUNTIME_DIR", qEnvironmentVariable("XDG_RUNTIME_DIR"));
+    env.remove("DISPLAY");
+    // Inherited by what the installer launches, so a browser comes up here
+    // rather than looking for X11
+    env.insert("GDK_BACKEND", "wayland");
+    env.insert("MOZ_ENABLE_WAYLAND", "1");
+    // Shared memory is all we draw: Mesa's EGL renders into wl_shm in
+    // software, which takes Firefox along; GTK, WebKitGTK and Qt Quick have
+    // switches of their own
+    env.insert("LIBGL_ALWAYS_SOFTWARE", "1");
+    env.insert("GSK_RENDERER", "cairo");
+    env.insert("WEBKIT_DISABLE_DMABUF_RENDERER", "1");
+    env.insert("QT_QUICK_BACKEND", "software");
+    installer.setProcessEnvironment(env);
+    installer.setProcessChannelMode(QProcess::ForwardedChannels);
+    QObject::connect(&installer, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), &app,
+                     [](int exitCode, QProcess::ExitStatus status) {
+        QCoreApplication::exit(status == QProcess::NormalExit ? exitCode : 1);
+    });
+    QObject::connect(&installer, &QProcess::errorOccurred, &app, [&installer](QProcess::ProcessError error) {
+        if (error != QProcess::FailedToStart) return;
+        qCritical("Kiosk: could not start the installer: %s", qPrintable(installer.errorString()));
+        QCoreApplication::exit(1);
+    });
+    installer.start(QCoreApplication::applicationFilePath(), installerArguments(args));
+    if (installer.state() == QProcess::NotRunning) {
+        qCritical("Kiosk: could not start the installer: %s", qPrintable(installer.errorString()));
+        return 1;
+    }
+    compositor.setInstallerPid(installer.processId());
+    return app.exec();
+}
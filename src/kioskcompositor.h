@@ -0,0 +1,19 @@
+#pragma once
+
+// Runs the installer without a desktop session. nixlyinstall becomes a small
+// Wayland compositor straight on DRM/KMS (Qt's eglfs platform) and starts
+// itself again as that compositor's only fullscreen client. Other clients
+// the installer launches, such as the browser for GitHub's device page, are
+// shown fullscreen above it; closing them returns to the installer, and
+// Alt+Tab cycles through them.
+//
+//   nixlyinstall --kiosk [--kiosk-platform=eglfs|wayland|xcb|offscreen] [installer options]
+//
+// Under a running Wayland or X11 session it opens a window there instead,
+// and with --kiosk-platform=offscreen it runs headless. Clients are drawn
+// in software from shared-memory buffers. The compositor has no GPU buffer
+// path, so it offers no hardware integration, and the installer and what it
+// launches get an environment that makes Mesa, GTK and browsers render in
+// software into wl_shm.
+// Returns the installer's exit code.
+int runKiosk(int &argc, char **argv);
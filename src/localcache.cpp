@@ -0,0 +1,147 @@
+#include "localcache.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QRegularExpression>
+
+QStringList LocalBinaryCache::candidateDirs(const QString &override)
+{
+    if (!override.isEmpty()) return { override };
+    QStringList dirs;
+    // The NixOS ISO mounts its boot medium at /iso
+    dirs << "/iso/nix-cache" << "/iso/nix-store";
+    // Removable media: /media/<label> and /run/media/<user>/<label>
+    QStringList mounts;
+    for (const QFileInfo &fi : QDir("/media").entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot))
+        mounts << fi.absoluteFilePath();
+    for (const QFileInfo &user : QDir("/run/media").entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        for (const QFileInfo &fi : QDir(user.absoluteFilePath()).entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot))
+            mounts << fi.absoluteFilePath();
+    }
+    for (const QString &m : std::as_const(mounts)) dirs << m + "/nix-cache" << m + "/nix-store";
+    return dirs;
+}
+
+bool LocalBinaryCache::looksLikeCache(const QString &dir)
+{
+    return QFileInfo::exists(dir + "/nix-cache-info")
+        || (QFileInfo::exists(dir + "/nix/store") && QFileInfo::exists(dir + "/nix/var/nix/db/db.sqlite"));
+}
+
+bool LocalBinaryCache::detectAndLoad(const QString &override)
+{
+    for (const QString &d : candidateDirs(override)) {
+        // What we shipped, or what the user named; never a stick that happens to be plugged in
+        const bool trusted = !override.isEmpty() || d.startsWith("/iso/");
+        if (looksLikeCache(d) && load(d, trusted)) return true;
+    }
+    return false;
+}
+
+bool LocalBinaryCache::load(const QString &dir, bool trusted)
+{
+    index_.clear();
+    dir_.clear();
+    trusted_ = trusted;
+    storeLayout_ = !QFileInfo::exists(dir + "/nix-cache-info");
+    const bool ok = storeLayout_ ? loadStoreDir(dir) : loadFileCache(dir);
+    if (ok) dir_ = QDir(dir).absolutePath();
+    return ok;
+}
+
+bool LocalBinaryCache::loadFileCache(const QString &dir)
+{
+    QDirIterator it(dir, { "*.narinfo" }, QDir::Files);
+    while (it.hasNext()) {
+        QFile f(it.next());
+        if (!f.open(QIODevice::ReadOnly)) continue;
+        Entry e;
+        QString storePath;
+        while (!f.atEnd()) {
+            const QByteArray line = f.readLine().trimmed();
+            if (line.startsWith("StorePath: ")) storePath = QString::fromUtf8(line.mid(11));
+            else if (line.startsWith("FileSize: ")) e.fileSize = line.mid(10).toLongLong();
+            else if (line.startsWith("NarSize: ")) e.narSize = line.mid(9).toLongLong();
+        }
+        if (storePath.isEmpty()) continue;
+        if (e.fileSize == 0) e.fileSize = e.narSize;
+        index_.insert(hashPart(storePath), e);
+    }
+    return true;
+}
+
+bool LocalBinaryCache::loadStoreDir(const QString &dir)
+{
+    QProcess p;
+    p.start("nix", { "path-info", "--all", "--json", "--store", "local?root=" + dir + "&read-only=true" });
+    if (!p.waitForFinished(120000) || p.exitCode() != 0) return false;
+    const QJsonDocument doc = QJsonDocument::fromJson(p.readAllStandardOutput());
+    auto add = [this](const QString &path, const QJsonObject &o) {
+        Entry e;
+        e.narSize = o.value("narSize").toVariant().toLongLong();
+        e.fileSize = e.narSize;
+        index_.insert(hashPart(path), e);
+    };
+    // Older Nix prints an array of objects with "path", newer an object keyed by path
+    if (doc.isArray()) {
+        for (const QJsonValue &v : doc.array()) add(v.toObject().value("path").toString(), v.toObject());
+    } else {
+        const QJsonObject obj = doc.object();
+        for (auto it = obj.constBegin(); it != obj.constEnd(); ++it) add(it.key(), it.value().toObject());
+    }
+    return true;
+}
+
+QString LocalBinaryCache::substituterUrl() const
+{
+    if (dir_.isEmpty()) return QString();
+    // Lower priority numbers win; cache.nixos.org is 40
+    const QString trust = trusted_ ? "&trusted=1" : "";
+    if (storeLayout_) return QString("local?root=%1&read-only=true&priority=10%2").arg(dir_, trust);
+    return QString("file://%1?priority=10%2").arg(dir_, trust);
+}
+
+QString LocalBinaryCache::hashPart(const QString &storePath)
+{
+    return QFileInfo(storePath).fileName().left(32);
+}
+
+void LocalBinaryCache::recordLine(const QString &line)
+{
+    static const QRegularExpression re("copying path '([^']+)' from '([^']+)'");
+    const QRegularExpressionMatch m = re.match(line);
+    if (m.hasMatch()) recordCopy(m.captured(1), m.captured(2));
+}
+
+void LocalBinaryCache::recordCopy(const QString &storePath, const QString &fromUrl)
+{
+    const bool local = !dir_.isEmpty() && fromUrl.contains(dir_);
+    if (!local) {
+        // Copies from the live system's own store are neither hits nor downloads
+        if (fromUrl.startsWith("http")) ++remoteFetches_;
+        return;
+    }
+    ++localHits_;
+    bytesSaved_ += index_.value(hashPart(storePath)).fileSize;
+}
+
+double LocalBinaryCache::hitRate() const
+{
+    const int total = localHits_ + remoteFetches_;
+    return total > 0 ? double(localHits_) / total : 0.0;
+}
+
+QString LocalBinaryCache::summary() const
+{
+    if (dir_.isEmpty()) return QString("No binary cache on the boot medium");
+    return QString("Local cache: %1/%2 paths (%3%), %4 MiB not downloaded")
+        .arg(localHits_).arg(localHits_ + remoteFetches_)
+        .arg(hitRate() * 100.0, 0, 'f', 1)
+        .arg(bytesSaved_ / (1024.0 * 1024.0), 0, 'f', 1);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+// A binary cache shipped on the boot medium, used as the highest-priority
+// substituter so only paths missing from it come from the network.
+//
+// Only the boot medium (/iso) and a cache named with --local-cache are
+// trusted to carry unsigned paths. One found on other removable media is
+// used like any substituter: Nix accepts its paths only when they are signed
+// by a key in trusted-public-keys.
+//
+// Two layouts are recognised:
+//   <dir>/nix-cache-info + *.narinfo + nar/   (nix copy --to file://<dir>)
+//   <dir>/nix/store + <dir>/nix/var/nix/db     (a plain Nix store)
+// For an offline check, generate one with
+//   nix copy --to file:///tmp/cache $(nix-store -qR /run/current-system)
+// and start the installer with --local-cache=/tmp/cache.
+class LocalBinaryCache
+{
+public:
+    struct Entry {
+        qint64 fileSize = 0;            // bytes a download would have cost
+        qint64 narSize = 0;
+    };
+
+    // Default search locations, or just `override` when it is set.
+    static QStringList candidateDirs(const QString &override = QString());
+    static bool looksLikeCache(const QString &dir);
+
+    // Finds the first cache and indexes it. Blocking; run on a worker thread.
+    bool detectAndLoad(const QString &override = QString());
+    bool load(const QString &dir, bool trusted = false);
+
+    bool isValid() const { return !dir_.isEmpty(); }
+    QString dir() const { return dir_; }
+    bool isTrusted() const { return trusted_; }
+    // Substituter URL; signatures are required unless the cache is trusted.
+    QString substituterUrl() const;
+    int pathCount() const { return index_.size(); }
+
+    // Feeds "copying path '/nix/store/...' from '<url>'" lines from Nix.
+    void recordLine(const QString &line);
+    void recordCopy(const QString &storePath, const QString &fromUrl);
+
+    int localHits() const { return localHits_; }
+    int remoteFetches() const { return remoteFetches_; }
+    qint64 bytesSaved() const { return bytesSaved_; }
+    double hitRate() const;
+    QString summary() const;
+
+private:
+    static QString hashPart(const QString &storePath);
+    bool loadFileCache(const QString &dir);
+    bool loadStoreDir(const QString &dir);
+
+    QString dir_;
+    bool storeLayout_ = false;
+    bool trusted_ = false;
+    QHash<QString, Entry> index_;       // store path hash part -> sizes
+    int localHits_ = 0;
+    int remoteFetches_ = 0;
+    qint64 bytesSaved_ = 0;
+};
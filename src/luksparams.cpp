@@ -0,0 +1,186 @@
+#include "luksparams.h"
+
+#include <QFile>
+#include <QMutex>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QSysInfo>
+#include <QThread>
+
+namespace {
+
+QString runBenchmark(const QStringList &args, QStringList *log)
+{
+    QProcess p;
+    p.setProcessChannelMode(QProcess::MergedChannels);
+    p.start("cryptsetup", QStringList() << "benchmark" << args);
+    if (!p.waitForFinished(60000) || p.exitStatus() != QProcess::NormalExit || p.exitCode() != 0) {
+        if (log) *log << QString("cryptsetup benchmark %1 failed: %2").arg(args.join(' '), p.errorString());
+        return QString();
+    }
+    const QString out = QString::fromUtf8(p.readAllStandardOutput());
+    if (log) *log << out.trimmed();
+    return out;
+}
+
+} // namespace
+
+QString LuksParams::summary() const
+{
+    const QString name = isAdiantum() ? QString("Adiantum") : QString("AES-XTS %1-bit").arg(keySizeBits);
+    QString s = name;
+    if (decryptMiBps > 0.0) s += QString(", ~%1 MiB/s decrypt").arg(decryptMiBps, 0, 'f', 0);
+    s += QString(", Argon2id %1 MiB x%2").arg(pbkdfMemoryKiB / 1024).arg(pbkdfParallel);
+    if (pbkdfIterations > 0) s += QString(", %1 iterations").arg(pbkdfIterations);
+    s += QString(" (~%1 s unlock)").arg(targetUnlockMs / 1000.0, 0, 'f', 1);
+    return s;
+}
+
+QStringList LuksParams::formatArgs() const
+{
+    QStringList args;
+    args << "--cipher" << cipher
+         << "--key-size" << QString::number(keySizeBits)
+         << "--pbkdf" << "argon2id"
+         << "--pbkdf-memory" << QString::number(pbkdfMemoryKiB)
+         << "--pbkdf-parallel" << QString::number(pbkdfParallel);
+    if (pbkdfIterations > 0) args << "--pbkdf-force-iterations" << QString::number(pbkdfIterations);
+    else args << "--iter-time" << QString::number(targetUnlockMs);
+    return args;
+}
+
+QStringList LuksParams::configLines() const
+{
+    QStringList lines;
+    lines << QString("# LUKS2: %1").arg(summary());
+    if (isAdiantum()) {
+        lines << "boot.initrd.availableKernelModules = [ \"adiantum\" \"chacha_generic\" \"nhpoly1305\" ];";
+    } else if (aesNi && QSysInfo::currentCpuArchitecture().startsWith("x86")) {
+        lines << "boot.initrd.availableKernelModules = [ \"aesni_intel\" \"cryptd\" ];";
+    }
+    return lines;
+}
+
+QJsonObject LuksParams::toJson() const
+{
+    return QJsonObject {
+        { "cipher", cipher }, { "keySizeBits", keySizeBits }, { "aesNi", aesNi },
+        { "pbkdfMemoryKiB", pbkdfMemoryKiB }, { "pbkdfParallel", pbkdfParallel },
+        { "pbkdfIterations", pbkdfIterations }, { "targetUnlockMs", targetUnlockMs },
+        { "encryptMiBps", encryptMiBps }, { "decryptMiBps", decryptMiBps },
+        { "calibrated", calibrated } };
+}
+
+LuksParams LuksParams::fromJson(const QJsonObject &o)
+{
+    LuksParams p;
+    p.cipher = o.value("cipher").toString(p.cipher);
+    p.keySizeBits = o.value("keySizeBits").toInt(p.keySizeBits);
+    p.aesNi = o.value("aesNi").toBool();
+    p.pbkdfMemoryKiB = o.value("pbkdfMemoryKiB").toInt(p.pbkdfMemoryKiB);
+    p.pbkdfParallel = o.value("pbkdfParallel").toInt(p.pbkdfParallel);
+    p.pbkdfIterations = o.value("pbkdfIterations").toInt();
+    p.targetUnlockMs = o.value("targetUnlockMs").toInt(p.targetUnlockMs);
+    p.encryptMiBps = o.value("encryptMiBps").toDouble();
+    p.decryptMiBps = o.value("decryptMiBps").toDouble();
+    p.calibrated = o.value("calibrated").toBool();
+    return p;
+}
+
+bool LuksCalibrator::cpuHasAes()
+{
+    QFile f("/proc/cpuinfo");
+    if (!f.open(QIODevice::ReadOnly)) return false;
+    // x86 lists it under "flags", arm64 under "Features"
+    static const QRegularExpression re("^(flags|Features)\\s*:.*\\baes\\b", QRegularExpression::MultilineOption);
+    return re.match(QString::fromLatin1(f.readAll())).hasMatch();
+}
+
+qint64 LuksCalibrator::memAvailableKiB()
+{
+    QFile f("/proc/meminfo");
+    if (!f.open(QIODevice::ReadOnly)) return 0;
+    static const QRegularExpression re("^MemAvailable:\\s+(\\d+) kB", QRegularExpression::MultilineOption);
+    const QRegularExpressionMatch m = re.match(QString::fromLatin1(f.readAll()));
+    return m.hasMatch() ? m.captured(1).toLongLong() : 0;
+}
+
+bool LuksCalibrator::parseCipherBenchmark(const QString &output, double *encMiBps, double *decMiBps)
+{
+    static const QRegularExpression re("^\\s*\\S+\\s+\\d+b\\s+([\\d.]+)\\s+MiB/s\\s+([\\d.]+)\\s+MiB/s",
+                                       QRegularExpression::MultilineOption);
+    const QRegularExpressionMatch m = re.match(output);
+    if (!m.hasMatch()) return false;
+    *encMiBps = m.captured(1).toDouble();
+    *decMiBps = m.captured(2).toDouble();
+    return true;
+}
+
+bool LuksCalibrator::parseArgon2Benchmark(const QString &output, int *iterations, int *memoryKiB, int *threads)
+{
+    static const QRegularExpression re("argon2id\\s+(\\d+) iterations?, (\\d+) memory, (\\d+) parallel");
+    const QRegularExpressionMatch m = re.match(output);
+    if (!m.hasMatch()) return false;
+    *iterations = m.captured(1).toInt();
+    *memoryKiB = m.captured(2).toInt();
+    *threads = m.captured(3).toInt();
+    return true;
+}
+
+LuksParams LuksCalibrator::calibrate(int targetUnlockMs, QStringList *log)
+{
+    // The Install page calibrates as soon as it is shown and the engine's
+    // luks-calibrate step may ask again while that runs: one benchmark at a
+    // time, and a finished one answers every later call for the same target
+    static QMutex mutex;
+    static LuksParams measured;
+    QMutexLocker lock(&mutex);
+    if (measured.calibrated && measured.targetUnlockMs == targetUnlockMs) {
+        if (log) *log << "Reusing the benchmark taken earlier in this session";
+        return measured;
+    }
+
+    LuksParams p;
+    p.targetUnlockMs = targetUnlockMs;
+    p.aesNi = cpuHasAes();
+
+    double aesEnc = 0.0, aesDec = 0.0, adiEnc = 0.0, adiDec = 0.0;
+    parseCipherBenchmark(runBenchmark({ "--cipher", "aes-xts-plain64", "--key-size", "512" }, log), &aesEnc, &aesDec);
+    // Without AES instructions Adiantum is usually several times faster; measure to be sure
+    if (!p.aesNi || aesDec <= 0.0) {
+        parseCipherBenchmark(runBenchmark({ "--cipher", "xchacha12,aes-adiantum-plain64", "--key-size", "256" }, log), &adiEnc, &adiDec);
+    }
+    if (adiDec > aesDec) {
+        p.cipher = "xchacha12,aes-adiantum-plain64";
+        p.keySizeBits = 256;
+        p.encryptMiBps = adiEnc;
+        p.decryptMiBps = adiDec;
+    } else {
+        p.encryptMiBps = aesEnc;
+        p.decryptMiBps = aesDec;
+    }
+
+    // A quarter of what is free now, kept to 64 MiB..2 GiB (cryptsetup itself
+    // allows 32 MiB..4 GiB); the initrd has more free memory than the live
+    // session at unlock time.
+    const qint64 avail = memAvailableKiB();
+    qint64 mem = avail > 0 ? avail / 4 : 1048576;
+    mem = qBound<qint64>(64 * 1024, mem, 2 * 1048576);
+    p.pbkdfMemoryKiB = int(mem / 1024 * 1024);
+    p.pbkdfParallel = qBound(1, QThread::idealThreadCount(), 4);
+
+    int iterations = 0, memoryKiB = 0, threads = 0;
+    const QString kdf = runBenchmark({ "--pbkdf", "argon2id",
+                                       "--iter-time", QString::number(targetUnlockMs),
+                                       "--pbkdf-memory", QString::number(p.pbkdfMemoryKiB),
+                                       "--pbkdf-parallel", QString::number(p.pbkdfParallel) }, log);
+    if (parseArgon2Benchmark(kdf, &iterations, &memoryKiB, &threads)) {
+        // cryptsetup lowers memory itself when the target time cannot be met
+        p.pbkdfIterations = qMax(4, iterations);
+        p.pbkdfMemoryKiB = memoryKiB;
+        p.pbkdfParallel = threads;
+    }
+    p.calibrated = p.decryptMiBps > 0.0 || p.pbkdfIterations > 0;
+    if (p.calibrated) measured = p;
+    return p;
+}
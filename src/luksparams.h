@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QString>
+#include <QStringList>
+
+// LUKS2 cipher and Argon2id parameters chosen for the machine being installed.
+struct LuksParams
+{
+    QString cipher = "aes-xts-plain64";
+    int keySizeBits = 512;
+    bool aesNi = false;
+    int pbkdfMemoryKiB = 1048576;
+    int pbkdfParallel = 4;
+    int pbkdfIterations = 0;            // 0 = let cryptsetup calibrate --iter-time
+    int targetUnlockMs = 2000;
+    double encryptMiBps = 0.0;
+    double decryptMiBps = 0.0;
+    bool calibrated = false;
+
+    bool isAdiantum() const { return cipher.contains("adiantum"); }
+    QString summary() const;
+    // Extra arguments for `cryptsetup luksFormat`
+    QStringList formatArgs() const;
+    // NixOS options the initrd needs to unlock with this cipher
+    QStringList configLines() const;
+
+    // For the install journal: a resumed install reuses the parameters the
+    // volume was formatted with.
+    QJsonObject toJson() const;
+    static LuksParams fromJson(const QJsonObject &o);
+};
+
+// Measures on this machine with `cryptsetup benchmark`. Blocking: run it on a
+// worker thread. Calls are serialised, and the first successful measurement
+// is reused for the rest of the session.
+class LuksCalibrator
+{
+public:
+    static bool cpuHasAes();
+    static qint64 memAvailableKiB();
+    static LuksParams calibrate(int targetUnlockMs = 2000, QStringList *log = nullptr);
+
+    // "aes-xts 512b 2550.2 MiB/s 2561.6 MiB/s"
+    static bool parseCipherBenchmark(const QString &output, double *encMiBps, double *decMiBps);
+    // "argon2id 6 iterations, 1048576 memory, 4 parallel threads (CPUs) for 256-bit key ..."
+    static bool parseArgon2Benchmark(const QString &output, int *iterations, int *memoryKiB, int *threads);
+};
@@ -13,6 +13,7 @@
 #include <QButtonGroup>
 #include <QAbstractButton>
 #include <QPixmap>
+#include <QImageReader>
 #include <QLineEdit>
 #include <QProcess>
 #include <QTimer>
@@ -32,9 +33,59 @@
 #include <QToolTip>
 #include <QScrollArea>
 #include <QRadioButton>
+#include <QCheckBox>
+#include <QComboBox>
+#include <QGridLayout>
+#include <QListWidget>
+#include <QMessageBox>
+#include <QPlainTextEdit>
+#include <QProgressBar>
+#include <QThreadPool>
+#include <QFontMetrics>
+#include <cmath>
 #include <functional>
 #include <memory>
 
+#include "backend.h"
+#include "diskwipe.h"
+#include "installbench.h"
+#include "installengine.h"
+#include "keymapcache.h"
+#include "kioskcompositor.h"
+#include "nixprogress.h"
+#include "pageregistry.h"
+#include "passwordhash.h"
+#include "regionindex.h"
+#include "storeverify.h"
+#include "systemprefetch.h"
+#include "substituterproxy.h"
+#include "theme.h"
+#include "tracer.h"
+#include "wizardbench.h"
+
+// Value of a "--name=value" command line option, empty when absent
+static QString argumentValue(const QString &name)
+{
+    const QString prefix = name + "=";
+    for (const QString &arg : QCoreApplication::arguments()) {
+        if (arg.startsWith(prefix)) return arg.mid(prefix.size());
+    }
+    return QString();
+}
+
+// HTTP endpoints of the connectivity check, tried in order. The offscreen
+// benchmark points it at its local stand-in.
+static QList<QUrl> connectivityUrls()
+{
+    const QString standIn = qEnvironmentVariable("NIXLYINSTALL_CONNECTIVITY_URL");
+    if (!standIn.isEmpty()) return { QUrl(standIn) };
+    return {
+        QUrl("http://connectivitycheck.gstatic.com/generate_204"),
+        QUrl("http://clients3.google.com/generate_204"),
+        QUrl("http://example.com/")
+    };
+}
+
 class MainWindow : public QMainWindow
 {
 private:
@@ -47,6 +98,183 @@ private:
     QString currentDrivePath;
     QLabel *driveSelectedHint = nullptr;
     QPushButton *installButton = nullptr;
+    InstallEngine *installEngine = nullptr;
+    LuksParams luksParams;
+    SubstituterProxy *substituterProxy = nullptr;
+    SystemPrefetcher *prefetcher = nullptr;
+    bool luksCalibrationStarted = false;
+    bool repoCloneStarted = false;
+    std::unique_ptr<PageRegistry> pages;
+    bool firstFrameSeen = false;
+    std::shared_ptr<const RegionIndex> regionIndex;
+    bool regionIndexStarted = false;
+    std::function<void()> onRegionIndexReady;
+    QString chosenTimeZone;             // picked on the Settings page
+    QString chosenLocale;
+    std::unique_ptr<KeymapCache> keymapCache;
+    QString chosenKeyLayout;            // empty unless picked on the Settings page
+    QString chosenKeyVariant;
+    // Password hashing has a worker of its own: the first job measures the
+    // hash cost on this CPU, later jobs reuse it, and a job whose password
+    // has been edited since it was queued is dropped
+    QThreadPool credentialPool;
+    std::shared_ptr<PasswordHashParams> workerHashParams = std::make_shared<PasswordHashParams>();
+    std::shared_ptr<std::atomic<quint64>> passwordGeneration = std::make_shared<std::atomic<quint64>>(0);
+    PasswordHashParams passwordParams;  // GUI thread copy, once calibrated
+    QString userName;                   // set once its password is hashed
+    QByteArray userPasswordHash;
+    bool accountPending = false;        // entered on Settings but not hashed (or not valid) yet
+
+    QStringList extraSubstituters() const
+    {
+        QStringList urls;
+        if (substituterProxy) urls << substituterProxy->substituterUrl();
+        // e.g. a provisioning box running --serve-cache
+        const QString extra = argumentValue("--extra-substituter");
+        if (!extra.isEmpty()) urls << extra;
+        return urls;
+    }
+
+    // The cloned configuration is known: fetch its closure while the user is
+    // still on the drive and settings pages.
+    void startPrefetch(const QString &repoUrl, const QString &branch)
+    {
+        if (!prefetcher || QCoreApplication::arguments().contains("--no-prefetch")) return;
+        const QString flakeDir = QDir::homePath() + "/.nixlyos";
+        if (!QFileInfo::exists(flakeDir + "/flake.nix")) return;
+        const QString host = InstallPlan().flakeHost;
+        const QStringList substituters = extraSubstituters();
+        // The key asks git for the checked-out revision
+        Backend::run(prefetcher, "prefetch key", [repoUrl, branch, flakeDir, host]() {
+            return SystemPrefetcher::keyFor(repoUrl, branch, flakeDir, host);
+        }, [this, flakeDir, host, substituters](const QString &key) {
+            prefetcher->start(key, flakeDir, host, substituters);
+        });
+    }
+
+    // Clones the system configuration into ~/.nixlyos; an existing checkout is
+    // kept. Called from the GitHub page and on the way to Select Drive.
+    void cloneConfiguration(const QString &repoUrl, const QString &branch)
+    {
+        const QString targetPath = QDir::homePath() + "/.nixlyos";
+        // No UI messages here; keep Step 3 text stable
+
+        QProcess *cl = new QProcess(this);
+        NIXLY_TRACE_PROCESS(cl, "clone");
+        QObject::connect(cl, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
+                         [=, this](int exitCode, QProcess::ExitStatus) mutable {
+            const QByteArray out = cl->readAllStandardOutput();
+            const QByteArray err = cl->readAllStandardError();
+            cl->deleteLater();
+            // No UI messages here either; a real failure goes to the log
+            Backend::run(this, "classify clone", [exitCode, out, err]() {
+                return Backend::classifyClone(exitCode, QString::fromUtf8(out), QString::fromUtf8(err));
+            }, [this, repoUrl, branch](const Backend::CloneResult &result) {
+                if (!result.ok && !result.kept) {
+                    qWarning("Cloning %s failed: %s", qPrintable(repoUrl), qPrintable(result.message));
+                    return;
+                }
+                // An existing checkout is reused as well
+                startPrefetch(repoUrl, branch);
+            });
+        });
+
+        QStringList args;
+        args << "clone";
+        if (!branch.isEmpty()) args << "--branch" << branch << "--single-branch";
+        args << repoUrl << (QDir::homePath() + "/.nixlyos");
+        repoCloneStarted = true;
+        cl->start("git", args);
+    }
+
+    // Zones and locales, read once on a worker the first time a page needs them
+    void loadRegionIndex()
+    {
+        if (regionIndexStarted) return;
+        regionIndexStarted = true;
+        QPointer<MainWindow> self(this);
+        QThreadPool::globalInstance()->start([self]() {
+            NIXLY_TRACE_SCOPE("worker", "region index");
+            std::shared_ptr<const RegionIndex> index = RegionIndex::build();
+            QMetaObject::invokeMethod(qApp, [self, index]() {
+                if (!self) return;
+                self->regionIndex = index;
+                if (self->onRegionIndexReady) self->onRegionIndexReady();
+            }, Qt::QueuedConnection);
+        });
+    }
+
+    // Picks the embedded 1x/2x/3x logo for the label's device pixel ratio and
+    // decodes it on a worker; a fractional ratio is scaled from the next
+    // larger copy there too
+    void loadLogo(QLabel *label)
+    {
+        const qreal dpr = label->devicePixelRatioF();
+        const int variant = qBound(1, int(std::ceil(dpr - 0.01)), 3);
+        const QString path = variant == 1 ? QString(":/images/logo_320.png")
+                                          : QString(":/images/logo_320@%1x.png").arg(variant);
+        QPointer<QLabel> target(label);
+        QThreadPool::globalInstance()->start([target, path, dpr, variant]() {
+            NIXLY_TRACE_SCOPE("worker", "decode logo");
+            QElapsedTimer timer;
+            timer.start();
+            QImageReader reader(path);
+            const int px = qRound(320 * dpr);
+            if (px != 320 * variant) reader.setScaledSize(QSize(px, px));
+            QImage image = reader.read();
+            image.setDevicePixelRatio(dpr);
+            const qint64 us = timer.nsecsElapsed() / 1000;
+            const QString error = image.isNull() ? reader.errorString() : QString();
+            QMetaObject::invokeMethod(qApp, [target, image, path, us, error]() {
+                if (!target) return;
+                if (image.isNull()) {
+                    qWarning("Logo %s: %s", qPrintable(path), qPrintable(error));
+                    target->setText("NixlyOS");
+                    Theme::setRole(target, "logo");
+                    return;
+                }
+                target->setPixmap(QPixmap::fromImage(image));
+                qInfo("Logo %s decoded in %.1f ms, shown %lld ms after start", qPrintable(path), us / 1000.0,
+                      PageRegistry::msSinceProcessStart());
+            }, Qt::QueuedConnection);
+        });
+    }
+
+    void calibratePasswordHash()
+    {
+        QPointer<MainWindow> self(this);
+        auto params = workerHashParams;
+        credentialPool.start([self, params]() {
+            NIXLY_TRACE_SCOPE("worker", "calibrate password hash");
+            if (!params->calibrated) *params = PasswordHasher::calibrate();
+            const PasswordHashParams p = *params;
+            QMetaObject::invokeMethod(qApp, [self, p]() { if (self) self->passwordParams = p; }, Qt::QueuedConnection);
+        });
+    }
+
+    // `done` runs on the GUI thread unless the password changed in between
+    void hashPassword(const QByteArray &password, const std::function<void(const QString &error)> &done)
+    {
+        const quint64 generation = ++*passwordGeneration;
+        userPasswordHash.clear();
+        QPointer<MainWindow> self(this);
+        auto params = workerHashParams;
+        auto current = passwordGeneration;
+        credentialPool.start([self, params, current, generation, password, done]() {
+            if (current->load() != generation) return;
+            NIXLY_TRACE_SCOPE("worker", "hash password");
+            if (!params->calibrated) *params = PasswordHasher::calibrate();
+            QString error;
+            const QByteArray hash = PasswordHasher::hash(password, *params, &error);
+            const PasswordHashParams p = *params;
+            QMetaObject::invokeMethod(qApp, [self, current, generation, hash, error, p, done]() {
+                if (!self || current->load() != generation) return;
+                self->passwordParams = p;
+                self->userPasswordHash = hash;
+                done(error);
+            }, Qt::QueuedConnection);
+        });
+    }
 
 public:
     MainWindow(QWidget *parent = nullptr) : QMainWindow(parent)
@@ -99,33 +327,7 @@ public:
             button->setMinimumHeight(40);
             button->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
             
-            button->setStyleSheet(
-                "QPushButton {"
-                "    background-color: #2A2A2A;"
-                "    color: white;"
-                "    border: 1px solid #444444;"
-                "    border-radius: 5px;"
-                "    padding: 8px 16px;"
-                "    font-size: 12px;"
-                "    font-weight: bold;"
-                "}"
-                "QPushButton:hover {"
-                "    background-color: #3A3A3A;"
-                "    border-color: #666666;"
-                "}"
-                "QPushButton:checked {"
-                "    background-color: #0078D4;"
-                "    border-color: #106EBE;"
-                "}"
-                "QPushButton:pressed {"
-                "    background-color: #005A9E;"
-                "}"
-                "QPushButton:disabled {"
-                "    background-color: #1A1A1A;"
-                "    color: #666666;"
-                "    border-color: #333333;"
-                "}"
-            );
+            Theme::setRole(button, "menu");
             
             menuButtons.append(button);
             menuButtonGroup->addButton(button, i);
@@ -141,27 +343,7 @@ public:
         contentPanel->setPalette(contentPalette);
         
         QStackedWidget *contentStack = new QStackedWidget();
-        
-        auto createPage = [](const QString &title, const QString &description) {
-            QWidget *page = new QWidget();
-            QVBoxLayout *layout = new QVBoxLayout(page);
-            layout->setContentsMargins(40, 40, 40, 40);
-            layout->setSpacing(20);
-            
-            QLabel *titleLabel = new QLabel(title);
-            titleLabel->setStyleSheet("color: white; font-size: 28px; font-weight: bold;");
-            titleLabel->setAlignment(Qt::AlignCenter);
-            layout->addWidget(titleLabel);
-            
-            QLabel *descLabel = new QLabel(description);
-            descLabel->setStyleSheet("color: #cccccc; font-size: 16px; line-height: 1.5;");
-            descLabel->setWordWrap(true);
-            descLabel->setAlignment(Qt::AlignCenter);
-            layout->addWidget(descLabel);
-            
-            layout->addStretch();
-            return page;
-        };
+        pages = std::make_unique<PageRegistry>(contentStack);
         
         QWidget *welcomePage = new QWidget();
         QVBoxLayout *welcomeLayout = new QVBoxLayout(welcomePage);
@@ -169,41 +351,20 @@ public:
         welcomeLayout->setSpacing(30);
         
         QLabel *logoLabel = new QLabel();
-        QStringList logoPaths = {
-            "src/images/NixlyOS_logo.png",           // From build directory
-            "../src/images/NixlyOS_logo.png",        // From build subdirectory
-            "images/NixlyOS_logo.png",               // Relative to src
-            "/home/total/nixlyinstall/src/images/NixlyOS_logo.png"  // Absolute path
-        };
-        
-        QPixmap logo;
-        bool logoLoaded = false;
-        for (const QString &path : logoPaths) {
-            logo.load(path);
-            if (!logo.isNull()) {
-                logoLoaded = true;
-                break;
-            }
-        }
-        
-        if (logoLoaded) {
-            QPixmap scaledLogo = logo.scaled(320, 320, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-            logoLabel->setPixmap(scaledLogo);
-        } else {
-            logoLabel->setText("NixlyOS");
-            logoLabel->setStyleSheet("color: #0078D4; font-size: 32px; font-weight: bold;");
-        }
+        // Sized up front: the first frame is painted before the logo arrives
+        logoLabel->setFixedHeight(320);
         logoLabel->setAlignment(Qt::AlignCenter);
+        loadLogo(logoLabel);
         welcomeLayout->addWidget(logoLabel);
         
         QLabel *welcomeTitleLabel = new QLabel("Welcome to NixlyOS");
-        welcomeTitleLabel->setStyleSheet("color: white; font-size: 28px; font-weight: bold;");
+        Theme::setRole(welcomeTitleLabel, "title");
         welcomeTitleLabel->setAlignment(Qt::AlignCenter);
         welcomeLayout->addWidget(welcomeTitleLabel);
         
         QLabel *welcomeDescLabel = new QLabel("Welcome to the NixlyOS installation wizard. This installer will guide you through "
             "setting up your new NixlyOS system with all the necessary configurations. ");
-        welcomeDescLabel->setStyleSheet("color: #cccccc; font-size: 16px; line-height: 1.5;");
+        Theme::setRole(welcomeDescLabel, "lead");
         welcomeDescLabel->setWordWrap(true);
         welcomeDescLabel->setAlignment(Qt::AlignCenter);
         welcomeLayout->addWidget(welcomeDescLabel);
@@ -213,30 +374,14 @@ public:
             "<b>Before we begin, we want to be crystal clear: NixlyOS uses every method available to make your system and computer as secure and stable as possible — including Secure Boot, strict control of open ports, strict control of incoming traffic, isolation of every package, limited access to change/edit files, limited information shared through the browser and full encryption of all partitions. If this is not acceptable, you should not start the installation of NixlyOS.</b>");
         welcomeSecurityNote->setTextFormat(Qt::RichText);
         welcomeSecurityNote->setWordWrap(true);
-        welcomeSecurityNote->setStyleSheet("color: #e6e6e6; font-size: 16px; line-height: 1.5; font-weight: bold;");
+        Theme::setRole(welcomeSecurityNote, "heading");
         welcomeSecurityNote->setAlignment(Qt::AlignCenter);
         welcomeLayout->addWidget(welcomeSecurityNote);
         
         QPushButton *letsStartButton = new QPushButton("Let's start!");
         letsStartButton->setMinimumHeight(50);
         letsStartButton->setMaximumWidth(200);
-        letsStartButton->setStyleSheet(
-            "QPushButton {"
-            "    background-color: #0078D4;"
-            "    color: white;"
-            "    border: none;"
-            "    border-radius: 8px;"
-            "    padding: 12px 24px;"
-            "    font-size: 16px;"
-            "    font-weight: bold;"
-            "}"
-            "QPushButton:hover {"
-            "    background-color: #106EBE;"
-            "}"
-            "QPushButton:pressed {"
-            "    background-color: #005A9E;"
-            "}"
-        );
+        Theme::setRole(letsStartButton, "primary");
         
         QHBoxLayout *buttonLayout = new QHBoxLayout();
         buttonLayout->addStretch();
@@ -245,6 +390,8 @@ public:
         welcomeLayout->addLayout(buttonLayout);
         
         welcomeLayout->addStretch();
+        // The first frame: built right away, as is the small Internet page
+        pages->addBuilt("Welcome", welcomePage);
         
         QWidget *internetPage = new QWidget();
         QVBoxLayout *internetLayout = new QVBoxLayout(internetPage);
@@ -252,12 +399,13 @@ public:
         internetLayout->setSpacing(20);
         
         QLabel *internetTitle = new QLabel("Internet Connection");
-        internetTitle->setStyleSheet("color: white; font-size: 28px; font-weight: bold;");
+        Theme::setRole(internetTitle, "title");
         internetTitle->setAlignment(Qt::AlignCenter);
         internetLayout->addWidget(internetTitle);
         
         QLabel *connectionStatus = new QLabel("No internet access");
-        connectionStatus->setStyleSheet("color: #FF6B6B; font-size: 16px;");
+        Theme::setRole(connectionStatus, "banner");
+        Theme::setTone(connectionStatus, Theme::Tone::Error);
         connectionStatus->setAlignment(Qt::AlignCenter);
         internetLayout->addWidget(connectionStatus);
         
@@ -268,19 +416,7 @@ public:
         QPushButton *continueButton = new QPushButton("Perfect! Let's continue!");
         continueButton->setMinimumHeight(40);
         continueButton->setMaximumWidth(260);
-        continueButton->setStyleSheet(
-            "QPushButton {"
-            "    background-color: #0078D4;"
-            "    color: white;"
-            "    border: none;"
-            "    border-radius: 8px;"
-            "    padding: 12px 24px;"
-            "    font-size: 16px;"
-            "    font-weight: bold;"
-            "}"
-            "QPushButton:hover { background-color: #106EBE; }"
-            "QPushButton:pressed { background-color: #005A9E; }"
-        );
+        Theme::setRole(continueButton, "primary");
         continueButton->hide();
         
         QHBoxLayout *continueLayout = new QHBoxLayout();
@@ -290,9 +426,26 @@ public:
         internetLayout->addLayout(continueLayout);
         
         internetLayout->addStretch();
+        pages->addBuilt("Internet", internetPage);
 
         // network manager instance
         netManager = new QNetworkAccessManager(this);
+
+        // Optional caching proxy in front of cache.nixos.org, kept on disk across retries
+        const QString proxyDir = argumentValue("--substituter-proxy");
+        if (!proxyDir.isEmpty()) {
+            const QString upstream = argumentValue("--substituter-proxy-upstream");
+            substituterProxy = new SubstituterProxy(proxyDir, upstream.isEmpty() ? QUrl("https://cache.nixos.org") : QUrl(upstream), this);
+            QString listenSpec = argumentValue("--substituter-proxy-listen");
+            if (listenSpec.isEmpty()) listenSpec = "127.0.0.1:0";
+            if (!substituterProxy->listen(listenSpec)) {
+                qWarning("Could not start the substituter proxy on %s: %s", qPrintable(listenSpec), qPrintable(substituterProxy->errorString()));
+                delete substituterProxy;
+                substituterProxy = nullptr;
+            }
+        }
+        prefetcher = new SystemPrefetcher(this);
+        credentialPool.setMaxThreadCount(1);
         
         // Function to check actual internet connectivity (HTTP, multiple endpoints, no TLS)
         std::function<void(QLabel*, QPushButton*)> checkInternetConnectivity;
@@ -301,11 +454,7 @@ public:
 
             isCheckingInternet = true;
 
-            const QList<QUrl> urls = {
-                QUrl("http://connectivitycheck.gstatic.com/generate_204"),
-                QUrl("http://clients3.google.com/generate_204"),
-                QUrl("http://example.com/")
-            };
+            const QList<QUrl> urls = connectivityUrls();
 
             // recursive-like sequence using shared lambda
             auto tryIndex = std::make_shared<std::function<void(int)>>();
@@ -314,7 +463,7 @@ public:
                     // Final failure
                     if (contentStack->currentIndex() == 1 && statusLabel && contButton) {
                         statusLabel->setText("No internet access");
-                        statusLabel->setStyleSheet("color: #FF6B6B; font-size: 16px;");
+                        Theme::setTone(statusLabel, Theme::Tone::Error);
                         contButton->hide();
                     }
                     isCheckingInternet = false;
@@ -324,6 +473,7 @@ public:
                 QNetworkRequest request(urls[idx]);
                 request.setRawHeader("User-Agent", "NixlyInstall");
                 QNetworkReply *reply = netManager->get(request);
+                NIXLY_TRACE_REPLY(reply, "internet", "GET " + urls[idx].host());
 
                 QTimer *to = new QTimer(reply);
                 to->setSingleShot(true);
@@ -342,7 +492,7 @@ public:
                     reply->deleteLater();
                     if (ok) {
                         statusLabel->setText("✓ Internet access");
-                        statusLabel->setStyleSheet("color: #00AA00; font-size: 16px; font-weight: bold;");
+                        Theme::setTone(statusLabel, Theme::Tone::Ok);
                         contButton->show();
                         isCheckingInternet = false;
                     } else {
@@ -839,18 +989,14 @@ public:
             contentStack->setCurrentIndex(2);
         });
 
-        // Track repo clone state and provide a reusable clone helper across handlers
-        auto repoCloneStarted = std::make_shared<bool>(false);
-        std::function<void(const QString&, const QString&)> doClone;
-
-        QWidget *githubPage = new QWidget();
-        {
+        pages->add("GitHub", [=, this](PageRegistry::Hooks &hooks) -> QWidget* {
+            QWidget *githubPage = new QWidget();
             QVBoxLayout *ghLayout = new QVBoxLayout(githubPage);
             ghLayout->setContentsMargins(40, 40, 40, 40);
             ghLayout->setSpacing(16);
 
             QLabel *title = new QLabel("GitHub");
-            title->setStyleSheet("color: white; font-size: 28px; font-weight: bold;");
+            Theme::setRole(title, "title");
             title->setAlignment(Qt::AlignCenter);
             ghLayout->addWidget(title);
 
@@ -863,29 +1009,25 @@ public:
             );
             intro->setWordWrap(true);
             intro->setAlignment(Qt::AlignLeft | Qt::AlignTop);
-            intro->setStyleSheet("color: #cccccc; font-size: 15px; line-height: 1.5;");
+            Theme::setRole(intro, "intro");
             ghLayout->addWidget(intro);
             ghLayout->addSpacing(24); // Extra space between intro text and Step 1
 
             // Step 1 card
             QWidget *step1Card = new QWidget();
-            step1Card->setStyleSheet("QWidget { background-color: #232323; border: 1px solid #3A3A3A; border-radius: 8px; }");
+            Theme::setRole(step1Card, "card");
             QVBoxLayout *step1Layout = new QVBoxLayout(step1Card);
             step1Layout->setContentsMargins(16, 16, 16, 16);
             step1Layout->setSpacing(10);
 
             QLabel *step1 = new QLabel("You can skip this step if you already have a GitHub account. If not, create one.");
-            step1->setStyleSheet("color: #cccccc; font-size: 15px; line-height: 1.5;");
+            Theme::setRole(step1, "intro");
             step1->setWordWrap(true);
             step1->setAlignment(Qt::AlignLeft | Qt::AlignTop);
             step1Layout->addWidget(step1);
 
             QHBoxLayout *step1Actions = new QHBoxLayout();
             QPushButton *createAccountBtn = new QPushButton("Create GitHub account");
-            createAccountBtn->setStyleSheet(
-                "QPushButton { background-color: #2A2A2A; color: white; border: 1px solid #444444; border-radius: 8px; padding: 10px 16px; font-weight: bold; }"
-                "QPushButton:hover { background-color: #3A3A3A; }"
-            );
             step1Actions->addStretch();
             step1Actions->addWidget(createAccountBtn);
             step1Actions->addStretch();
@@ -896,7 +1038,7 @@ public:
             QLabel *badge1 = new QLabel("1");
             badge1->setFixedSize(32, 32);
             badge1->setAlignment(Qt::AlignCenter);
-            badge1->setStyleSheet("QLabel { background-color: #0078D4; color: white; border-radius: 16px; font-size: 16px; font-weight: bold; }");
+            Theme::setRole(badge1, "badge");
             step1Row->addWidget(badge1, 0, Qt::AlignTop);
             step1Row->addSpacing(10);
             step1Row->addWidget(step1Card, 1);
@@ -905,25 +1047,24 @@ public:
 
             // Step 2 card
             QWidget *step2Card = new QWidget();
-            step2Card->setStyleSheet("QWidget { background-color: #232323; border: 1px solid #3A3A3A; border-radius: 8px; }");
+            Theme::setRole(step2Card, "card");
             QVBoxLayout *step2Layout = new QVBoxLayout(step2Card);
             step2Layout->setContentsMargins(16, 16, 16, 16);
             step2Layout->setSpacing(10);
 
             QLabel *step2 = new QLabel("We now need to go through a Device Activation so that NixlyInstall gets temporary access to view/create your private repository for storing your entire NixlyOS system. When you click ‘Github activation’, we will display your one-time code, copy it to your clipboard, and automatically open the activation page in your browser.");
-            step2->setStyleSheet("color: #cccccc; font-size: 15px; line-height: 1.5; margin-top: 2px;");
+            Theme::setRole(step2, "intro");
             step2->setWordWrap(true);
             step2->setAlignment(Qt::AlignLeft | Qt::AlignTop);
             step2Layout->addWidget(step2);
 
             // Status spinner (shown during login)
             QLabel *status = new QLabel("Klar til å logge inn med GitHub CLI.");
-            status->setStyleSheet("color: #cccccc; font-size: 14px;");
             status->setAlignment(Qt::AlignLeft | Qt::AlignVCenter);
 
             QLabel *spinnerLbl = new QLabel("");
             // Make it white, 5x larger, and without any ring/border
-            spinnerLbl->setStyleSheet("color: white; font-size: 80px; border: none; background: transparent;");
+            Theme::setRole(spinnerLbl, "spinner");
             spinnerLbl->setFrameStyle(QFrame::NoFrame);
             spinnerLbl->setFocusPolicy(Qt::NoFocus);
             spinnerLbl->setFixedWidth(80);
@@ -933,7 +1074,7 @@ public:
 
             // Show the exact one-time code sentence when captured
             QLabel *oneTimeMsg = new QLabel("");
-            oneTimeMsg->setStyleSheet("color: #cccccc; font-size: 18px; font-weight: bold; letter-spacing: 2px;");
+            Theme::setRole(oneTimeMsg, "oneTime");
             oneTimeMsg->setAlignment(Qt::AlignCenter);
             oneTimeMsg->hide();
             step2Layout->addWidget(oneTimeMsg);
@@ -941,10 +1082,6 @@ public:
             // Dedicated copy button for the one-time code
             QHBoxLayout *oneTimeActions = new QHBoxLayout();
             QPushButton *oneTimeCopyBtn = new QPushButton("Kopier kode");
-            oneTimeCopyBtn->setStyleSheet(
-                "QPushButton { background-color: #2A2A2A; color: white; border: 1px solid #444444; border-radius: 5px; padding: 8px 12px; font-weight: bold; }"
-                "QPushButton:hover { background-color: #3A3A3A; }"
-            );
             oneTimeActions->addStretch();
             oneTimeActions->addWidget(oneTimeCopyBtn);
             oneTimeActions->addStretch();
@@ -953,47 +1090,31 @@ public:
 
             // Device code row
             QLabel *codeLabel = new QLabel("Engangskode (lim inn på github.com/login/device):");
-            codeLabel->setStyleSheet("color: white; font-size: 14px; font-weight: bold;");
+            Theme::setRole(codeLabel, "field");
             ghLayout->addWidget(codeLabel);
 
             QHBoxLayout *codeRow = new QHBoxLayout();
             QLineEdit *deviceCodeEdit = new QLineEdit();
             deviceCodeEdit->setReadOnly(true);
             deviceCodeEdit->setPlaceholderText("Klikk ‘Generer kode (uten CLI)’ eller ‘Logg inn med GitHub CLI’ for å få koden...");
-            deviceCodeEdit->setStyleSheet(
-                "QLineEdit { background-color: #2A2A2A; color: #EEEEEE; border: 1px solid #444444; border-radius: 5px; padding: 8px; font-size: 18px; font-weight: bold; text-transform: uppercase; }"
-            );
+            Theme::setRole(deviceCodeEdit, "code");
             QPushButton *copyCodeBtn = new QPushButton("Kopier kode");
-            copyCodeBtn->setStyleSheet(
-                "QPushButton { background-color: #2A2A2A; color: white; border: 1px solid #444444; border-radius: 5px; padding: 8px 12px; font-weight: bold; }"
-                "QPushButton:hover { background-color: #3A3A3A; }"
-            );
             codeRow->addWidget(deviceCodeEdit, 1);
             codeRow->addWidget(copyCodeBtn);
             ghLayout->addLayout(codeRow);
 
             QHBoxLayout *actions = new QHBoxLayout();
             QPushButton *openDevicePageBtn = new QPushButton("Åpne github.com/login/device");
-            openDevicePageBtn->setStyleSheet(
-                "QPushButton { background-color: #2A2A2A; color: white; border: 1px solid #444444; border-radius: 5px; padding: 10px 16px; font-weight: bold; }"
-                "QPushButton:hover { background-color: #3A3A3A; }"
-            );
             QPushButton *ghLoginBtn = new QPushButton("Github Activation");
-            ghLoginBtn->setStyleSheet(
-                "QPushButton { background-color: #0078D4; color: white; border: none; border-radius: 8px; padding: 12px 24px; font-size: 16px; font-weight: bold; }"
-                "QPushButton:hover { background-color: #106EBE; }"
-                "QPushButton:pressed { background-color: #005A9E; }"
-            );
+            Theme::setRole(ghLoginBtn, "primary");
             // Success indicator to replace the GitHub Login button after approval
             QLabel *activationOkLabel = new QLabel("✅ Device Activation Successfull!");
-            activationOkLabel->setStyleSheet("color: #00AA00; font-size: 16px; font-weight: bold;");
+            Theme::setRole(activationOkLabel, "banner");
+            Theme::setTone(activationOkLabel, Theme::Tone::Ok);
             activationOkLabel->setAlignment(Qt::AlignCenter);
             activationOkLabel->hide();
             QPushButton *ghCancelBtn = new QPushButton("Avbryt");
-            ghCancelBtn->setStyleSheet(
-                "QPushButton { background-color: #2A2A2A; color: white; border: 1px solid #444444; border-radius: 8px; padding: 12px 18px; font-size: 14px; font-weight: bold; }"
-                "QPushButton:hover { background-color: #3A3A3A; }"
-            );
+            Theme::setRole(ghCancelBtn, "large");
             ghCancelBtn->hide();
             actions->addStretch();
             actions->addWidget(openDevicePageBtn);
@@ -1019,21 +1140,16 @@ public:
 
             // Alternative: Device Flow uten CLI
             QLabel *altLabel = new QLabel("Alternativ: Generer kode uten CLI (OAuth Device Flow)");
-            altLabel->setStyleSheet("color: white; font-size: 14px; font-weight: bold; margin-top: 8px;");
+            Theme::setRole(altLabel, "field");
             altLabel->setAlignment(Qt::AlignCenter);
             ghLayout->addWidget(altLabel);
 
             QHBoxLayout *clientRow = new QHBoxLayout();
             QLineEdit *clientIdEdit = new QLineEdit();
             clientIdEdit->setPlaceholderText("GitHub OAuth Client ID (env: GITHUB_OAUTH_CLIENT_ID)");
-            clientIdEdit->setStyleSheet("QLineEdit { background-color: #2A2A2A; color: white; border: 1px solid #444444; border-radius: 5px; padding: 8px; }");
             QString envClient = qEnvironmentVariable("GITHUB_OAUTH_CLIENT_ID");
             if (!envClient.isEmpty()) clientIdEdit->setText(envClient);
             QPushButton *genCodeBtn = new QPushButton("Generer kode (uten CLI)");
-            genCodeBtn->setStyleSheet(
-                "QPushButton { background-color: #2A2A2A; color: white; border: 1px solid #444444; border-radius: 5px; padding: 10px 16px; font-weight: bold; }"
-                "QPushButton:hover { background-color: #3A3A3A; }"
-            );
             clientRow->addStretch();
             clientRow->addWidget(clientIdEdit, 1);
             clientRow->addSpacing(8);
@@ -1051,20 +1167,14 @@ public:
             QVBoxLayout *tokenLayout = new QVBoxLayout(tokenContainer);
             tokenLayout->setContentsMargins(0, 12, 0, 0);
             QLabel *tokenLabel = new QLabel("GitHub tilgangstoken:");
-            tokenLabel->setStyleSheet("color: white; font-size: 14px; font-weight: bold;");
+            Theme::setRole(tokenLabel, "field");
             tokenLayout->addWidget(tokenLabel);
             QHBoxLayout *tokenRow = new QHBoxLayout();
             QLineEdit *tokenEdit = new QLineEdit();
             tokenEdit->setReadOnly(true);
             tokenEdit->setPlaceholderText("Genereres etter at du bekrefter på GitHub...");
-            tokenEdit->setStyleSheet(
-                "QLineEdit { background-color: #1F1F1F; color: #E6E6E6; border: 1px solid #555555; border-radius: 6px; padding: 10px; font-family: Monospace; font-size: 14px; }"
-            );
+            Theme::setRole(tokenEdit, "token");
             QPushButton *copyTokenBtn = new QPushButton("Kopier token");
-            copyTokenBtn->setStyleSheet(
-                "QPushButton { background-color: #2A2A2A; color: white; border: 1px solid #444444; border-radius: 6px; padding: 10px 12px; font-weight: bold; }"
-                "QPushButton:hover { background-color: #3A3A3A; }"
-            );
             tokenRow->addWidget(tokenEdit, 1);
             tokenRow->addSpacing(8);
             tokenRow->addWidget(copyTokenBtn);
@@ -1079,7 +1189,7 @@ public:
             QLabel *badge2 = new QLabel("2");
             badge2->setFixedSize(32, 32);
             badge2->setAlignment(Qt::AlignCenter);
-            badge2->setStyleSheet("QLabel { background-color: #0078D4; color: white; border-radius: 16px; font-size: 16px; font-weight: bold; }");
+            Theme::setRole(badge2, "badge");
             step2Row->addWidget(badge2, 0, Qt::AlignTop);
             step2Row->addSpacing(10);
             step2Row->addWidget(step2Card, 1);
@@ -1088,7 +1198,7 @@ public:
 
             // Step 3 card: Check repo, list branches, and New system
             QWidget *step3Card = new QWidget();
-            step3Card->setStyleSheet("QWidget { background-color: #232323; border: 1px solid #3A3A3A; border-radius: 8px; }");
+            Theme::setRole(step3Card, "card");
             QVBoxLayout *step3Layout = new QVBoxLayout(step3Card);
             step3Layout->setContentsMargins(16, 16, 16, 16);
             step3Layout->setSpacing(10);
@@ -1096,7 +1206,6 @@ public:
             // Remove verbose description above the buttons per new UX
 
             QLabel *repoStatus3 = new QLabel("Waiting for access to Github");
-            repoStatus3->setStyleSheet("color: #cccccc; font-size: 14px;");
             step3Layout->addWidget(repoStatus3);
 
             // Branch list container
@@ -1110,10 +1219,7 @@ public:
             QHBoxLayout *step3Actions = new QHBoxLayout();
 
             QPushButton *continueToDriveBtn = new QPushButton("Continue to Select Drive");
-            continueToDriveBtn->setStyleSheet(
-                "QPushButton { background-color: #0078D4; color: white; border: none; border-radius: 8px; padding: 10px 18px; font-weight: bold; }"
-                "QPushButton:hover { background-color: #106EBE; }"
-            );
+            Theme::setRole(continueToDriveBtn, "primary");
 
             step3Actions->addStretch();
             step3Actions->addWidget(continueToDriveBtn);
@@ -1124,7 +1230,7 @@ public:
             QLabel *badge3 = new QLabel("3");
             badge3->setFixedSize(32, 32);
             badge3->setAlignment(Qt::AlignCenter);
-            badge3->setStyleSheet("QLabel { background-color: #0078D4; color: white; border-radius: 16px; font-size: 16px; font-weight: bold; }");
+            Theme::setRole(badge3, "badge");
             step3Row->addWidget(badge3, 0, Qt::AlignTop);
             step3Row->addSpacing(10);
             step3Row->addWidget(step3Card, 1);
@@ -1142,44 +1248,13 @@ public:
                 }
             };
 
-            // Clone helper will reference this state via repoCloneStarted
-            // Helper: clone into ~/.nixlyos
-            doClone = [=, this](const QString &repoUrl, const QString &branch) {
-                const QString targetPath = QDir::homePath() + "/.nixlyos";
-                // No UI messages here; keep Step 3 text stable
-
-                QProcess *cl = new QProcess(this);
-                QObject::connect(cl, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
-                                 [=, this](int exitCode, QProcess::ExitStatus) mutable {
-                    const QString out = QString::fromUtf8(cl->readAllStandardOutput());
-                    const QString err = QString::fromUtf8(cl->readAllStandardError());
-                    cl->deleteLater();
-                    if (exitCode != 0) {
-                        const QString combined = out + "\n" + err;
-                        const QString lc = combined.toLower();
-                        // Suppress error message if destination exists already
-                        if (lc.contains("destination path") && lc.contains("already exists")) {
-                            return;
-                        }
-                        if (lc.contains("already exists and is not an empty directory") || lc.contains("not an empty directory")) {
-                            return;
-                        }
-                    }
-                });
-
-                QStringList args;
-                args << "clone";
-                if (!branch.isEmpty()) args << "--branch" << branch << "--single-branch";
-                args << repoUrl << (QDir::homePath() + "/.nixlyos");
-                *repoCloneStarted = true;
-                cl->start("git", args);
-            };
 
             // Helper: list branches for <login>/nixlyos
             auto listBranches = [=, this](const QString &login) {
                 clearBranchButtons();
                 // Keep UI minimal: only show final messages as specified
                 QProcess *bp = new QProcess(this);
+                NIXLY_TRACE_PROCESS(bp, "github");
                 QObject::connect(bp, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
                                  [=, this, login](int exitCode, QProcess::ExitStatus) mutable {
                     const QString out = QString::fromUtf8(bp->readAllStandardOutput());
@@ -1188,30 +1263,27 @@ public:
                     if (exitCode != 0) {
                         // Repo missing or inaccessible
                         repoStatus3->setText("No existing system configurations were found. Please proceed to \"Select drive\" to start a new configuration.");
-                        repoStatus3->setStyleSheet("color: #cccccc; font-size: 14px;");
+                        Theme::setTone(repoStatus3, Theme::Tone::Neutral);
                         return;
                     }
                     QStringList lines = out.split('\n', Qt::SkipEmptyParts);
                     if (lines.isEmpty()) {
                         repoStatus3->setText("No existing system configurations were found. Please proceed to \"Select drive\" to start a new configuration.");
-                        repoStatus3->setStyleSheet("color: #cccccc; font-size: 14px;");
+                        Theme::setTone(repoStatus3, Theme::Tone::Neutral);
                         return;
                     }
 
                     repoStatus3->setText("Please select an existing system configuration or simply press \"Select drive\" to start a new configuration.");
-                    repoStatus3->setStyleSheet("color: #cccccc; font-size: 14px;");
+                    Theme::setTone(repoStatus3, Theme::Tone::Neutral);
                     for (const QString &b : lines) {
                         QString branch = b.trimmed();
                         if (branch.isEmpty()) continue;
                         QPushButton *btn = new QPushButton(branch);
-                        btn->setStyleSheet(
-                            "QPushButton { background-color: #2A2A2A; color: white; border: 1px solid #444444; border-radius: 5px; padding: 10px; text-align: left; }"
-                            "QPushButton:hover { background-color: #3A3A3A; }"
-                        );
+                        Theme::setRole(btn, "listItem");
                         branchListLayout->addWidget(btn);
                         QObject::connect(btn, &QPushButton::clicked, this, [=, this, login, branch]() mutable {
                             const QString url = QString("https://github.com/%1/nixlyos.git").arg(login);
-                            doClone(url, branch);
+                            cloneConfiguration(url, branch);
                         });
                     }
                 });
@@ -1225,6 +1297,7 @@ public:
             auto ensureRepoExists = [=, this](const QString &login, std::function<void()> cont) {
                 // Check if repo exists
                 QProcess *vp = new QProcess(this);
+                NIXLY_TRACE_PROCESS(vp, "github");
                 QObject::connect(vp, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
                                  [=, this, login, cont](int exitCode, QProcess::ExitStatus) mutable {
                     vp->deleteLater();
@@ -1234,6 +1307,7 @@ public:
                     }
                     // Create the repo if missing (private, no README to avoid creating a branch)
                     QProcess *cp = new QProcess(this);
+                    NIXLY_TRACE_PROCESS(cp, "github");
                     QObject::connect(cp, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
                                      [=, this, cont](int createExit, QProcess::ExitStatus) mutable {
                         cp->deleteLater();
@@ -1253,6 +1327,7 @@ public:
             auto checkRepo = [=, this]() {
                 // Get the authenticated login
                 QProcess *lp = new QProcess(this);
+                NIXLY_TRACE_PROCESS(lp, "github");
                 QObject::connect(lp, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
                                  [=, this](int exitCode, QProcess::ExitStatus) mutable {
                     const QString out = QString::fromUtf8(lp->readAllStandardOutput()).trimmed();
@@ -1260,7 +1335,7 @@ public:
                     lp->deleteLater();
                     if (exitCode != 0 || out.isEmpty()) {
                         repoStatus3->setText("Waiting for access to Github");
-                        repoStatus3->setStyleSheet("color: #cccccc; font-size: 14px;");
+                        Theme::setTone(repoStatus3, Theme::Tone::Neutral);
                         return;
                     }
                     ensureRepoExists(out, [=]() { listBranches(out); });
@@ -1271,13 +1346,13 @@ public:
 
             // Auto-trigger check when activation succeeded or when visiting GitHub page
             // On activation success (from gh device flow above), activationOkLabel is shown; we can also allow manual retry via New system
-            QTimer::singleShot(600, githubPage, [=]() { checkRepo(); });
+            hooks.shown = [=]() { QTimer::singleShot(600, githubPage, [=]() { checkRepo(); }); };
 
             // Navigation to drive page
             connect(continueToDriveBtn, &QPushButton::clicked, this, [=, this]() {
-                if (!*repoCloneStarted) {
+                if (!repoCloneStarted) {
                     const QString defaultRepo = "https://github.com/aCeTotal/nixlyos_master.git";
-                    doClone(defaultRepo, QString());
+                    cloneConfiguration(defaultRepo, QString());
                 }
                 if (menuButtons.size() > 3) {
                     menuButtons[3]->setEnabled(true);
@@ -1330,12 +1405,12 @@ public:
                 QString clientId = clientIdEdit->text().trimmed();
                 if (clientId.isEmpty()) {
                     status->setText("Oppgi en GitHub OAuth Client ID.");
-                    status->setStyleSheet("color: #FF6B6B; font-size: 14px;");
+                    Theme::setTone(status, Theme::Tone::Error);
                     return;
                 }
                 spinnerLbl->setText("⠋"); spinnerLbl->show(); if (!ghState->spin->isActive()) ghState->spin->start();
                 status->setText("Henter aktiveringskode fra GitHub...");
-                status->setStyleSheet("color: #FFAA00; font-size: 14px;");
+                Theme::setTone(status, Theme::Tone::Working);
 
                 QUrl url("https://github.com/login/device/code");
                 QNetworkRequest req(url);
@@ -1348,6 +1423,7 @@ public:
                 QByteArray body = form.toString(QUrl::FullyEncoded).toUtf8();
 
                 QNetworkReply *rep = netManager->post(req, body);
+                NIXLY_TRACE_REPLY(rep, "github", "POST " + req.url().path());
                 connect(rep, &QNetworkReply::finished, this, [=, this]() mutable {
                     if (ghState->spin->isActive()) ghState->spin->stop();
                     spinnerLbl->hide();
@@ -1356,7 +1432,7 @@ public:
                     QJsonParseError jerr; QJsonDocument jd = QJsonDocument::fromJson(data, &jerr);
                     if (jerr.error != QJsonParseError::NoError || !jd.isObject()) {
                         status->setText("Kunne ikke tolke svar fra GitHub.");
-                        status->setStyleSheet("color: #FF6B6B; font-size: 14px;");
+                        Theme::setTone(status, Theme::Tone::Error);
                         return;
                     }
                     QJsonObject obj = jd.object();
@@ -1366,14 +1442,14 @@ public:
                     int interval = obj.value("interval").toInt(5);
                     if (user_code.isEmpty()) {
                         status->setText("GitHub returnerte ingen kode. Sjekk Client ID.");
-                        status->setStyleSheet("color: #FF6B6B; font-size: 14px;");
+                        Theme::setTone(status, Theme::Tone::Error);
                         return;
                     }
                     deviceCodeEdit->setText(user_code.toUpper());
                     deviceCodeEdit->setCursorPosition(0);
                     QGuiApplication::clipboard()->setText(deviceCodeEdit->text());
                     status->setText("Koden er generert og kopiert. Åpne lenken under og godkjenn.");
-                    status->setStyleSheet("color: #00AA00; font-size: 14px;");
+                    Theme::setTone(status, Theme::Tone::Ok);
                     if (!verification_uri.isEmpty()) {
                         openDevicePageBtn->setText("Åpne " + verification_uri);
                         openDevicePageBtn->disconnect();
@@ -1383,10 +1459,10 @@ public:
                                 deviceCodeEdit->setFocus();
                                 deviceCodeEdit->selectAll();
                                 status->setText("Koden er kopiert. Lim den inn på siden.");
-                                status->setStyleSheet("color: #00AA00; font-size: 14px;");
+                                Theme::setTone(status, Theme::Tone::Ok);
                             } else {
                                 status->setText("Ingen kode ennå. Klikk ‘Generer kode (uten CLI)’ først.");
-                                status->setStyleSheet("color: #FFAA00; font-size: 14px;");
+                                Theme::setTone(status, Theme::Tone::Working);
                             }
                             QDesktopServices::openUrl(QUrl(verification_uri));
                         });
@@ -1401,7 +1477,7 @@ public:
                     if (ghState->spin && !ghState->spin->isActive()) ghState->spin->start();
                     spinnerLbl->show();
                     status->setText("Venter på aktivering... (polling)");
-                    status->setStyleSheet("color: #FFAA00; font-size: 14px;");
+                    Theme::setTone(status, Theme::Tone::Working);
                     if (ghState->devicePoll && !ghState->devicePoll->isActive()) ghState->devicePoll->start();
                 });
             });
@@ -1412,7 +1488,7 @@ public:
                     QClipboard *cb = QGuiApplication::clipboard();
                     cb->setText(deviceCodeEdit->text());
                     status->setText("Koden er kopiert til utklippstavlen.");
-                    status->setStyleSheet("color: #cccccc; font-size: 14px;");
+                    Theme::setTone(status, Theme::Tone::Neutral);
                 }
             });
 
@@ -1423,10 +1499,10 @@ public:
                     deviceCodeEdit->setFocus();
                     deviceCodeEdit->selectAll();
                     status->setText("Koden er kopiert. Lim den inn på siden.");
-                    status->setStyleSheet("color: #00AA00; font-size: 14px;");
+                    Theme::setTone(status, Theme::Tone::Ok);
                 } else {
                     status->setText("Ingen kode ennå. Klikk ‘Generer kode (uten CLI)’ først.");
-                    status->setStyleSheet("color: #FFAA00; font-size: 14px;");
+                    Theme::setTone(status, Theme::Tone::Working);
                 }
                 QDesktopServices::openUrl(QUrl("https://github.com/login/device"));
             });
@@ -1444,6 +1520,7 @@ public:
                 form.addQueryItem("grant_type", "urn:ietf:params:oauth:grant-type:device_code");
                 QByteArray body = form.toString(QUrl::FullyEncoded).toUtf8();
                 QNetworkReply *rep = netManager->post(req, body);
+                NIXLY_TRACE_REPLY(rep, "github", "POST " + req.url().path());
                 QObject::connect(rep, &QNetworkReply::finished, this, [=, this]() mutable {
                     QByteArray data = rep->readAll();
                     rep->deleteLater();
@@ -1490,7 +1567,7 @@ public:
                 if (!tokenEdit->text().isEmpty()) {
                     QGuiApplication::clipboard()->setText(tokenEdit->text());
                     status->setText("Token kopiert til utklippstavlen.");
-                    status->setStyleSheet("color: #cccccc; font-size: 14px;");
+                    Theme::setTone(status, Theme::Tone::Neutral);
                 }
             });
 
@@ -1527,6 +1604,7 @@ public:
                 if (!ghState->inProgress || ghState->statusCheckRunning) return;
                 ghState->statusCheckRunning = true;
                 QProcess *chk = new QProcess(githubPage);
+                NIXLY_TRACE_PROCESS(chk, "github");
                 QObject::connect(chk, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
                                  [=, this](int exitCode, QProcess::ExitStatus) mutable {
                     if (!ghState->inProgress) { chk->deleteLater(); ghState->statusCheckRunning = false; return; }
@@ -1553,6 +1631,7 @@ public:
                 deviceCodeEdit->clear();
 
                 QProcess *proc = new QProcess(this);
+                NIXLY_TRACE_PROCESS(proc, "github");
                 QString program = "gh";
                 QStringList args;
                 args << "auth" << "login"
@@ -1567,54 +1646,32 @@ public:
                 proc->setReadChannel(QProcess::StandardOutput);
                 ghState->proc = proc;
 
-                // Capture and parse output for the one-time code (e.g. XXXX-XXXX)
+                // Capture output and scan it on the backend pool for prompts and
+                // the one-time code (e.g. XXXX-XXXX)
                 auto parseOutput = [=, this]() mutable {
                     if (!proc) return;
-                    QString combined = QString::fromUtf8(proc->readAll());
-
-                    // Auto-answer prompts if they appear
-                    if (combined.contains("Authenticate Git with your GitHub credentials?") ||
-                        combined.contains("Authenticate Git with your GitHub credentials", Qt::CaseInsensitive)) {
-                        proc->write("y\n");
-                    }
-                    if (combined.contains("Press Enter", Qt::CaseInsensitive)) {
-                        proc->write("\n");
-                    }
-
-                    // 1) Direct code pattern (case-insensitive): XXXX-XXXX
-                    QRegularExpression re1("([A-Za-z0-9]{4}-[A-Za-z0-9]{4})", QRegularExpression::CaseInsensitiveOption);
-                    QRegularExpressionMatch m1 = re1.match(combined);
-                    QString foundCode;
-                    if (m1.hasMatch()) {
-                        foundCode = m1.captured(1);
-                    } else {
-                        // 2) Look for phrases like "one-time code: <code>" or "code: <code>"
-                        QRegularExpression re2("one[- ]?time code\\s*:\\s*([A-Za-z0-9\\-]{4,})", QRegularExpression::CaseInsensitiveOption);
-                        QRegularExpressionMatch m2 = re2.match(combined);
-                        if (m2.hasMatch()) {
-                            foundCode = m2.captured(1);
-                        } else {
-                            QRegularExpression re3("code\\s*:\\s*([A-Za-z0-9\\-]{4,})", QRegularExpression::CaseInsensitiveOption);
-                            QRegularExpressionMatch m3 = re3.match(combined);
-                            if (m3.hasMatch()) foundCode = m3.captured(1);
+                    const QByteArray chunk = proc->readAll();
+                    Backend::run(proc, "scan gh login", [chunk]() { return Backend::scanGhLogin(QString::fromUtf8(chunk)); },
+                                 [=](const Backend::GhLoginOutput &out) {
+                        // Auto-answer prompts if they appear
+                        if (out.asksGitCredentials) proc->write("y\n");
+                        if (out.asksEnter) proc->write("\n");
+
+                        if (!out.deviceCode.isEmpty() && !ghState->codeCaptured) {
+                            ghState->codeCaptured = true;
+                            deviceCodeEdit->setText(out.deviceCode);
+                            deviceCodeEdit->setCursorPosition(0);
+                            // Show the one-time code just above the GitHub Login button
+                            oneTimeMsg->setText(out.deviceCode);
+                            oneTimeMsg->show();
+                            QClipboard *cb = QGuiApplication::clipboard();
+                            cb->setText(out.deviceCode);
+                            // Confirm prompt to open browser automatically
+                            proc->write("\n");
+                            // Fallback: open the Device Activation page directly
+                            QDesktopServices::openUrl(QUrl("https://github.com/login/device"));
                         }
-                    }
-
-                    if (!foundCode.isEmpty() && !ghState->codeCaptured) {
-                        ghState->codeCaptured = true;
-                        QString codeUp = foundCode.toUpper();
-                        deviceCodeEdit->setText(codeUp);
-                        deviceCodeEdit->setCursorPosition(0);
-                        // Show the one-time code just above the GitHub Login button
-                        oneTimeMsg->setText(codeUp);
-                        oneTimeMsg->show();
-                        QClipboard *cb = QGuiApplication::clipboard();
-                        cb->setText(codeUp);
-                        // Confirm prompt to open browser automatically
-                        proc->write("\n");
-                        // Fallback: open the Device Activation page directly
-                        QDesktopServices::openUrl(QUrl("https://github.com/login/device"));
-                    }
+                    });
 
                 // Do not surface additional copy UI per new UX
                 };
@@ -1658,6 +1715,7 @@ public:
 
                 // Pre-check: ensure gh exists
                 QProcess *check = new QProcess(this);
+                NIXLY_TRACE_PROCESS(check, "github");
                 QObject::connect(check, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
                                  [=, this](int code, QProcess::ExitStatus) mutable {
                     check->deleteLater();
@@ -1675,22 +1733,23 @@ public:
                 });
                 check->start("gh", QStringList() << "--version");
             });
-        }
+            return githubPage;
+        });
             
-        QWidget *drivePage = new QWidget();
-        {
+        pages->add("Select Drive", [=, this](PageRegistry::Hooks &hooks) -> QWidget* {
+            QWidget *drivePage = new QWidget();
             QVBoxLayout *driveLayout = new QVBoxLayout(drivePage);
             driveLayout->setContentsMargins(40, 40, 40, 40);
             driveLayout->setSpacing(16);
 
             QLabel *title = new QLabel("Select Drive");
-            title->setStyleSheet("color: white; font-size: 28px; font-weight: bold;");
+            Theme::setRole(title, "title");
             title->setAlignment(Qt::AlignCenter);
             driveLayout->addWidget(title);
 
             QLabel *desc = new QLabel(
                 "Choose the drive where NixlyOS will be installed. WARNING: All data on the selected drive will be erased during installation.");
-            desc->setStyleSheet("color: #cccccc; font-size: 15px; line-height: 1.5;");
+            Theme::setRole(desc, "intro");
             desc->setWordWrap(true);
             desc->setAlignment(Qt::AlignCenter);
             driveLayout->addWidget(desc);
@@ -1698,7 +1757,6 @@ public:
             driveLayout->addSpacing(12);
 
             QLabel *driveStatus = new QLabel("");
-            driveStatus->setStyleSheet("color: #cccccc; font-size: 14px;");
             driveStatus->setAlignment(Qt::AlignCenter);
             driveLayout->addWidget(driveStatus);
 
@@ -1716,44 +1774,19 @@ public:
 
             // Selection hint
             QLabel *selectedHint = new QLabel("");
-            selectedHint->setStyleSheet("color: #e6e6e6; font-size: 14px; font-weight: bold;");
+            Theme::setRole(selectedHint, "label");
             selectedHint->setAlignment(Qt::AlignCenter);
             driveLayout->addWidget(selectedHint);
             driveSelectedHint = selectedHint;
 
-            auto humanSize = [](qulonglong bytes) -> QString {
-                const double kb = 1024.0;
-                const double mb = kb * 1024.0;
-                const double gb = mb * 1024.0;
-                const double tb = gb * 1024.0;
-                if (bytes >= (qulonglong)tb) return QString::number(bytes / tb, 'f', 2) + " TB";
-                if (bytes >= (qulonglong)gb) return QString::number(bytes / gb, 'f', 2) + " GB";
-                if (bytes >= (qulonglong)mb) return QString::number(bytes / mb, 'f', 2) + " MB";
-                if (bytes >= (qulonglong)kb) return QString::number(bytes / kb, 'f', 2) + " KB";
-                return QString::number(bytes) + " B";
-            };
-
-            auto ifaceLabel = [](const QString &tran, const QString &name) -> QString {
-                QString t = tran.trimmed().toLower();
-                if (t == "sata" || t == "ata") return "SATA";
-                if (t == "nvme") return "NVMe";
-                if (t == "usb") return "USB";
-                if (t == "mmc") return "MMC";
-                if (t == "virtio") return "Virtio";
-                if (name.startsWith("nvme")) return "NVMe";
-                return t.isEmpty() ? "" : t.toUpper();
-            };
-
             auto styleCard = [](QFrame *card, bool checked) {
                 if (!card) return;
-                if (checked) {
-                    card->setStyleSheet("QFrame { background-color: #2a3f5a; border: none; border-bottom: 1px solid #3A3A3A; }");
-                } else {
-                    card->setStyleSheet("QFrame { background-color: transparent; border: none; border-bottom: 1px solid #3A3A3A; } QFrame:hover { background-color: #2A2A2A; }");
-                }
+                Theme::setRole(card, "driveRow");
+                Theme::setSelected(card, checked);
             };
 
             // Clear & repopulate drive list
+            auto driveScans = std::make_shared<quint64>(0);
             std::function<void()> refreshDrives = [=, this]() {
                 // Reset previous selection pointer to avoid dangling references
                 currentDriveCard = nullptr;
@@ -1768,168 +1801,757 @@ public:
                 }
 
                 driveStatus->setText("Scanning for drives...");
-                driveStatus->setStyleSheet("color: #cccccc; font-size: 14px;");
+                Theme::setTone(driveStatus, Theme::Tone::Neutral);
 
                 QProcess *proc = new QProcess(drivePage);
+                NIXLY_TRACE_PROCESS(proc, "drive");
+                const quint64 scan = ++*driveScans;
                 QObject::connect(proc, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), drivePage,
                                  [=, this](int exitCode, QProcess::ExitStatus) mutable {
-                    QByteArray out = proc->readAllStandardOutput();
+                    const QByteArray out = proc->readAllStandardOutput();
                     proc->deleteLater();
                     if (exitCode != 0) {
                         driveStatus->setText("Could not list drives.");
-                        driveStatus->setStyleSheet("color: #FF6B6B; font-size: 14px;");
+                        Theme::setTone(driveStatus, Theme::Tone::Error);
                         return;
                     }
-                    QJsonParseError jerr; QJsonDocument jd = QJsonDocument::fromJson(out, &jerr);
-                    if (jerr.error != QJsonParseError::NoError || !jd.isObject()) {
-                        driveStatus->setText("Could not parse drive information.");
-                        driveStatus->setStyleSheet("color: #FF6B6B; font-size: 14px;");
-                        return;
-                    }
-                    QJsonArray devs = jd.object().value("blockdevices").toArray();
-                    int count = 0;
-                    for (const QJsonValue &v : devs) {
-                        QJsonObject o = v.toObject();
-                        QString type = o.value("type").toString();
-                        if (type != "disk") continue;
-                        QString path = o.value("path").toString();
-                        if (path.isEmpty()) {
-                            QString name = o.value("name").toString();
-                            if (!name.isEmpty()) path = "/dev/" + name;
-                        }
-                        QString model = o.value("model").toString().trimmed();
-                        QString vendor = o.value("vendor").toString().trimmed();
-                        QString tran = o.value("tran").toString().trimmed();
-                        qulonglong size = o.value("size").toVariant().toULongLong();
-                        QString iface = ifaceLabel(tran, o.value("name").toString());
-                        // Compose vendor + model nicely
-                        QString nameCombo;
-                        if (!vendor.isEmpty()) {
-                            nameCombo = vendor;
-                            if (!model.isEmpty()) {
-                                if (!model.startsWith(vendor)) nameCombo += " " + model;
-                            }
-                        } else {
-                            nameCombo = model;
+                    // JSON and hover text on the backend pool; cards here
+                    Backend::run(drivePage, "parse lsblk", [out]() { return Backend::parseDrives(out); },
+                                 [=, this](const Backend::DriveScan &result) {
+                        // A newer scan has cleared the list since
+                        if (scan != *driveScans) return;
+                        if (!result.error.isEmpty()) {
+                            driveStatus->setText("Could not parse drive information.");
+                            Theme::setTone(driveStatus, Theme::Tone::Error);
+                            return;
                         }
-                        if (nameCombo.trimmed().isEmpty()) nameCombo = "Unknown";
-
-                        // Build tooltip of existing partitions for this disk
-                        QString tooltip;
-                        QStringList partLines;
-                        for (const QJsonValue &pv : o.value("children").toArray()) {
-                            QJsonObject po = pv.toObject();
-                            if (po.value("type").toString() != "part") continue;
-                            QString ppath = po.value("path").toString();
-                            if (ppath.isEmpty()) {
-                                QString pname = po.value("name").toString();
-                                if (!pname.isEmpty()) ppath = "/dev/" + pname;
-                            }
-                            qulonglong psize = po.value("size").toVariant().toULongLong();
-                            QString fstype = po.value("fstype").toString();
-                            QString label = po.value("label").toString();
-                            QString uuid = po.value("uuid").toString();
-                            // mountpoints may be an array; fallback to single mountpoint if present
-                            QStringList mps;
-                            QJsonValue mpsVal = po.value("mountpoints");
-                            if (mpsVal.isArray()) {
-                                for (const QJsonValue &mv : mpsVal.toArray()) {
-                                    QString s = mv.toString();
-                                    if (!s.isEmpty()) mps << s;
-                                }
-                            } else {
-                                QString mp = po.value("mountpoint").toString();
-                                if (!mp.isEmpty()) mps << mp;
-                            }
-                            // Truncate long fields for compact tooltips
-                            QString labelDisp = label;
-                            if (labelDisp.size() > 16) labelDisp = labelDisp.left(16) + "…";
-                            QString uuidDisp = uuid;
-                            if (uuidDisp.size() > 8) uuidDisp = uuidDisp.left(8) + "…";
-
-                            QString extra;
-                            if (!labelDisp.isEmpty()) extra += QString(" • LABEL=%1").arg(labelDisp);
-                            if (!uuidDisp.isEmpty()) extra += QString(" • UUID=%1").arg(uuidDisp);
-                            if (!fstype.isEmpty()) extra += QString(" • %1").arg(fstype);
-                            if (!mps.isEmpty()) extra += QString(" • %1").arg(mps.join(", "));
-                            partLines << QString("%1 — %2%3").arg(ppath, humanSize(psize), extra);
+                        for (const Backend::Drive &d : result.drives) {
+                            // Card widget: compact single-row with right-aligned size
+                            QFrame *card = new QFrame();
+                            styleCard(card, false);
+                            QHBoxLayout *row = new QHBoxLayout(card);
+                            row->setContentsMargins(4, 0, 4, 0);
+                            row->setSpacing(4);
+                            card->setFixedHeight(20);
+
+                            // Entire row is clickable; no radio button
+
+                            QLabel *info = new QLabel(QString("<b>%1</b> • %2 • %3").arg(d.path, d.name, d.interface));
+                            Theme::setRole(info, "item");
+                            info->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+                            info->setAttribute(Qt::WA_TransparentForMouseEvents, true);
+                            row->addWidget(info, 1);
+
+                            QLabel *sz = new QLabel(d.size);
+                            Theme::setRole(sz, "field");
+                            sz->setAttribute(Qt::WA_TransparentForMouseEvents, true);
+                            row->addWidget(sz, 0, Qt::AlignRight | Qt::AlignVCenter);
+
+                            // Click handling is done via eventFilter
+
+                            // Store drive path + hover text on the card
+                            card->setProperty("drivePath", d.path);
+                            card->setProperty("hoverTipHtml", d.partitionsHtml);
+                            card->setAttribute(Qt::WA_Hover, true);
+                            card->setMouseTracking(true);
+                            card->installEventFilter(this);
+                            driveListLayout->addWidget(card);
                         }
-                        if (!partLines.isEmpty()) {
-                            tooltip = QString("<div style='min-width:700px; font-size:14px; font-weight:600;'>Partitions on %1</div><div style='min-width:700px; font-size:14px;'>%2</div>")
-                                               .arg(path, partLines.join("<br>"));
+                        if (result.drives.isEmpty()) {
+                            driveStatus->setText("No drives found.");
+                            Theme::setTone(driveStatus, Theme::Tone::Working);
                         } else {
-                            tooltip = QString("<div style='min-width:480px; font-size:14px; font-weight:600;'>No partitions found on %1</div>").arg(path);
+                            driveStatus->setText("");
                         }
-
-                        // Card widget: compact single-row with right-aligned size
-                        QFrame *card = new QFrame();
-                        styleCard(card, false);
-                        QHBoxLayout *row = new QHBoxLayout(card);
-                        row->setContentsMargins(4, 0, 4, 0);
-                        row->setSpacing(4);
-                        card->setFixedHeight(20);
-
-                        // Entire row is clickable; no radio button
-
-                        QLabel *info = new QLabel(QString("<b>%1</b> • %2 • %3")
-                                                   .arg(path, nameCombo, iface.isEmpty() ? "Unknown" : iface));
-                        info->setStyleSheet("color: #e6e6e6; font-size: 14px;");
-                        info->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
-                        info->setAttribute(Qt::WA_TransparentForMouseEvents, true);
-                        row->addWidget(info, 1);
-
-                        QLabel *sz = new QLabel(humanSize(size));
-                        sz->setStyleSheet("color: white; font-size: 14px; font-weight: bold;");
-                        sz->setAttribute(Qt::WA_TransparentForMouseEvents, true);
-                        row->addWidget(sz, 0, Qt::AlignRight | Qt::AlignVCenter);
-
-                        // Click handling is done via eventFilter
-
-                        // Store drive path + hover text on the card
-                        card->setProperty("drivePath", path);
-                        card->setProperty("hoverTipHtml", tooltip);
-                        card->setAttribute(Qt::WA_Hover, true);
-                        card->setMouseTracking(true);
-                        card->installEventFilter(this);
-                        driveListLayout->addWidget(card);
-                        ++count;
-                    }
-                    if (count == 0) {
-                        driveStatus->setText("No drives found.");
-                        driveStatus->setStyleSheet("color: #FFAA00; font-size: 14px;");
-                    } else {
-                        driveStatus->setText("");
-                    }
+                    });
                 });
                 QStringList args;
                 args << "-J" << "-b" << "-o" << "NAME,KNAME,PATH,MODEL,VENDOR,SIZE,TYPE,TRAN,FSTYPE,MOUNTPOINTS,LABEL,UUID";
                 proc->start("lsblk", args);
             };
 
-            // Initial scan
-            QTimer::singleShot(200, drivePage, refreshDrives);
+            // Scan each time Select Drive is shown
+            hooks.shown = [=]() { QTimer::singleShot(50, drivePage, refreshDrives); };
+            return drivePage;
+        });
+            
+        pages->add("Settings", [=, this](PageRegistry::Hooks &hooks) -> QWidget* {
+            QWidget *settingsPage = new QWidget();
+            QVBoxLayout *setLayout = new QVBoxLayout(settingsPage);
+            setLayout->setContentsMargins(40, 40, 40, 40);
+            setLayout->setSpacing(16);
+
+            QLabel *title = new QLabel("Settings");
+            Theme::setRole(title, "title");
+            title->setAlignment(Qt::AlignCenter);
+            setLayout->addWidget(title);
 
-            // Rescan when navigating to Select Drive
-            QObject::connect(contentStack, &QStackedWidget::currentChanged, drivePage, [=](int idx){
-                if (idx == 3) QTimer::singleShot(50, drivePage, refreshDrives);
+            QLabel *desc = new QLabel(
+                "Choose the time zone and language of the installed system. Type any part of a city, "
+                "country or language to search.");
+            Theme::setRole(desc, "lead");
+            desc->setWordWrap(true);
+            desc->setAlignment(Qt::AlignCenter);
+            setLayout->addWidget(desc);
+
+            QLabel *suggestionLabel = new QLabel("Loading time zones and locales...");
+            Theme::setRole(suggestionLabel, "detail");
+            Theme::setTone(suggestionLabel, Theme::Tone::Muted);
+            suggestionLabel->setAlignment(Qt::AlignCenter);
+            suggestionLabel->setWordWrap(true);
+            setLayout->addWidget(suggestionLabel);
+
+            struct RegionColumn {
+                RegionIndex::Kind kind;
+                QLineEdit *search;
+                QListWidget *list;
+                QLabel *chosen;
+                QLabel *stats;
+            };
+            QHBoxLayout *columns = new QHBoxLayout();
+            columns->setSpacing(24);
+            auto makeColumn = [=](RegionIndex::Kind kind, const QString &heading, const QString &placeholder) {
+                QVBoxLayout *col = new QVBoxLayout();
+                col->setSpacing(8);
+                QLabel *h = new QLabel(heading);
+                Theme::setRole(h, "heading");
+                col->addWidget(h);
+                RegionColumn c { kind, new QLineEdit(), new QListWidget(), new QLabel(), new QLabel() };
+                c.search->setPlaceholderText(placeholder);
+                c.search->setClearButtonEnabled(true);
+                c.list->setUniformItemSizes(true);
+                Theme::setRole(c.stats, "caption");
+                col->addWidget(c.search);
+                col->addWidget(c.list, 1);
+                col->addWidget(c.chosen);
+                col->addWidget(c.stats);
+                columns->addLayout(col, 1);
+                return c;
+            };
+            const RegionColumn zoneCol = makeColumn(RegionIndex::Kind::TimeZone, "Time zone", "Search city, region or country");
+            const RegionColumn localeCol = makeColumn(RegionIndex::Kind::Locale, "Language and formats", "Search language or country");
+            setLayout->addLayout(columns, 1);
+
+            // Keyboard: the layout list is read on first show, keymaps compile
+            // on KeymapCache's workers and the try-it field switches to each as
+            // soon as it is ready
+            QLabel *kbHeading = new QLabel("Keyboard layout");
+            Theme::setRole(kbHeading, "heading");
+            setLayout->addWidget(kbHeading);
+            QHBoxLayout *kbRow = new QHBoxLayout();
+            kbRow->setSpacing(12);
+            QComboBox *layoutCombo = new QComboBox();
+            QComboBox *variantCombo = new QComboBox();
+            KeymapTryField *tryField = new KeymapTryField();
+            tryField->setPlaceholderText("Type here to try the layout");
+            layoutCombo->setEnabled(false);
+            variantCombo->setEnabled(false);
+            kbRow->addWidget(layoutCombo, 2);
+            kbRow->addWidget(variantCombo, 2);
+            kbRow->addWidget(tryField, 3);
+            setLayout->addLayout(kbRow);
+            QLabel *keymapStatus = new QLabel("");
+            Theme::setRole(keymapStatus, "caption");
+            setLayout->addWidget(keymapStatus);
+
+            // User account: the password is hashed on a worker once typing
+            // pauses, so the hash is ready by the time Install is pressed
+            QLabel *accountHeading = new QLabel("User account");
+            Theme::setRole(accountHeading, "heading");
+            setLayout->addWidget(accountHeading);
+            QHBoxLayout *accountRow = new QHBoxLayout();
+            accountRow->setSpacing(12);
+            QLineEdit *userEdit = new QLineEdit();
+            userEdit->setPlaceholderText("User name");
+            QLineEdit *userPass = new QLineEdit();
+            userPass->setEchoMode(QLineEdit::Password);
+            userPass->setPlaceholderText("Password");
+            QLineEdit *userPassConfirm = new QLineEdit();
+            userPassConfirm->setEchoMode(QLineEdit::Password);
+            userPassConfirm->setPlaceholderText("Repeat password");
+            for (QLineEdit *e : { userEdit, userPass, userPassConfirm }) {
+                accountRow->addWidget(e, 1);
+            }
+            setLayout->addLayout(accountRow);
+            QLabel *accountStatus = new QLabel("No user account will be created; the system configuration has to provide one.");
+            Theme::setRole(accountStatus, "caption");
+            accountStatus->setWordWrap(true);
+            setLayout->addWidget(accountStatus);
+            QTimer *hashDelay = new QTimer(settingsPage);
+            hashDelay->setSingleShot(true);
+            hashDelay->setInterval(300);
+
+            auto setAccountStatus = [=](const QString &text, Theme::Tone tone) {
+                accountStatus->setText(text);
+                Theme::setTone(accountStatus, tone);
+            };
+            auto accountChanged = [=, this]() {
+                hashDelay->stop();
+                ++*passwordGeneration;
+                userName.clear();
+                userPasswordHash.clear();
+                const QString name = userEdit->text().trimmed();
+                accountPending = !name.isEmpty() || !userPass->text().isEmpty();
+                if (!accountPending) {
+                    setAccountStatus("No user account will be created; the system configuration has to provide one.", Theme::Tone::Muted);
+                } else if (!PasswordHasher::isValidUserName(name)) {
+                    setAccountStatus("User names start with a lower case letter and use only a-z, 0-9, '-' and '_'.", Theme::Tone::Error);
+                } else if (userPass->text().isEmpty()) {
+                    setAccountStatus("Choose a password.", Theme::Tone::Error);
+                } else if (userPass->text() != userPassConfirm->text()) {
+                    setAccountStatus("The passwords do not match.", Theme::Tone::Error);
+                } else {
+                    setAccountStatus(passwordParams.calibrated ? QString("Hashing the password...")
+                                                               : QString("Measuring the password hash cost on this machine..."), Theme::Tone::Working);
+                    hashDelay->start();
+                }
+            };
+            for (QLineEdit *e : { userEdit, userPass, userPassConfirm })
+                QObject::connect(e, &QLineEdit::textChanged, settingsPage, accountChanged);
+            QObject::connect(hashDelay, &QTimer::timeout, settingsPage, [=, this]() {
+                const QString name = userEdit->text().trimmed();
+                hashPassword(userPass->text().toUtf8(), [=, this](const QString &error) {
+                    if (userPasswordHash.isEmpty()) {
+                        setAccountStatus(error, Theme::Tone::Error);
+                        return;
+                    }
+                    userName = name;
+                    accountPending = false;
+                    setAccountStatus(QString("%1 will be created (%2).").arg(name, passwordParams.summary()), Theme::Tone::Ok);
+                });
             });
-        }
-            
-        QWidget *settingsPage = createPage("Settings", 
-            "Configure system settings including timezone, keyboard layout, user accounts, "
-            "and other system preferences.");
+
+            auto layouts = std::make_shared<QList<KeyboardLayouts::Layout>>();
+            auto compileSelected = [=, this]() {
+                const QString layout = layoutCombo->currentData().toString();
+                const QString variant = variantCombo->currentData().toString();
+                if (layout.isEmpty()) return;
+                keymapStatus->setText(QString("Compiling %1...").arg(variantCombo->currentText()));
+                Theme::setTone(keymapStatus, Theme::Tone::Working);
+                keymapCache->request(layout, variant, tryField, [=, this](KeymapCache::Keymap keymap, qint64 us, const QString &error) {
+                    // An older selection finishing late
+                    if (layout != layoutCombo->currentData().toString() || variant != variantCombo->currentData().toString()) return;
+                    tryField->setKeymap(keymap);
+                    const KeymapCache::Stats st = keymapCache->stats();
+                    keymapStatus->setText(!keymap ? error
+                        : QString("%1: %2, cache %3 hits / %4 compiled")
+                              .arg(variantCombo->currentText(),
+                                   us == 0 ? QString("cached") : QString("compiled in %1 ms").arg(us / 1000.0, 0, 'f', 1))
+                              .arg(st.hits).arg(st.misses));
+                    Theme::setTone(keymapStatus, keymap ? Theme::Tone::Muted : Theme::Tone::Error);
+                });
+            };
+            QObject::connect(layoutCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), settingsPage, [=](int i) {
+                if (i < 0 || i >= layouts->size()) return;
+                const KeyboardLayouts::Layout &l = layouts->at(i);
+                const QSignalBlocker block(variantCombo);
+                variantCombo->clear();
+                variantCombo->addItem(l.description, QString());
+                for (const KeyboardLayouts::Variant &v : l.variants) variantCombo->addItem(v.description, v.name);
+                variantCombo->setEnabled(!l.variants.isEmpty());
+                compileSelected();
+            });
+            QObject::connect(variantCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), settingsPage, [=]() { compileSelected(); });
+            // Only what the user picked goes into the configuration
+            for (QComboBox *combo : { layoutCombo, variantCombo }) {
+                QObject::connect(combo, &QComboBox::activated, settingsPage, [=, this]() {
+                    chosenKeyLayout = layoutCombo->currentData().toString();
+                    chosenKeyVariant = variantCombo->currentData().toString();
+                });
+            }
+
+            auto loadLayouts = [=, this]() {
+                if (keymapCache) return;
+                keymapCache = std::make_unique<KeymapCache>();
+                keymapStatus->setText("Reading keyboard layouts...");
+                QPointer<QWidget> page(settingsPage);
+                QThreadPool::globalInstance()->start([=]() {
+                    NIXLY_TRACE_SCOPE("worker", "load keyboard layouts");
+                    QString error;
+                    const QList<KeyboardLayouts::Layout> loaded = KeyboardLayouts::load(&error);
+                    QMetaObject::invokeMethod(qApp, [=]() {
+                        if (!page) return;
+                        if (loaded.isEmpty()) {
+                            keymapStatus->setText(error);
+                            Theme::setTone(keymapStatus, Theme::Tone::Error);
+                            return;
+                        }
+                        *layouts = loaded;
+                        int us = 0;
+                        {
+                            const QSignalBlocker block(layoutCombo);
+                            for (int i = 0; i < loaded.size(); ++i) {
+                                layoutCombo->addItem(loaded.at(i).description, loaded.at(i).name);
+                                if (loaded.at(i).name == "us") us = i;
+                            }
+                            layoutCombo->setCurrentIndex(-1);
+                        }
+                        layoutCombo->setEnabled(true);
+                        layoutCombo->setCurrentIndex(us);
+                    }, Qt::QueuedConnection);
+                });
+            };
+
+            auto chosenOf = [this](const RegionColumn &c) -> QString & {
+                return c.kind == RegionIndex::Kind::TimeZone ? chosenTimeZone : chosenLocale;
+            };
+            // Until something is picked, the suggestion
+            auto effective = [=, this](const RegionColumn &c) {
+                if (!chosenOf(c).isEmpty() || !regionIndex) return chosenOf(c);
+                return c.kind == RegionIndex::Kind::TimeZone ? regionIndex->suggestedTimeZone() : regionIndex->suggestedLocale();
+            };
+            auto showChosen = [=, this](const RegionColumn &c) {
+                const QString id = effective(c);
+                const int at = regionIndex ? regionIndex->indexOf(c.kind, id) : -1;
+                const QString prefix = chosenOf(c).isEmpty() ? "Suggested" : "Selected";
+                c.chosen->setText(at < 0 ? QString("%1: %2").arg(prefix, id)
+                                         : QString("%1: %2 (%3)").arg(prefix, regionIndex->entries(c.kind).at(at).label, id));
+            };
+            // The index is small and pre-folded: searching on every keystroke
+            // stays well inside a frame, so there is no debounce
+            auto refresh = [=, this](const RegionColumn &c) {
+                if (!regionIndex) return;
+                QElapsedTimer t;
+                t.start();
+                const QList<int> hits = regionIndex->search(c.kind, c.search->text(), 100);
+                const qint64 searchNs = t.nsecsElapsed();
+                const QList<RegionIndex::Entry> &entries = regionIndex->entries(c.kind);
+                c.list->setUpdatesEnabled(false);
+                c.list->clear();
+                for (int i : hits) {
+                    const RegionIndex::Entry &e = entries.at(i);
+                    QListWidgetItem *item = new QListWidgetItem(e.label + "\n" + e.detail, c.list);
+                    item->setData(Qt::UserRole, e.id);
+                    if (e.id == effective(c)) item->setSelected(true);
+                }
+                c.list->setUpdatesEnabled(true);
+                c.stats->setText(QString("%1 of %2 shown, search %3 ms, list %4 ms")
+                                     .arg(hits.size()).arg(entries.size())
+                                     .arg(searchNs / 1e6, 0, 'f', 2).arg(t.nsecsElapsed() / 1e6, 0, 'f', 1));
+            };
+            for (const RegionColumn &c : { zoneCol, localeCol }) {
+                QObject::connect(c.search, &QLineEdit::textChanged, settingsPage, [=]() { refresh(c); });
+                QObject::connect(c.list, &QListWidget::itemClicked, settingsPage, [=, this](QListWidgetItem *item) {
+                    chosenOf(c) = item->data(Qt::UserRole).toString();
+                    showChosen(c);
+                });
+            }
+
+            onRegionIndexReady = [=, this]() {
+                QString text = QString("%1 time zones and %2 locales indexed in %3 ms.")
+                                   .arg(regionIndex->entries(RegionIndex::Kind::TimeZone).size())
+                                   .arg(regionIndex->entries(RegionIndex::Kind::Locale).size())
+                                   .arg(regionIndex->buildMs());
+                if (!regionIndex->suggestionReason().isEmpty())
+                    text += QString(" Suggested %1 from %2.").arg(regionIndex->suggestedTimeZone(), regionIndex->suggestionReason());
+                suggestionLabel->setText(text);
+                for (const RegionColumn &c : { zoneCol, localeCol }) {
+                    refresh(c);
+                    showChosen(c);
+                }
+            };
+
+            hooks.shown = [=, this]() {
+                loadRegionIndex();
+                loadLayouts();
+                if (!passwordParams.calibrated) calibratePasswordHash();
+                if (!regionIndex) return;
+                // Loaded for the Install page before this page existed
+                if (zoneCol.list->count() == 0) onRegionIndexReady();
+                // Bring the current choice into view
+                for (const RegionColumn &c : { zoneCol, localeCol }) {
+                    if (!c.search->text().isEmpty()) continue;
+                    const QList<QListWidgetItem*> sel = c.list->selectedItems();
+                    if (!sel.isEmpty()) c.list->scrollToItem(sel.first(), QAbstractItemView::PositionAtCenter);
+                }
+            };
+            return settingsPage;
+        });
             
-        QWidget *installPage = createPage("Install", 
-            "Ready to install NixlyOS! Review your settings and click install to begin "
-            "the installation process. This may take several minutes to complete.");
-        
-        // Add pages to stack
-        contentStack->addWidget(welcomePage);
-        contentStack->addWidget(internetPage);
-        contentStack->addWidget(githubPage);
-        contentStack->addWidget(drivePage);
-        contentStack->addWidget(settingsPage);
-        contentStack->addWidget(installPage);
+        pages->add("Install", [=, this](PageRegistry::Hooks &hooks) -> QWidget* {
+            QWidget *installPage = new QWidget();
+            QVBoxLayout *instLayout = new QVBoxLayout(installPage);
+            instLayout->setContentsMargins(40, 40, 40, 40);
+            instLayout->setSpacing(16);
+
+            QLabel *title = new QLabel("Install");
+            Theme::setRole(title, "title");
+            title->setAlignment(Qt::AlignCenter);
+            instLayout->addWidget(title);
+
+            QLabel *desc = new QLabel(
+                "Ready to install NixlyOS! Review your settings and click install to begin "
+                "the installation process. This may take several minutes to complete.");
+            Theme::setRole(desc, "lead");
+            desc->setWordWrap(true);
+            desc->setAlignment(Qt::AlignCenter);
+            instLayout->addWidget(desc);
+
+            QLabel *targetLabel = new QLabel("");
+            Theme::setRole(targetLabel, "label");
+            targetLabel->setAlignment(Qt::AlignCenter);
+            instLayout->addWidget(targetLabel);
+
+            // Disk encryption passphrase
+            QHBoxLayout *passRow = new QHBoxLayout();
+            QLineEdit *passEdit = new QLineEdit();
+            passEdit->setEchoMode(QLineEdit::Password);
+            passEdit->setPlaceholderText("Disk encryption passphrase");
+            QLineEdit *passConfirm = new QLineEdit();
+            passConfirm->setEchoMode(QLineEdit::Password);
+            passConfirm->setPlaceholderText("Repeat passphrase");
+            for (QLineEdit *e : { passEdit, passConfirm }) {
+                passRow->addWidget(e, 1);
+            }
+            instLayout->addLayout(passRow);
+
+            QLabel *encryptionLabel = new QLabel("Encryption: measuring this machine...");
+            encryptionLabel->setAlignment(Qt::AlignCenter);
+            encryptionLabel->setWordWrap(true);
+            instLayout->addWidget(encryptionLabel);
+
+            QLabel *cacheLabel = new QLabel("");
+            cacheLabel->setAlignment(Qt::AlignCenter);
+            instLayout->addWidget(cacheLabel);
+
+            QLabel *prefetchLabel = new QLabel("");
+            prefetchLabel->setAlignment(Qt::AlignCenter);
+            prefetchLabel->setWordWrap(true);
+            instLayout->addWidget(prefetchLabel);
+            QPushButton *prefetchStopBtn = new QPushButton("Stop prefetch");
+            Theme::setRole(prefetchStopBtn, "compact");
+            prefetchStopBtn->hide();
+            instLayout->addWidget(prefetchStopBtn, 0, Qt::AlignCenter);
+            connect(prefetchStopBtn, &QPushButton::clicked, this, [this]() { prefetcher->cancel(); });
+            // Background fetch started when the configuration was cloned
+            QTimer *prefetchTick = new QTimer(installPage);
+            prefetchTick->setInterval(500);
+            connect(prefetchTick, &QTimer::timeout, this, [=, this]() {
+                prefetchLabel->setText(prefetcher->summary());
+                Theme::setTone(prefetchLabel, prefetcher->state() == SystemPrefetcher::State::Failed ? Theme::Tone::Error
+                                                                                                     : Theme::Tone::Neutral);
+                prefetchStopBtn->setVisible(prefetcher->isRunning());
+            });
+
+            QCheckBox *dryRunBox = new QCheckBox("Dry run on a loop device (nothing is written to the selected drive)");
+            dryRunBox->setChecked(QCoreApplication::arguments().contains("--dry-run"));
+            instLayout->addWidget(dryRunBox);
+
+            QCheckBox *eraseBox = new QCheckBox("Erase the whole drive before installing");
+            // Opt-in: without discard or write-zeroes support this zero-fills for hours
+            eraseBox->setChecked(QCoreApplication::arguments().contains("--full-wipe"));
+            instLayout->addWidget(eraseBox);
+
+            QCheckBox *verifyBox = new QCheckBox("Verify every installed file against its recorded hash");
+            verifyBox->setChecked(QCoreApplication::arguments().contains("--verify-after-install"));
+            instLayout->addWidget(verifyBox);
+
+            // Discard takes seconds, zero-filling a large hard disk takes hours
+            QLabel *eraseLabel = new QLabel("");
+            Theme::setRole(eraseLabel, "detail");
+            Theme::setTone(eraseLabel, Theme::Tone::Muted);
+            eraseLabel->setAlignment(Qt::AlignCenter);
+            eraseLabel->setWordWrap(true);
+            instLayout->addWidget(eraseLabel);
+
+            QProgressBar *progressBar = new QProgressBar();
+            progressBar->setRange(0, 1000);
+            progressBar->setValue(0);
+            progressBar->setTextVisible(false);
+            progressBar->setFixedHeight(10);
+            instLayout->addWidget(progressBar);
+
+            QLabel *installStatus = new QLabel("");
+            installStatus->setAlignment(Qt::AlignCenter);
+            installStatus->setWordWrap(true);
+            instLayout->addWidget(installStatus);
+
+            // Paths, bytes and ETA of the system build, from Nix's structured log
+            QLabel *nixProgressLabel = new QLabel("");
+            Theme::setRole(nixProgressLabel, "detail");
+            nixProgressLabel->setAlignment(Qt::AlignCenter);
+            nixProgressLabel->setWordWrap(true);
+            nixProgressLabel->hide();
+            instLayout->addWidget(nixProgressLabel);
+
+            // One row per install step: title, state, elapsed time
+            QWidget *stepsWidget = new QWidget();
+            QGridLayout *stepsGrid = new QGridLayout(stepsWidget);
+            stepsGrid->setContentsMargins(0, 0, 0, 0);
+            stepsGrid->setHorizontalSpacing(16);
+            stepsGrid->setVerticalSpacing(2);
+            stepsGrid->setColumnStretch(0, 1);
+            instLayout->addWidget(stepsWidget);
+
+            QPlainTextEdit *logView = new QPlainTextEdit();
+            logView->setReadOnly(true);
+            logView->setMaximumBlockCount(500);
+            instLayout->addWidget(logView, 1);
+
+            QHBoxLayout *instActions = new QHBoxLayout();
+            QPushButton *startInstallBtn = new QPushButton("Install NixlyOS");
+            Theme::setRole(startInstallBtn, "primary");
+            QPushButton *cancelInstallBtn = new QPushButton("Cancel");
+            Theme::setRole(cancelInstallBtn, "large");
+            cancelInstallBtn->hide();
+            instActions->addStretch();
+            instActions->addWidget(startInstallBtn);
+            instActions->addSpacing(12);
+            instActions->addWidget(cancelInstallBtn);
+            instActions->addStretch();
+            instLayout->addLayout(instActions);
+
+            struct StepRow { QLabel *state = nullptr; QLabel *time = nullptr; };
+            auto stepRows = std::make_shared<QHash<QString, StepRow>>();
+
+            auto stateTone = [](InstallStep::State st) {
+                switch (st) {
+                    case InstallStep::State::Done: return Theme::Tone::Ok;
+                    case InstallStep::State::Running: return Theme::Tone::Working;
+                    case InstallStep::State::Failed: return Theme::Tone::Error;
+                    case InstallStep::State::Skipped:
+                    case InstallStep::State::Cancelled: return Theme::Tone::Muted;
+                    default: return Theme::Tone::Neutral;
+                }
+            };
+
+            auto updateRow = [=, this](const InstallStep &s) {
+                auto it = stepRows->find(s.id);
+                if (it == stepRows->end()) return;
+                QString text = installStepStateName(s.state);
+                if (s.state == InstallStep::State::Running && s.progress > 0.0)
+                    text += QString(" %1%").arg(int(s.progress * 100));
+                it->state->setText(text);
+                Theme::setTone(it->state, stateTone(s.state));
+                if (!s.error.isEmpty()) it->state->setToolTip(s.error);
+                qint64 ms = s.elapsedMs;
+                if (s.state == InstallStep::State::Running && installEngine) ms = installEngine->elapsedMs() - s.startedMs;
+                it->time->setText(s.startedMs >= 0 ? QString::number(ms / 1000.0, 'f', 1) + " s" : "");
+            };
+
+            // Elapsed times, the progress bar and Nix's counters refresh at a
+            // fixed rate, however fast the log lines come in
+            QTimer *installTick = new QTimer(installPage);
+            installTick->setInterval(100);
+            connect(installTick, &QTimer::timeout, this, [=, this]() {
+                if (!installEngine) return;
+                installEngine->pollProgress();
+                for (const InstallStep &s : installEngine->steps()) {
+                    if (s.state == InstallStep::State::Running) updateRow(s);
+                }
+                const InstallStep *build = installEngine->step("build-system");
+                if (build && build->state == InstallStep::State::Running) {
+                    const NixProgress::Snapshot np = installEngine->nixProgress();
+                    QString text = np.summary();
+                    if (!np.currentActivity.isEmpty())
+                        text += "\n" + QFontMetrics(nixProgressLabel->font()).elidedText(np.currentActivity, Qt::ElideMiddle, 600);
+                    nixProgressLabel->setText(text);
+                    nixProgressLabel->show();
+                }
+                progressBar->setValue(int(installEngine->progress() * 1000));
+                if (installEngine->localCache().isValid()) cacheLabel->setText(installEngine->localCache().summary());
+            });
+
+            hooks.hidden = [=]() { prefetchTick->stop(); };
+            hooks.shown = [=, this]() {
+                // The suggested zone and locale, if Settings was skipped
+                loadRegionIndex();
+                prefetchLabel->setText(prefetcher->summary());
+                prefetchTick->start();
+                targetLabel->setText(currentDrivePath.isEmpty() ? QString("No drive selected")
+                                                                : QString("Target drive: %1").arg(currentDrivePath));
+                eraseLabel->setText(currentDrivePath.isEmpty() ? QString()
+                                                               : DiskWiper::describe(DiskWiper::probe(currentDrivePath)));
+                // Benchmark ciphers and Argon2id once, off the GUI thread
+                if (luksCalibrationStarted) return;
+                luksCalibrationStarted = true;
+                QPointer<MainWindow> self(this);
+                QPointer<QLabel> label(encryptionLabel);
+                QThreadPool::globalInstance()->start([self, label]() {
+                    NIXLY_TRACE_SCOPE("worker", "calibrate LUKS");
+                    const LuksParams params = LuksCalibrator::calibrate();
+                    QMetaObject::invokeMethod(qApp, [self, label, params]() {
+                        if (!self) return;
+                        self->luksParams = params;
+                        if (label) label->setText(params.calibrated ? "Encryption: " + params.summary()
+                                                                    : QString("Encryption: cryptsetup benchmark unavailable, using defaults"));
+                    }, Qt::QueuedConnection);
+                });
+            };
+
+            connect(cancelInstallBtn, &QPushButton::clicked, this, [=, this]() {
+                if (installEngine && installEngine->isRunning()) {
+                    installStatus->setText("Cancelling...");
+                    Theme::setTone(installStatus, Theme::Tone::Working);
+                    installEngine->cancel();
+                }
+            });
+
+            connect(startInstallBtn, &QPushButton::clicked, this, [=, this]() {
+                if (installEngine && installEngine->isRunning()) return;
+                const bool dryRun = dryRunBox->isChecked();
+                if (!dryRun && currentDrivePath.isEmpty()) {
+                    installStatus->setText("Select a drive first.");
+                    Theme::setTone(installStatus, Theme::Tone::Error);
+                    return;
+                }
+                if (passEdit->text() != passConfirm->text()) {
+                    installStatus->setText("The passphrases do not match.");
+                    Theme::setTone(installStatus, Theme::Tone::Error);
+                    return;
+                }
+                if (!dryRun && passEdit->text().isEmpty()) {
+                    installStatus->setText("Choose a disk encryption passphrase.");
+                    Theme::setTone(installStatus, Theme::Tone::Error);
+                    return;
+                }
+                if (accountPending) {
+                    installStatus->setText("Finish the user account on the Settings page first.");
+                    Theme::setTone(installStatus, Theme::Tone::Error);
+                    return;
+                }
+                InstallPlan plan;
+                plan.device = dryRun ? QString() : currentDrivePath;
+                plan.flakeDir = QDir::homePath() + "/.nixlyos";
+                plan.luksPassphrase = passEdit->text().toUtf8();
+                plan.dryRun = dryRun;
+                plan.fullWipe = eraseBox->isChecked();
+                plan.verifyStore = verifyBox->isChecked();
+                plan.reuseExistingStore = !QCoreApplication::arguments().contains("--no-store-reuse");
+                if (luksParams.calibrated) plan.luks = luksParams;
+                plan.localCacheDir = argumentValue("--local-cache");
+                plan.extraSubstituters << extraSubstituters();
+                // An explicit pick beats the system flake; a suggestion only fills a gap
+                if (!chosenTimeZone.isEmpty()) plan.configLines << QString("time.timeZone = lib.mkForce \"%1\";").arg(chosenTimeZone);
+                else if (regionIndex) plan.configLines << QString("time.timeZone = lib.mkDefault \"%1\";").arg(regionIndex->suggestedTimeZone());
+                if (!chosenLocale.isEmpty()) plan.configLines << QString("i18n.defaultLocale = lib.mkForce \"%1\";").arg(chosenLocale);
+                else if (regionIndex) plan.configLines << QString("i18n.defaultLocale = lib.mkDefault \"%1\";").arg(regionIndex->suggestedLocale());
+                plan.userName = userName;
+                plan.userPasswordHash = userPasswordHash;
+                plan.passwordHash = passwordParams;
+                if (!chosenKeyLayout.isEmpty()) {
+                    plan.configLines << QString("services.xserver.xkb.layout = lib.mkForce \"%1\";").arg(chosenKeyLayout)
+                                     << QString("services.xserver.xkb.variant = lib.mkForce \"%1\";").arg(chosenKeyVariant)
+                                     << "console.useXkbConfig = lib.mkDefault true;";
+                }
+                // Already in the live store; also lets compress-profile sample the real closure
+                if (prefetcher->state() == SystemPrefetcher::State::Done) plan.systemPath = prefetcher->systemPath();
+
+                InstallEngine *engine = new InstallEngine(this);
+                engine->setPlan(plan);
+                engine->buildDefaultGraph();
+
+                // A previous run on this drive stopped part way: offer to continue it
+                const QStringList completed = engine->resumableSteps();
+                bool resume = false;
+                if (!completed.isEmpty()) {
+                    const auto answer = QMessageBox::question(this, "Resume installation?",
+                        QString("A previous installation on %1 stopped after \"%2\". Continue it instead of starting over?")
+                            .arg(dryRun ? QString("the dry-run image") : currentDrivePath,
+                                 engine->step(completed.last()) ? engine->step(completed.last())->title : completed.last()),
+                        QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel, QMessageBox::Yes);
+                    if (answer == QMessageBox::Cancel) {
+                        engine->deleteLater();
+                        return;
+                    }
+                    resume = answer == QMessageBox::Yes;
+                }
+                if (!dryRun && !resume) {
+                    const auto answer = QMessageBox::warning(this, "Erase drive?",
+                        QString("All data on %1 will be erased. Continue?").arg(currentDrivePath),
+                        QMessageBox::Yes | QMessageBox::No, QMessageBox::No);
+                    if (answer != QMessageBox::Yes) {
+                        engine->deleteLater();
+                        return;
+                    }
+                }
+                engine->plan().resume = resume;
+
+                if (installEngine) installEngine->deleteLater();
+                installEngine = engine;
+
+                // Rebuild the step rows for this graph
+                QLayoutItem *child;
+                while ((child = stepsGrid->takeAt(0)) != nullptr) {
+                    if (child->widget()) child->widget()->deleteLater();
+                    delete child;
+                }
+                stepRows->clear();
+                int row = 0;
+                for (const InstallStep &s : installEngine->steps()) {
+                    QLabel *name = new QLabel(s.title);
+                    Theme::setRole(name, "stepName");
+                    StepRow r;
+                    r.state = new QLabel();
+                    Theme::setRole(r.state, "stepState");
+                    r.time = new QLabel();
+                    Theme::setRole(r.time, "detail");
+                    Theme::setTone(r.time, Theme::Tone::Muted);
+                    r.time->setAlignment(Qt::AlignRight | Qt::AlignVCenter);
+                    stepsGrid->addWidget(name, row, 0);
+                    stepsGrid->addWidget(r.state, row, 1);
+                    stepsGrid->addWidget(r.time, row, 2);
+                    stepRows->insert(s.id, r);
+                    updateRow(s);
+                    ++row;
+                }
+
+                logView->clear();
+                progressBar->setValue(0);
+                installStatus->setText(resume ? "Resuming the previous installation..."
+                                              : dryRun ? "Dry run in progress..." : "Installing NixlyOS...");
+                Theme::setTone(installStatus, Theme::Tone::Working);
+                startInstallBtn->setEnabled(false);
+                nixProgressLabel->hide();
+                dryRunBox->setEnabled(false);
+                eraseBox->setEnabled(false);
+                verifyBox->setEnabled(false);
+                passEdit->setEnabled(false);
+                passConfirm->setEnabled(false);
+                cancelInstallBtn->show();
+
+                installEngine->onStepChanged = updateRow;
+                installEngine->onLog = [=](const QString &stepId, const QString &line) {
+                    logView->appendPlainText(QString("[%1] %2").arg(stepId, line));
+                };
+                installEngine->onFinished = [=, this](bool ok, const QString &error) {
+                    installTick->stop();
+                    if (installEngine->plan().luks.calibrated) {
+                        luksParams = installEngine->plan().luks;
+                        encryptionLabel->setText("Encryption: " + luksParams.summary());
+                    }
+                    for (const InstallStep &s : installEngine->steps()) {
+                        updateRow(s);
+                        if (s.startedMs >= 0)
+                            logView->appendPlainText(QString("%1: %2 ms (started at %3 ms)").arg(s.id).arg(s.elapsedMs).arg(s.startedMs));
+                    }
+                    progressBar->setValue(ok ? 1000 : progressBar->value());
+                    if (!nixProgressLabel->isHidden()) nixProgressLabel->setText(installEngine->nixProgress().summary());
+                    QString cacheText = installEngine->localCache().summary();
+                    if (!installEngine->storeReuse().source.isEmpty()) cacheText += "\n" + installEngine->storeReuse().summary();
+                    if (substituterProxy) cacheText += "\n" + substituterProxy->summary();
+                    cacheLabel->setText(cacheText);
+                    const QString secs = QString::number(installEngine->elapsedMs() / 1000.0, 'f', 1);
+                    if (ok) {
+                        installStatus->setText(QString("%1 finished in %2 s.").arg(dryRun ? "Dry run" : "Installation", secs));
+                        Theme::setTone(installStatus, Theme::Tone::Ok);
+                    } else {
+                        installStatus->setText(error);
+                        Theme::setTone(installStatus, Theme::Tone::Error);
+                    }
+                    startInstallBtn->setEnabled(true);
+                    dryRunBox->setEnabled(true);
+                    eraseBox->setEnabled(true);
+                    verifyBox->setEnabled(true);
+                    passEdit->setEnabled(true);
+                    passConfirm->setEnabled(true);
+                    cancelInstallBtn->hide();
+                };
+                installTick->start();
+                installEngine->start();
+            });
+            return installPage;
+        });
         
         // Layout for content panel
         QVBoxLayout *contentLayout = new QVBoxLayout(contentPanel);
@@ -1959,11 +2581,9 @@ public:
                 [=, this](QAbstractButton* button) {
                     int index = menuButtonGroup->id(button);
                     // If navigating to Select Drive without a chosen branch, clone default
-                    if (index == 3) {
-                        if (repoCloneStarted && !*repoCloneStarted) {
-                            const QString defaultRepo = "https://github.com/aCeTotal/nixlyos_master.git";
-                            doClone(defaultRepo, QString());
-                        }
+                    if (index == 3 && !repoCloneStarted) {
+                        const QString defaultRepo = "https://github.com/aCeTotal/nixlyos_master.git";
+                        cloneConfiguration(defaultRepo, QString());
                     }
                     contentStack->setCurrentIndex(index);
                     
@@ -2014,6 +2634,15 @@ public:
             // Disable window decorations if your WM supports it
             windowHandle()->setFlag(Qt::FramelessWindowHint, false);
         }
+
+        // Only Welcome and Internet exist yet; the rest follow once the
+        // window is on screen
+        if (firstFrameSeen) return;
+        firstFrameSeen = true;
+        PageRegistry::onFirstFrame(this, [this]() {
+            qInfo("First frame %lld ms after start, %lld KiB resident", PageRegistry::msSinceProcessStart(), PageRegistry::rssKiB());
+            if (!QCoreApplication::arguments().contains("--no-idle-pages")) pages->buildRemainingWhenIdle();
+        });
     }
     
     bool eventFilter(QObject *obj, QEvent *event) override
@@ -2035,9 +2664,9 @@ public:
                         hoverTipLabel = new QLabel();
                         hoverTipLabel->setTextFormat(Qt::RichText);
                         hoverTipLabel->setWordWrap(true);
-                        hoverTipLabel->setStyleSheet("color: #e6e6e6; font-size: 14px;");
+                        Theme::setRole(hoverTipLabel, "item");
                         vl->addWidget(hoverTipLabel);
-                        hoverTip->setStyleSheet("background-color: #1e1e1e; border: 1px solid #3A3A3A; border-radius: 6px;");
+                        Theme::setRole(hoverTip, "tip");
                         hoverTip->setMinimumWidth(680);
                     }
                     hoverTipLabel->setText(text);
@@ -2053,13 +2682,13 @@ public:
                     if (!path.isEmpty()) {
                         // Deselect previous
                         if (currentDriveCard && currentDriveCard != w) {
-                            currentDriveCard->setStyleSheet("QFrame { background-color: transparent; border: none; border-bottom: 1px solid #3A3A3A; } QFrame:hover { background-color: #2A2A2A; }");
+                            Theme::setSelected(currentDriveCard, false);
                         }
                         // Select new
                         currentDriveCard = qobject_cast<QFrame*>(w);
                         currentDrivePath = path;
                         if (currentDriveCard) {
-                            currentDriveCard->setStyleSheet("QFrame { background-color: #2a3f5a; border: none; border-bottom: 1px solid #3A3A3A; }");
+                            Theme::setSelected(currentDriveCard, true);
                         }
                         if (driveSelectedHint) driveSelectedHint->setText(QString("Selected drive: %1").arg(path));
                         if (installButton) installButton->setEnabled(true);
@@ -2083,8 +2712,233 @@ public:
     }
 };
 
+// Roughly what substituting a 2000-path closure looks like, build output included
+static QByteArray syntheticNixLog()
+{
+    QByteArray log;
+    quint64 id = 1;
+    const quint64 realise = id++, copies = id++;
+    log += "@nix {\"action\":\"start\",\"id\":" + QByteArray::number(realise) + ",\"level\":0,\"parent\":0,\"text\":\"\",\"type\":102}\n";
+    log += "@nix {\"action\":\"start\",\"id\":" + QByteArray::number(copies) + ",\"level\":0,\"parent\":0,\"text\":\"\",\"type\":103}\n";
+    log += "@nix {\"action\":\"result\",\"fields\":[101,4000000000],\"id\":" + QByteArray::number(realise) + ",\"type\":106}\n";
+    for (int n = 0; n < 2000; ++n) {
+        const QByteArray path = "/nix/store/" + QByteArray::number(n).rightJustified(32, 'a') + "-pkg-" + QByteArray::number(n);
+        const QByteArray cp = QByteArray::number(id++), dl = QByteArray::number(id++);
+        log += "@nix {\"action\":\"start\",\"fields\":[\"" + path + "\",\"https://cache.nixos.org\",\"local\"],\"id\":" + cp
+             + ",\"level\":3,\"parent\":0,\"text\":\"copying path '" + path + "' from 'https://cache.nixos.org'\",\"type\":100}\n";
+        log += "@nix {\"action\":\"start\",\"fields\":[\"https://cache.nixos.org/nar/x.nar.xz\"],\"id\":" + dl
+             + ",\"level\":4,\"parent\":" + cp + ",\"text\":\"downloading 'https://cache.nixos.org/nar/x.nar.xz'\",\"type\":101}\n";
+        for (int k = 1; k <= 10; ++k) {
+            log += "@nix {\"action\":\"result\",\"fields\":[" + QByteArray::number(k * 200000) + ",2000000,0,0],\"id\":" + dl + ",\"type\":105}\n";
+            log += "@nix {\"action\":\"result\",\"fields\":[\"unpacking source archive\"],\"id\":" + cp + ",\"type\":101}\n";
+        }
+        log += "@nix {\"action\":\"stop\",\"id\":" + dl + "}\n";
+        log += "@nix {\"action\":\"stop\",\"id\":" + cp + "}\n";
+        log += "@nix {\"action\":\"result\",\"fields\":[" + QByteArray::number(n + 1) + ",2000,0,0],\"id\":" + QByteArray::number(copies) + ",\"type\":105}\n";
+    }
+    return log;
+}
+
+static int benchNixLog(const QString &file, int repeat)
+{
+    QByteArray log;
+    if (file.isEmpty()) {
+        log = syntheticNixLog();
+    } else {
+        QFile f(file);
+        if (!f.open(QIODevice::ReadOnly)) {
+            qCritical("Could not read %s", qPrintable(file));
+            return 1;
+        }
+        log = f.readAll();
+    }
+    const QList<QByteArray> lines = log.split('\n');
+    NixProgress progress;
+    QElapsedTimer timer;
+    timer.start();
+    for (int r = 0; r < repeat; ++r) {
+        progress.reset();
+        for (const QByteArray &line : lines) progress.feedLine(line);
+    }
+    const double secs = qMax(timer.nsecsElapsed() / 1e9, 1e-9);
+    const NixProgress::Snapshot snap = progress.snapshot();
+    printf("{\"lines\": %lld, \"bytes\": %lld, \"seconds\": %.3f, \"MBps\": %.1f, \"linesPerSec\": %.0f}\n",
+           qint64(lines.size()) * repeat, qint64(log.size()) * repeat, secs,
+           log.size() * double(repeat) / secs / 1e6, lines.size() * double(repeat) / secs);
+    printf("%s\n", qPrintable(snap.summary()));
+    return 0;
+}
+
+// Compiles the most common keyboard layouts one after another, uncached, as the
+// Settings page would on a first selection. Exit code 77 (skip) without
+// xkeyboard-config.
+static int benchKeymaps(int count)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QString error;
+    const QList<KeyboardLayouts::Layout> layouts = KeyboardLayouts::load(&error);
+    const double enumerateMs = timer.nsecsElapsed() / 1e6;
+    if (layouts.isEmpty()) {
+        qCritical("%s", qPrintable(error));
+        return 77;
+    }
+    QStringList available;
+    for (const KeyboardLayouts::Layout &l : layouts) available << l.name;
+    QStringList names;
+    for (const QString &n : KeyboardLayouts::popular()) {
+        if (available.contains(n) && names.size() < count) names << n;
+    }
+    for (const QString &n : std::as_const(available)) {
+        if (!names.contains(n) && names.size() < count) names << n;
+    }
+
+    QJsonObject perLayout;
+    QList<double> times;
+    for (const QString &n : std::as_const(names)) {
+        timer.restart();
+        if (!KeymapCache::compile(n, QString(), &error)) {
+            qCritical("%s", qPrintable(error));
+            return 1;
+        }
+        const double ms = timer.nsecsElapsed() / 1e6;
+        times << ms;
+        perLayout.insert(n, qRound(ms * 100) / 100.0);
+    }
+    std::sort(times.begin(), times.end());
+    double total = 0;
+    for (double t : std::as_const(times)) total += t;
+    auto pct = [&times](double p) { return times.at(qMin<qsizetype>(times.size() - 1, qsizetype(p * times.size()))); };
+    const QJsonObject result {
+        { "layoutsListed", int(layouts.size()) },
+        { "enumerateMs", enumerateMs },
+        { "compiled", int(times.size()) },
+        { "totalMs", total },
+        { "p50Ms", pct(0.50) },
+        { "p95Ms", pct(0.95) },
+        { "maxMs", times.last() },
+        { "perLayoutMs", perLayout } };
+    printf("%s", QJsonDocument(result).toJson().constData());
+    fprintf(stderr, "%lld keymaps: p50 %.1f ms, p95 %.1f ms, total %.0f ms\n",
+            qint64(times.size()), pct(0.50), pct(0.95), total);
+    return 0;
+}
+
+// Hashes store paths against their recorded narHash and prints the result as JSON.
+// Exit code 1 when anything mismatched or the check itself failed, 77 (skip)
+// only when there is no store to check: a root without a Nix database, or a
+// running system that is not NixOS.
+static int verifyStoreCommand()
+{
+    QString root = argumentValue("--verify-store");
+    if (root.isEmpty()) root = "/";
+    const QString prefix = root == "/" ? QString() : root;
+    if (!QFileInfo(prefix + "/nix/var/nix/db").isDir()) {
+        qCritical("No Nix store under %s", qPrintable(root));
+        return 77;
+    }
+    if (root == "/" && !QFileInfo::exists("/run/current-system")) {
+        qCritical("Not running NixOS: no /run/current-system");
+        return 77;
+    }
+    QStringList paths;
+    const QString path = argumentValue("--verify-path");
+    if (!path.isEmpty()) paths << path;
+    if (QCoreApplication::arguments().contains("--verify-portable")) Sha256::forcePortable(true);
+
+    StoreVerifier verifier;
+    verifier.threads = argumentValue("--verify-threads").toInt();
+    StoreVerifier::Result result;
+    QString error;
+    if (!verifier.verify(root, paths, {}, {}, &result, &error)) {
+        qCritical("%s", qPrintable(error));
+        return 1;
+    }
+    printf("%s", QJsonDocument(result.toJson()).toJson().constData());
+    fprintf(stderr, "%s\n", qPrintable(result.summary()));
+    return result.ok() ? 0 : 1;
+}
+
 int main(int argc, char *argv[])
 {
+    // Spans of the probes, processes, pages and install steps of this run,
+    // written as Chrome trace JSON when it exits (see tracer.h):
+    //   nixlyinstall --trace=/tmp/nixlyinstall-trace.json
+    for (int i = 1; i < argc; ++i) {
+        if (QByteArray(argv[i]).startsWith("--trace=")) Tracer::start(QString::fromLocal8Bit(argv[i] + 8));
+    }
+    // Whichever mode below runs, the trace is written on the way out
+    struct TraceWriter { ~TraceWriter() { Tracer::stop(); } } traceWriter;
+
+    // Headless caching proxy, e.g. on a provisioning box serving several installs:
+    //   nixlyinstall --serve-cache=/srv/nix-cache --substituter-proxy-listen=0.0.0.0:37515
+    // Installers then use --extra-substituter=http://<box>:37515
+    for (int i = 1; i < argc; ++i) {
+        if (!QByteArray(argv[i]).startsWith("--serve-cache=")) continue;
+        QCoreApplication core(argc, argv);
+        const QString upstream = argumentValue("--substituter-proxy-upstream");
+        SubstituterProxy proxy(argumentValue("--serve-cache"),
+                               upstream.isEmpty() ? QUrl("https://cache.nixos.org") : QUrl(upstream));
+        QString listenSpec = argumentValue("--substituter-proxy-listen");
+        if (listenSpec.isEmpty()) listenSpec = "0.0.0.0:37515";
+        if (!proxy.listen(listenSpec)) {
+            qCritical("Could not listen on %s: %s", qPrintable(listenSpec), qPrintable(proxy.errorString()));
+            return 1;
+        }
+        qInfo("Serving %s", qPrintable(proxy.cacheDir()));
+        return core.exec();
+    }
+
+    // Install pipeline benchmark on a loop device, see installbench.h
+    for (int i = 1; i < argc; ++i) {
+        if (QByteArray(argv[i]) != "--bench-install") continue;
+        QCoreApplication core(argc, argv);
+        return runInstallBenchmark(core.arguments().mid(1));
+    }
+
+    // Replays a recorded `nix build --log-format internal-json` log through the
+    // progress parser as fast as it goes; without a file a synthetic log is used:
+    //   nixlyinstall --bench-nix-log=build.log [--bench-repeat=20]
+    for (int i = 1; i < argc; ++i) {
+        if (!QByteArray(argv[i]).startsWith("--bench-nix-log")) continue;
+        QCoreApplication core(argc, argv);
+        return benchNixLog(argumentValue("--bench-nix-log"), qMax(1, argumentValue("--bench-repeat").toInt()));
+    }
+
+    // Keymap compile times for the Settings page's layout preview:
+    //   nixlyinstall --bench-keymaps[=50]
+    for (int i = 1; i < argc; ++i) {
+        if (!QByteArray(argv[i]).startsWith("--bench-keymaps")) continue;
+        QCoreApplication core(argc, argv);
+        const int count = argumentValue("--bench-keymaps").toInt();
+        return benchKeymaps(count > 0 ? count : 50);
+    }
+
+    // Standalone check of an installed (or the running) store:
+    //   nixlyinstall --verify-store=/mnt [--verify-path=/nix/store/...-nixos-system-...]
+    //                [--verify-threads=N] [--verify-portable]
+    for (int i = 1; i < argc; ++i) {
+        if (!QByteArray(argv[i]).startsWith("--verify-store")) continue;
+        QCoreApplication core(argc, argv);
+        return verifyStoreCommand();
+    }
+
+    // Welcome to Install on the offscreen platform against stand-in backends,
+    // timing every page switch, see wizardbench.h:
+    //   nixlyinstall --benchmark [--benchmark-runs=10] [--benchmark-latency=50]
+    for (int i = 1; i < argc; ++i) {
+        if (QByteArray(argv[i]) != "--benchmark") continue;
+        return runWizardBenchmark(argc, argv, []() -> QWidget* { return new MainWindow(); });
+    }
+
+    // Live ISO without a desktop session: the installer as the only client of
+    // its own compositor on DRM/KMS, see kioskcompositor.h:
+    //   nixlyinstall --kiosk [--kiosk-platform=wayland]
+    for (int i = 1; i < argc; ++i) {
+        if (QByteArray(argv[i]) != "--kiosk") continue;
+        return runKiosk(argc, argv);
+    }
+
     // We need to set these environment variables before QApplication is created
     
     // Always use Wayland platform if available; otherwise fall back to XCB
@@ -2111,10 +2965,13 @@ int main(int argc, char *argv[])
     app.setApplicationDisplayName("NixlyCC");
     app.setApplicationVersion("0.1");
     app.setDesktopFileName("nixlycc");
+    Theme::install(app);
     
     // Create and show the main window
     MainWindow window;
     window.show();
+    // Debug builds: abort when the GUI thread stalls, see backend.h
+    Backend::startWatchdog();
     
     return app.exec();
 }
@@ -0,0 +1,186 @@
+#include "memorybudget.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/swap.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr qint64 kGiB = 1LL << 30;
+// Evaluating a NixOS system alone peaks around 1.5 GiB
+constexpr qint64 kEvalBytes = 2 * kGiB;
+constexpr qint64 kMaxSwapBytes = 8 * kGiB;
+constexpr long kBtrfsMagic = 0x9123683E;
+
+// "MemAvailable:    3785472 kB" -> bytes
+qint64 meminfoValue(const QByteArray &key)
+{
+    QFile f("/proc/meminfo");
+    if (!f.open(QIODevice::ReadOnly)) return 0;
+    for (const QByteArray &line : f.readAll().split('\n')) {
+        if (!line.startsWith(key + ':')) continue;
+        return line.mid(key.size() + 1).simplified().split(' ').value(0).toLongLong() * 1024;
+    }
+    return 0;
+}
+
+// Our own cgroup v2 directory, e.g. /sys/fs/cgroup/user.slice/...
+QString cgroupDir()
+{
+    QFile f("/proc/self/cgroup");
+    if (!f.open(QIODevice::ReadOnly)) return QString();
+    for (const QByteArray &line : f.readAll().split('\n')) {
+        if (line.startsWith("0::")) return "/sys/fs/cgroup" + QString::fromUtf8(line.mid(3)).trimmed();
+    }
+    return QString();
+}
+
+qint64 cgroupValue(const QString &file)
+{
+    const QString dir = cgroupDir();
+    if (dir.isEmpty()) return 0;
+    QFile f(dir + "/" + file);
+    if (!f.open(QIODevice::ReadOnly)) return 0;
+    // "max" reads as 0: unlimited
+    return f.readAll().trimmed().toLongLong();
+}
+
+QString mib(qint64 bytes)
+{
+    return QString("%1 MiB").arg(bytes >> 20);
+}
+
+} // namespace
+
+qint64 MemoryBudget::Assessment::available() const
+{
+    if (cgroupLimit <= 0) return memAvailable;
+    return qMin(memAvailable, qMax<qint64>(0, cgroupLimit - cgroupUsage));
+}
+
+qint64 MemoryBudget::Assessment::required() const
+{
+    // Sources unpacked during builds and parallel downloads grow with the closure
+    return kEvalBytes + qMin(closureBytes / 8, 6 * kGiB);
+}
+
+qint64 MemoryBudget::Assessment::swapBytes() const
+{
+    if (!constrained()) return 0;
+    const qint64 missing = required() - available() + kGiB;
+    return qMin(kMaxSwapBytes, qMax(2 * kGiB, (missing + kGiB - 1) / kGiB * kGiB));
+}
+
+QString MemoryBudget::Assessment::summary() const
+{
+    QString s = QString("%1 available").arg(mib(available()));
+    if (cgroupLimit > 0) s += QString(" (cgroup limit %1)").arg(mib(cgroupLimit));
+    s += QString(", %1 needed for a %2%3 system")
+             .arg(mib(required()), mib(closureBytes), closureEstimated ? " (estimated)" : "");
+    return s;
+}
+
+MemoryBudget::Assessment MemoryBudget::assess(const QString &systemPath)
+{
+    Assessment a;
+    a.memAvailable = meminfoValue("MemAvailable");
+    a.cgroupLimit = cgroupValue("memory.max");
+    a.cgroupUsage = cgroupValue("memory.current");
+    a.closureBytes = kDefaultClosureBytes;
+    a.closureEstimated = true;
+    if (!systemPath.isEmpty() && QFileInfo::exists(systemPath)) {
+        // "/nix/store/...-nixos-system-...   8123456789"
+        QProcess p;
+        p.start("nix", { "path-info", "--extra-experimental-features", "nix-command", "--closure-size", systemPath });
+        if (p.waitForFinished(60000) && p.exitCode() == 0) {
+            const qint64 size = QString::fromUtf8(p.readAllStandardOutput()).simplified().section(' ', -1).toLongLong();
+            if (size > 0) {
+                a.closureBytes = size;
+                a.closureEstimated = false;
+            }
+        }
+    }
+    return a;
+}
+
+QStringList MemoryBudget::nixOptions(const Assessment &a)
+{
+    if (!a.constrained()) return {};
+    // One build at a time, and 16 MiB per download instead of 64
+    return { "max-jobs", "1", "download-buffer-size", QString::number(16 << 20) };
+}
+
+bool MemoryBudget::addSwapFile(const QString &path, qint64 bytes, QString *error)
+{
+    removeSwapFile(path);
+    const QByteArray file = QFile::encodeName(path);
+    const int fd = ::open(file.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        *error = QString("Could not create %1: %2").arg(path, QString::fromLocal8Bit(strerror(errno)));
+        return false;
+    }
+    struct statfs fs;
+    if (::fstatfs(fd, &fs) == 0 && fs.f_type == kBtrfsMagic) {
+        // Swap on btrfs must be NOCOW, which also keeps it uncompressed; only
+        // an empty file can change that
+        int flags = 0;
+        if (::ioctl(fd, FS_IOC_GETFLAGS, &flags) == 0) {
+            flags |= FS_NOCOW_FL;
+            flags &= ~FS_COMPR_FL;
+            ::ioctl(fd, FS_IOC_SETFLAGS, &flags);
+        }
+    }
+    const int err = ::posix_fallocate(fd, 0, bytes);
+    ::close(fd);
+    if (err != 0) {
+        *error = QString("Could not allocate %1 for swap: %2").arg(mib(bytes), QString::fromLocal8Bit(strerror(err)));
+        ::unlink(file.constData());
+        return false;
+    }
+    QProcess mkswap;
+    mkswap.setProcessChannelMode(QProcess::MergedChannels);
+    mkswap.start("mkswap", { path });
+    if (!mkswap.waitForFinished(60000) || mkswap.exitCode() != 0) {
+        *error = "mkswap failed: " + QString::fromUtf8(mkswap.readAll()).trimmed();
+        ::unlink(file.constData());
+        return false;
+    }
+    if (::swapon(file.constData(), 0) != 0) {
+        *error = QString("swapon %1 failed: %2").arg(path, QString::fromLocal8Bit(strerror(errno)));
+        ::unlink(file.constData());
+        return false;
+    }
+    return true;
+}
+
+void MemoryBudget::removeSwapFile(const QString &path)
+{
+    const QByteArray file = QFile::encodeName(path);
+    ::swapoff(file.constData());
+    ::unlink(file.constData());
+}
+
+QString MemoryBudget::peakSummary()
+{
+    // ru_maxrss is in KiB; for children it is the largest single one reaped
+    rusage self {}, children {};
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    QString s = QString("Peak RSS: installer %1, largest child %2")
+                    .arg(mib(qint64(self.ru_maxrss) * 1024), mib(qint64(children.ru_maxrss) * 1024));
+    const qint64 cgroupPeak = cgroupValue("memory.peak");
+    if (cgroupPeak > 0) s += QString(", cgroup peak %1").arg(mib(cgroupPeak));
+    const qint64 swapUsed = meminfoValue("SwapTotal") - meminfoValue("SwapFree");
+    if (swapUsed > 0) s += QString(", swap in use %1").arg(mib(swapUsed));
+    return s;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+
+// Keeps the build from running the live session out of memory. On the ISO,
+// /tmp and the Nix build directory are tmpfs, so every unpacked source and
+// build tree costs RAM. Once the target is mounted, scratch moves to the
+// target filesystem. When what is left is still tight for the closure being
+// installed, Nix is told to build one job at a time with small download
+// buffers, and a temporary swap file is added on the target.
+class MemoryBudget
+{
+public:
+    struct Assessment {
+        qint64 memAvailable = 0;        // /proc/meminfo MemAvailable
+        qint64 cgroupLimit = 0;         // memory.max of our cgroup, 0 when unlimited
+        qint64 cgroupUsage = 0;
+        qint64 closureBytes = 0;        // expected system size, estimated when unknown
+        bool closureEstimated = false;
+
+        // The tighter of MemAvailable and the cgroup's headroom
+        qint64 available() const;
+        // What evaluation plus a build of this closure needs in memory
+        qint64 required() const;
+        bool constrained() const { return available() < required(); }
+        // Swap to add, whole GiB; 0 when memory suffices
+        qint64 swapBytes() const;
+        QString summary() const;
+    };
+
+    // Used when the system is not in the live store yet to be measured
+    static constexpr qint64 kDefaultClosureBytes = 8LL << 30;
+
+    // `systemPath` may be empty or not yet realised.
+    static Assessment assess(const QString &systemPath);
+
+    // Nix options (name, value pairs) for a constrained session.
+    static QStringList nixOptions(const Assessment &a);
+
+    // Creates and enables `path` as swap of `bytes` (btrfs needs it NOCOW and
+    // uncompressed). Blocking.
+    static bool addSwapFile(const QString &path, qint64 bytes, QString *error);
+    // Disables and removes it again; harmless when it does not exist.
+    static void removeSwapFile(const QString &path);
+
+    // Peak resident memory of the installer and its largest child, the
+    // cgroup's peak (memory.peak) and the swap in use right now.
+    static QString peakSummary();
+};
@@ -0,0 +1,182 @@
+#include "nixprogress.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QStringList>
+
+// Throughput is averaged over this window so one slow NAR doesn't swing the ETA
+static constexpr qint64 kRateWindowMs = 5000;
+
+double NixProgress::Snapshot::fraction() const
+{
+    // Bytes are the best measure of remaining work; fall back to path counts
+    if (copyExpected > 0) return qBound(0.0, double(copyDone) / copyExpected, 1.0);
+    if (downloadExpected > 0) return qBound(0.0, double(downloadDone) / downloadExpected, 1.0);
+    const qint64 expected = pathsExpected + buildsExpected;
+    if (expected > 0) return qBound(0.0, double(pathsDone + buildsDone) / expected, 1.0);
+    return 0.0;
+}
+
+QString NixProgress::Snapshot::summary() const
+{
+    auto mib = [](qint64 b) { return QString::number(b / (1024.0 * 1024.0), 'f', 1); };
+    QStringList parts;
+    if (pathsExpected > 0) parts << QString("%1/%2 paths fetched").arg(pathsDone).arg(pathsExpected);
+    if (buildsExpected > 0) parts << QString("%1/%2 built").arg(buildsDone).arg(buildsExpected);
+    if (downloadExpected > 0 || downloadDone > 0)
+        parts << QString("%1/%2 MiB downloaded").arg(mib(downloadDone), mib(qMax(downloadDone, downloadExpected)));
+    if (bytesPerSec > 0) parts << QString("%1 MiB/s").arg(bytesPerSec / (1024.0 * 1024.0), 0, 'f', 1);
+    if (etaSecs >= 0) parts << QString("about %1:%2 left").arg(etaSecs / 60).arg(etaSecs % 60, 2, 10, QChar('0'));
+    return parts.isEmpty() ? QString("Evaluating...") : parts.join(", ");
+}
+
+NixProgress::NixProgress()
+{
+    clock_.start();
+}
+
+void NixProgress::reset()
+{
+    activities_.clear();
+    byType_.clear();
+    currentActivity_.clear();
+    lastError_.clear();
+    lines_ = 0;
+    samples_.clear();
+    clock_.restart();
+}
+
+void NixProgress::feedLine(const QByteArray &raw)
+{
+    QByteArray line = raw.trimmed();
+    if (!line.startsWith("@nix ")) return;
+    ++lines_;
+    // Build log lines (resBuildLogLine, resPostBuildLogLine) dominate large
+    // logs and carry nothing we aggregate. Nix serialises keys in sorted order,
+    // so "action" comes first and "type" last; start events of file transfers
+    // and path verification end in the same type numbers and must get through.
+    static const QByteArray resultPrefix = "@nix {\"action\":\"result\"";
+    if (line.startsWith(resultPrefix) && (line.endsWith("\"type\":101}") || line.endsWith("\"type\":107}"))) return;
+
+    const QJsonObject o = QJsonDocument::fromJson(line.mid(5)).object();
+    const QString action = o.value("action").toString();
+    const quint64 id = quint64(o.value("id").toDouble());
+    const QJsonArray fields = o.value("fields").toArray();
+
+    if (action == "start") {
+        Activity a;
+        a.type = o.value("type").toInt();
+        a.parent = quint64(o.value("parent").toDouble());
+        activities_.insert(id, a);
+        byType_[a.type].ids.append(id);
+        const QString text = o.value("text").toString();
+        if (!text.isEmpty()) currentActivity_ = text;
+    } else if (action == "stop") {
+        auto it = activities_.find(id);
+        if (it == activities_.end()) return;
+        // Keep the finished activity's counters in the per-type totals
+        ByType &t = byType_[it->type];
+        t.done += it->done;
+        t.failed += it->failed;
+        t.ids.removeOne(id);
+        for (auto e = it->expectedByType.constBegin(); e != it->expectedByType.constEnd(); ++e)
+            byType_[e.key()].expected -= e.value();
+        const int type = it->type;
+        activities_.erase(it);
+        if (type == actFileTransfer || type == actCopyPath)
+            sample(totals(actFileTransfer).done + totals(actCopyPath).done);
+    } else if (action == "result") {
+        auto it = activities_.find(id);
+        if (it == activities_.end()) return;
+        const int type = o.value("type").toInt();
+        if (type == resProgress && fields.size() >= 4) {
+            it->done = qint64(fields.at(0).toDouble());
+            it->expected = qint64(fields.at(1).toDouble());
+            it->running = qint64(fields.at(2).toDouble());
+            it->failed = qint64(fields.at(3).toDouble());
+            if (it->type == actFileTransfer || it->type == actCopyPath)
+                sample(totals(actFileTransfer).done + totals(actCopyPath).done);
+        } else if (type == resSetExpected && fields.size() >= 2) {
+            const int of = fields.at(0).toInt();
+            const qint64 n = qint64(fields.at(1).toDouble());
+            qint64 &slot = it->expectedByType[of];
+            byType_[of].expected += n - slot;
+            slot = n;
+        } else if (type == resSetPhase && !fields.isEmpty()) {
+            currentActivity_ = fields.at(0).toString();
+        }
+    } else if (action == "msg") {
+        // level 0 is lvlError
+        if (o.value("level").toInt() == 0) lastError_ = o.value("msg").toString();
+    }
+}
+
+QString NixProgress::messageText(const QByteArray &raw)
+{
+    const QByteArray line = raw.trimmed();
+    if (!line.startsWith("@nix ") || !line.contains("\"action\":\"msg\"")) return QString();
+    const QJsonObject o = QJsonDocument::fromJson(line.mid(5)).object();
+    // lvlError = 0 ... lvlInfo = 3; -v also sends talkative (4) messages
+    if (o.value("level").toInt() > 3) return QString();
+    static const QRegularExpression ansi("\x1b\\[[0-9;]*[A-Za-z]");
+    return o.value("msg").toString().remove(ansi).trimmed();
+}
+
+NixProgress::Totals NixProgress::totals(int type) const
+{
+    Totals r;
+    const auto bt = byType_.constFind(type);
+    if (bt == byType_.constEnd()) return r;
+    r.done = bt->done;
+    qint64 expected = bt->done;
+    for (quint64 id : bt->ids) {
+        const auto a = activities_.constFind(id);
+        if (a == activities_.constEnd()) continue;
+        r.done += a->done;
+        expected += a->expected;
+        r.running += a->running;
+    }
+    // Parents (Realise) announce the whole amount up front
+    r.expected = qMax(expected, bt->expected);
+    return r;
+}
+
+void NixProgress::sample(qint64 bytes)
+{
+    const qint64 now = clock_.elapsed();
+    samples_.append({ now, bytes });
+    while (samples_.size() > 2 && now - samples_.first().first > kRateWindowMs) samples_.removeFirst();
+}
+
+NixProgress::Snapshot NixProgress::snapshot() const
+{
+    Snapshot s;
+    const Totals builds = totals(actBuilds);
+    const Totals paths = totals(actCopyPaths);
+    const Totals dl = totals(actFileTransfer);
+    const Totals copy = totals(actCopyPath);
+    s.buildsDone = builds.done;
+    s.buildsExpected = builds.expected;
+    s.buildsRunning = builds.running;
+    s.pathsDone = paths.done;
+    s.pathsExpected = paths.expected;
+    s.pathsRunning = paths.running;
+    s.downloadDone = dl.done;
+    s.downloadExpected = dl.expected;
+    s.copyDone = copy.done;
+    s.copyExpected = copy.expected;
+    s.currentActivity = currentActivity_;
+    s.lastError = lastError_;
+    s.linesParsed = lines_;
+
+    if (samples_.size() >= 2) {
+        const auto &a = samples_.first();
+        const auto &b = samples_.last();
+        if (b.first > a.first) s.bytesPerSec = (b.second - a.second) * 1000.0 / (b.first - a.first);
+    }
+    const qint64 remaining = qMax<qint64>(0, dl.expected - dl.done) + qMax<qint64>(0, copy.expected - copy.done);
+    if (s.bytesPerSec > 0 && remaining > 0) s.etaSecs = qint64(remaining / s.bytesPerSec);
+    return s;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+// Aggregates Nix's `--log-format internal-json` stream ("@nix {...}" lines)
+// the same way Nix's own progress bar does: per activity type, the done and
+// expected counters of running activities plus those of stopped ones, with
+// expectations announced by parents via resSetExpected. Feeding lines is
+// cheap; the UI reads snapshot() on its own timer.
+class NixProgress
+{
+public:
+    // Activity and result types from libutil/logging.hh
+    enum ActivityType {
+        actCopyPath = 100, actFileTransfer = 101, actRealise = 102, actCopyPaths = 103,
+        actBuilds = 104, actBuild = 105, actOptimiseStore = 106, actVerifyPaths = 107,
+        actSubstitute = 108, actQueryPathInfo = 109, actPostBuildHook = 110, actBuildWaiting = 111,
+    };
+    enum ResultType {
+        resFileLinked = 100, resBuildLogLine = 101, resUntrustedPath = 102, resCorruptedPath = 103,
+        resSetPhase = 104, resProgress = 105, resSetExpected = 106, resPostBuildLogLine = 107,
+    };
+
+    struct Snapshot {
+        qint64 buildsDone = 0, buildsExpected = 0, buildsRunning = 0;
+        qint64 pathsDone = 0, pathsExpected = 0, pathsRunning = 0;
+        qint64 downloadDone = 0, downloadExpected = 0;      // bytes
+        qint64 copyDone = 0, copyExpected = 0;              // NAR bytes
+        double bytesPerSec = 0.0;
+        qint64 etaSecs = -1;
+        QString currentActivity;
+        QString lastError;
+        qint64 linesParsed = 0;
+
+        double fraction() const;
+        QString summary() const;
+    };
+
+    NixProgress();
+
+    // One line of output, with or without the "@nix " prefix check.
+    void feedLine(const QByteArray &line);
+    void feedLine(const QString &line) { feedLine(line.toUtf8()); }
+    Snapshot snapshot() const;
+    void reset();
+
+    // Text of a "msg" line at info level or more important, without colour
+    // codes; empty for everything else.
+    static QString messageText(const QByteArray &line);
+
+private:
+    struct Activity {
+        int type = 0;
+        quint64 parent = 0;
+        qint64 done = 0, expected = 0, running = 0, failed = 0;
+        QHash<int, qint64> expectedByType;
+    };
+    struct ByType {
+        qint64 done = 0, expected = 0, failed = 0;     // stopped activities and announced totals
+        QList<quint64> ids;
+    };
+    struct Totals { qint64 done = 0, expected = 0, running = 0; };
+
+    Totals totals(int type) const;
+    void sample(qint64 bytes);
+
+    QHash<quint64, Activity> activities_;
+    QHash<int, ByType> byType_;
+    QString currentActivity_;
+    QString lastError_;
+    qint64 lines_ = 0;
+    QElapsedTimer clock_;
+    QList<QPair<qint64, qint64>> samples_;  // (ms, bytes) over the last few seconds
+};
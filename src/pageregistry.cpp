@@ -0,0 +1,189 @@
+#include "pageregistry.h"
+#include "tracer.h"
+
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QFile>
+#include <QStackedWidget>
+#include <QTimer>
+#include <QVBoxLayout>
+#include <QWidget>
+#include <QWindow>
+
+#include <ctime>
+#include <unistd.h>
+
+namespace {
+
+// Removes itself after the first exposure of the window it watches
+class FirstFrameFilter : public QObject
+{
+public:
+    FirstFrameFilter(QWindow *window, std::function<void()> done)
+        : QObject(window), window_(window), done_(std::move(done))
+    {
+        window->installEventFilter(this);
+    }
+
+    bool eventFilter(QObject *obj, QEvent *event) override
+    {
+        if (obj == window_ && event->type() == QEvent::Expose && window_->isExposed()) {
+            window_->removeEventFilter(this);
+            // Widgets paint and flush inside the expose handler; queue behind it
+            QTimer::singleShot(0, window_, done_);
+            deleteLater();
+        }
+        return QObject::eventFilter(obj, event);
+    }
+
+private:
+    QWindow *window_;
+    std::function<void()> done_;
+};
+
+} // namespace
+
+PageRegistry::PageRegistry(QStackedWidget *stack)
+    : stack_(stack)
+{
+    connection_ = QObject::connect(stack, &QStackedWidget::currentChanged, stack, [this](int index) { currentChanged(index); });
+}
+
+PageRegistry::~PageRegistry()
+{
+    QObject::disconnect(connection_);
+}
+
+int PageRegistry::add(const QString &name, Builder build)
+{
+    Page page;
+    page.name = name;
+    page.build = std::move(build);
+    page.container = new QWidget();
+    QVBoxLayout *layout = new QVBoxLayout(page.container);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->setSpacing(0);
+    // Before addWidget: the first page added becomes current right away
+    pages_.append(page);
+    return stack_->addWidget(page.container);
+}
+
+int PageRegistry::addBuilt(const QString &name, QWidget *page, const Hooks &hooks)
+{
+    Page p;
+    p.name = name;
+    p.hooks = hooks;
+    p.container = page;
+    p.built = true;
+    pages_.append(p);
+    return stack_->addWidget(page);
+}
+
+bool PageRegistry::isBuilt(int index) const
+{
+    return index >= 0 && index < pages_.size() && pages_.at(index).built;
+}
+
+void PageRegistry::ensureBuilt(int index)
+{
+    if (index >= 0 && index < pages_.size() && !pages_.at(index).built) build(index, true);
+}
+
+void PageRegistry::build(int index, bool onDemand)
+{
+    Page &page = pages_[index];
+    page.built = true;
+    NIXLY_TRACE_SCOPE("page", "build " + page.name);
+    const qint64 rssBefore = rssKiB();
+    QElapsedTimer timer;
+    timer.start();
+    QWidget *content = page.build(page.hooks);
+    page.container->layout()->addWidget(content);
+    page.build = nullptr;
+    Timing t;
+    t.name = page.name;
+    t.buildMs = timer.nsecsElapsed() / 1e6;
+    // Would otherwise happen on first show; doing it here keeps it in the
+    // idle pass and makes the style's share measurable
+    timer.restart();
+    content->ensurePolished();
+    t.polishMs = timer.nsecsElapsed() / 1e6;
+    t.rssKiB = rssKiB() - rssBefore;
+    t.builtAtMs = msSinceProcessStart();
+    t.onDemand = onDemand;
+    timings_.append(t);
+    qInfo("Page %s built in %.1f ms, polished in %.1f ms, %+lld KiB (%s)", qPrintable(t.name), t.buildMs, t.polishMs,
+          t.rssKiB, onDemand ? "on navigation" : "while idle");
+}
+
+void PageRegistry::currentChanged(int index)
+{
+    if (current_ >= 0 && current_ < pages_.size() && current_ != index && pages_.at(current_).hooks.hidden)
+        pages_.at(current_).hooks.hidden();
+    current_ = index;
+    if (index < 0 || index >= pages_.size()) return;
+    NIXLY_TRACE_SCOPE("page", "show " + pages_.at(index).name);
+    ensureBuilt(index);
+    if (pages_.at(index).hooks.shown) pages_.at(index).hooks.shown();
+}
+
+void PageRegistry::buildRemainingWhenIdle()
+{
+    if (idleScheduled_) return;
+    idleScheduled_ = true;
+    QTimer::singleShot(0, stack_, [this]() { buildNextIdle(); });
+}
+
+void PageRegistry::buildNextIdle()
+{
+    for (int i = 0; i < pages_.size(); ++i) {
+        if (pages_.at(i).built) continue;
+        build(i, false);
+        // One page per pass: input queued meanwhile is handled before the next
+        QTimer::singleShot(0, stack_, [this]() { buildNextIdle(); });
+        return;
+    }
+    double build = 0.0, polish = 0.0;
+    for (const Timing &t : std::as_const(timings_)) {
+        build += t.buildMs;
+        polish += t.polishMs;
+    }
+    qInfo("All pages built %lld ms after start, %.1f ms of construction, %.1f ms of polish, %lld KiB resident",
+          msSinceProcessStart(), build, polish, rssKiB());
+}
+
+void PageRegistry::onFirstFrame(QWidget *window, std::function<void()> done)
+{
+    QWindow *handle = window->windowHandle();
+    if (!handle) {
+        QTimer::singleShot(0, window, std::move(done));
+        return;
+    }
+    new FirstFrameFilter(handle, std::move(done));
+}
+
+qint64 PageRegistry::rssKiB()
+{
+    // "size resident shared ..." in pages
+    QFile f("/proc/self/statm");
+    if (!f.open(QIODevice::ReadOnly)) return -1;
+    const QList<QByteArray> fields = f.readAll().split(' ');
+    if (fields.size() < 2) return -1;
+    return fields.at(1).toLongLong() * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+qint64 PageRegistry::msSinceProcessStart()
+{
+    // Field 22 of /proc/self/stat, in clock ticks since boot; the command name
+    // before it may contain spaces, so count from its closing parenthesis
+    QFile f("/proc/self/stat");
+    if (!f.open(QIODevice::ReadOnly)) return -1;
+    const QByteArray stat = f.readAll();
+    const QList<QByteArray> fields = stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+    if (fields.size() < 20) return -1;
+    const qint64 startTicks = fields.at(19).toLongLong();
+    timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    const qint64 nowMs = qint64(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+    return nowMs - startTicks * 1000 / sysconf(_SC_CLK_TCK);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QList>
+#include <QMetaObject>
+#include <QString>
+#include <functional>
+
+class QStackedWidget;
+class QWidget;
+
+// Builds the wizard's pages on demand instead of all in MainWindow's
+// constructor. Every page gets a placeholder in the stack at a fixed index;
+// its builder runs the first time the page becomes current or, after the
+// window's first frame, in the idle time between events, one page per pass.
+// Work a page does in the background (scans, polls, calibrations) belongs in
+// its shown/hidden hooks, so nothing runs before the page is wanted.
+//
+// Build and polish costs, the memory each page adds and the first-frame time
+// go to the log and timings().
+class PageRegistry
+{
+public:
+    struct Hooks {
+        std::function<void()> shown;    // each time the page becomes current
+        std::function<void()> hidden;   // each time another page replaces it
+    };
+    using Builder = std::function<QWidget*(Hooks &hooks)>;
+
+    struct Timing {
+        QString name;
+        double buildMs = 0.0;
+        double polishMs = 0.0;          // matching the page against the style
+        qint64 rssKiB = 0;              // resident set growth over both
+        qint64 builtAtMs = 0;           // since the process started
+        bool onDemand = false;          // by navigation, not while idle
+    };
+
+    explicit PageRegistry(QStackedWidget *stack);
+    ~PageRegistry();
+
+    // Both return the page's index in the stack.
+    int add(const QString &name, Builder build);
+    int addBuilt(const QString &name, QWidget *page, const Hooks &hooks = Hooks());
+
+    bool isBuilt(int index) const;
+    void ensureBuilt(int index);
+    void buildRemainingWhenIdle();
+    const QList<Timing> &timings() const { return timings_; }
+
+    // `done` runs once `window` has been exposed and painted for the first time.
+    static void onFirstFrame(QWidget *window, std::function<void()> done);
+    // From the kernel's process start time, so it includes loading Qt
+    // itself; 10 ms resolution.
+    static qint64 msSinceProcessStart();
+    // Resident set size from /proc/self/statm; -1 if unavailable
+    static qint64 rssKiB();
+
+private:
+    struct Page {
+        QString name;
+        Builder build;
+        Hooks hooks;
+        QWidget *container = nullptr;
+        bool built = false;
+    };
+
+    void build(int index, bool onDemand);
+    void currentChanged(int index);
+    void buildNextIdle();
+
+    QStackedWidget *stack_;
+    QList<Page> pages_;
+    QList<Timing> timings_;
+    int current_ = -1;
+    bool idleScheduled_ = false;
+    QMetaObject::Connection connection_;
+};
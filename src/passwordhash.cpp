@@ -0,0 +1,133 @@
+#include "passwordhash.h"
+
+#include <QElapsedTimer>
+#include <QRegularExpression>
+
+#include <cmath>
+#include <crypt.h>
+#include <memory>
+#include <string.h>
+#include <unistd.h>
+
+namespace {
+
+// One hash of a throwaway password, in milliseconds; negative on failure
+double timeOne(const QByteArray &prefix, int cost, QString *error)
+{
+    PasswordHashParams p;
+    p.scheme = prefix == "$y$" ? "yescrypt" : "sha512crypt";
+    p.cost = cost;
+    QElapsedTimer timer;
+    timer.start();
+    if (PasswordHasher::hash("calibration-password", p, error).isEmpty()) return -1.0;
+    return timer.nsecsElapsed() / 1e6;
+}
+
+// yescrypt takes 16 MiB at cost 5 and twice that per step, 1 GiB at 11.
+// Logins and sudo hash concurrently on the installed machine, so one hash
+// gets at most 1/32 of its RAM and never more than 128 MiB (cost 8).
+int maxYescryptCost()
+{
+    const long pages = sysconf(_SC_PHYS_PAGES);
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    int cost = 8;
+    if (pages > 0 && pageSize > 0) {
+        const qint64 perHash = qint64(pages) * pageSize / 32;
+        while (cost > 3 && (qint64(1) << (cost + 19)) > perHash) --cost;
+    }
+    return cost;
+}
+
+} // namespace
+
+QString PasswordHashParams::summary() const
+{
+    const QString name = scheme == "yescrypt" ? QString("yescrypt cost %1").arg(cost)
+                                              : QString("SHA-512-crypt %1 rounds").arg(cost);
+    return QString("%1, %2 ms per hash (target %3 ms)").arg(name).arg(measuredMs, 0, 'f', 0).arg(targetMs);
+}
+
+QJsonObject PasswordHashParams::toJson() const
+{
+    return QJsonObject {
+        { "scheme", scheme }, { "cost", cost }, { "targetMs", targetMs },
+        { "measuredMs", measuredMs }, { "calibrationMs", calibrationMs },
+        { "calibrated", calibrated } };
+}
+
+QByteArray PasswordHasher::hash(const QByteArray &password, const PasswordHashParams &params, QString *error)
+{
+    char setting[CRYPT_GENSALT_OUTPUT_SIZE];
+    // Random salt from the kernel when rbytes is null
+    if (!crypt_gensalt_rn(params.prefix().constData(), static_cast<unsigned long>(params.cost), nullptr, 0,
+                          setting, sizeof setting)) {
+        *error = QString("crypt_gensalt %1 cost %2: %3").arg(params.scheme).arg(params.cost).arg(strerror(errno));
+        return QByteArray();
+    }
+    // About 32 KiB; keep it off the worker's stack
+    auto data = std::make_unique<crypt_data>();
+    memset(data.get(), 0, sizeof(crypt_data));
+    const QByteArray phrase = password + '\0';
+    const char *out = crypt_rn(phrase.constData(), setting, data.get(), sizeof(crypt_data));
+    QByteArray result;
+    // Failures are "*" followed by anything
+    if (out && out[0] != '*') result = QByteArray(out);
+    else *error = QString("crypt %1 failed").arg(params.scheme);
+    // The plaintext passed through these buffers
+    explicit_bzero(data.get(), sizeof(crypt_data));
+    explicit_bzero(const_cast<char*>(phrase.constData()), size_t(phrase.size()));
+    return result;
+}
+
+PasswordHashParams PasswordHasher::calibrate(int targetMs, QStringList *log)
+{
+    QElapsedTimer timer;
+    timer.start();
+    PasswordHashParams p;
+    p.targetMs = targetMs;
+    QString error;
+
+    // yescrypt at cost 5 is libxcrypt's default; each step doubles it
+    double ms = timeOne("$y$", 5, &error);
+    if (ms > 0) {
+        p.scheme = "yescrypt";
+        const int steps = int(std::floor(std::log2(targetMs / ms)));
+        const int maxCost = maxYescryptCost();
+        p.cost = qBound(3, 5 + steps, maxCost);
+        if (log) *log << QString("yescrypt cost 5: %1 ms").arg(ms, 0, 'f', 1);
+        if (log && 5 + steps > maxCost)
+            *log << QString("yescrypt cost capped at %1 (%2 MiB per hash) for this machine's memory")
+                        .arg(maxCost).arg(1 << (maxCost - 1));
+    } else {
+        // No yescrypt in this libxcrypt (or a glibc crypt)
+        if (log) *log << error;
+        p.scheme = "sha512crypt";
+        ms = timeOne("$6$", 5000, &error);
+        if (ms <= 0) {
+            if (log) *log << error;
+            p.cost = 5000;
+            p.calibrationMs = timer.elapsed();
+            return p;
+        }
+        if (log) *log << QString("SHA-512-crypt 5000 rounds: %1 ms").arg(ms, 0, 'f', 1);
+        p.cost = int(qBound(5000.0, 5000.0 * targetMs / ms, 9999999.0));
+    }
+
+    p.measuredMs = timeOne(p.prefix(), p.cost, &error);
+    // The estimate can overshoot on a noisy first measurement: back off once
+    if (p.measuredMs > 2.0 * targetMs) {
+        p.cost = p.scheme == "yescrypt" ? qMax(3, p.cost - 1) : qMax(5000, int(p.cost * targetMs / p.measuredMs));
+        p.measuredMs = timeOne(p.prefix(), p.cost, &error);
+    }
+    p.calibrated = p.measuredMs > 0;
+    p.calibrationMs = timer.elapsed();
+    if (log) *log << p.summary();
+    return p;
+}
+
+bool PasswordHasher::isValidUserName(const QString &name)
+{
+    // As useradd's default NAME_REGEX, minus the trailing '$' for machine accounts
+    static const QRegularExpression re("^[a-z_][a-z0-9_-]{0,31}$");
+    return re.match(name).hasMatch() && name != "root";
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+#include <QStringList>
+
+// Password hashing cost chosen for the machine being installed: the same CPU
+// checks the hash at every login and sudo, so it is measured here rather than
+// fixed. yescrypt when libxcrypt has it, SHA-512-crypt otherwise.
+struct PasswordHashParams
+{
+    QString scheme = "yescrypt";        // or "sha512crypt"
+    int cost = 5;                       // yescrypt 3..8 (memory-bound), or SHA-512-crypt rounds
+    int targetMs = 250;
+    double measuredMs = 0.0;            // one hash at `cost`
+    qint64 calibrationMs = 0;           // time spent measuring
+    bool calibrated = false;
+
+    // crypt(3) setting prefix for crypt_gensalt: "$y$" or "$6$"
+    QByteArray prefix() const { return scheme == "yescrypt" ? "$y$" : "$6$"; }
+    QString summary() const;
+    // For the install log and the benchmark output
+    QJsonObject toJson() const;
+};
+
+// Blocking: run it on a worker thread.
+class PasswordHasher
+{
+public:
+    // Hashes a fixed password at a low cost, then extrapolates (yescrypt time
+    // doubles per cost step, SHA-512-crypt is linear in rounds) and confirms
+    // the pick with one more hash.
+    static PasswordHashParams calibrate(int targetMs = 250, QStringList *log = nullptr);
+
+    // A crypt(3) string for users.users.<name>.hashedPasswordFile; empty and
+    // `error` set on failure. Uses crypt_rn, so any number may run at once.
+    static QByteArray hash(const QByteArray &password, const PasswordHashParams &params, QString *error);
+
+    // Login names NixOS accepts for users.users.<name>
+    static bool isValidUserName(const QString &name);
+};
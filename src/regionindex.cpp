@@ -0,0 +1,305 @@
+#include "regionindex.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QLocale>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QSet>
+
+#include <algorithm>
+
+namespace {
+
+QString zoneInfoDir()
+{
+    QStringList dirs;
+    const QString tzdir = qEnvironmentVariable("TZDIR");
+    if (!tzdir.isEmpty()) dirs << tzdir;
+    dirs << "/etc/zoneinfo" << "/usr/share/zoneinfo" << "/run/current-system/sw/share/zoneinfo";
+    for (const QString &d : std::as_const(dirs)) {
+        if (QFile::exists(d + "/zone1970.tab") || QFile::exists(d + "/zone.tab")) return d;
+    }
+    return QString();
+}
+
+QList<QStringList> readTable(const QString &path)
+{
+    QList<QStringList> rows;
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) return rows;
+    for (const QByteArray &line : f.readAll().split('\n')) {
+        if (line.isEmpty() || line.startsWith('#')) continue;
+        rows << QString::fromUtf8(line).split('\t');
+    }
+    return rows;
+}
+
+// "en_US.UTF-8/UTF-8" lines; on NixOS the list ships with glibc-locales
+// next to the archive in LOCALE_ARCHIVE
+QStringList supportedLocales()
+{
+    QStringList files { "/usr/share/i18n/SUPPORTED", "/run/current-system/sw/share/i18n/SUPPORTED" };
+    const QString archive = qEnvironmentVariable("LOCALE_ARCHIVE");
+    if (!archive.isEmpty()) files.prepend(QFileInfo(archive).absolutePath() + "/../../share/i18n/SUPPORTED");
+    QStringList names;
+    for (const QString &path : std::as_const(files)) {
+        QFile f(path);
+        if (!f.open(QIODevice::ReadOnly)) continue;
+        for (const QByteArray &line : f.readAll().split('\n')) {
+            const QList<QByteArray> parts = line.trimmed().split('/');
+            if (parts.size() == 2 && parts.at(1) == "UTF-8" && parts.at(0).contains(".UTF-8"))
+                names << QString::fromLatin1(parts.at(0));
+        }
+        if (!names.isEmpty()) return names;
+    }
+    // The locales compiled into the live system's archive
+    QProcess p;
+    p.start("locale", { "-a" });
+    if (!p.waitForFinished(3000)) return names;
+    for (const QString &l : QString::fromLatin1(p.readAllStandardOutput()).split('\n', Qt::SkipEmptyParts)) {
+        const qsizetype dot = l.indexOf('.');
+        if (dot > 0 && l.mid(dot + 1).startsWith("utf8", Qt::CaseInsensitive))
+            names << l.left(dot) + ".UTF-8" + l.mid(dot + 5);
+    }
+    return names;
+}
+
+// Two letters from `iw reg get`, or the cfg80211 module parameter. "00" is
+// the world domain and says nothing about where we are.
+QString regulatoryCountry()
+{
+    QProcess p;
+    p.start("iw", { "reg", "get" });
+    if (p.waitForFinished(1000) && p.exitCode() == 0) {
+        static const QRegularExpression re(R"(country ([A-Z]{2}):)");
+        auto it = re.globalMatch(QString::fromLatin1(p.readAllStandardOutput()));
+        while (it.hasNext()) {
+            const QString cc = it.next().captured(1);
+            if (cc != "00") return cc;
+        }
+    }
+    QFile f("/sys/module/cfg80211/parameters/ieee80211_regdom");
+    if (f.open(QIODevice::ReadOnly)) {
+        const QString cc = QString::fromLatin1(f.readAll()).trimmed().toUpper();
+        if (cc.size() == 2 && cc != "00") return cc;
+    }
+    return QString();
+}
+
+QString systemZone()
+{
+    const QString tz = qEnvironmentVariable("TZ").remove(QRegularExpression("^:"));
+    if (!tz.isEmpty() && tz.contains('/')) return tz;
+    QFile f("/etc/timezone");
+    if (f.open(QIODevice::ReadOnly)) {
+        const QString zone = QString::fromUtf8(f.readAll()).trimmed();
+        if (!zone.isEmpty()) return zone;
+    }
+    const QString target = QFileInfo("/etc/localtime").symLinkTarget();
+    const qsizetype at = target.indexOf("zoneinfo/");
+    return at >= 0 ? target.mid(at + 9) : QString();
+}
+
+// Per word of the query; 0 is no match
+int matchScore(const QByteArray &key, const QByteArray &word)
+{
+    if (key.startsWith(' ' + word)) return 400;
+    if (key.contains(' ' + word)) return 300;
+    if (key.contains(word)) return 150;
+    // Subsequence, penalised by how spread out it is
+    qsizetype pos = 0, first = -1, last = 0;
+    for (char c : word) {
+        pos = key.indexOf(c, pos);
+        if (pos < 0) return 0;
+        if (first < 0) first = pos;
+        last = pos++;
+    }
+    return int(qMax<qsizetype>(1, 100 - (last - first - word.size())));
+}
+
+} // namespace
+
+QByteArray RegionIndex::fold(const QString &text)
+{
+    const QString decomposed = text.normalized(QString::NormalizationForm_KD);
+    QByteArray out(" ");
+    out.reserve(decomposed.size() + 1);
+    for (QChar c : decomposed) {
+        if (c.category() == QChar::Mark_NonSpacing) continue;
+        if (c.isLetterOrNumber()) {
+            const QChar lower = c.toLower();
+            if (lower.unicode() < 0x80) out += char(lower.unicode());
+            else out += QString(lower).toUtf8();
+        } else if (!out.endsWith(' ')) {
+            out += ' ';
+        }
+    }
+    if (out.size() > 1 && out.endsWith(' ')) out.chop(1);
+    return out;
+}
+
+std::shared_ptr<const RegionIndex> RegionIndex::build()
+{
+    QElapsedTimer timer;
+    timer.start();
+    auto index = std::make_shared<RegionIndex>();
+    const QString dir = zoneInfoDir();
+
+    QHash<QString, QString> countryNames;
+    for (const QStringList &row : readTable(dir + "/iso3166.tab")) {
+        if (row.size() >= 2) countryNames.insert(row.at(0), row.at(1));
+    }
+
+    // zone.tab names a zone per country (Europe/Oslo); since 2022 zone1970.tab
+    // folds countries into shared zones (Europe/Berlin for DE,DK,NO,SE), so it
+    // only contributes what zone.tab lacks
+    QHash<QString, int> byId;
+    QHash<QString, QString> countryZone;
+    for (const QString &file : { QString("zone.tab"), QString("zone1970.tab") }) {
+        for (const QStringList &row : readTable(dir + "/" + file)) {
+            if (row.size() < 3) continue;
+            const QString id = row.at(2);
+            const QString comment = row.value(3);
+            for (const QString &cc : row.at(0).split(',')) {
+                if (!countryZone.contains(cc)) countryZone.insert(cc, id);
+            }
+            if (byId.contains(id)) continue;
+            QStringList names;
+            for (const QString &cc : row.at(0).split(',')) names << countryNames.value(cc, cc);
+            Entry e;
+            e.id = id;
+            e.label = id.section('/', -1).replace('_', ' ');
+            e.detail = id.section('/', 0, -2).replace('_', ' ') + " · " + names.join(", ");
+            if (!comment.isEmpty()) e.detail += " (" + comment + ")";
+            e.countries = row.at(0);
+            e.key = fold(id + ' ' + names.join(' ') + ' ' + row.at(0).split(',').join(' ') + ' ' + comment);
+            byId.insert(id, int(index->zones_.size()));
+            index->zones_ << e;
+        }
+    }
+    if (!byId.contains("UTC")) index->zones_ << Entry { "UTC", "UTC", "Coordinated Universal Time", QString(), fold("UTC Coordinated Universal Time GMT") };
+    std::sort(index->zones_.begin(), index->zones_.end(), [](const Entry &a, const Entry &b) { return a.id < b.id; });
+
+    // "L Europe/Kyiv Europe/Kiev": target, then link name
+    QFile zi(dir + "/tzdata.zi");
+    if (zi.open(QIODevice::ReadOnly)) {
+        for (const QByteArray &line : zi.readAll().split('\n')) {
+            if (!line.startsWith("L ")) continue;
+            const QList<QByteArray> parts = line.split(' ');
+            if (parts.size() >= 3) index->links_.insert(QString::fromLatin1(parts.at(2)), QString::fromLatin1(parts.at(1)));
+        }
+    }
+
+    QSet<QString> seen;
+    for (const QString &name : supportedLocales()) {
+        if (seen.contains(name)) continue;
+        seen.insert(name);
+        const QString base = name.section('.', 0, 0);
+        const QLocale loc(base);
+        Entry e;
+        e.id = name;
+        e.countries = base.section('_', 1, 1).left(2);
+        if (loc.language() != QLocale::C && loc.name().section('_', 0, 0) == base.section('_', 0, 0)) {
+            e.label = QLocale::languageToString(loc.language());
+            const QString native = loc.nativeLanguageName();
+            e.detail = QLocale::territoryToString(loc.territory()) + " · " + name;
+            e.key = fold(base + ' ' + e.label + ' ' + native + ' ' + QLocale::territoryToString(loc.territory())
+                         + ' ' + loc.nativeTerritoryName());
+            if (!native.isEmpty() && native.compare(e.label, Qt::CaseInsensitive) != 0) e.label += " — " + native;
+        } else {
+            e.label = base;
+            e.detail = name;
+            e.key = fold(base + ' ' + countryNames.value(e.countries));
+        }
+        index->locales_ << e;
+    }
+    std::sort(index->locales_.begin(), index->locales_.end(), [](const Entry &a, const Entry &b) { return a.id < b.id; });
+
+    const QString current = index->canonicalZone(systemZone());
+    const int currentAt = index->indexOf(Kind::TimeZone, current);
+    if (currentAt >= 0 && current != "UTC" && !current.startsWith("Etc/")) {
+        index->suggestedZone_ = current;
+        index->suggestedCountry_ = index->zones_.at(currentAt).countries.section(',', 0, 0);
+        index->suggestionReason_ = "the live system's time zone";
+    } else {
+        const QString cc = regulatoryCountry();
+        if (countryZone.contains(cc)) {
+            index->suggestedZone_ = countryZone.value(cc);
+            index->suggestedCountry_ = cc;
+            index->suggestionReason_ = QString("the Wi-Fi regulatory domain (%1)").arg(countryNames.value(cc, cc));
+        } else {
+            index->suggestedZone_ = "UTC";
+        }
+    }
+    index->buildMs_ = timer.elapsed();
+    return index;
+}
+
+int RegionIndex::indexOf(Kind kind, const QString &id) const
+{
+    const QList<Entry> &list = entries(kind);
+    auto it = std::lower_bound(list.begin(), list.end(), id, [](const Entry &e, const QString &v) { return e.id < v; });
+    return it != list.end() && it->id == id ? int(it - list.begin()) : -1;
+}
+
+QString RegionIndex::canonicalZone(const QString &name) const
+{
+    if (name.isEmpty() || indexOf(Kind::TimeZone, name) >= 0) return name;
+    QString target = name;
+    // Links may chain through "backward"
+    for (int hops = 0; hops < 4 && links_.contains(target); ++hops) {
+        target = links_.value(target);
+        if (indexOf(Kind::TimeZone, target) >= 0) return target;
+    }
+    return name;
+}
+
+QString RegionIndex::suggestedLocale() const
+{
+    if (!suggestedCountry_.isEmpty()) {
+        // Qt fills in the likely language for a territory ("und_NO" -> nb_NO)
+        const QLocale likely(QLocale::AnyLanguage, QLocale::codeToTerritory(suggestedCountry_));
+        const QString name = likely.name() + ".UTF-8";
+        if (likely.name().endsWith(suggestedCountry_) && indexOf(Kind::Locale, name) >= 0) return name;
+        for (const Entry &e : locales_) {
+            if (e.countries == suggestedCountry_) return e.id;
+        }
+    }
+    return "en_US.UTF-8";
+}
+
+QList<int> RegionIndex::search(Kind kind, const QString &query, int limit) const
+{
+    const QList<Entry> &list = entries(kind);
+    QList<int> out;
+    const QList<QByteArray> words = fold(query).split(' ');
+    QList<QByteArray> needles;
+    for (const QByteArray &w : words) {
+        if (!w.isEmpty()) needles << w;
+    }
+    if (needles.isEmpty()) {
+        for (int i = 0; i < list.size() && out.size() < limit; ++i) out << i;
+        return out;
+    }
+    QList<QPair<int, int>> scored;
+    for (int i = 0; i < list.size(); ++i) {
+        int total = 0;
+        for (const QByteArray &n : std::as_const(needles)) {
+            const int s = matchScore(list.at(i).key, n);
+            if (s == 0) {
+                total = 0;
+                break;
+            }
+            total += s;
+        }
+        if (total > 0) scored.append({ -total, i });
+    }
+    // Ties keep the alphabetical order of the index
+    const qsizetype n = qMin<qsizetype>(limit, scored.size());
+    std::partial_sort(scored.begin(), scored.begin() + n, scored.end());
+    for (qsizetype i = 0; i < n; ++i) out << scored.at(i).second;
+    return out;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <memory>
+
+// Time zones and locales for the Settings page, read once from tzdata
+// (zone1970.tab for the selectable zones, tzdata.zi for the backward links,
+// iso3166.tab for country names) and glibc's SUPPORTED list. Every entry
+// carries a pre-folded search key (lower case, no diacritics, separators as
+// spaces), so a query is one pass over about a thousand short byte strings:
+// far below a frame, and cheap enough to run on every keystroke.
+//
+// build() reads files and runs `iw reg get`; call it on a worker thread and
+// hand the finished, immutable index to the GUI.
+class RegionIndex
+{
+public:
+    struct Entry {
+        QString id;                     // "Europe/Oslo", "nb_NO.UTF-8"
+        QString label;                  // "Oslo", "Norwegian Bokmål"
+        QString detail;                 // "Europe · Norway", "Norway · nb_NO.UTF-8"
+        QString countries;              // ISO 3166 codes, comma separated
+        QByteArray key;                 // " " + folded words, see fold()
+    };
+
+    enum class Kind { TimeZone, Locale };
+
+    static std::shared_ptr<const RegionIndex> build();
+
+    const QList<Entry> &entries(Kind kind) const { return kind == Kind::TimeZone ? zones_ : locales_; }
+    int indexOf(Kind kind, const QString &id) const;
+
+    // Best matches first: whole-key prefix, then word prefixes, substrings and
+    // finally in-order subsequences ("eosl" finds Europe/Oslo). Every word of
+    // the query has to match. An empty query lists the entries in order.
+    QList<int> search(Kind kind, const QString &query, int limit) const;
+
+    // Link names ("US/Eastern", "Europe/Kiev") resolve to their target.
+    QString canonicalZone(const QString &name) const;
+
+    // The live system's own zone when it is not UTC, else the first zone
+    // listed for the Wi-Fi regulatory domain's country. No network access.
+    QString suggestedTimeZone() const { return suggestedZone_; }
+    QString suggestionReason() const { return suggestionReason_; }
+    // A UTF-8 locale of the suggested zone's country, or en_US.UTF-8
+    QString suggestedLocale() const;
+
+    qint64 buildMs() const { return buildMs_; }
+
+    static QByteArray fold(const QString &text);
+
+private:
+    QList<Entry> zones_;
+    QList<Entry> locales_;
+    QHash<QString, QString> links_;
+    QString suggestedZone_;
+    QString suggestionReason_;
+    QString suggestedCountry_;
+    qint64 buildMs_ = 0;
+};
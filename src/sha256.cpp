@@ -0,0 +1,191 @@
+#include "sha256.h"
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define NIXLY_SHA_X86 1
+#endif
+
+namespace {
+
+using CompressFn = void (*)(uint32_t state[8], const uint8_t *data, size_t blocks);
+
+alignas(16) const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+inline uint32_t rotr(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+void compressPortable(uint32_t state[8], const uint8_t *data, size_t blocks)
+{
+    uint32_t w[64];
+    while (blocks--) {
+        for (int i = 0; i < 16; ++i) {
+            w[i] = uint32_t(data[4 * i]) << 24 | uint32_t(data[4 * i + 1]) << 16
+                 | uint32_t(data[4 * i + 2]) << 8 | uint32_t(data[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; ++i) {
+            const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            const uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            const uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        data += 64;
+    }
+}
+
+#ifdef NIXLY_SHA_X86
+// Four rounds per sha256rnds2 pair; the message schedule runs four words
+// ahead with sha256msg1/msg2.
+__attribute__((target("sha,sse4.1")))
+void compressShaNi(uint32_t state[8], const uint8_t *data, size_t blocks)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The instructions want ABEF and CDGH
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4])), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    while (blocks--) {
+        const __m128i abefSave = state0;
+        const __m128i cdghSave = state1;
+        __m128i msg[4];
+        for (int i = 0; i < 4; ++i)
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)), byteSwap);
+
+#pragma GCC unroll 16
+        for (int r = 0; r < 16; ++r) {
+            __m128i m = _mm_add_epi32(msg[r & 3], _mm_load_si128(reinterpret_cast<const __m128i*>(&K[4 * r])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+            if (r < 12) {
+                // W[t..t+3] for t = 4r + 16
+                __m128i next = _mm_sha256msg1_epu32(msg[r & 3], msg[(r + 1) & 3]);
+                next = _mm_add_epi32(next, _mm_alignr_epi8(msg[(r + 3) & 3], msg[(r + 2) & 3], 4));
+                msg[r & 3] = _mm_sha256msg2_epu32(next, msg[(r + 3) & 3]);
+            }
+            m = _mm_shuffle_epi32(m, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, m);
+        }
+
+        state0 = _mm_add_epi32(state0, abefSave);
+        state1 = _mm_add_epi32(state1, cdghSave);
+        data += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+bool cpuHasShaNi()
+{
+    unsigned a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return false;
+    const bool ssse3 = c & (1u << 9), sse41 = c & (1u << 19);
+    if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return false;
+    return ssse3 && sse41 && (b & (1u << 29));
+}
+#endif
+
+std::atomic<bool> portableForced { false };
+
+CompressFn compressFn()
+{
+#ifdef NIXLY_SHA_X86
+    static const bool shaNi = cpuHasShaNi();
+    if (shaNi && !portableForced.load(std::memory_order_relaxed)) return compressShaNi;
+#endif
+    return compressPortable;
+}
+
+} // namespace
+
+Sha256::Sha256()
+{
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(state_, initial, sizeof state_);
+}
+
+void Sha256::update(const void *data, size_t size)
+{
+    const CompressFn compress = compressFn();
+    const uint8_t *p = static_cast<const uint8_t*>(data);
+    length_ += size;
+    if (buffered_ > 0) {
+        const size_t n = size < 64 - buffered_ ? size : 64 - buffered_;
+        memcpy(buffer_ + buffered_, p, n);
+        buffered_ += n;
+        p += n;
+        size -= n;
+        if (buffered_ < 64) return;
+        compress(state_, buffer_, 1);
+        buffered_ = 0;
+    }
+    if (size >= 64) {
+        compress(state_, p, size / 64);
+        p += size / 64 * 64;
+        size %= 64;
+    }
+    memcpy(buffer_, p, size);
+    buffered_ = size;
+}
+
+Sha256::Digest Sha256::finish()
+{
+    const uint64_t bits = length_ * 8;
+    const uint8_t pad = 0x80;
+    update(&pad, 1);
+    const uint8_t zero[64] = {};
+    update(zero, (buffered_ <= 56 ? 56 : 120) - buffered_);
+    uint8_t be[8];
+    for (int i = 0; i < 8; ++i) be[i] = uint8_t(bits >> (56 - 8 * i));
+    update(be, 8);
+
+    Digest digest;
+    for (int i = 0; i < 8; ++i) {
+        digest[4 * i] = uint8_t(state_[i] >> 24);
+        digest[4 * i + 1] = uint8_t(state_[i] >> 16);
+        digest[4 * i + 2] = uint8_t(state_[i] >> 8);
+        digest[4 * i + 3] = uint8_t(state_[i]);
+    }
+    return digest;
+}
+
+const char *Sha256::implementation()
+{
+    return compressFn() == compressPortable ? "scalar" : "sha-ni";
+}
+
+void Sha256::forcePortable(bool portable)
+{
+    portableForced.store(portable);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Streaming SHA-256. Blocks go through the x86 SHA extensions when the CPU
+// has them and through portable code otherwise; the choice is made once.
+class Sha256
+{
+public:
+    using Digest = std::array<uint8_t, 32>;
+
+    Sha256();
+    void update(const void *data, size_t size);
+    Digest finish();
+
+    // "sha-ni" or "scalar"
+    static const char *implementation();
+    // For benchmarks: use the portable code even where SHA-NI exists.
+    static void forcePortable(bool portable);
+
+private:
+    uint32_t state_[8];
+    uint8_t buffer_[64];
+    size_t buffered_ = 0;
+    uint64_t length_ = 0;
+};
@@ -0,0 +1,417 @@
+#include "storecopy.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPair>
+#include <QProcess>
+#include <QSet>
+#include <QThread>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <memory>
+#include <mutex>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Registering is a database transaction; batch it
+constexpr int kRegisterBatch = 256;
+constexpr qint64 kRegisterIntervalMs = 2000;
+constexpr size_t kFallbackBuffer = 1 << 20;
+
+// Nix's canonical timestamp
+const timespec kStoreTimes[2] = { { 1, 0 }, { 1, 0 } };
+
+struct FileTask {
+    QByteArray source;
+    std::vector<QByteArray> dests;      // the first is copied, the rest hardlinked
+    std::vector<int> destPaths;         // store path index of each dest
+    qint64 size = 0;
+    bool executable = false;
+};
+
+struct PathState {
+    QString path;
+    QByteArray dest;
+    std::vector<QByteArray> dirs;       // parents before children
+    std::atomic<int> pending { 0 };     // file tasks still writing into this path
+    bool finalized = false;
+};
+
+QString absolute(const QString &p)
+{
+    return p.startsWith('/') ? p : "/nix/store/" + p;
+}
+
+// path -> references, for the paths `nix path-info` reports as valid in `store`
+QHash<QString, QStringList> pathInfo(const QStringList &paths, const QString &store, QString *error)
+{
+    QStringList args { "path-info", "--extra-experimental-features", "nix-command", "--json" };
+    if (!store.isEmpty()) args << "--store" << store;
+    QProcess p;
+    p.start("nix", args + paths);
+    if (!p.waitForFinished(300000)) {
+        if (error) *error = "nix path-info did not finish";
+        return {};
+    }
+    QHash<QString, QStringList> info;
+    auto add = [&info](const QString &path, const QJsonValue &v) {
+        const QJsonObject o = v.toObject();
+        if (o.isEmpty() || o.value("valid").toBool(true) == false) return;
+        QStringList refs;
+        for (const QJsonValue &r : o.value("references").toArray()) refs << absolute(r.toString());
+        info.insert(absolute(path), refs);
+    };
+    // Older Nix prints an array of objects with "path", newer an object keyed by path
+    const QJsonDocument doc = QJsonDocument::fromJson(p.readAllStandardOutput());
+    if (doc.isArray()) {
+        for (const QJsonValue &v : doc.array()) add(v.toObject().value("path").toString(), v);
+    } else {
+        const QJsonObject obj = doc.object();
+        for (auto it = obj.constBegin(); it != obj.constEnd(); ++it) add(it.key(), it.value());
+    }
+    return info;
+}
+
+bool runWithInput(const QString &program, const QStringList &args, const QByteArray &input,
+                  QByteArray *output, QString *error)
+{
+    QProcess p;
+    p.start(program, args);
+    if (!p.waitForStarted(10000)) {
+        *error = "Could not start " + program;
+        return false;
+    }
+    p.write(input);
+    p.closeWriteChannel();
+    if (!p.waitForFinished(600000) || p.exitStatus() != QProcess::NormalExit || p.exitCode() != 0) {
+        *error = QString("%1 %2 failed: %3").arg(program, args.value(0), QString::fromUtf8(p.readAllStandardError()).trimmed());
+        return false;
+    }
+    if (output) *output = p.readAllStandardOutput();
+    return true;
+}
+
+QString errnoText(const char *what, const QByteArray &path)
+{
+    return QString("%1 %2: %3").arg(what, QString::fromLocal8Bit(path), QString::fromLocal8Bit(strerror(errno)));
+}
+
+// Returns false with `error` set; `cloned` tells which way the data went
+bool copyData(int in, int out, qint64 size, bool *cloned, QString *error, const QByteArray &path)
+{
+    *cloned = false;
+    if (size == 0) return true;
+    if (::ioctl(out, FICLONE, in) == 0) {
+        *cloned = true;
+        return true;
+    }
+    qint64 left = size;
+    bool kernelCopy = true;
+    while (left > 0 && kernelCopy) {
+        const ssize_t n = ::copy_file_range(in, nullptr, out, nullptr, size_t(left), 0);
+        if (n > 0) {
+            left -= n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        // Cross-filesystem on older kernels, or a filesystem without support
+        if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL) && left == size) {
+            kernelCopy = false;
+            break;
+        }
+        if (n == 0) break;
+        *error = errnoText("Copying", path);
+        return false;
+    }
+    if (left == 0) return true;
+    std::vector<char> buffer(kFallbackBuffer);
+    while (true) {
+        const ssize_t n = ::read(in, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            *error = errnoText("Reading", path);
+            return false;
+        }
+        if (n == 0) return true;
+        for (ssize_t off = 0; off < n;) {
+            const ssize_t w = ::write(out, buffer.data() + off, size_t(n - off));
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) {
+                *error = errnoText("Writing", path);
+                return false;
+            }
+            off += w;
+        }
+    }
+}
+
+} // namespace
+
+QString StoreCopier::Stats::summary() const
+{
+    return QString("Copied %1 paths, %2 files, %3 MiB in %4 s (%5 MB/s; %6 cloned, %7 hardlinked)")
+        .arg(paths).arg(files).arg(bytes >> 20).arg(elapsedMs / 1000.0, 0, 'f', 1)
+        .arg(mbps(), 0, 'f', 0).arg(reflinked).arg(hardlinked);
+}
+
+bool StoreCopier::copy(const QStringList &paths, const QString &targetRoot,
+                       const std::function<bool()> &cancelled,
+                       const std::function<void(const Progress&)> &progress,
+                       QString *error)
+{
+    stats_ = Stats();
+    QElapsedTimer timer;
+    timer.start();
+    const QString targetStore = "local?root=" + targetRoot;
+
+    const QHash<QString, QStringList> source = pathInfo(paths, QString(), error);
+    if (source.size() != QSet<QString>(paths.begin(), paths.end()).size()) {
+        if (error->isEmpty()) *error = "Some paths to copy are not valid in the live store";
+        return false;
+    }
+    const QHash<QString, QStringList> present = pathInfo(paths, targetStore, nullptr);
+
+    // Dependency order: references before referrers, so any prefix is closed
+    std::vector<std::unique_ptr<PathState>> order;
+    QHash<QString, int> indexOf;
+    QSet<QString> visiting;
+    std::function<void(const QString&)> visit = [&](const QString &path) {
+        if (indexOf.contains(path) || visiting.contains(path) || present.contains(path)) return;
+        visiting.insert(path);
+        for (const QString &r : source.value(path)) {
+            if (r != path) visit(r);
+        }
+        auto st = std::make_unique<PathState>();
+        st->path = path;
+        st->dest = QFile::encodeName(targetRoot + path);
+        indexOf.insert(path, int(order.size()));
+        order.push_back(std::move(st));
+    };
+    for (const QString &p : paths) visit(p);
+    if (order.empty()) {
+        stats_.elapsedMs = timer.elapsed();
+        return true;
+    }
+    QDir().mkpath(targetRoot + "/nix/store");
+
+    // Walk: directories and symlinks are made here, regular files become tasks
+    std::vector<FileTask> tasks;
+    QHash<QPair<quint64, quint64>, int> byInode;
+    qint64 bytesTotal = 0;
+    std::function<bool(const QByteArray&, const QByteArray&, int)> walk =
+        [&](const QByteArray &src, const QByteArray &dst, int pathIndex) -> bool {
+        struct stat st;
+        if (::lstat(src.constData(), &st) != 0) {
+            *error = errnoText("Reading", src);
+            return false;
+        }
+        if (S_ISLNK(st.st_mode)) {
+            std::vector<char> target(size_t(st.st_size) + 1);
+            const ssize_t n = ::readlink(src.constData(), target.data(), target.size());
+            if (n < 0 || ::symlink(QByteArray(target.data(), int(n)).constData(), dst.constData()) != 0) {
+                *error = errnoText("Linking", dst);
+                return false;
+            }
+            ::utimensat(AT_FDCWD, dst.constData(), kStoreTimes, AT_SYMLINK_NOFOLLOW);
+            return true;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            if (::mkdir(dst.constData(), 0755) != 0) {
+                *error = errnoText("Creating", dst);
+                return false;
+            }
+            order[pathIndex]->dirs.push_back(dst);
+            DIR *d = ::opendir(src.constData());
+            if (!d) {
+                *error = errnoText("Reading", src);
+                return false;
+            }
+            QList<QByteArray> names;
+            while (dirent *e = ::readdir(d)) {
+                if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0) names << QByteArray(e->d_name);
+            }
+            ::closedir(d);
+            for (const QByteArray &name : std::as_const(names)) {
+                if (!walk(src + '/' + name, dst + '/' + name, pathIndex)) return false;
+            }
+            return true;
+        }
+        if (!S_ISREG(st.st_mode)) {
+            *error = QString("%1 is not a file, directory or symlink").arg(QString::fromLocal8Bit(src));
+            return false;
+        }
+        // Optimised stores hardlink identical files, often across paths
+        const QPair<quint64, quint64> key { quint64(st.st_dev), quint64(st.st_ino) };
+        int t = st.st_nlink > 1 ? byInode.value(key, -1) : -1;
+        if (t < 0) {
+            FileTask task;
+            task.source = src;
+            task.size = st.st_size;
+            task.executable = st.st_mode & S_IXUSR;
+            tasks.push_back(std::move(task));
+            t = int(tasks.size()) - 1;
+            if (st.st_nlink > 1) byInode.insert(key, t);
+            bytesTotal += st.st_size;
+        }
+        tasks[size_t(t)].dests.push_back(dst);
+        tasks[size_t(t)].destPaths.push_back(pathIndex);
+        order[pathIndex]->pending.fetch_add(1);
+        return true;
+    };
+    for (int i = 0; i < int(order.size()); ++i) {
+        if (cancelled && cancelled()) {
+            *error = "Cancelled";
+            return false;
+        }
+        // An unregistered leftover (an interrupted copy) is garbage
+        QDir(QFile::decodeName(order[i]->dest)).removeRecursively();
+        if (!walk(QFile::encodeName(order[i]->path), order[i]->dest, i)) return false;
+    }
+
+    std::atomic<size_t> next { 0 };
+    std::atomic<qint64> bytesDone { 0 };
+    std::atomic<int> reflinked { 0 };
+    std::atomic<int> hardlinked { 0 };
+    std::atomic<bool> stop { false };
+    std::atomic<int> running { 0 };
+    std::mutex errorMutex;
+    QString copyError;
+    auto fail = [&](const QString &e) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (copyError.isEmpty()) copyError = e;
+        stop.store(true);
+    };
+
+    const int workers = threads > 0 ? threads : qMax(1, QThread::idealThreadCount());
+    running.store(workers);
+    std::vector<std::thread> pool;
+    for (int w = 0; w < workers; ++w) {
+        pool.emplace_back([&]() {
+            // Tasks are in dependency order, so the first paths finish first
+            for (size_t i = next++; i < tasks.size() && !stop.load(); i = next++) {
+                const FileTask &task = tasks[i];
+                const int in = ::open(task.source.constData(), O_RDONLY | O_CLOEXEC);
+                if (in < 0) {
+                    fail(errnoText("Reading", task.source));
+                    break;
+                }
+                const QByteArray &first = task.dests.front();
+                const int out = ::open(first.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+                if (out < 0) {
+                    ::close(in);
+                    fail(errnoText("Creating", first));
+                    break;
+                }
+                QString e;
+                bool cloned = false;
+                const bool ok = copyData(in, out, task.size, &cloned, &e, first);
+                ::fchmod(out, task.executable ? 0555 : 0444);
+                ::futimens(out, kStoreTimes);
+                ::close(out);
+                ::close(in);
+                if (!ok) {
+                    fail(e);
+                    break;
+                }
+                if (cloned) ++reflinked;
+                for (size_t d = 1; d < task.dests.size(); ++d) {
+                    if (::link(first.constData(), task.dests[d].constData()) != 0) {
+                        fail(errnoText("Linking", task.dests[d]));
+                        break;
+                    }
+                    ++hardlinked;
+                }
+                bytesDone += task.size;
+                for (int p : task.destPaths) order[size_t(p)]->pending.fetch_sub(1);
+            }
+            running.fetch_sub(1);
+        });
+    }
+
+    // Finalize and register from here while the workers copy
+    const QString targetDir = targetRoot + "/nix/store";
+    int registered = 0;
+    QElapsedTimer sinceRegister;
+    sinceRegister.start();
+    auto registerPrefix = [&](bool force) -> bool {
+        int end = registered;
+        while (end < int(order.size())) {
+            PathState &st = *order[size_t(end)];
+            if (!st.finalized) {
+                if (st.pending.load() != 0) break;
+                // Read-only last: children before parents
+                for (auto it = st.dirs.rbegin(); it != st.dirs.rend(); ++it) {
+                    ::chmod(it->constData(), 0555);
+                    ::utimensat(AT_FDCWD, it->constData(), kStoreTimes, AT_SYMLINK_NOFOLLOW);
+                }
+                st.finalized = true;
+            }
+            ++end;
+        }
+        const int count = end - registered;
+        if (count == 0 || (!force && count < kRegisterBatch && sinceRegister.elapsed() < kRegisterIntervalMs)) return true;
+        // Data first, then the database that vouches for it
+        const int fd = ::open(QFile::encodeName(targetDir).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0) {
+            ::syncfs(fd);
+            ::close(fd);
+        }
+        QStringList slice;
+        for (int i = registered; i < end; ++i) slice << order[size_t(i)]->path;
+        QByteArray db;
+        if (!runWithInput("nix-store", QStringList { "--dump-db" } + slice, {}, &db, error)
+            || !runWithInput("nix-store", { "--load-db", "--store", targetStore }, db, nullptr, error)) {
+            return false;
+        }
+        registered = end;
+        sinceRegister.restart();
+        return true;
+    };
+
+    bool ok = true;
+    while (running.load() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        if (cancelled && cancelled()) stop.store(true);
+        if (ok && !stop.load()) ok = registerPrefix(false);
+        if (!ok) stop.store(true);
+        if (progress) progress({ bytesDone.load(), bytesTotal, registered, int(order.size()) });
+    }
+    for (std::thread &t : pool) t.join();
+
+    stats_.files = int(tasks.size());
+    stats_.bytes = bytesDone.load();
+    stats_.reflinked = reflinked.load();
+    stats_.hardlinked = hardlinked.load();
+    if (!copyError.isEmpty()) {
+        *error = copyError;
+        ok = false;
+    } else if (cancelled && cancelled()) {
+        *error = "Cancelled";
+        ok = false;
+    }
+    if (ok) ok = registerPrefix(true);
+    if (ok && registered != int(order.size())) {
+        *error = "Not every copied path could be registered";
+        ok = false;
+    }
+    stats_.paths = registered;
+    stats_.elapsedMs = timer.elapsed();
+    if (progress) progress({ bytesDone.load(), bytesTotal, registered, int(order.size()) });
+    return ok;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+// Copies store paths from the live store into the target's store with every
+// core, instead of one NAR stream per path. Files are cloned (FICLONE) when
+// both stores share a filesystem, otherwise copied in the kernel with
+// copy_file_range. Files the source store deduplicated (one inode, several
+// names) are copied once and hardlinked. Metadata is made canonical the way
+// Nix does it (read-only modes, mtime 1, owned by root).
+//
+// Paths are registered in the target database in dependency order and only
+// after their contents and everything they reference are synced, so a crash
+// never leaves a registered path without its data or references. Paths that
+// are already valid in the target are left alone.
+class StoreCopier
+{
+public:
+    struct Progress {
+        qint64 bytesDone = 0;
+        qint64 bytesTotal = 0;
+        int pathsDone = 0;              // registered
+        int pathsTotal = 0;
+    };
+
+    struct Stats {
+        int paths = 0;
+        int files = 0;
+        qint64 bytes = 0;
+        int reflinked = 0;
+        int hardlinked = 0;
+        qint64 elapsedMs = 0;
+        double mbps() const { return elapsedMs > 0 ? bytes / 1e3 / elapsedMs : 0.0; }
+        QString summary() const;
+    };
+
+    int threads = 0;                    // 0 = QThread::idealThreadCount()
+
+    // `paths` must be closed under references (a closure). Blocking; run on a
+    // worker thread.
+    bool copy(const QStringList &paths, const QString &targetRoot,
+              const std::function<bool()> &cancelled,
+              const std::function<void(const Progress&)> &progress,
+              QString *error);
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    Stats stats_;
+};
@@ -0,0 +1,263 @@
+#include "storereuse.h"
+#include "memorybudget.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+
+#include <sys/statvfs.h>
+
+namespace {
+
+// Filesystems NixOS roots and /nix partitions commonly use
+const QStringList kStoreFsTypes { "btrfs", "ext4", "xfs", "f2fs", "bcachefs" };
+const QString kMapperName = "nixly-oldstore";
+
+// Exit code, or -1 when the program did not run to completion
+int run(const QString &program, const QStringList &args, QByteArray *output = nullptr,
+        const QByteArray &input = QByteArray(), const std::function<bool()> &cancelled = {},
+        int timeoutMs = 60000)
+{
+    QProcess p;
+    p.start(program, args);
+    if (!p.waitForStarted(10000)) return -1;
+    if (!input.isEmpty()) p.write(input);
+    p.closeWriteChannel();
+    QElapsedTimer timer;
+    timer.start();
+    while (p.state() != QProcess::NotRunning && !p.waitForFinished(500)) {
+        if ((cancelled && cancelled()) || timer.elapsed() > timeoutMs) {
+            p.kill();
+            p.waitForFinished(5000);
+            return -1;
+        }
+    }
+    if (output) *output = p.readAllStandardOutput();
+    return p.exitStatus() == QProcess::NormalExit ? p.exitCode() : -1;
+}
+
+QString blkidType(const QString &device)
+{
+    QByteArray out;
+    if (run("blkid", { "-p", "-o", "value", "-s", "TYPE", device }, &out) != 0) return QString();
+    return QString::fromUtf8(out).trimmed();
+}
+
+void collectPartitions(const QJsonArray &devices, QStringList *parts)
+{
+    for (const QJsonValue &v : devices) {
+        const QJsonObject o = v.toObject();
+        if (o.value("type").toString() == "part") *parts << o.value("path").toString();
+        collectPartitions(o.value("children").toArray(), parts);
+    }
+}
+
+bool isNixDir(const QString &dir)
+{
+    return QFileInfo(dir + "/store").isDir() && QFileInfo::exists(dir + "/var/nix/db/db.sqlite");
+}
+
+// The root filesystem (<m>/nix), a /nix partition (<m>), or btrfs subvolumes
+// seen from the top level (<m>/@nix, <m>/@/nix, <m>/root/nix, ...)
+QString locateNixDir(const QString &mountPoint)
+{
+    if (isNixDir(mountPoint)) return mountPoint;
+    if (isNixDir(mountPoint + "/nix")) return mountPoint + "/nix";
+    const QStringList subdirs = QDir(mountPoint).entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden);
+    for (const QString &d : subdirs) {
+        const QString base = mountPoint + "/" + d;
+        if (isNixDir(base)) return base;
+        if (isNixDir(base + "/nix")) return base + "/nix";
+    }
+    return QString();
+}
+
+QString storeName(const QString &path)
+{
+    return QFileInfo(path).fileName();
+}
+
+} // namespace
+
+QString StoreReuse::Found::storeUrl() const
+{
+    if (nixDir.endsWith("/nix"))
+        return QString("local?root=%1&read-only=true").arg(nixDir.chopped(4));
+    return QString("local?real=%1/store&state=%1/var/nix&read-only=true").arg(nixDir);
+}
+
+QString StoreReuse::Result::summary() const
+{
+    if (source.isEmpty()) return QString("No existing Nix store on the target drive");
+    return QString("Reused %1 of %2 matching paths (%3 MiB) from the store on %4 in %5 s")
+        .arg(paths).arg(candidates).arg(bytes >> 20).arg(source).arg(elapsedMs / 1000.0, 0, 'f', 1);
+}
+
+StoreReuse::Found StoreReuse::find(const QString &device, const QByteArray &passphrase, const QString &mountBase,
+                                   const std::function<void(const QString&)> &log)
+{
+    QByteArray out;
+    if (run("lsblk", { "-J", "-o", "PATH,TYPE", device }, &out) != 0) return {};
+    QStringList parts;
+    collectPartitions(QJsonDocument::fromJson(out).object().value("blockdevices").toArray(), &parts);
+
+    for (const QString &part : std::as_const(parts)) {
+        Found f;
+        f.partition = part;
+        QString source = part;
+        QString type = blkidType(part);
+        if (type == "crypto_LUKS") {
+            if (passphrase.isEmpty()) continue;
+            if (run("cryptsetup", { "open", "--readonly", "--key-file=-", part, kMapperName }, nullptr, passphrase) != 0) {
+                if (log) log(QString("%1 is encrypted with a different passphrase; skipping it").arg(part));
+                continue;
+            }
+            f.mapper = kMapperName;
+            source = "/dev/mapper/" + kMapperName;
+            type = blkidType(source);
+        }
+        if (kStoreFsTypes.contains(type)) {
+            f.mountPoint = mountBase + "/" + QFileInfo(part).fileName();
+            QDir().mkpath(f.mountPoint);
+            // subvolid=5 is the btrfs top level, so every subvolume is visible
+            const QString options = type == "btrfs" ? "ro,subvolid=5" : "ro";
+            if (run("mount", { "-o", options, source, f.mountPoint }) == 0) {
+                f.nixDir = locateNixDir(f.mountPoint);
+                if (f.isValid()) return f;
+            } else {
+                f.mountPoint.clear();
+            }
+        }
+        release(f);
+    }
+    return {};
+}
+
+void StoreReuse::release(const Found &found)
+{
+    if (!found.mountPoint.isEmpty()) {
+        run("umount", { found.mountPoint });
+        QDir().rmdir(found.mountPoint);
+    }
+    if (!found.mapper.isEmpty()) run("cryptsetup", { "close", found.mapper });
+}
+
+QStringList StoreReuse::systemPaths(const QString &flakeDir, const QString &host, QString *error)
+{
+    const QString attr = QString("%1#nixosConfigurations.%2.config.system.build.toplevel.drvPath").arg(flakeDir, host);
+    QByteArray out;
+    if (run("nix", { "eval", "--extra-experimental-features", "nix-command flakes", "--raw", attr }, &out,
+            {}, {}, 600000) != 0) {
+        *error = "Could not evaluate the system";
+        return {};
+    }
+    const QString drv = QString::fromUtf8(out).trimmed();
+    if (run("nix", { "derivation", "show", "--extra-experimental-features", "nix-command", "--recursive", drv }, &out,
+            {}, {}, 120000) != 0) {
+        *error = "Could not list the derivations of " + drv;
+        return {};
+    }
+    QJsonObject drvs = QJsonDocument::fromJson(out).object();
+    // Newer Nix nests them and leaves out the store directory
+    if (drvs.value("derivations").isObject()) drvs = drvs.value("derivations").toObject();
+    auto absolute = [](const QString &p) { return p.startsWith('/') ? p : "/nix/store/" + p; };
+
+    QStringList paths;
+    for (auto it = drvs.constBegin(); it != drvs.constEnd(); ++it) {
+        const QJsonObject d = it.value().toObject();
+        const QJsonObject outputs = d.value("outputs").toObject();
+        for (auto o = outputs.constBegin(); o != outputs.constEnd(); ++o) {
+            const QString path = o.value().toObject().value("path").toString();
+            // Content-addressed outputs have no path until they are built
+            if (!path.isEmpty()) paths << absolute(path);
+        }
+        QJsonValue srcs = d.value("inputSrcs");
+        if (srcs.isObject()) srcs = srcs.toObject().value("srcs");
+        for (const QJsonValue &s : srcs.toArray()) paths << absolute(s.toString());
+    }
+    paths.removeDuplicates();
+    return paths;
+}
+
+StoreReuse::Result StoreReuse::import(const Found &found, const QStringList &wanted, const QString &destRoot,
+                                      const std::function<bool()> &cancelled, QString *error)
+{
+    Result result;
+    result.source = found.partition;
+    QElapsedTimer timer;
+    timer.start();
+
+    const QString destStore = destRoot + "/nix/store";
+    QStringList candidates;
+    for (const QString &path : wanted) {
+        const QString name = storeName(path);
+        if (QFileInfo::exists(found.nixDir + "/store/" + name) && !QFileInfo::exists(destStore + "/" + name))
+            candidates << "/nix/store/" + name;
+    }
+    result.candidates = candidates.size();
+    if (candidates.isEmpty()) return result;
+
+    // Registered in the old database, and how big; invalid paths are missing or marked
+    QByteArray out;
+    run("nix", QStringList { "path-info", "--extra-experimental-features", "nix-command", "--json",
+                             "--store", found.storeUrl() } + candidates, &out, {}, cancelled, 300000);
+    QHash<QString, qint64> sizes;
+    auto add = [&sizes](const QString &path, const QJsonValue &v) {
+        const QJsonObject o = v.toObject();
+        if (o.isEmpty() || o.value("valid").toBool(true) == false) return;
+        sizes.insert(path, o.value("narSize").toVariant().toLongLong());
+    };
+    const QJsonDocument doc = QJsonDocument::fromJson(out);
+    if (doc.isArray()) {
+        for (const QJsonValue &v : doc.array()) add(v.toObject().value("path").toString(), v);
+    } else {
+        const QJsonObject obj = doc.object();
+        for (auto it = obj.constBegin(); it != obj.constEnd(); ++it) add(it.key(), it.value());
+    }
+
+    // Leave the destination room for the rest of the build. The live store is
+    // usually a tmpfs, where whatever comes in also has to fit the memory the
+    // build will need.
+    QDir().mkpath(destStore);
+    struct statvfs vfs;
+    qint64 budget = ::statvfs(QFile::encodeName(destStore).constData(), &vfs) == 0
+                        ? qint64(vfs.f_bavail) * qint64(vfs.f_frsize) * 8 / 10 : 0;
+    if (destRoot.isEmpty()) {
+        const MemoryBudget::Assessment a = MemoryBudget::assess(QString());
+        budget = qMin(budget, a.available() - a.required());
+    }
+    QStringList selected;
+    for (const QString &path : std::as_const(candidates)) {
+        const qint64 size = sizes.value(path, -1);
+        if (size < 0 || size > budget) continue;
+        budget -= size;
+        selected << path;
+    }
+    if (selected.isEmpty()) {
+        result.elapsedMs = timer.elapsed();
+        return result;
+    }
+
+    // Signatures are checked as for any substituter; a locally built path
+    // without one is refused here and built or fetched later
+    QStringList args { "copy", "--extra-experimental-features", "nix-command", "--from", found.storeUrl() };
+    if (!destRoot.isEmpty()) args << "--to" << "local?root=" + destRoot;
+    const int rc = run("nix", args + selected, nullptr, {}, cancelled, 3600000);
+    if (rc != 0) *error = cancelled && cancelled() ? QString("Cancelled")
+                                                   : QString("nix copy could not import every path (exit %1)").arg(rc);
+    // A refused path fails the copy but not the others; count what arrived
+    for (const QString &path : std::as_const(selected)) {
+        if (!QFileInfo::exists(destStore + "/" + storeName(path))) continue;
+        ++result.paths;
+        result.imported << path;
+        result.bytes += sizes.value(path);
+    }
+    result.elapsedMs = timer.elapsed();
+    return result;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+// Salvages store paths from a NixOS installation already on the target drive
+// before it is wiped. Every partition of the drive is probed; a LUKS volume
+// is tried with the passphrase chosen for the new install, which reinstalls
+// usually keep. A filesystem holding store/ and var/nix/db is opened as a
+// read-only Nix store, and the paths of the new system found there are copied
+// into the live store, where build-system substitutes them from.
+//
+// The copy is checked like any substitution: a path needs a signature by a
+// key the live system trusts (the old database keeps the ones it was
+// fetched with) or must be content-addressed, and its NAR has to match the
+// recorded hash. Anything refused is fetched normally instead. The live store
+// is RAM on the ISO, so the import stays within the memory budget.
+class StoreReuse
+{
+public:
+    struct Found {
+        QString partition;              // e.g. /dev/nvme0n1p2
+        QString mapper;                 // set when the partition was unlocked
+        QString mountPoint;
+        QString nixDir;                 // holds store/ and var/nix/
+        QString storeUrl() const;       // read-only local store URL for nix
+        bool isValid() const { return !nixDir.isEmpty(); }
+    };
+
+    struct Result {
+        int candidates = 0;             // wanted paths present in the old store
+        int paths = 0;                  // copied into the live store
+        QStringList imported;           // those paths
+        qint64 bytes = 0;               // their NAR size
+        qint64 elapsedMs = 0;
+        QString source;                 // partition the store was found on
+        QString summary() const;
+    };
+
+    // Mounts everything under `mountBase`. Blocking; run on a worker thread.
+    static Found find(const QString &device, const QByteArray &passphrase, const QString &mountBase,
+                      const std::function<void(const QString&)> &log = {});
+    // Unmounts and locks again what find() opened.
+    static void release(const Found &found);
+
+    // Store paths the system `host` of `flakeDir` can consist of: the outputs
+    // and sources of every derivation in its build closure.
+    static QStringList systemPaths(const QString &flakeDir, const QString &host, QString *error);
+
+    // Copies `wanted` paths that are valid in the old store and missing from
+    // the destination, within what it has room for. The destination is the
+    // live store, or the store under `destRoot` when that is set.
+    static Result import(const Found &found, const QStringList &wanted, const QString &destRoot,
+                         const std::function<bool()> &cancelled, QString *error);
+};
@@ -0,0 +1,327 @@
+#include "storeverify.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QProcess>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr size_t kReadBlock = 1 << 20;
+
+struct Expected {
+    QString path;
+    QString narHash;                    // "sha256:<base32>" or "sha256-<base64>"
+    qint64 narSize = 0;
+};
+
+// Streams the NAR format (see Nix's archive.cc) straight into the hash
+class NarHasher
+{
+public:
+    explicit NarHasher(std::vector<char> &buffer) : buffer_(buffer) {}
+
+    bool dump(const QByteArray &path, QString *error)
+    {
+        str("nix-archive-1");
+        return node(path, error);
+    }
+
+    Sha256::Digest finish() { return sha_.finish(); }
+    qint64 size() const { return size_; }
+
+private:
+    void raw(const void *data, size_t n)
+    {
+        sha_.update(data, n);
+        size_ += qint64(n);
+    }
+
+    void u64(quint64 n)
+    {
+        uint8_t le[8];
+        for (int i = 0; i < 8; ++i) le[i] = uint8_t(n >> (8 * i));
+        raw(le, 8);
+    }
+
+    void pad(quint64 n)
+    {
+        static const char zero[8] = {};
+        if (n % 8) raw(zero, 8 - n % 8);
+    }
+
+    void str(const char *s, size_t n)
+    {
+        u64(n);
+        raw(s, n);
+        pad(n);
+    }
+
+    void str(const char *s) { str(s, strlen(s)); }
+    void str(const QByteArray &s) { str(s.constData(), size_t(s.size())); }
+
+    bool node(const QByteArray &path, QString *error)
+    {
+        struct stat st;
+        if (::lstat(path.constData(), &st) != 0) return fail(path, error);
+        str("(");
+        str("type");
+        if (S_ISREG(st.st_mode)) {
+            str("regular");
+            if (st.st_mode & S_IXUSR) {
+                str("executable");
+                str("");
+            }
+            str("contents");
+            if (!contents(path, quint64(st.st_size), error)) return false;
+        } else if (S_ISLNK(st.st_mode)) {
+            std::vector<char> target(size_t(st.st_size) + 1);
+            const ssize_t n = ::readlink(path.constData(), target.data(), target.size());
+            if (n < 0) return fail(path, error);
+            str("symlink");
+            str("target");
+            str(target.data(), size_t(n));
+        } else if (S_ISDIR(st.st_mode)) {
+            str("directory");
+            DIR *d = ::opendir(path.constData());
+            if (!d) return fail(path, error);
+            QList<QByteArray> names;
+            while (dirent *e = ::readdir(d)) {
+                if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0) names << QByteArray(e->d_name);
+            }
+            ::closedir(d);
+            // Byte order, as Nix sorts them
+            std::sort(names.begin(), names.end());
+            for (const QByteArray &name : std::as_const(names)) {
+                str("entry");
+                str("(");
+                str("name");
+                str(name);
+                str("node");
+                if (!node(path + '/' + name, error)) return false;
+                str(")");
+            }
+        } else {
+            *error = QString("%1: not a file, directory or symlink").arg(QString::fromLocal8Bit(path));
+            return false;
+        }
+        str(")");
+        return true;
+    }
+
+    bool contents(const QByteArray &path, quint64 size, QString *error)
+    {
+        const int fd = ::open(path.constData(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return fail(path, error);
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        u64(size);
+        quint64 left = size;
+        while (left > 0) {
+            const ssize_t n = ::read(fd, buffer_.data(), std::min<quint64>(left, buffer_.size()));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                ::close(fd);
+                if (n == 0) *error = QString("%1: shorter than its size").arg(QString::fromLocal8Bit(path));
+                return n == 0 ? false : fail(path, error);
+            }
+            raw(buffer_.data(), size_t(n));
+            left -= quint64(n);
+        }
+        ::close(fd);
+        pad(size);
+        return true;
+    }
+
+    static bool fail(const QByteArray &path, QString *error)
+    {
+        *error = QString("%1: %2").arg(QString::fromLocal8Bit(path), QString::fromLocal8Bit(strerror(errno)));
+        return false;
+    }
+
+    std::vector<char> &buffer_;
+    Sha256 sha_;
+    qint64 size_ = 0;
+};
+
+QList<Expected> recordedHashes(const QString &root, const QStringList &paths, QString *error)
+{
+    QStringList args { "path-info", "--extra-experimental-features", "nix-command", "--json" };
+    if (root != "/") args << "--store" << "local?root=" + root + "&read-only=true";
+    if (paths.isEmpty()) args << "--all";
+    else args << "--recursive" << paths;
+    QProcess p;
+    p.start("nix", args);
+    if (!p.waitForFinished(600000) || p.exitStatus() != QProcess::NormalExit || p.exitCode() != 0) {
+        *error = "nix path-info failed: " + QString::fromUtf8(p.readAllStandardError()).trimmed();
+        return {};
+    }
+    QList<Expected> expected;
+    auto add = [&expected](const QString &path, const QJsonObject &o) {
+        if (o.isEmpty() || o.value("narHash").toString().isEmpty()) return;
+        expected.append({ path.startsWith('/') ? path : "/nix/store/" + path,
+                          o.value("narHash").toString(), o.value("narSize").toVariant().toLongLong() });
+    };
+    // Older Nix prints an array of objects with "path", newer an object keyed by path
+    const QJsonDocument doc = QJsonDocument::fromJson(p.readAllStandardOutput());
+    if (doc.isArray()) {
+        for (const QJsonValue &v : doc.array()) add(v.toObject().value("path").toString(), v.toObject());
+    } else {
+        const QJsonObject obj = doc.object();
+        for (auto it = obj.constBegin(); it != obj.constEnd(); ++it) add(it.key(), it.value().toObject());
+    }
+    return expected;
+}
+
+bool hashMatches(const QString &recorded, const Sha256::Digest &digest)
+{
+    const QByteArray bytes(reinterpret_cast<const char*>(digest.data()), int(digest.size()));
+    if (recorded.startsWith("sha256-")) return recorded.mid(7) == QString::fromLatin1(bytes.toBase64());
+    const QString value = recorded.startsWith("sha256:") ? recorded.mid(7) : recorded;
+    // Very old databases hold hex
+    if (value.size() == 64) return value == QString::fromLatin1(bytes.toHex());
+    return value == StoreVerifier::nixBase32(digest);
+}
+
+} // namespace
+
+QString StoreVerifier::nixBase32(const Sha256::Digest &digest)
+{
+    static const char alphabet[] = "0123456789abcdfghijklmnpqrsvwxyz";
+    const int len = int(digest.size());
+    const int chars = (len * 8 - 1) / 5 + 1;
+    QString s;
+    s.reserve(chars);
+    for (int n = chars - 1; n >= 0; --n) {
+        const int b = n * 5;
+        const int i = b / 8, j = b % 8;
+        const unsigned c = (digest[size_t(i)] >> j) | (i + 1 < len ? unsigned(digest[size_t(i + 1)]) << (8 - j) : 0u);
+        s += QLatin1Char(alphabet[c & 0x1f]);
+    }
+    return s;
+}
+
+bool StoreVerifier::narHash(const QByteArray &fsPath, Sha256::Digest *digest, qint64 *narSize, QString *error)
+{
+    std::vector<char> buffer(kReadBlock);
+    NarHasher hasher(buffer);
+    if (!hasher.dump(fsPath, error)) return false;
+    *digest = hasher.finish();
+    *narSize = hasher.size();
+    return true;
+}
+
+QString StoreVerifier::Result::summary() const
+{
+    QString s = QString("Verified %1 paths, %2 MiB in %3 s (%4 MB/s, %5 threads, %6)")
+                    .arg(paths).arg(bytes >> 20).arg(elapsedMs / 1000.0, 0, 'f', 1)
+                    .arg(mbps(), 0, 'f', 0).arg(threads).arg(implementation);
+    if (!mismatches.isEmpty()) s += QString(": %1 mismatched").arg(mismatches.size());
+    return s;
+}
+
+QJsonObject StoreVerifier::Result::toJson() const
+{
+    QJsonArray bad;
+    for (const Mismatch &m : mismatches) {
+        bad.append(QJsonObject { { "path", m.path }, { "expected", m.expected },
+                                 { "actual", m.actual }, { "reason", m.reason } });
+    }
+    return QJsonObject {
+        { "paths", paths },
+        { "bytes", bytes },
+        { "ms", elapsedMs },
+        { "MBps", mbps() },
+        { "threads", threads },
+        { "sha256", implementation },
+        { "mismatches", bad } };
+}
+
+bool StoreVerifier::verify(const QString &root, const QStringList &paths,
+                           const std::function<bool()> &cancelled,
+                           const std::function<void(qint64 done, qint64 total)> &progress,
+                           Result *result, QString *error)
+{
+    *result = Result();
+    QElapsedTimer timer;
+    timer.start();
+    QList<Expected> expected = recordedHashes(root, paths, error);
+    if (expected.isEmpty()) {
+        if (error->isEmpty()) *error = "No store paths to verify";
+        return false;
+    }
+    // Largest first, so one huge path does not finish last on a single core
+    std::sort(expected.begin(), expected.end(), [](const Expected &a, const Expected &b) { return a.narSize > b.narSize; });
+    qint64 total = 0;
+    for (const Expected &e : std::as_const(expected)) total += e.narSize;
+    const QString prefix = root == "/" ? QString() : root;
+
+    const int workers = threads > 0 ? threads : qMax(1, QThread::idealThreadCount());
+    result->threads = workers;
+    result->implementation = QString::fromLatin1(Sha256::implementation());
+    std::atomic<int> next { 0 };
+    std::atomic<qint64> done { 0 };
+    std::atomic<int> running { workers };
+    std::mutex mutex;
+    std::vector<std::thread> pool;
+    for (int w = 0; w < workers; ++w) {
+        pool.emplace_back([&]() {
+            std::vector<char> buffer(kReadBlock);
+            for (int i = next++; i < expected.size(); i = next++) {
+                if (cancelled && cancelled()) break;
+                const Expected &e = expected.at(i);
+                NarHasher hasher(buffer);
+                QString readError;
+                Mismatch m;
+                if (!hasher.dump(QFile::encodeName(prefix + e.path), &readError)) {
+                    m.reason = readError;
+                } else {
+                    const Sha256::Digest digest = hasher.finish();
+                    if (!hashMatches(e.narHash, digest)) {
+                        m.actual = "sha256:" + nixBase32(digest);
+                        m.reason = "hash mismatch";
+                    } else if (e.narSize > 0 && hasher.size() != e.narSize) {
+                        m.actual = "sha256:" + nixBase32(digest);
+                        m.reason = QString("size %1, recorded %2").arg(hasher.size()).arg(e.narSize);
+                    }
+                }
+                done += e.narSize;
+                if (m.reason.isEmpty()) continue;
+                m.path = e.path;
+                m.expected = e.narHash;
+                std::lock_guard<std::mutex> lock(mutex);
+                result->mismatches.append(m);
+            }
+            running.fetch_sub(1);
+        });
+    }
+    while (running.load() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        if (progress) progress(done.load(), total);
+    }
+    for (std::thread &t : pool) t.join();
+
+    result->paths = int(qMin<qint64>(next.load(), expected.size()));
+    result->bytes = done.load();
+    result->elapsedMs = timer.elapsed();
+    if (progress) progress(done.load(), total);
+    if (cancelled && cancelled()) {
+        *error = "Cancelled";
+        return false;
+    }
+    return true;
+}
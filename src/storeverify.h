@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+#include "sha256.h"
+
+// Proves that the store paths written to the target are what Nix recorded:
+// every path is serialised as a NAR on the fly (nothing is buffered beyond a
+// read block) and hashed with SHA-256, one path per core, largest first.
+// The digest is compared with the narHash and narSize in the target database,
+// so this checks the same thing as `nix-store --verify --check-contents`
+// without its one-path-at-a-time pace.
+class StoreVerifier
+{
+public:
+    struct Mismatch {
+        QString path;
+        QString expected;
+        QString actual;                 // empty when the path could not be read
+        QString reason;
+    };
+
+    struct Result {
+        int paths = 0;
+        qint64 bytes = 0;               // NAR bytes hashed
+        qint64 elapsedMs = 0;
+        int threads = 0;
+        QString implementation;         // Sha256::implementation()
+        QList<Mismatch> mismatches;
+
+        bool ok() const { return mismatches.isEmpty(); }
+        double mbps() const { return elapsedMs > 0 ? bytes / 1e3 / elapsedMs : 0.0; }
+        QString summary() const;
+        QJsonObject toJson() const;
+    };
+
+    int threads = 0;                    // 0 = QThread::idealThreadCount()
+
+    // Checks the closures of `paths` in the store under `root` ("/" for the
+    // running system); an empty list checks every valid path. Blocking; run
+    // on a worker thread. False only when nothing could be checked.
+    bool verify(const QString &root, const QStringList &paths,
+                const std::function<bool()> &cancelled,
+                const std::function<void(qint64 done, qint64 total)> &progress,
+                Result *result, QString *error);
+
+    // sha256 of the NAR serialisation of `fsPath`.
+    static bool narHash(const QByteArray &fsPath, Sha256::Digest *digest, qint64 *narSize, QString *error);
+    // Nix's base-32 ("sha256:0m...") form of a digest.
+    static QString nixBase32(const Sha256::Digest &digest);
+};
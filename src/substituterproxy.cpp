@@ -0,0 +1,370 @@
+#include "substituterproxy.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QRandomGenerator>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+namespace {
+
+const qint64 kChunk = 256 * 1024;
+const qint64 kMaxQueued = 1024 * 1024;  // keep at most this much in the socket buffer
+const int kNegativeTtlSecs = 300;
+
+// Returns 0 without a usable Range header, 1 with [start, end] set and -1
+// when the range cannot be satisfied.
+int parseRange(const QByteArray &header, qint64 size, qint64 *start, qint64 *end)
+{
+    if (!header.startsWith("bytes=") || header.contains(',')) return 0;
+    const QByteArray spec = header.mid(6).trimmed();
+    const int dash = spec.indexOf('-');
+    if (dash < 0) return 0;
+    const QByteArray a = spec.left(dash), b = spec.mid(dash + 1);
+    bool ok = true;
+    if (a.isEmpty()) {
+        // Suffix range: the last N bytes
+        const qint64 n = b.toLongLong(&ok);
+        if (!ok || n <= 0) return -1;
+        *start = qMax<qint64>(0, size - n);
+        *end = size - 1;
+    } else {
+        *start = a.toLongLong(&ok);
+        if (!ok) return 0;
+        *end = b.isEmpty() ? size - 1 : qMin(size - 1, b.toLongLong(&ok));
+        if (!ok) return 0;
+    }
+    if (*start >= size || *start > *end) return -1;
+    return 1;
+}
+
+QByteArray contentType(const QString &path)
+{
+    if (path.endsWith(".narinfo")) return "text/x-nix-narinfo";
+    if (path == "nix-cache-info") return "text/x-nix-cache-info";
+    return "application/x-nix-nar";
+}
+
+} // namespace
+
+SubstituterProxy::SubstituterProxy(const QString &cacheDir, const QUrl &upstream, QObject *parent)
+    : QObject(parent), cacheDir_(cacheDir), upstream_(upstream)
+{
+    QDir().mkpath(cacheDir_ + "/nar");
+    QDir().mkpath(cacheDir_ + "/tmp");
+    server_ = new QTcpServer(this);
+    net_ = new QNetworkAccessManager(this);
+    QObject::connect(server_, &QTcpServer::newConnection, this, [this]() { onNewConnection(); });
+}
+
+SubstituterProxy::~SubstituterProxy()
+{
+    for (Connection &c : connections_) delete c.sending;
+    for (Fetch &f : fetches_) {
+        if (f.file) f.file->remove();
+        delete f.file;
+    }
+}
+
+bool SubstituterProxy::listen(const QHostAddress &address, quint16 port)
+{
+    return server_->listen(address, port);
+}
+
+bool SubstituterProxy::listen(const QString &spec)
+{
+    const int colon = spec.lastIndexOf(':');
+    const QString host = colon >= 0 ? spec.left(colon) : QString();
+    const quint16 port = quint16((colon >= 0 ? spec.mid(colon + 1) : spec).toUInt());
+    return listen(host.isEmpty() ? QHostAddress(QHostAddress::LocalHost) : QHostAddress(host), port);
+}
+
+QString SubstituterProxy::substituterUrl() const
+{
+    if (!server_->isListening()) return QString();
+    // Between a boot medium cache (10) and cache.nixos.org (40)
+    return QString("http://127.0.0.1:%1?priority=30").arg(server_->serverPort());
+}
+
+QString SubstituterProxy::summary() const
+{
+    return QString("Cache proxy: %1 hits, %2 fetched (%3 joined in-flight), %4 MiB served, %5 MiB from upstream")
+        .arg(stats_.hits).arg(stats_.misses).arg(stats_.coalesced)
+        .arg(stats_.bytesServed / (1024.0 * 1024.0), 0, 'f', 1)
+        .arg(stats_.bytesFetched / (1024.0 * 1024.0), 0, 'f', 1);
+}
+
+QString SubstituterProxy::errorString() const
+{
+    return server_->errorString();
+}
+
+bool SubstituterProxy::cacheable(const QString &path)
+{
+    if (path.contains("..")) return false;
+    if (path == "nix-cache-info") return true;
+    if (path.endsWith(".narinfo")) return !path.contains('/');
+    if (path.startsWith("nar/")) return !path.mid(4).contains('/');
+    return false;
+}
+
+QString SubstituterProxy::localPath(const QString &key) const
+{
+    return cacheDir_ + "/" + key;
+}
+
+void SubstituterProxy::onNewConnection()
+{
+    while (server_->hasPendingConnections()) {
+        QTcpSocket *sock = server_->nextPendingConnection();
+        connections_.insert(sock, Connection());
+        QObject::connect(sock, &QTcpSocket::readyRead, this, [this, sock]() {
+            auto it = connections_.find(sock);
+            if (it == connections_.end()) return;
+            it->buffer += sock->readAll();
+            processBuffer(sock);
+        });
+        QObject::connect(sock, &QTcpSocket::bytesWritten, this, [this, sock]() { pump(sock); });
+        QObject::connect(sock, &QTcpSocket::disconnected, this, [this, sock]() {
+            auto it = connections_.find(sock);
+            if (it != connections_.end()) {
+                delete it->sending;
+                connections_.erase(it);
+            }
+            sock->deleteLater();
+        });
+    }
+}
+
+void SubstituterProxy::processBuffer(QTcpSocket *sock)
+{
+    auto it = connections_.find(sock);
+    if (it == connections_.end() || it->busy) return;
+    const int end = it->buffer.indexOf("\r\n\r\n");
+    if (end < 0) {
+        if (it->buffer.size() > 16 * 1024) sock->abort();
+        return;
+    }
+    const QList<QByteArray> lines = it->buffer.left(end).split('\n');
+    it->buffer.remove(0, end + 4);
+    it->busy = true;
+
+    const QList<QByteArray> requestLine = lines.value(0).trimmed().split(' ');
+    Request req;
+    req.socket = sock;
+    req.method = QString::fromLatin1(requestLine.value(0));
+    QString path = QString::fromLatin1(requestLine.value(1));
+    path = path.section('?', 0, 0);
+    while (path.startsWith('/')) path.remove(0, 1);
+    req.path = QUrl::fromPercentEncoding(path.toLatin1());
+    for (int i = 1; i < lines.size(); ++i) {
+        const QByteArray line = lines[i].trimmed();
+        if (line.toLower().startsWith("range:")) req.range = line.mid(6).trimmed();
+    }
+    handle(req);
+}
+
+void SubstituterProxy::handle(const Request &req)
+{
+    QTcpSocket *sock = req.socket;
+    if (!sock) return;
+    if (req.method != "GET" && req.method != "HEAD") {
+        sendSimple(sock, 405, "Method Not Allowed");
+        return;
+    }
+    if (!cacheable(req.path)) {
+        sendSimple(sock, 404, "Not Found");
+        return;
+    }
+    const QString file = localPath(req.path);
+    if (QFileInfo::exists(file)) {
+        ++stats_.hits;
+        serveFile(req, file);
+        return;
+    }
+    auto neg = negative_.find(req.path);
+    if (neg != negative_.end()) {
+        if (neg->secsTo(QDateTime::currentDateTimeUtc()) < kNegativeTtlSecs) {
+            sendSimple(sock, 404, "Not Found");
+            return;
+        }
+        negative_.erase(neg);
+    }
+    fetch(req, req.path);
+}
+
+void SubstituterProxy::serveFile(const Request &req, const QString &path)
+{
+    QTcpSocket *sock = req.socket;
+    auto it = connections_.find(sock);
+    if (!sock || it == connections_.end()) return;
+    QFile *f = new QFile(path);
+    if (!f->open(QIODevice::ReadOnly)) {
+        delete f;
+        sendSimple(sock, 500, "Internal Server Error");
+        return;
+    }
+    const qint64 size = f->size();
+    qint64 start = 0, end = size - 1;
+    const int ranged = size > 0 ? parseRange(req.range, size, &start, &end) : 0;
+    if (ranged < 0) {
+        delete f;
+        QByteArray head = "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Length: 0\r\n";
+        head += "Content-Range: bytes */" + QByteArray::number(size) + "\r\n\r\n";
+        sock->write(head);
+        finishResponse(sock);
+        return;
+    }
+    const qint64 length = size > 0 ? end - start + 1 : 0;
+    QByteArray head = ranged > 0 ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+    head += "Content-Type: " + contentType(req.path) + "\r\n";
+    head += "Content-Length: " + QByteArray::number(length) + "\r\n";
+    head += "Accept-Ranges: bytes\r\n";
+    if (ranged > 0) {
+        head += "Content-Range: bytes " + QByteArray::number(start) + "-" + QByteArray::number(end)
+              + "/" + QByteArray::number(size) + "\r\n";
+    }
+    head += "\r\n";
+    sock->write(head);
+    if (req.method == "HEAD" || length == 0) {
+        delete f;
+        finishResponse(sock);
+        return;
+    }
+    f->seek(start);
+    it->sending = f;
+    it->remaining = length;
+    pump(sock);
+}
+
+void SubstituterProxy::pump(QTcpSocket *sock)
+{
+    auto it = connections_.find(sock);
+    if (it == connections_.end() || !it->sending) return;
+    // NARs can be hundreds of MiB; stream them instead of buffering
+    while (it->remaining > 0 && sock->bytesToWrite() < kMaxQueued) {
+        const QByteArray chunk = it->sending->read(qMin(kChunk, it->remaining));
+        if (chunk.isEmpty()) {
+            sock->abort();
+            return;
+        }
+        sock->write(chunk);
+        it->remaining -= chunk.size();
+        stats_.bytesServed += chunk.size();
+    }
+    if (it->remaining == 0) {
+        delete it->sending;
+        it->sending = nullptr;
+        finishResponse(sock);
+    }
+}
+
+void SubstituterProxy::sendSimple(QTcpSocket *sock, int status, const QByteArray &reason, const QByteArray &body)
+{
+    QByteArray head = "HTTP/1.1 " + QByteArray::number(status) + " " + reason + "\r\n";
+    head += "Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n";
+    sock->write(head + body);
+    finishResponse(sock);
+}
+
+void SubstituterProxy::finishResponse(QTcpSocket *sock)
+{
+    auto it = connections_.find(sock);
+    if (it == connections_.end()) return;
+    it->busy = false;
+    // Keep-alive: the client may already have sent its next request
+    if (!it->buffer.isEmpty()) {
+        QPointer<QTcpSocket> guard(sock);
+        QMetaObject::invokeMethod(this, [this, guard]() { if (guard) processBuffer(guard); }, Qt::QueuedConnection);
+    }
+}
+
+void SubstituterProxy::fetch(const Request &req, const QString &key)
+{
+    auto existing = fetches_.find(key);
+    if (existing != fetches_.end()) {
+        ++stats_.coalesced;
+        existing->waiters << req;
+        return;
+    }
+    ++stats_.misses;
+
+    Fetch f;
+    QString tmpName = key;
+    tmpName.replace('/', '_');
+    f.file = new QFile(QString("%1/tmp/%2.%3.part").arg(cacheDir_, tmpName)
+                           .arg(QRandomGenerator::global()->generate(), 8, 16, QChar('0')));
+    if (!f.file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        delete f.file;
+        if (req.socket) sendSimple(req.socket, 500, "Internal Server Error");
+        return;
+    }
+    f.waiters << req;
+    fetches_.insert(key, f);
+
+    QUrl url(upstream_.toString(QUrl::StripTrailingSlash) + "/" + key);
+    QNetworkRequest nreq(url);
+    nreq.setRawHeader("User-Agent", "NixlyInstall");
+    QNetworkReply *reply = net_->get(nreq);
+    QObject::connect(reply, &QNetworkReply::readyRead, this, [this, reply, key]() {
+        auto it = fetches_.find(key);
+        if (it == fetches_.end()) return;
+        const QByteArray data = reply->readAll();
+        it->file->write(data);
+        stats_.bytesFetched += data.size();
+    });
+    QObject::connect(reply, &QNetworkReply::finished, this, [this, reply, key]() {
+        reply->deleteLater();
+        auto it = fetches_.find(key);
+        if (it == fetches_.end()) return;
+        Fetch done = *it;
+        fetches_.erase(it);
+
+        const QByteArray rest = reply->readAll();
+        done.file->write(rest);
+        stats_.bytesFetched += rest.size();
+        const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        const bool ok = reply->error() == QNetworkReply::NoError && status == 200 && done.file->flush();
+        done.file->close();
+
+        const QString finalPath = localPath(key);
+        if (ok) {
+            // Rename is atomic, so readers never see a partial file
+            QFile::remove(finalPath);
+            if (!done.file->rename(finalPath)) done.file->remove();
+        } else {
+            done.file->remove();
+            if (status == 404 || status == 403) rememberMissing(key);
+        }
+        delete done.file;
+
+        for (const Request &w : std::as_const(done.waiters)) {
+            if (!w.socket) continue;
+            if (ok && QFileInfo::exists(finalPath)) serveFile(w, finalPath);
+            else if (status == 404 || status == 403) sendSimple(w.socket, 404, "Not Found");
+            else sendSimple(w.socket, 502, "Bad Gateway");
+        }
+    });
+}
+
+void SubstituterProxy::rememberMissing(const QString &key)
+{
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    // Oldest first: expired entries, then whatever is over the limit
+    while (!negativeOrder_.isEmpty()) {
+        const QString oldKey = negativeOrder_.head().first;
+        const QDateTime at = negativeOrder_.head().second;
+        // Not dropped by handle() or remembered again since
+        const bool current = negative_.value(oldKey) == at;
+        if (current && at.secsTo(now) < kNegativeTtlSecs && negative_.size() < maxNegativeEntries) break;
+        if (current) negative_.remove(oldKey);
+        negativeOrder_.dequeue();
+    }
+    if (maxNegativeEntries <= 0) return;
+    negative_.insert(key, now);
+    negativeOrder_.enqueue({ key, now });
+}
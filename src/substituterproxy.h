@@ -0,0 +1,95 @@
+#pragma once
+
+#include <QDateTime>
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QPointer>
+#include <QQueue>
+#include <QString>
+#include <QUrl>
+
+class QFile;
+class QNetworkAccessManager;
+class QTcpServer;
+class QTcpSocket;
+
+// Caching HTTP proxy for a Nix binary cache. Answers /nix-cache-info,
+// <hash>.narinfo and /nar/... from a directory on disk and fetches misses
+// from the upstream cache once, however many clients ask for the same path
+// at the same time. The on-disk layout mirrors the upstream URLs, which are
+// content-addressed, so the directory can be reused across retries and
+// shared with other installers pointed at this proxy.
+class SubstituterProxy : public QObject
+{
+public:
+    struct Stats {
+        int hits = 0;
+        int misses = 0;
+        int coalesced = 0;              // requests that joined an in-flight fetch
+        qint64 bytesServed = 0;
+        qint64 bytesFetched = 0;
+    };
+
+    explicit SubstituterProxy(const QString &cacheDir,
+                              const QUrl &upstream = QUrl("https://cache.nixos.org"),
+                              QObject *parent = nullptr);
+    ~SubstituterProxy() override;
+
+    bool listen(const QHostAddress &address = QHostAddress::LocalHost, quint16 port = 0);
+    // "host:port", "0.0.0.0:37515" or just a port
+    bool listen(const QString &spec);
+    // Substituter URL for nix, ordered between a boot medium cache and cache.nixos.org
+    QString substituterUrl() const;
+    QString cacheDir() const { return cacheDir_; }
+    const Stats &stats() const { return stats_; }
+    QString summary() const;
+    // Why listen() failed
+    QString errorString() const;
+
+    // Upstream 404s are remembered for a few minutes, up to this many paths;
+    // the oldest are forgotten first
+    int maxNegativeEntries = 4096;
+
+private:
+    struct Request {
+        QPointer<QTcpSocket> socket;
+        QString method;
+        QString path;
+        QByteArray range;
+    };
+    struct Fetch {
+        QFile *file = nullptr;
+        QList<Request> waiters;
+    };
+    struct Connection {
+        QByteArray buffer;
+        bool busy = false;
+        QFile *sending = nullptr;
+        qint64 remaining = 0;
+    };
+
+    void onNewConnection();
+    void processBuffer(QTcpSocket *socket);
+    void handle(const Request &req);
+    void serveFile(const Request &req, const QString &file);
+    void pump(QTcpSocket *socket);
+    void sendSimple(QTcpSocket *socket, int status, const QByteArray &reason, const QByteArray &body = QByteArray());
+    void finishResponse(QTcpSocket *socket);
+    void fetch(const Request &req, const QString &key);
+    void rememberMissing(const QString &key);
+    QString localPath(const QString &key) const;
+    static bool cacheable(const QString &path);
+
+    QString cacheDir_;
+    QUrl upstream_;
+    QTcpServer *server_ = nullptr;
+    QNetworkAccessManager *net_ = nullptr;
+    QHash<QTcpSocket*, Connection> connections_;
+    QHash<QString, Fetch> fetches_;
+    QHash<QString, QDateTime> negative_;    // recent upstream 404s
+    QQueue<QPair<QString, QDateTime>> negativeOrder_;   // the same, oldest first
+    Stats stats_;
+};
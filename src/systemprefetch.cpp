@@ -0,0 +1,160 @@
+#include "systemprefetch.h"
+#include "backend.h"
+#include "memorybudget.h"
+#include "tracer.h"
+
+#include <QProcess>
+#include <QTimer>
+
+SystemPrefetcher::SystemPrefetcher(QObject *parent)
+    : QObject(parent),
+      progress_(std::make_unique<NixProgress>())
+{
+    // /proc and cgroup reads only; cheap enough for the GUI thread
+    memoryCheck_ = new QTimer(this);
+    memoryCheck_->setInterval(2000);
+    QObject::connect(memoryCheck_, &QTimer::timeout, this, [this]() {
+        const QString shortage = memoryShortage();
+        if (shortage.isEmpty() || !process_) return;
+        stopProcess();
+        finish(State::Skipped, "stopped: " + shortage);
+    });
+}
+
+SystemPrefetcher::~SystemPrefetcher()
+{
+    if (process_) {
+        process_->disconnect();
+        process_->kill();
+        process_->waitForFinished(2000);
+    }
+}
+
+QString SystemPrefetcher::keyFor(const QString &repoUrl, const QString &branch,
+                                 const QString &flakeDir, const QString &host)
+{
+    Backend::assertOffGuiThread("SystemPrefetcher::keyFor");
+    QProcess git;
+    git.start("git", { "-C", flakeDir, "rev-parse", "HEAD" });
+    git.waitForFinished(5000);
+    const QString rev = QString::fromUtf8(git.readAllStandardOutput()).trimmed();
+    return QStringList { repoUrl, branch, rev, host }.join('|');
+}
+
+void SystemPrefetcher::start(const QString &key, const QString &flakeDir, const QString &host,
+                             const QStringList &extraSubstituters)
+{
+    if (key == key_ && (state_ == State::Running || state_ == State::Done)) return;
+    cancel();
+    const QString shortage = memoryShortage();
+    if (!shortage.isEmpty()) {
+        key_ = key;
+        clock_.start();
+        finish(State::Skipped, "skipped: " + shortage);
+        return;
+    }
+
+    key_ = key;
+    systemPath_.clear();
+    error_.clear();
+    lineBuffer_.clear();
+    progress_->reset();
+    clock_.start();
+    state_ = State::Running;
+
+    QStringList args { "build", "--extra-experimental-features", "nix-command flakes",
+                       "--no-link", "--print-out-paths", "--log-format", "internal-json", "-v" };
+    if (!extraSubstituters.isEmpty()) args << "--option" << "extra-substituters" << extraSubstituters.join(' ');
+    args << QString("%1#nixosConfigurations.%2.config.system.build.toplevel").arg(flakeDir, host);
+
+    QProcess *p = new QProcess(this);
+    NIXLY_TRACE_PROCESS(p, "prefetch");
+    process_ = p;
+    p->setProcessChannelMode(QProcess::MergedChannels);
+    QObject::connect(p, &QProcess::readyReadStandardOutput, this, [this, p]() {
+        lineBuffer_ += p->readAllStandardOutput();
+        int nl;
+        while ((nl = lineBuffer_.indexOf('\n')) >= 0) {
+            const QByteArray line = lineBuffer_.left(nl).trimmed();
+            lineBuffer_.remove(0, nl + 1);
+            if (line.startsWith("@nix ")) progress_->feedLine(line);
+            else if (line.startsWith("/nix/store/") && !line.contains(' ')) systemPath_ = QString::fromUtf8(line);
+        }
+    });
+    QObject::connect(p, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
+                     [this, p](int exitCode, QProcess::ExitStatus es) {
+        if (p != process_) return;
+        process_ = nullptr;
+        p->deleteLater();
+        if (state_ != State::Running) return;
+        if (es == QProcess::NormalExit && exitCode == 0 && !systemPath_.isEmpty()) {
+            finish(State::Done);
+        } else {
+            const QString err = progress_->snapshot().lastError;
+            finish(State::Failed, err.isEmpty() ? QString("nix build exited with %1").arg(exitCode) : err);
+        }
+    });
+    QObject::connect(p, &QProcess::errorOccurred, this, [this, p](QProcess::ProcessError err) {
+        if (err != QProcess::FailedToStart || p != process_) return;
+        process_ = nullptr;
+        p->deleteLater();
+        finish(State::Failed, "Could not start nix: " + p->errorString());
+    });
+    p->start("nix", args);
+    memoryCheck_->start();
+}
+
+void SystemPrefetcher::cancel()
+{
+    if (!process_) return;
+    stopProcess();
+    finish(State::Cancelled);
+}
+
+void SystemPrefetcher::stopProcess()
+{
+    memoryCheck_->stop();
+    QProcess *p = process_;
+    process_ = nullptr;
+    p->disconnect(this);
+    // nix cleans up its locks on SIGTERM; the kill is for a stuck download
+    p->terminate();
+    QTimer::singleShot(3000, p, [p]() { p->kill(); });
+    QObject::connect(p, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), p, &QObject::deleteLater);
+}
+
+QString SystemPrefetcher::memoryShortage()
+{
+    // Evaluation plus the later build of an average system; the closure it
+    // stages comes out of the same RAM, so this is checked while it grows
+    const MemoryBudget::Assessment a = MemoryBudget::assess(QString());
+    if (!a.constrained()) return QString();
+    return QString("memory is short for staging the system in RAM (%1)").arg(a.summary());
+}
+
+void SystemPrefetcher::finish(State state, const QString &error)
+{
+    memoryCheck_->stop();
+    state_ = state;
+    error_ = error;
+    if (onFinished) onFinished();
+}
+
+QString SystemPrefetcher::summary() const
+{
+    const QString secs = QString::number(clock_.isValid() ? clock_.elapsed() / 1000 : 0);
+    const NixProgress::Snapshot s = progress_->snapshot();
+    switch (state_) {
+        case State::Idle: return QString();
+        case State::Running:
+            if (s.pathsExpected == 0 && s.buildsExpected == 0) return QString("Prefetch: evaluating the configuration (%1 s)").arg(secs);
+            return "Prefetch: " + s.summary();
+        case State::Done:
+            return QString("Prefetch: system ready, %1 paths and %2 MiB fetched before install")
+                .arg(s.pathsDone).arg(s.downloadDone >> 20);
+        case State::Failed: return "Prefetch failed: " + error_;
+        case State::Cancelled: return QString("Prefetch cancelled");
+        case State::Skipped: return "Prefetch " + error_ + "; the install downloads the rest";
+    }
+    return QString();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <functional>
+#include <memory>
+
+#include "nixprogress.h"
+
+class QProcess;
+class QTimer;
+
+// Evaluates and realises the chosen system in the background as soon as the
+// configuration is cloned, so downloads overlap the time spent on the drive
+// and settings pages. The live system's store is the staging store: the
+// build-system step substitutes from it (auto?trusted=1) into the target, so
+// prefetched paths are copied locally instead of downloaded again.
+//
+// On the ISO that store is RAM. A prefetch only starts while the memory
+// budget (see memorybudget.h) leaves room for the install's own build, and
+// it stops as soon as it no longer does; what it fetched until then is kept.
+class SystemPrefetcher : public QObject
+{
+public:
+    enum class State { Idle, Running, Done, Failed, Cancelled, Skipped };
+
+    explicit SystemPrefetcher(QObject *parent = nullptr);
+    ~SystemPrefetcher() override;
+
+    // Identifies a choice: repository, branch, checked-out revision and host.
+    // Blocking, it asks git; run it on the backend pool.
+    static QString keyFor(const QString &repoUrl, const QString &branch,
+                          const QString &flakeDir, const QString &host);
+
+    // Starts prefetching `host` from `flakeDir`. Nothing happens when the same
+    // key is already running or done; a different key cancels the old run.
+    void start(const QString &key, const QString &flakeDir, const QString &host,
+               const QStringList &extraSubstituters = {});
+    void cancel();
+
+    State state() const { return state_; }
+    bool isRunning() const { return state_ == State::Running; }
+    QString key() const { return key_; }
+    QString systemPath() const { return systemPath_; }
+    QString error() const { return error_; }
+    NixProgress::Snapshot progress() const { return progress_->snapshot(); }
+    QString summary() const;
+
+    // On the GUI thread, once per run that ends (done, failed or cancelled).
+    std::function<void()> onFinished;
+
+private:
+    void finish(State state, const QString &error = QString());
+    // Stops nix without reporting; finish() says why
+    void stopProcess();
+    // Empty while the live session can afford to stage more
+    static QString memoryShortage();
+
+    QProcess *process_ = nullptr;
+    QTimer *memoryCheck_ = nullptr;
+    std::unique_ptr<NixProgress> progress_;
+    QByteArray lineBuffer_;
+    QElapsedTimer clock_;
+    State state_ = State::Idle;
+    QString key_;
+    QString systemPath_;
+    QString error_;
+};
@@ -0,0 +1,196 @@
+#include "theme.h"
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QProxyStyle>
+#include <QStyleFactory>
+#include <QWidget>
+
+namespace {
+
+// Roles, by widget type:
+//   QLabel       title lead intro heading label field item logo badge spinner
+//                oneTime banner detail caption stepName stepState
+//   QPushButton  menu primary large compact listItem (unset: secondary)
+//   QLineEdit    code token (unset: the common input)
+//   any          card driveRow tip
+// Tone rules come after the roles: at equal specificity the later rule sets
+// the colour.
+const char *const kStyleSheet = R"(
+QLabel { color: #cccccc; font-size: 14px; background: transparent; }
+QLabel[role="title"] { color: white; font-size: 28px; font-weight: bold; }
+QLabel[role="lead"] { font-size: 16px; }
+QLabel[role="intro"] { font-size: 15px; }
+QLabel[role="heading"] { color: #e6e6e6; font-size: 16px; font-weight: bold; }
+QLabel[role="label"] { color: #e6e6e6; font-weight: bold; }
+QLabel[role="field"] { color: white; font-weight: bold; }
+QLabel[role="item"] { color: #e6e6e6; }
+QLabel[role="logo"] { color: #0078D4; font-size: 32px; font-weight: bold; }
+QLabel[role="badge"] { background-color: #0078D4; color: white; border-radius: 16px; font-size: 16px; font-weight: bold; }
+QLabel[role="spinner"] { color: white; font-size: 80px; }
+QLabel[role="oneTime"] { font-size: 18px; font-weight: bold; }
+QLabel[role="banner"] { font-size: 16px; }
+QLabel[role="detail"] { font-size: 13px; }
+QLabel[role="caption"] { color: #888888; font-size: 12px; }
+QLabel[role="stepName"] { color: #e6e6e6; font-size: 13px; }
+QLabel[role="stepState"] { font-size: 13px; font-weight: bold; }
+
+QLabel[tone="neutral"] { color: #cccccc; }
+QLabel[tone="muted"] { color: #888888; }
+QLabel[tone="working"] { color: #FFAA00; }
+QLabel[tone="ok"] { color: #00AA00; }
+QLabel[tone="error"] { color: #FF6B6B; }
+QLabel[role="banner"][tone="ok"] { font-weight: bold; }
+
+QCheckBox { color: #cccccc; font-size: 14px; }
+
+QPushButton { background-color: #2A2A2A; color: white; border: 1px solid #444444; border-radius: 5px; padding: 10px 16px; font-weight: bold; }
+QPushButton:hover { background-color: #3A3A3A; }
+QPushButton:pressed { background-color: #1A1A1A; }
+QPushButton:disabled { background-color: #1A1A1A; color: #666666; border-color: #333333; }
+QPushButton[role="large"] { border-radius: 8px; padding: 12px 18px; font-size: 14px; }
+QPushButton[role="compact"] { padding: 6px 14px; font-size: 13px; font-weight: normal; }
+QPushButton[role="listItem"] { padding: 12px; font-size: 14px; font-weight: normal; text-align: left; }
+QPushButton[role="menu"] { padding: 8px 16px; font-size: 12px; }
+QPushButton[role="menu"]:hover { border-color: #666666; }
+QPushButton[role="menu"]:checked { background-color: #0078D4; border-color: #106EBE; }
+QPushButton[role="menu"]:pressed { background-color: #005A9E; }
+QPushButton[role="menu"]:disabled { background-color: #1A1A1A; color: #666666; border-color: #333333; }
+QPushButton[role="primary"] { background-color: #0078D4; border: none; border-radius: 8px; padding: 12px 24px; font-size: 16px; }
+QPushButton[role="primary"]:hover { background-color: #106EBE; }
+QPushButton[role="primary"]:pressed { background-color: #005A9E; }
+QPushButton[role="primary"]:disabled { background-color: #1A1A1A; color: #666666; }
+
+QLineEdit { background-color: #2A2A2A; color: white; border: 1px solid #444444; border-radius: 5px; padding: 8px; }
+QLineEdit[role="code"] { color: #EEEEEE; font-size: 18px; font-weight: bold; }
+QLineEdit[role="token"] { background-color: #1F1F1F; color: #E6E6E6; border-color: #555555; border-radius: 6px; padding: 10px; font-family: Monospace; font-size: 14px; }
+
+QComboBox { background-color: #2A2A2A; color: white; border: 1px solid #444444; border-radius: 5px; padding: 6px; }
+QComboBox QAbstractItemView { background-color: #1E1E1E; color: #e6e6e6; selection-background-color: #2a3f5a; }
+
+QListWidget { background-color: #1E1E1E; color: #e6e6e6; border: 1px solid #3A3A3A; border-radius: 5px; font-size: 14px; }
+QListWidget::item { padding: 6px; border-bottom: 1px solid #2A2A2A; }
+QListWidget::item:selected { background-color: #2a3f5a; color: white; }
+
+QProgressBar { background-color: #2A2A2A; border: none; border-radius: 5px; }
+QProgressBar::chunk { background-color: #0078D4; border-radius: 5px; }
+
+QPlainTextEdit { background-color: #1F1F1F; color: #BBBBBB; border: 1px solid #3A3A3A; border-radius: 6px; font-family: Monospace; font-size: 12px; }
+
+*[role="card"] { background-color: #232323; border: 1px solid #3A3A3A; border-radius: 8px; }
+*[role="tip"] { background-color: #1e1e1e; border: 1px solid #3A3A3A; border-radius: 6px; }
+QFrame[role="driveRow"] { background-color: transparent; border: none; border-bottom: 1px solid #3A3A3A; }
+QFrame[role="driveRow"]:hover { background-color: #2A2A2A; }
+QFrame[role="driveRow"][selected="true"] { background-color: #2a3f5a; }
+)";
+
+const char *toneName(Theme::Tone tone)
+{
+    switch (tone) {
+        case Theme::Tone::Muted: return "muted";
+        case Theme::Tone::Working: return "working";
+        case Theme::Tone::Ok: return "ok";
+        case Theme::Tone::Error: return "error";
+        default: return "neutral";
+    }
+}
+
+// Property selectors are matched at polish time only
+void repolish(QWidget *w)
+{
+    w->style()->unpolish(w);
+    w->style()->polish(w);
+    w->update();
+}
+
+// Fusion with the installer's palette; what the stylesheet leaves alone
+// (scroll bars, message boxes, menus) follows it too
+class NixlyStyle : public QProxyStyle
+{
+public:
+    NixlyStyle() : QProxyStyle(QStyleFactory::create("Fusion")) {}
+
+    QPalette standardPalette() const override { return Theme::palette(); }
+
+    int styleHint(StyleHint hint, const QStyleOption *option, const QWidget *widget,
+                  QStyleHintReturn *returnData) const override
+    {
+        switch (hint) {
+            // Fusion animates progress bars and default buttons with timers
+            // that repaint while the installer is busy with real work
+            case SH_Widget_Animation_Duration: return 0;
+            case SH_UnderlineShortcut: return 0;
+            default: return QProxyStyle::styleHint(hint, option, widget, returnData);
+        }
+    }
+
+    int pixelMetric(PixelMetric metric, const QStyleOption *option, const QWidget *widget) const override
+    {
+        if (metric == PM_ScrollBarExtent) return 10;
+        return QProxyStyle::pixelMetric(metric, option, widget);
+    }
+};
+
+} // namespace
+
+QPalette Theme::palette()
+{
+    QPalette p;
+    p.setColor(QPalette::Window, QColor(26, 26, 26));
+    p.setColor(QPalette::WindowText, Qt::white);
+    p.setColor(QPalette::Base, QColor(0x1E, 0x1E, 0x1E));
+    p.setColor(QPalette::AlternateBase, QColor(0x23, 0x23, 0x23));
+    p.setColor(QPalette::Text, QColor(0xe6, 0xe6, 0xe6));
+    p.setColor(QPalette::PlaceholderText, QColor(0x88, 0x88, 0x88));
+    p.setColor(QPalette::Button, QColor(0x2A, 0x2A, 0x2A));
+    p.setColor(QPalette::ButtonText, Qt::white);
+    p.setColor(QPalette::Highlight, QColor(0x2a, 0x3f, 0x5a));
+    p.setColor(QPalette::HighlightedText, Qt::white);
+    p.setColor(QPalette::ToolTipBase, QColor(0x1e, 0x1e, 0x1e));
+    p.setColor(QPalette::ToolTipText, QColor(0xe6, 0xe6, 0xe6));
+    p.setColor(QPalette::Link, QColor(0x00, 0x78, 0xD4));
+    p.setColor(QPalette::Mid, QColor(0x3A, 0x3A, 0x3A));
+    p.setColor(QPalette::Disabled, QPalette::ButtonText, QColor(0x66, 0x66, 0x66));
+    p.setColor(QPalette::Disabled, QPalette::WindowText, QColor(0x66, 0x66, 0x66));
+    p.setColor(QPalette::Disabled, QPalette::Text, QColor(0x66, 0x66, 0x66));
+    return p;
+}
+
+const QString &Theme::styleSheet()
+{
+    static const QString sheet = QString::fromUtf8(kStyleSheet).simplified();
+    return sheet;
+}
+
+void Theme::install(QApplication &app)
+{
+    QElapsedTimer timer;
+    timer.start();
+    // The application takes ownership
+    app.setStyle(new NixlyStyle());
+    app.setPalette(palette());
+    app.setStyleSheet(styleSheet());
+    qInfo("Theme installed in %.1f ms", timer.nsecsElapsed() / 1e6);
+}
+
+void Theme::setRole(QWidget *w, const char *role)
+{
+    w->setProperty("role", role);
+    if (w->testAttribute(Qt::WA_WState_Polished)) repolish(w);
+}
+
+void Theme::setTone(QWidget *w, Tone tone)
+{
+    const char *name = toneName(tone);
+    if (w->property("tone").toByteArray() == name) return;
+    w->setProperty("tone", name);
+    // Not polished yet: the first polish picks the property up
+    if (w->testAttribute(Qt::WA_WState_Polished)) repolish(w);
+}
+
+void Theme::setSelected(QWidget *w, bool selected)
+{
+    if (w->property("selected").toBool() == selected) return;
+    w->setProperty("selected", selected);
+    if (w->testAttribute(Qt::WA_WState_Polished)) repolish(w);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QPalette>
+#include <QString>
+
+class QApplication;
+class QWidget;
+
+// The installer's look, in one place: a QProxyStyle over Fusion that supplies
+// the dark palette and a few metrics, plus one application stylesheet built
+// and parsed once at startup. Widgets pick their rules through the "role"
+// dynamic property instead of carrying a stylesheet of their own; changes of
+// state (a status turning red, a drive row being selected) flip the "tone"
+// or "selected" property and re-polish that one widget against the already
+// parsed sheet.
+class Theme
+{
+public:
+    enum class Tone { Neutral, Muted, Working, Ok, Error };
+
+    static void install(QApplication &app);
+
+    // Best before the widget is first polished, i.e. shown; later it costs a
+    // re-polish. Roles are listed at the top of theme.cpp.
+    static void setRole(QWidget *w, const char *role);
+    // Cheap when unchanged; otherwise re-polishes just `w`
+    static void setTone(QWidget *w, Tone tone);
+    static void setSelected(QWidget *w, bool selected);
+
+    static QPalette palette();
+    static const QString &styleSheet();
+};
@@ -0,0 +1,269 @@
+#include "tracer.h"
+
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QNetworkReply>
+#include <QProcess>
+#include <QThread>
+
+#include <chrono>
+#include <memory>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+std::atomic<bool> Tracer::enabled_ { false };
+
+namespace {
+
+struct Event
+{
+    quint64 tsNs;
+    quint64 durNs;
+    quint64 id;
+    quint64 parent;
+    qint64 result;
+    const char *category;
+    char phase;                         // 'X' complete, 'b'/'e' async, 'i' instant
+    bool hasResult;
+    char name[62];                      // truncated UTF-8, always terminated
+};
+
+// Written only by its own thread, which raises `writing` around each event.
+// The exporter turns tracing off and then waits for every flag to drop, so
+// it reads the slots only once no writer can touch them again.
+struct ThreadBuffer
+{
+    quint64 tid = 0;
+    QByteArray threadName;
+    std::atomic<bool> writing { false };
+    std::atomic<quint64> head { 0 };
+    std::unique_ptr<Event[]> events { new Event[Tracer::RingSize] };
+};
+
+QMutex registryMutex;
+std::vector<std::shared_ptr<ThreadBuffer>> registry;
+QString tracePath;
+std::chrono::steady_clock::time_point origin;
+std::atomic<quint64> nextId { 1 };
+thread_local quint64 currentSpan = 0;
+thread_local std::shared_ptr<ThreadBuffer> localBuffer;
+
+quint64 nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+ThreadBuffer *buffer()
+{
+    if (!localBuffer) {
+        // Once per thread; the registry keeps the buffer after the thread exits
+        auto b = std::make_shared<ThreadBuffer>();
+        b->tid = quint64(gettid());
+        QFile comm(QString("/proc/self/task/%1/comm").arg(b->tid));
+        if (comm.open(QIODevice::ReadOnly)) b->threadName = comm.readAll().trimmed();
+        if (b->tid == quint64(getpid())) b->threadName = "GUI";
+        QMutexLocker lock(&registryMutex);
+        registry.push_back(b);
+        localBuffer = b;
+    }
+    return localBuffer.get();
+}
+
+void record(char phase, const char *category, const QString &name, quint64 id, quint64 parent, quint64 tsNs,
+            quint64 durNs = 0, bool hasResult = false, qint64 result = 0)
+{
+    ThreadBuffer *b = buffer();
+    // Pairs with the fence in stop(): either it sees the flag, or this sees
+    // tracing off
+    b->writing.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!Tracer::enabled()) {
+        b->writing.store(false, std::memory_order_release);
+        return;
+    }
+    const quint64 head = b->head.load(std::memory_order_relaxed);
+    Event &e = b->events[head % Tracer::RingSize];
+    e.tsNs = tsNs;
+    e.durNs = durNs;
+    e.id = id;
+    e.parent = parent;
+    e.result = result;
+    e.category = category;
+    e.phase = phase;
+    e.hasResult = hasResult;
+    const QByteArray utf8 = name.toUtf8();
+    const size_t n = qMin(size_t(utf8.size()), sizeof e.name - 1);
+    memcpy(e.name, utf8.constData(), n);
+    e.name[n] = '\0';
+    b->head.store(head + 1, std::memory_order_relaxed);
+    b->writing.store(false, std::memory_order_release);
+}
+
+void appendString(QByteArray &out, const char *s)
+{
+    out += '"';
+    for (; *s; ++s) {
+        const unsigned char c = static_cast<unsigned char>(*s);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += char(c);
+        } else if (c < 0x20) {
+            out += QByteArray("\\u00") + QByteArray::number(c, 16).rightJustified(2, '0');
+        } else {
+            out += char(c);
+        }
+    }
+    out += '"';
+}
+
+void appendEvent(QByteArray &out, const Event &e, quint64 tid)
+{
+    out += "{\"name\":";
+    appendString(out, e.name);
+    out += ",\"cat\":";
+    appendString(out, e.category ? e.category : "");
+    out += ",\"ph\":\"";
+    out += e.phase;
+    out += "\",\"ts\":" + QByteArray::number(e.tsNs / 1000.0, 'f', 3);
+    if (e.phase == 'X') out += ",\"dur\":" + QByteArray::number(e.durNs / 1000.0, 'f', 3);
+    if (e.phase == 'b' || e.phase == 'e') out += ",\"id\":\"0x" + QByteArray::number(e.id, 16) + '"';
+    if (e.phase == 'i') out += ",\"s\":\"t\"";
+    out += ",\"pid\":" + QByteArray::number(getpid()) + ",\"tid\":" + QByteArray::number(tid);
+    out += ",\"args\":{\"id\":" + QByteArray::number(e.id) + ",\"parent\":" + QByteArray::number(e.parent);
+    if (e.hasResult) out += ",\"result\":" + QByteArray::number(e.result);
+    out += "}}";
+}
+
+} // namespace
+
+void Tracer::start(const QString &path)
+{
+#ifdef NIXLY_TRACING
+    tracePath = path;
+    origin = std::chrono::steady_clock::now();
+    enabled_.store(true, std::memory_order_release);
+    qInfo("Tracing to %s", qPrintable(path));
+#else
+    qWarning("Built without tracing (-Dtracing=false); --trace=%s ignored", qPrintable(path));
+#endif
+}
+
+bool Tracer::stop(QString *error)
+{
+    if (!enabled_.exchange(false)) return true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        QMutexLocker lock(&registryMutex);
+        buffers = registry;
+    }
+    QByteArray out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    size_t total = 0, dropped = 0;
+    for (const auto &b : buffers) {
+        if (!first) out += ",\n";
+        first = false;
+        out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + QByteArray::number(getpid())
+               + ",\"tid\":" + QByteArray::number(b->tid) + ",\"args\":{\"name\":";
+        appendString(out, b->threadName.constData());
+        out += "}}";
+        // A writer that saw tracing still on finishes its one event
+        while (b->writing.load(std::memory_order_acquire)) QThread::yieldCurrentThread();
+        const quint64 head = b->head.load(std::memory_order_relaxed);
+        const quint64 begin = head > quint64(RingSize) ? head - RingSize : 0;
+        dropped += begin;
+        for (quint64 i = begin; i < head; ++i) {
+            out += ",\n";
+            appendEvent(out, b->events[i % RingSize], b->tid);
+            ++total;
+        }
+    }
+    out += "\n]}\n";
+
+    QFile f(tracePath);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate) || f.write(out) != out.size()) {
+        const QString message = QString("Could not write %1: %2").arg(tracePath, f.errorString());
+        qWarning("%s", qPrintable(message));
+        if (error) *error = message;
+        return false;
+    }
+    qInfo("Trace: %zu events from %zu threads in %s (%zu overwritten)", total, buffers.size(), qPrintable(tracePath),
+          dropped);
+    return true;
+}
+
+quint64 Tracer::current()
+{
+    return currentSpan;
+}
+
+quint64 Tracer::beginScope(quint64 *prev, quint64 *startNs)
+{
+    const quint64 id = nextId.fetch_add(1, std::memory_order_relaxed);
+    *prev = currentSpan;
+    currentSpan = id;
+    *startNs = nowNs();
+    return id;
+}
+
+void Tracer::endScope(const char *category, const QString &name, quint64 id, quint64 parent, quint64 prev,
+                      quint64 startNs)
+{
+    currentSpan = prev;
+    // Tracing stopped while the span was open: the file is already written
+    if (!enabled()) return;
+    const quint64 end = nowNs();
+    record('X', category, name, id, parent, startNs, end - startNs);
+}
+
+quint64 Tracer::beginAsync(const char *category, const QString &name, quint64 parent)
+{
+    if (!enabled()) return 0;
+    const quint64 id = nextId.fetch_add(1, std::memory_order_relaxed);
+    record('b', category, name, id, parent, nowNs());
+    return id;
+}
+
+void Tracer::endAsync(const char *category, quint64 id, qint64 result)
+{
+    if (!id || !enabled()) return;
+    record('e', category, QString(), id, 0, nowNs(), 0, true, result);
+}
+
+void Tracer::instant(const char *category, const QString &name)
+{
+    if (!enabled()) return;
+    record('i', category, name, 0, currentSpan, nowNs());
+}
+
+void Tracer::traceProcess(QProcess *process, const char *category, quint64 parent)
+{
+    if (!enabled()) return;
+    auto id = std::make_shared<quint64>(0);
+    QObject::connect(process, &QProcess::started, process, [process, category, parent, id]() {
+        const QString name = (QStringList { process->program() } + process->arguments().mid(0, 2)).join(' ');
+        *id = beginAsync(category, name, parent);
+    });
+    QObject::connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), process,
+                     [category, id](int exitCode, QProcess::ExitStatus status) {
+        endAsync(category, *id, status == QProcess::NormalExit ? exitCode : -1);
+        *id = 0;
+    });
+    QObject::connect(process, &QProcess::errorOccurred, process, [process, category, parent](QProcess::ProcessError err) {
+        if (err != QProcess::FailedToStart) return;
+        // Never started: a zero-length span so the attempt still shows up
+        const quint64 failed = beginAsync(category, "failed to start " + process->program(), parent);
+        endAsync(category, failed, -1);
+    });
+}
+
+void Tracer::traceReply(QNetworkReply *reply, const char *category, const QString &name, quint64 parent)
+{
+    if (!enabled()) return;
+    const quint64 id = beginAsync(category, name, parent);
+    QObject::connect(reply, &QNetworkReply::finished, reply, [reply, category, id]() {
+        endAsync(category, id, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    });
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <QString>
+#include <atomic>
+
+class QNetworkReply;
+class QProcess;
+
+// Span tracer for the installer's asynchronous work: probes, gh and git
+// calls, lsblk scans, page builds and switches, worker jobs and install
+// steps. Off until Tracer::start() (--trace=<file>); then every thread
+// records into its own ring buffer without taking a lock, and stop() writes
+// the lot as Chrome trace JSON, which chrome://tracing and ui.perfetto.dev
+// open directly.
+//
+// Timestamps are steady_clock, thread ids the kernel's. Each span carries
+// its id and its parent's: the span open on the same thread when it began,
+// or one passed explicitly when work hops threads.
+//
+// Use the NIXLY_TRACE_* macros below. They check enabled() before building
+// a name, so an untraced run pays one relaxed load per site. Built with
+// -Dtracing=false they compile to nothing: the arguments only appear in a
+// lambda that is never called, which keeps captured span ids in use.
+class Tracer
+{
+public:
+    // Events kept per thread; older ones are overwritten
+    static constexpr int RingSize = 4096;
+
+    static void start(const QString &path);
+    // Writes the trace file; false and `error` set on failure
+    static bool stop(QString *error = nullptr);
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // Id of the innermost scoped span open on this thread, 0 if none
+    static quint64 current();
+
+    // Spans that end in another callback; 0 when not tracing
+    static quint64 beginAsync(const char *category, const QString &name, quint64 parent);
+    static void endAsync(const char *category, quint64 id, qint64 result);
+    static void instant(const char *category, const QString &name);
+
+    // From QProcess::started to finished or a failure to start; named after
+    // the program and its first arguments, the exit code as result
+    static void traceProcess(QProcess *process, const char *category, quint64 parent);
+    // From now to finished; the HTTP status as result
+    static void traceReply(QNetworkReply *reply, const char *category, const QString &name, quint64 parent);
+
+private:
+    friend class TraceScope;
+    // Makes the new span this thread's current one; `prev` is restored by endScope
+    static quint64 beginScope(quint64 *prev, quint64 *startNs);
+    static void endScope(const char *category, const QString &name, quint64 id, quint64 parent, quint64 prev,
+                         quint64 startNs);
+
+    static std::atomic<bool> enabled_;
+};
+
+// A span from construction to destruction, on one thread
+class TraceScope
+{
+public:
+    // `name` is called for the span's name, only while tracing
+    template <typename Name>
+    TraceScope(const char *category, const Name &name, quint64 parent = 0)
+    {
+        if (!Tracer::enabled()) return;
+        category_ = category;
+        name_ = name();
+        id_ = Tracer::beginScope(&prev_, &startNs_);
+        parent_ = parent ? parent : prev_;
+    }
+    ~TraceScope()
+    {
+        if (id_) Tracer::endScope(category_, name_, id_, parent_, prev_, startNs_);
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+    quint64 id() const { return id_; }
+
+private:
+    const char *category_ = nullptr;
+    QString name_;
+    quint64 id_ = 0;
+    quint64 parent_ = 0;
+    quint64 prev_ = 0;
+    quint64 startNs_ = 0;
+};
+
+#ifdef NIXLY_TRACING
+#define NIXLY_TRACE_CAT_(a, b) a##b
+#define NIXLY_TRACE_CAT(a, b) NIXLY_TRACE_CAT_(a, b)
+#define NIXLY_TRACE_SCOPE(category, name) \
+    TraceScope NIXLY_TRACE_CAT(traceScope_, __LINE__)(category, [&]() { return QString(name); })
+#define NIXLY_TRACE_SCOPE_CHILD(category, name, parent) \
+    TraceScope NIXLY_TRACE_CAT(traceScope_, __LINE__)(category, [&]() { return QString(name); }, parent)
+#define NIXLY_TRACE_BEGIN(category, name) \
+    (Tracer::enabled() ? Tracer::beginAsync(category, name, Tracer::current()) : quint64(0))
+#define NIXLY_TRACE_END(category, id, result) Tracer::endAsync(category, id, result)
+#define NIXLY_TRACE_INSTANT(category, name) (Tracer::enabled() ? Tracer::instant(category, name) : void())
+#define NIXLY_TRACE_PROCESS(process, category) Tracer::traceProcess(process, category, Tracer::current())
+#define NIXLY_TRACE_CHILD_PROCESS(process, category, parent) Tracer::traceProcess(process, category, parent)
+#define NIXLY_TRACE_REPLY(reply, category, name) \
+    (Tracer::enabled() ? Tracer::traceReply(reply, category, name, Tracer::current()) : void())
+#else
+#define NIXLY_TRACE_SCOPE(category, name) ((void)0)
+#define NIXLY_TRACE_SCOPE_CHILD(category, name, parent) ((void)[&]() { (void)(name); (void)(parent); })
+#define NIXLY_TRACE_BEGIN(category, name) quint64(0)
+#define NIXLY_TRACE_END(category, id, result) ((void)[&]() { (void)(id); })
+#define NIXLY_TRACE_INSTANT(category, name) ((void)0)
+#define NIXLY_TRACE_PROCESS(process, category) ((void)0)
+#define NIXLY_TRACE_CHILD_PROCESS(process, category, parent) ((void)[&]() { (void)(process); (void)(parent); })
+#define NIXLY_TRACE_REPLY(reply, category, name) ((void)0)
+#endif
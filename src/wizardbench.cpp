@@ -0,0 +1,437 @@
+#include "wizardbench.h"
+
+#include "pageregistry.h"
+#include "theme.h"
+
+#include <QApplication>
+#include <QChildEvent>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkReply>
+#include <QPointer>
+#include <QProcess>
+#include <QPushButton>
+#include <QStackedWidget>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QTimer>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace {
+
+constexpr int kSettleTimeoutMs = 30000;
+
+QString option(const QStringList &args, const QString &name, const QString &fallback = QString())
+{
+    const QString prefix = name + "=";
+    for (const QString &a : args) {
+        if (a.startsWith(prefix)) return a.mid(prefix.size());
+    }
+    return fallback;
+}
+
+// What the wizard asks of each program, answered the same way every time:
+// a signed-in user "bench" whose nixlyos repository has three branches, two
+// disks, no cryptsetup benchmark or regulatory domain, and no Nix to build
+// with, should anything still ask it for a closure.
+struct StandIn {
+    const char *program;
+    const char *body;
+};
+
+const StandIn kStandIns[] = {
+    { "gh", R"(case "$1 $2" in
+    "api user") echo bench ;;
+    "repo view") echo "name: bench/nixlyos" ;;
+    "api repos/"*) printf 'main\nlaptop\ndesktop\n' ;;
+    --version*) echo "gh version 2.0.0 (stand-in)" ;;
+esac
+)" },
+    { "git", R"([ "$1" = clone ] || exit 0
+for target; do :; done
+mkdir -p "$target"
+)" },
+    { "lsblk", R"(cat <<'EOF'
+{"blockdevices": [
+  {"name": "nvme0n1", "kname": "nvme0n1", "path": "/dev/nvme0n1", "model": "Stand-in NVMe", "vendor": null,
+   "size": 1024209543168, "type": "disk", "tran": "nvme", "fstype": null, "mountpoints": [null],
+   "label": null, "uuid": null, "children": [
+    {"name": "nvme0n1p1", "kname": "nvme0n1p1", "path": "/dev/nvme0n1p1", "size": 1073741824, "type": "part",
+     "fstype": "vfat", "mountpoints": [null], "label": "BOOT", "uuid": "1234-ABCD"},
+    {"name": "nvme0n1p2", "kname": "nvme0n1p2", "path": "/dev/nvme0n1p2", "size": 1023135801344, "type": "part",
+     "fstype": "crypto_LUKS", "mountpoints": [null], "label": null, "uuid": "0f4c1d3e-5a6b-4c7d-8e9f-a0b1c2d3e4f5"}]},
+  {"name": "sda", "kname": "sda", "path": "/dev/sda", "model": "Stand-in SSD", "vendor": "ATA",
+   "size": 500107862016, "type": "disk", "tran": "sata", "fstype": null, "mountpoints": [null],
+   "label": null, "uuid": null}
+]}
+EOF
+)" },
+    { "cryptsetup", "echo 'cryptsetup: no benchmark in the stand-in' >&2\nexit 1\n" },
+    { "iw", "exit 1\n" },
+    { "nix", "echo 'nix: nothing to build in the stand-in' >&2\nexit 1\n" },
+    { "nix-store", "exit 1\n" },
+};
+
+bool writeStandIns(const QString &dir, int latencyMs, QString *error)
+{
+    if (!QDir().mkpath(dir)) {
+        *error = "Could not create " + dir;
+        return false;
+    }
+    const QByteArray delay = QByteArray::number(latencyMs / 1000.0, 'f', 3);
+    for (const StandIn &s : kStandIns) {
+        QFile f(dir + "/" + s.program);
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            || f.write("#!/bin/sh\nsleep " + delay + "\n" + s.body) < 0
+            || !f.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner | QFileDevice::ExeOwner)) {
+            *error = QString("Could not write %1: %2").arg(f.fileName(), f.errorString());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Answers every request with 204 after the stand-in latency, like
+// connectivitycheck.gstatic.com
+bool listenForProbes(QTcpServer *server, int latencyMs)
+{
+    QObject::connect(server, &QTcpServer::newConnection, server, [server, latencyMs]() {
+        while (QTcpSocket *socket = server->nextPendingConnection()) {
+            QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            QObject::connect(socket, &QTcpSocket::readyRead, socket, [socket, latencyMs]() {
+                if (!socket->peek(socket->bytesAvailable()).contains("\r\n\r\n")) return;
+                socket->readAll();
+                QTimer::singleShot(latencyMs, socket, [socket]() {
+                    socket->write("HTTP/1.1 204 No Content\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+                    socket->disconnectFromHost();
+                });
+            });
+        }
+    });
+    return server->listen(QHostAddress::LocalHost, 0);
+}
+
+// Backend calls a page makes each time it is shown, by stack index. A
+// transition has settled once these have finished and nothing else it
+// started is still running.
+QStringList expectedCalls(int index)
+{
+    switch (index) {
+        case 1: return { "probe" };                 // Internet: connectivity check
+        case 2: return { "gh", "gh", "gh" };        // GitHub: login, repository, branches
+        case 3: return { "lsblk" };                 // Select Drive
+        default: return {};
+    }
+}
+
+struct Stats {
+    QList<double> frameMs;
+    QList<double> settledMs;
+    double coldFrameMs = -1.0;
+    double coldSettledMs = -1.0;
+};
+
+double percentile(QList<double> times, double p)
+{
+    std::sort(times.begin(), times.end());
+    return times.at(qMin<qsizetype>(times.size() - 1, qsizetype(p * times.size())));
+}
+
+QJsonObject distribution(const QList<double> &times)
+{
+    return QJsonObject {
+        { "p50Ms", percentile(times, 0.50) },
+        { "p90Ms", percentile(times, 0.90) },
+        { "p99Ms", percentile(times, 0.99) },
+        { "maxMs", percentile(times, 1.0) } };
+}
+
+// Clicks through the menu and times each page switch. Backend calls are seen
+// through an application event filter: a QProcess or QNetworkReply announces
+// itself to its parent with ChildAdded, and is identified once constructed.
+class WizardDriver : public QObject
+{
+public:
+    WizardDriver(QWidget *window, int runs) : runs_(runs)
+    {
+        stack_ = window->findChild<QStackedWidget*>();
+        for (QPushButton *b : window->findChildren<QPushButton*>()) {
+            if (b->property("role").toByteArray() == "menu") menu_ << b;
+        }
+        timeout_.setSingleShot(true);
+        timeout_.setInterval(kSettleTimeoutMs);
+        QObject::connect(&timeout_, &QTimer::timeout, this, [this]() {
+            error_ = QString("%1 did not settle within %2 s (%3 running, finished: %4)")
+                         .arg(transitionName(), QString::number(kSettleTimeoutMs / 1000), QString::number(pending_),
+                              completed_.isEmpty() ? QString("nothing") : completed_.join(", "));
+            if (done) done();
+        });
+    }
+
+    std::function<void()> done;
+
+    QString error() const { return error_; }
+    const QStringList &order() const { return order_; }
+    const QHash<QString, Stats> &stats() const { return stats_; }
+
+    void start()
+    {
+        if (!stack_ || menu_.size() != stack_->count()) {
+            error_ = "Could not find the page stack and its menu buttons";
+            if (done) done();
+            return;
+        }
+        qApp->installEventFilter(this);
+        // The benchmark walks the pages; it does not fill them in
+        for (QPushButton *b : std::as_const(menu_)) b->setEnabled(true);
+        next();
+    }
+
+protected:
+    bool eventFilter(QObject *obj, QEvent *event) override
+    {
+        if (event->type() == QEvent::ChildAdded) {
+            QObject *child = static_cast<QChildEvent*>(event)->child();
+            if (!child->isWidgetType()) {
+                // Still inside its constructor; its type is known once control returns
+                QPointer<QObject> c(child);
+                QTimer::singleShot(0, this, [this, c]() { if (c) track(c); });
+            }
+        } else if (event->type() == QEvent::Paint && obj == page_ && frameMs_ < 0 && !framePending_) {
+            framePending_ = true;
+            // Painted and flushed once the paint event returns
+            QTimer::singleShot(0, this, [this]() {
+                frameMs_ = clock_.nsecsElapsed() / 1e6;
+                checkSettled();
+            });
+        }
+        return QObject::eventFilter(obj, event);
+    }
+
+private:
+    QString pageName(int index) const { return menu_.at(index)->text(); }
+    QString transitionName() const { return pageName(from_) + " → " + pageName(target_); }
+
+    // Every run starts from Welcome and ends on Install
+    void next()
+    {
+        const int current = stack_->currentIndex();
+        if (current == menu_.size() - 1) {
+            if (++run_ == runs_) {
+                qApp->removeEventFilter(this);
+                if (done) done();
+                return;
+            }
+            click(0, false);
+        } else {
+            click(current + 1, true);
+        }
+    }
+
+    void click(int index, bool measured)
+    {
+        from_ = stack_->currentIndex();
+        target_ = index;
+        measured_ = measured;
+        page_ = stack_->widget(index);
+        frameMs_ = -1.0;
+        framePending_ = false;
+        completed_.clear();
+        timeout_.start();
+        clock_.start();
+        menu_.at(index)->click();
+    }
+
+    void track(QObject *obj)
+    {
+        if (QProcess *p = qobject_cast<QProcess*>(obj)) {
+            const QString name = QFileInfo(p->program()).fileName();
+            if (p->state() != QProcess::NotRunning) {
+                begin(p, name);
+            } else {
+                // Created now, started later (gh's login flow)
+                QObject::connect(p, &QProcess::started, this, [this, p, name]() { begin(p, name); });
+            }
+        } else if (QNetworkReply *r = qobject_cast<QNetworkReply*>(obj)) {
+            if (r->isRunning()) begin(r, "probe");
+        }
+    }
+
+    void begin(QObject *op, const QString &name)
+    {
+        ++pending_;
+        auto ended = std::make_shared<bool>(false);
+        auto end = [this, ended, name]() {
+            if (*ended) return;
+            *ended = true;
+            --pending_;
+            completed_ << name;
+            // After whatever the wizard starts in its own handler for this one
+            QTimer::singleShot(0, this, [this]() { checkSettled(); });
+        };
+        if (QProcess *p = qobject_cast<QProcess*>(op)) {
+            QObject::connect(p, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, end);
+            QObject::connect(p, &QProcess::errorOccurred, this, [end](QProcess::ProcessError e) {
+                if (e == QProcess::FailedToStart) end();
+            });
+        } else if (QNetworkReply *r = qobject_cast<QNetworkReply*>(op)) {
+            QObject::connect(r, &QNetworkReply::finished, this, end);
+        }
+        QObject::connect(op, &QObject::destroyed, this, end);
+    }
+
+    void checkSettled()
+    {
+        if (target_ < 0 || frameMs_ < 0 || pending_ > 0) return;
+        QStringList missing = expectedCalls(target_);
+        for (const QString &c : std::as_const(completed_)) missing.removeOne(c);
+        if (!missing.isEmpty()) return;
+        timeout_.stop();
+        const double settledMs = qMax(frameMs_, clock_.nsecsElapsed() / 1e6);
+        if (measured_) {
+            const QString name = transitionName();
+            if (!stats_.contains(name)) order_ << name;
+            Stats &s = stats_[name];
+            if (run_ == 0) {
+                s.coldFrameMs = frameMs_;
+                s.coldSettledMs = settledMs;
+            } else {
+                s.frameMs << frameMs_;
+                s.settledMs << settledMs;
+            }
+        }
+        target_ = -1;
+        QTimer::singleShot(0, this, [this]() { next(); });
+    }
+
+    QStackedWidget *stack_ = nullptr;
+    QList<QPushButton*> menu_;
+    const int runs_;
+    int run_ = 0;
+
+    // The transition in flight
+    int from_ = -1;
+    int target_ = -1;
+    bool measured_ = false;
+    QPointer<QWidget> page_;
+    QElapsedTimer clock_;
+    double frameMs_ = -1.0;
+    bool framePending_ = false;
+    int pending_ = 0;
+    QStringList completed_;
+    QTimer timeout_;
+
+    QStringList order_;
+    QHash<QString, Stats> stats_;
+    QString error_;
+};
+
+} // namespace
+
+int runWizardBenchmark(int &argc, char **argv, const std::function<QWidget*()> &createWindow)
+{
+    QStringList args;
+    for (int i = 1; i < argc; ++i) args << QString::fromLocal8Bit(argv[i]);
+    const int runs = qMax(1, option(args, "--benchmark-runs", "10").toInt());
+    const int latencyMs = qMax(0, option(args, "--benchmark-latency", "50").toInt());
+
+    // Stand-ins first on PATH; clones and caches land in a throwaway HOME
+    QTemporaryDir scratch;
+    QString error;
+    if (!scratch.isValid() || !writeStandIns(scratch.filePath("bin"), latencyMs, &error)
+        || !QDir().mkpath(scratch.filePath("home"))) {
+        fprintf(stderr, "%s\n", qPrintable(error.isEmpty() ? scratch.errorString() : error));
+        return 1;
+    }
+    qputenv("PATH", QFile::encodeName(scratch.filePath("bin")) + ":" + qgetenv("PATH"));
+    qputenv("HOME", QFile::encodeName(scratch.filePath("home")));
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    // The system closure is not part of the wizard's latency, and a stand-in
+    // clone has nothing to build
+    std::vector<char*> appArgv(argv, argv + argc);
+    char noPrefetch[] = "--no-prefetch";
+    appArgv.push_back(noPrefetch);
+    int appArgc = int(appArgv.size());
+    appArgv.push_back(nullptr);
+    QApplication app(appArgc, appArgv.data());
+    Theme::install(app);
+
+    QTcpServer probes;
+    if (!listenForProbes(&probes, latencyMs)) {
+        fprintf(stderr, "Could not listen for connectivity probes: %s\n", qPrintable(probes.errorString()));
+        return 1;
+    }
+    qputenv("NIXLYINSTALL_CONNECTIVITY_URL",
+            QString("http://127.0.0.1:%1/generate_204").arg(probes.serverPort()).toLatin1());
+
+    QElapsedTimer timer;
+    timer.start();
+    std::unique_ptr<QWidget> window(createWindow());
+    const double windowMs = timer.nsecsElapsed() / 1e6;
+    window->show();
+
+    WizardDriver driver(window.get(), runs);
+    qint64 firstFrameMs = -1, firstFrameRssKiB = -1;
+    driver.done = [&app]() { app.quit(); };
+    PageRegistry::onFirstFrame(window.get(), [&]() {
+        firstFrameMs = PageRegistry::msSinceProcessStart();
+        firstFrameRssKiB = PageRegistry::rssKiB();
+        driver.start();
+    });
+    app.exec();
+
+    QJsonArray transitions;
+    for (const QString &name : driver.order()) {
+        const Stats &s = driver.stats().value(name);
+        QJsonObject t {
+            { "transition", name },
+            { "coldFrameMs", s.coldFrameMs },
+            { "coldSettledMs", s.coldSettledMs } };
+        if (!s.frameMs.isEmpty()) {
+            t.insert("frame", distribution(s.frameMs));
+            t.insert("settled", distribution(s.settledMs));
+        }
+        transitions << t;
+        if (s.frameMs.isEmpty()) {
+            fprintf(stderr, "%s: frame %.1f ms, settled %.1f ms\n", qPrintable(name), s.coldFrameMs, s.coldSettledMs);
+        } else {
+            fprintf(stderr, "%s: frame p50 %.1f ms, p99 %.1f ms; settled p50 %.1f ms, p99 %.1f ms (cold %.1f / %.1f ms)\n",
+                    qPrintable(name), percentile(s.frameMs, 0.50), percentile(s.frameMs, 0.99),
+                    percentile(s.settledMs, 0.50), percentile(s.settledMs, 0.99), s.coldFrameMs, s.coldSettledMs);
+        }
+    }
+    QJsonObject result {
+        { "platform", QApplication::platformName() },
+        { "runs", runs },
+        { "standInLatencyMs", latencyMs },
+        { "windowMs", windowMs },
+        { "firstFrameMs", firstFrameMs },
+        { "firstFrameRssKiB", firstFrameRssKiB },
+        { "transitions", transitions } };
+    if (!driver.error().isEmpty()) {
+        result.insert("error", driver.error());
+        fprintf(stderr, "%s\n", qPrintable(driver.error()));
+    }
+    const QByteArray json = QJsonDocument(result).toJson();
+    printf("%s", json.constData());
+    const QString output = option(args, "--benchmark-output");
+    if (!output.isEmpty()) {
+        QFile f(output);
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate) || f.write(json) != json.size())
+            fprintf(stderr, "Could not write %s: %s\n", qPrintable(output), qPrintable(f.errorString()));
+    }
+    window.reset();
+    return driver.error().isEmpty() ? 0 : 1;
+}
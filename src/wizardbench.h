@@ -0,0 +1,22 @@
+#pragma once
+
+#include <functional>
+
+class QWidget;
+
+// Startup and page-switch latency of the whole wizard, with no display, disks
+// or network. Runs on the offscreen platform against stand-in backends: gh,
+// git, lsblk, cryptsetup, iw, nix and nix-store are shell scripts first on
+// PATH, the connectivity probe goes to a local HTTP server, HOME is a
+// temporary directory. Each stand-in answers after a fixed delay. The system
+// prefetch is off (--no-prefetch).
+//
+//   nixlyinstall --benchmark [--benchmark-runs=10] [--benchmark-latency=50]
+//                [--benchmark-output=result.json]
+//
+// Every run clicks through the menu from Welcome to Install. A transition is
+// timed to the new page's first paint ("frame") and to the end of the backend
+// work it started ("settled"). The first run, which includes building the
+// pages, is reported on its own; the others as p50/p90/p99. Prints one JSON
+// object; exit code 1 when a page never settled.
+int runWizardBenchmark(int &argc, char **argv, const std::function<QWidget*()> &createWindow);
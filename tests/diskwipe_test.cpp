@@ -0,0 +1,153 @@
+// Wipes two loop devices filled with a pattern: one backed by a file on tmpfs,
+// which punches holes, so an erase ioctl does the work, and one backed by a
+// file on ramfs, which cannot, so the loop device offers neither discard nor
+// write zeroes and only the O_DIRECT zero fill is left. Each must report
+// progress up to its full size and read back as zeros. Needs root and loop
+// devices; skipped (77) elsewhere.
+
+#include "diskwipe.h"
+#include "testing.h"
+
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const qint64 kSize = qint64(64) << 20;
+
+bool canOpen(const char *path)
+{
+    const int fd = ::open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) return false;
+    ::close(fd);
+    return true;
+}
+
+int run(const QString &program, const QStringList &args, QByteArray *output = nullptr)
+{
+    QProcess p;
+    p.setProcessChannelMode(QProcess::MergedChannels);
+    p.start(program, args);
+    if (!p.waitForFinished(60000) || p.exitStatus() != QProcess::NormalExit) return -1;
+    if (output) *output = p.readAll();
+    return p.exitCode();
+}
+
+// Unmounts the scratch filesystem however the test ends
+struct Mount {
+    QString dir;
+    ~Mount()
+    {
+        if (!dir.isEmpty()) run("umount", { dir });
+    }
+};
+
+// Detaches the loop device however the test ends, before its Mount goes
+struct Loop {
+    QString device;
+    ~Loop()
+    {
+        if (!device.isEmpty()) run("losetup", { "--detach", device });
+    }
+};
+
+bool fillWithPattern(const QString &file)
+{
+    QFile f(file);
+    if (!f.open(QIODevice::WriteOnly)) return false;
+    const QByteArray block(1 << 20, char(0xa5));
+    for (qint64 at = 0; at < kSize; at += block.size()) {
+        if (f.write(block) != block.size()) return false;
+    }
+    return true;
+}
+
+bool readsBackAsZeros(const QString &device)
+{
+    QFile f(device);
+    if (!f.open(QIODevice::ReadOnly)) return false;
+    qint64 total = 0;
+    while (total < kSize) {
+        const QByteArray block = f.read(1 << 20);
+        if (block.isEmpty()) return false;
+        if (block.count('\0') != block.size()) {
+            fprintf(stderr, "non-zero data near %lld MiB\n", total >> 20);
+            return false;
+        }
+        total += block.size();
+    }
+    return true;
+}
+
+// Mounts `fsType` under `dir`, attaches a patterned backing file on it and
+// wipes the loop device; `method` gets what DiskWiper settled on
+int wipeOn(const QString &fsType, const QString &dir, DiskWiper::Method *method)
+{
+    CHECK(QDir().mkpath(dir));
+    Mount mount;
+    CHECK_EQ(run("mount", { "-t", fsType, "none", dir }), 0);
+    mount.dir = dir;
+    const QString backing = dir + "/disk.img";
+    CHECK(fillWithPattern(backing));
+
+    Loop loop;
+    QByteArray out;
+    CHECK_EQ(run("losetup", { "--find", "--show", backing }, &out), 0);
+    loop.device = QString::fromUtf8(out).trimmed();
+    const DiskWiper::Capabilities caps = DiskWiper::probe(loop.device);
+    fprintf(stderr, "%s on %s: %s\n", qPrintable(loop.device), qPrintable(fsType), qPrintable(DiskWiper::describe(caps)));
+
+    DiskWiper wiper;
+    DiskWiper::Progress last;
+    int reports = 0;
+    bool backwards = false;
+    QString error;
+    const bool ok = wiper.wipe(loop.device, {}, [&](const DiskWiper::Progress &p) {
+        if (p.done < last.done) backwards = true;
+        last = p;
+        ++reports;
+    }, &error);
+    if (!ok) fprintf(stderr, "%s\n", qPrintable(error));
+    CHECK(ok);
+    fprintf(stderr, "%s: %s in %lld ms\n", qPrintable(fsType),
+            qPrintable(DiskWiper::methodName(wiper.usedMethod())), wiper.elapsedMs());
+
+    CHECK(reports > 0);
+    CHECK(!backwards);
+    CHECK_EQ(last.total, kSize);
+    CHECK_EQ(last.done, kSize);
+    CHECK(readsBackAsZeros(loop.device));
+    *method = wiper.usedMethod();
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    if (geteuid() != 0) SKIP("needs root");
+    if (!canOpen("/dev/loop-control")) SKIP("no loop control");
+    for (const char *tool : { "losetup", "mount", "umount" }) {
+        if (QStandardPaths::findExecutable(tool).isEmpty()) SKIP("%s is not installed", tool);
+    }
+
+    QTemporaryDir tmp;
+    CHECK(tmp.isValid());
+
+    // tmpfs punches holes: the loop device takes BLKZEROOUT or BLKDISCARD
+    DiskWiper::Method method = DiskWiper::Method::ZeroFill;
+    CHECK_EQ(wipeOn("tmpfs", tmp.path() + "/tmpfs", &method), 0);
+    CHECK(method == DiskWiper::Method::WriteZeroes || method == DiskWiper::Method::Discard);
+
+    // ramfs has no fallocate: nothing to offload, so the writers zero it
+    CHECK_EQ(wipeOn("ramfs", tmp.path() + "/ramfs", &method), 0);
+    CHECK(method == DiskWiper::Method::ZeroFill);
+    return 0;
+}
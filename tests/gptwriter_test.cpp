@@ -0,0 +1,72 @@
+// Writes the installer's layout into a sparse image file and has sgdisk, an
+// independent GPT reader, verify and print it back.
+
+#include "gptwriter.h"
+#include "testing.h"
+
+#include <QFile>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+
+namespace {
+
+int sgdisk(const QStringList &args, QString *output)
+{
+    QProcess p;
+    p.setProcessChannelMode(QProcess::MergedChannels);
+    p.start("sgdisk", args);
+    if (!p.waitForFinished(30000) || p.exitStatus() != QProcess::NormalExit) return -1;
+    *output = QString::fromUtf8(p.readAll());
+    return p.exitCode();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    if (QStandardPaths::findExecutable("sgdisk").isEmpty()) SKIP("needs sgdisk");
+
+    QTemporaryDir tmp;
+    CHECK(tmp.isValid());
+    const QString image = tmp.path() + "/disk.img";
+    QFile f(image);
+    CHECK(f.open(QIODevice::WriteOnly));
+    CHECK(f.resize(qint64(512) << 20));
+    f.close();
+
+    GptWriter gpt;
+    gpt.partitions << GptWriter::Partition { "ESP", GptWriter::EspType, qint64(64) << 20 }
+                   << GptWriter::Partition { "cryptroot", GptWriter::LinuxLuksType, 0 };
+    QString error;
+    CHECK(gpt.write(image, &error));
+    CHECK(error.isEmpty());
+
+    // 1 MiB aligned, the ESP exactly 64 MiB, root up to the last whole MiB
+    CHECK_EQ(gpt.partitions.at(0).firstLba, qint64(2048));
+    CHECK_EQ(gpt.partitions.at(0).lastLba, qint64(2048 + 131072 - 1));
+    CHECK_EQ(gpt.partitions.at(1).firstLba, qint64(2048 + 131072));
+    CHECK_EQ((gpt.partitions.at(1).lastLba + 1) % 2048, qint64(0));
+    CHECK(gpt.partitions.at(1).lastLba < (qint64(512) << 11) - 33);
+
+    QString out;
+    CHECK_EQ(sgdisk({ "--verify", image }, &out), 0);
+    CHECK(out.contains("No problems found"));
+
+    CHECK_EQ(sgdisk({ "--info=1", image }, &out), 0);
+    CHECK(out.contains("C12A7328-F81F-11D2-BA4B-00A0C93EC93B"));
+    CHECK(out.contains("'ESP'"));
+    CHECK(out.contains("First sector: 2048 "));
+    CHECK_EQ(sgdisk({ "--info=2", image }, &out), 0);
+    CHECK(out.contains("CA7D7CCB-63ED-4C53-861C-1742536059CC"));
+    CHECK(out.contains("'cryptroot'"));
+
+    // Too small for the layout: refused before anything is written
+    CHECK(f.open(QIODevice::WriteOnly));
+    CHECK(f.resize(qint64(32) << 20));
+    f.close();
+    CHECK(!gpt.write(image, &error));
+    CHECK(error.contains("too small"));
+    return 0;
+}
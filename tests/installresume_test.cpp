@@ -0,0 +1,135 @@
+// Kills a dry-run install right after each stage reached the journal, then
+// resumes it: every resumed run has to finish, and a stage that checks its
+// own result must not run again. Needs root, loop devices and the tools the
+// dry run calls; skipped (77) elsewhere.
+
+#include "installengine.h"
+#include "testing.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+InstallPlan dryRunPlan(const QString &dir)
+{
+    InstallPlan plan;
+    plan.dryRun = true;
+    plan.dryRunDir = dir;
+    plan.dryRunImageMiB = 1024;
+    plan.espSizeMiB = 64;
+    plan.fullWipe = false;
+    plan.reuseExistingStore = false;
+    plan.journalPath = dir + "/journal.json";
+    // Cheap key derivation; resuming has to reuse these from the journal
+    plan.luks.pbkdfMemoryKiB = 32768;
+    plan.luks.pbkdfParallel = 1;
+    plan.luks.pbkdfIterations = 4;
+    plan.luks.calibrated = true;
+    return plan;
+}
+
+// The install under test, killed by SIGKILL once `killAfter` is journaled
+int runInstall(const QString &dir, const QString &killAfter, bool resume)
+{
+    InstallPlan plan = dryRunPlan(dir);
+    plan.resume = resume;
+    InstallEngine engine;
+    engine.setPlan(plan);
+    engine.buildDefaultGraph();
+    engine.onLog = [](const QString &stepId, const QString &line) {
+        printf("[%s] %s\n", qPrintable(stepId), qPrintable(line));
+        fflush(stdout);
+    };
+    engine.onStepJournaled = [killAfter](const InstallStep &s) {
+        if (s.id == killAfter) ::raise(SIGKILL);
+    };
+    engine.onFinished = [](bool ok, const QString &error) {
+        if (!ok) printf("FAILED: %s\n", qPrintable(error));
+        QCoreApplication::exit(ok ? 0 : 1);
+    };
+    QMetaObject::invokeMethod(&engine, [&engine]() { engine.start(); }, Qt::QueuedConnection);
+    return QCoreApplication::exec();
+}
+
+struct Run {
+    bool killed = false;
+    int exitCode = -1;
+    QString output;
+};
+
+Run runChild(const QStringList &args)
+{
+    QProcess p;
+    p.setProcessChannelMode(QProcess::MergedChannels);
+    p.start(QCoreApplication::applicationFilePath(), args);
+    Run r;
+    if (!p.waitForFinished(600000)) p.kill();
+    r.killed = p.exitStatus() == QProcess::CrashExit;
+    r.exitCode = p.exitCode();
+    r.output = QString::fromUtf8(p.readAll());
+    return r;
+}
+
+bool canOpen(const char *path)
+{
+    const int fd = ::open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) return false;
+    ::close(fd);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments().mid(1);
+    if (args.value(0) == "--install") return runInstall(args.value(1), args.value(2), args.contains("--resume"));
+
+    if (geteuid() != 0) SKIP("needs root");
+    if (!canOpen("/dev/loop-control") || !canOpen("/dev/mapper/control")) SKIP("no loop or device-mapper control");
+    for (const char *tool : { "losetup", "wipefs", "sgdisk", "blkid", "mkfs.fat", "cryptsetup", "mkfs.btrfs", "mount",
+                              "umount", "nixos-generate-config" }) {
+        if (QStandardPaths::findExecutable(tool).isEmpty()) SKIP("%s is not installed", tool);
+    }
+
+    QTemporaryDir tmp;
+    CHECK(tmp.isValid());
+    const QString dir = tmp.path() + "/dryrun";
+
+    // Every stage a dry run really runs, in graph order
+    InstallEngine graph;
+    graph.setPlan(dryRunPlan(dir));
+    graph.buildDefaultGraph();
+    QList<InstallStep> stages;
+    for (const InstallStep &s : graph.steps()) {
+        if (!s.skipInDryRun) stages << s;
+    }
+    CHECK(!stages.isEmpty());
+
+    for (const InstallStep &stage : std::as_const(stages)) {
+        fprintf(stderr, "kill after %s\n", qPrintable(stage.id));
+        const Run killed = runChild({ "--install", dir, stage.id });
+        if (!killed.killed) fprintf(stderr, "%s", qPrintable(killed.output));
+        CHECK(killed.killed);
+
+        const Run resumed = runChild({ "--install", dir, QString(), "--resume" });
+        if (resumed.killed || resumed.exitCode != 0) fprintf(stderr, "%s", qPrintable(resumed.output));
+        CHECK(!resumed.killed);
+        CHECK_EQ(resumed.exitCode, 0);
+        CHECK(resumed.output.contains("[journal] Resuming"));
+        if (stage.verify) CHECK(resumed.output.contains(QString("[%1] Already done by a previous run.").arg(stage.id)));
+        // A finished install leaves no journal, mapping or mount behind
+        CHECK(!QFileInfo::exists(dir + "/journal.json"));
+        CHECK(!QFileInfo::exists(graph.plan().mapperPath()));
+    }
+    return 0;
+}
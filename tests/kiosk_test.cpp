@@ -0,0 +1,112 @@
+// Starts `nixlyinstall --kiosk` headless and connects clients to it: the
+// installer it launches itself, a raster window, and an OpenGL window that
+// has to fall back to shared memory under the kiosk's software rendering
+// environment. Each must get a frame drawn and none may commit a GPU buffer.
+
+#include "testing.h"
+
+#include <QGuiApplication>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QPainter>
+#include <QProcess>
+#include <QProcessEnvironment>
+#include <QRasterWindow>
+#include <QTemporaryDir>
+#include <QTimer>
+
+namespace {
+
+class FilledWindow : public QRasterWindow
+{
+protected:
+    void paintEvent(QPaintEvent *) override
+    {
+        QPainter(this).fillRect(QRect(QPoint(), size()), Qt::darkCyan);
+    }
+};
+
+// A client of the compositor WAYLAND_DISPLAY names; runs until killed
+int runClient(int argc, char **argv, bool gl)
+{
+    QGuiApplication app(argc, argv);
+    if (!gl) {
+        FilledWindow window;
+        window.show();
+        return app.exec();
+    }
+    QWindow window;
+    window.setSurfaceType(QSurface::OpenGLSurface);
+    window.show();
+    QOpenGLContext context;
+    if (!context.create()) return 77;
+    QTimer frames;
+    QObject::connect(&frames, &QTimer::timeout, &window, [&window, &context]() {
+        if (!window.isExposed() || !context.makeCurrent(&window)) return;
+        context.functions()->glClearColor(0.0f, 0.5f, 0.5f, 1.0f);
+        context.functions()->glClear(GL_COLOR_BUFFER_BIT);
+        context.swapBuffers(&window);
+    });
+    frames.start(16);
+    return app.exec();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && QByteArray(argv[1]) == "--client") return runClient(argc, argv, false);
+    if (argc > 1 && QByteArray(argv[1]) == "--gl-client") return runClient(argc, argv, true);
+
+    QCoreApplication app(argc, argv);
+    if (argc < 2) SKIP("usage: kiosk-test <nixlyinstall>");
+    QTemporaryDir runtime, home;
+    CHECK(runtime.isValid() && home.isValid());
+
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.remove("WAYLAND_DISPLAY");
+    env.remove("DISPLAY");
+    env.remove("QT_QPA_PLATFORM");
+    env.insert("XDG_RUNTIME_DIR", runtime.path());
+    env.insert("HOME", home.path());
+
+    QProcess kiosk;
+    QByteArray log;
+    kiosk.setProcessEnvironment(env);
+    kiosk.setProcessChannelMode(QProcess::MergedChannels);
+    QObject::connect(&kiosk, &QProcess::readyRead, [&kiosk, &log]() { log += kiosk.readAll(); });
+    kiosk.start(QString::fromLocal8Bit(argv[1]), { "--kiosk", "--kiosk-platform=offscreen", "--no-prefetch" });
+    CHECK(kiosk.waitForStarted());
+
+    waitUntil([&]() { return log.contains("installer's first frame") || kiosk.state() == QProcess::NotRunning; }, 60000);
+    if (log.contains("Could not load the Qt platform plugin")) SKIP("no offscreen or wayland platform plugin");
+    if (!log.contains("installer's first frame")) fprintf(stderr, "%s", log.constData());
+    CHECK(log.contains("Kiosk: installer window from pid"));
+    CHECK(log.contains("installer's first frame"));
+
+    env.insert("WAYLAND_DISPLAY", "nixly-kiosk-" + QString::number(kiosk.processId()));
+    env.insert("QT_QPA_PLATFORM", "wayland");
+    // As the kiosk sets it for what the installer launches
+    env.insert("LIBGL_ALWAYS_SOFTWARE", "1");
+    for (const char *mode : { "--client", "--gl-client" }) {
+        QProcess client;
+        client.setProcessEnvironment(env);
+        client.setProcessChannelMode(QProcess::ForwardedChannels);
+        client.start(QCoreApplication::applicationFilePath(), { mode });
+        CHECK(client.waitForStarted());
+        const QByteArray frame = "Kiosk: first frame from pid " + QByteArray::number(client.processId());
+        waitUntil([&]() { return log.contains(frame) || client.state() == QProcess::NotRunning; }, 30000);
+        if (client.state() == QProcess::NotRunning && client.exitCode() == 77) {
+            fprintf(stderr, "%s: no OpenGL for a client here, not checked\n", mode);
+            continue;
+        }
+        CHECK(log.contains(frame));
+        CHECK(!log.contains("committed a GPU buffer"));
+        client.kill();
+        client.waitForFinished();
+    }
+
+    kiosk.terminate();
+    if (!kiosk.waitForFinished(10000)) kiosk.kill();
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Builds a binary cache offline with `nix copy --to file://` from a scratch
+// store, detects and indexes it (and the store itself) the way the
+// local-cache step does, and feeds it the copy lines of an install.
+
+#include "localcache.h"
+#include "testing.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QUuid>
+
+namespace {
+
+// Adds a file with unique content to the store under `root`; empty on failure
+QString addToStore(const QString &root, const QString &dir, const QString &name)
+{
+    const QString file = dir + "/" + name;
+    QFile f(file);
+    if (!f.open(QIODevice::WriteOnly)) return QString();
+    // Big enough that compression leaves a FileSize worth counting
+    for (int i = 0; i < 1000; ++i) f.write(QUuid::createUuid().toByteArray());
+    f.close();
+    QProcess p;
+    p.start("nix-store", { "--store", root, "--add", file });
+    if (!p.waitForFinished(120000) || p.exitStatus() != QProcess::NormalExit || p.exitCode() != 0) return QString();
+    return QString::fromUtf8(p.readAllStandardOutput()).trimmed();
+}
+
+// FileSize from the path's .narinfo, read independently of LocalBinaryCache
+qint64 narinfoFileSize(const QString &cacheDir, const QString &storePath)
+{
+    QFile f(cacheDir + "/" + QFileInfo(storePath).fileName().left(32) + ".narinfo");
+    if (!f.open(QIODevice::ReadOnly)) return -1;
+    while (!f.atEnd()) {
+        const QByteArray line = f.readLine().trimmed();
+        if (line.startsWith("FileSize: ")) return line.mid(10).toLongLong();
+    }
+    return -1;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    if (QStandardPaths::findExecutable("nix").isEmpty() || QStandardPaths::findExecutable("nix-store").isEmpty())
+        SKIP("needs nix and nix-store");
+
+    QTemporaryDir tmp;
+    CHECK(tmp.isValid());
+    const QString storeRoot = tmp.path() + "/store";
+    const QString cacheDir = tmp.path() + "/cache";
+    const QString a = addToStore(storeRoot, tmp.path(), "a");
+    const QString b = addToStore(storeRoot, tmp.path(), "b");
+    if (a.isEmpty() || b.isEmpty()) SKIP("nix-store cannot create a store under %s", qPrintable(storeRoot));
+    CHECK_EQ(QProcess::execute("nix", { "copy", "--extra-experimental-features", "nix-command",
+                                        "--from", "local?root=" + storeRoot, "--to", "file://" + cacheDir, a, b }), 0);
+
+    // The cache named with --local-cache: indexed and trusted
+    CHECK(LocalBinaryCache::looksLikeCache(cacheDir));
+    LocalBinaryCache cache;
+    CHECK(cache.detectAndLoad(cacheDir));
+    CHECK_EQ(cache.dir(), cacheDir);
+    CHECK_EQ(cache.pathCount(), 2);
+    CHECK(cache.isTrusted());
+    CHECK_EQ(cache.substituterUrl(), "file://" + cacheDir + "?priority=10&trusted=1");
+
+    // One path from the cache, one downloaded, one from the live store
+    const qint64 sizeA = narinfoFileSize(cacheDir, a);
+    CHECK(sizeA > 0);
+    cache.recordLine("copying path '" + a + "' from 'file://" + cacheDir + "'...");
+    cache.recordLine("copying path '/nix/store/00000000000000000000000000000000-elsewhere' from 'https://cache.nixos.org'...");
+    cache.recordLine("copying path '" + b + "' from 'local'...");
+    cache.recordLine("building '/nix/store/11111111111111111111111111111111-x.drv'...");
+    CHECK_EQ(cache.localHits(), 1);
+    CHECK_EQ(cache.remoteFetches(), 1);
+    CHECK_EQ(cache.bytesSaved(), sizeA);
+    CHECK(qAbs(cache.hitRate() - 0.5) < 1e-9);
+
+    // Found anywhere but the boot medium: signatures still required
+    LocalBinaryCache found;
+    CHECK(found.load(cacheDir));
+    CHECK(!found.isTrusted());
+    CHECK(!found.substituterUrl().contains("trusted"));
+
+    // The scratch store itself, in the plain store layout
+    CHECK(LocalBinaryCache::looksLikeCache(storeRoot));
+    LocalBinaryCache store;
+    CHECK(store.load(storeRoot, true));
+    CHECK_EQ(store.pathCount(), 2);
+    CHECK(store.substituterUrl().startsWith("local?root=" + storeRoot));
+    store.recordLine("copying path '" + b + "' from 'local?root=" + storeRoot + "&read-only=true'...");
+    CHECK_EQ(store.localHits(), 1);
+    CHECK(store.bytesSaved() > 0);
+
+    // Store files are read-only; let QTemporaryDir remove them
+    QProcess::execute("chmod", { "-R", "u+w", tmp.path() });
+    return 0;
+}
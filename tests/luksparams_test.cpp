@@ -0,0 +1,124 @@
+// Calibrates LUKS for this machine, formats a loop device with the
+// luks-format step the engine builds from the result, and reads the header
+// back with `cryptsetup luksDump`: the chosen cipher, key size and Argon2id
+// cost must be what the volume got. Needs root and loop devices; skipped
+// (77) elsewhere.
+
+#include "gptwriter.h"
+#include "installengine.h"
+#include "luksparams.h"
+#include "testing.h"
+
+#include <QFile>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+bool canOpen(const char *path)
+{
+    const int fd = ::open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) return false;
+    ::close(fd);
+    return true;
+}
+
+int run(const QString &program, const QStringList &args, QByteArray *output = nullptr, const QByteArray &input = {})
+{
+    QProcess p;
+    p.setProcessChannelMode(QProcess::MergedChannels);
+    p.start(program, args);
+    if (!p.waitForStarted()) return -1;
+    if (!input.isNull()) p.write(input);
+    p.closeWriteChannel();
+    if (!p.waitForFinished(300000) || p.exitStatus() != QProcess::NormalExit) return -1;
+    if (output) *output = p.readAll();
+    return p.exitCode();
+}
+
+// Detaches the loop device however the test ends
+struct Loop {
+    QString device;
+    ~Loop()
+    {
+        if (!device.isEmpty()) run("losetup", { "--detach", device });
+    }
+};
+
+bool dumpHas(const QString &dump, const QString &pattern)
+{
+    return QRegularExpression(pattern, QRegularExpression::MultilineOption).match(dump).hasMatch();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    if (geteuid() != 0) SKIP("needs root");
+    if (!canOpen("/dev/loop-control")) SKIP("no loop control");
+    for (const char *tool : { "losetup", "cryptsetup" }) {
+        if (QStandardPaths::findExecutable(tool).isEmpty()) SKIP("%s is not installed", tool);
+    }
+
+    QStringList log;
+    const LuksParams params = LuksCalibrator::calibrate(500, &log);
+    for (const QString &line : std::as_const(log)) fprintf(stderr, "%s\n", qPrintable(line));
+    CHECK(params.calibrated);
+    CHECK(params.pbkdfIterations >= 4);
+    CHECK(params.pbkdfMemoryKiB >= 32 * 1024);
+    // AES-XTS with AES instructions that benchmarked; Adiantum only as the faster alternative
+    if (params.aesNi && params.decryptMiBps > 0.0) CHECK(!params.isAdiantum());
+    CHECK_EQ(params.keySizeBits, params.isAdiantum() ? 256 : 512);
+    fprintf(stderr, "%s\n", qPrintable(params.summary()));
+
+    QTemporaryDir tmp;
+    CHECK(tmp.isValid());
+    const QString image = tmp.path() + "/disk.img";
+    QFile f(image);
+    CHECK(f.open(QIODevice::WriteOnly));
+    CHECK(f.resize(qint64(256) << 20));
+    f.close();
+    GptWriter gpt;
+    gpt.partitions << GptWriter::Partition { "ESP", GptWriter::EspType, qint64(32) << 20 }
+                   << GptWriter::Partition { "cryptroot", GptWriter::LinuxLuksType, 0 };
+    QString error;
+    CHECK(gpt.write(image, &error));
+
+    Loop loop;
+    QByteArray out;
+    const QDateTime attached = QDateTime::currentDateTime();
+    CHECK_EQ(run("losetup", { "--find", "--show", "--partscan", image }, &out), 0);
+    loop.device = QString::fromUtf8(out).trimmed();
+
+    InstallPlan plan;
+    plan.device = loop.device;
+    plan.luks = params;
+    plan.luksPassphrase = "calibrated passphrase";
+    CHECK(GptWriter::waitForNodes({ plan.partitionPath(2) }, attached, 30000, &error));
+
+    InstallEngine engine;
+    engine.setPlan(plan);
+    engine.buildDefaultGraph();
+    InstallStep *format = engine.step("luks-format");
+    CHECK(format && format->command);
+    const InstallCommand cmd = format->command();
+    CHECK_EQ(cmd.program, QString("cryptsetup"));
+    CHECK_EQ(run(cmd.program, cmd.args, &out, cmd.input), 0);
+
+    CHECK_EQ(run("cryptsetup", { "luksDump", plan.partitionPath(2) }, &out), 0);
+    const QString dump = QString::fromUtf8(out);
+    fprintf(stderr, "%s", qPrintable(dump));
+    CHECK(dumpHas(dump, "^\\s+cipher:\\s+" + QRegularExpression::escape(params.cipher) + "$"));
+    CHECK(dumpHas(dump, QString("^\\s+Key:\\s+%1 bits$").arg(params.keySizeBits)));
+    CHECK(dumpHas(dump, "^\\s+PBKDF:\\s+argon2id$"));
+    CHECK(dumpHas(dump, QString("^\\s+Time cost:\\s+%1$").arg(params.pbkdfIterations)));
+    CHECK(dumpHas(dump, QString("^\\s+Memory:\\s+%1$").arg(params.pbkdfMemoryKiB)));
+    CHECK(dumpHas(dump, QString("^\\s+Threads:\\s+%1$").arg(params.pbkdfParallel)));
+    return 0;
+}
@@ -0,0 +1,103 @@
+// Replays a short `nix build --log-format internal-json` log through
+// NixProgress and checks the aggregated counters, file transfers included.
+
+#include "nixprogress.h"
+#include "testing.h"
+
+#include <QStringList>
+
+namespace {
+
+QByteArray start(int id, int type, int parent, const QByteArray &text, const QByteArray &fields = "[]")
+{
+    return "@nix {\"action\":\"start\",\"fields\":" + fields + ",\"id\":" + QByteArray::number(id) + ",\"level\":4,\"parent\":"
+         + QByteArray::number(parent) + ",\"text\":\"" + text + "\",\"type\":" + QByteArray::number(type) + "}";
+}
+
+QByteArray result(int id, int type, const QByteArray &fields)
+{
+    return "@nix {\"action\":\"result\",\"fields\":" + fields + ",\"id\":" + QByteArray::number(id)
+         + ",\"type\":" + QByteArray::number(type) + "}";
+}
+
+QByteArray stop(int id)
+{
+    return "@nix {\"action\":\"stop\",\"id\":" + QByteArray::number(id) + "}";
+}
+
+QByteArray progress(qint64 done, qint64 expected)
+{
+    return "[" + QByteArray::number(done) + "," + QByteArray::number(expected) + ",0,0]";
+}
+
+} // namespace
+
+int main()
+{
+    NixProgress p;
+    const QByteArray a = "/nix/store/aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa-hello";
+    const QByteArray b = "/nix/store/bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb-world";
+
+    // Realise announces two paths and 3 MB of downloads
+    p.feedLine(start(1, NixProgress::actRealise, 0, ""));
+    p.feedLine(start(2, NixProgress::actCopyPaths, 0, ""));
+    p.feedLine(result(1, NixProgress::resSetExpected, "[101,3000000]"));
+    p.feedLine(result(2, NixProgress::resProgress, progress(0, 2)));
+
+    // Two substitutions, each a copy with a download beneath it
+    p.feedLine(start(10, NixProgress::actCopyPath, 0, "copying path '" + a + "' from 'https://cache.nixos.org'",
+                     "[\"" + a + "\",\"https://cache.nixos.org\",\"local\"]"));
+    p.feedLine(start(11, NixProgress::actFileTransfer, 10, "downloading 'https://cache.nixos.org/nar/a.nar.xz'",
+                     "[\"https://cache.nixos.org/nar/a.nar.xz\"]"));
+    p.feedLine(start(20, NixProgress::actCopyPath, 0, "copying path '" + b + "' from 'https://cache.nixos.org'",
+                     "[\"" + b + "\",\"https://cache.nixos.org\",\"local\"]"));
+    p.feedLine(start(21, NixProgress::actFileTransfer, 20, "downloading 'https://cache.nixos.org/nar/b.nar.xz'",
+                     "[\"https://cache.nixos.org/nar/b.nar.xz\"]"));
+    p.feedLine(result(11, NixProgress::resProgress, progress(500000, 1000000)));
+    p.feedLine(result(21, NixProgress::resProgress, progress(250000, 2000000)));
+
+    NixProgress::Snapshot s = p.snapshot();
+    CHECK_EQ(s.downloadDone, qint64(750000));
+    CHECK_EQ(s.downloadExpected, qint64(3000000));
+    CHECK(s.fraction() > 0.24 && s.fraction() < 0.26);
+
+    // Log lines of either kind are skipped without touching the counters
+    p.feedLine(result(10, NixProgress::resBuildLogLine, "[\"unpacking source archive\"]"));
+    p.feedLine(result(10, NixProgress::resPostBuildLogLine, "[\"post-build hook\"]"));
+    CHECK_EQ(p.snapshot().downloadDone, qint64(750000));
+
+    // Finished transfers keep their bytes after they stop
+    p.feedLine(result(11, NixProgress::resProgress, progress(1000000, 1000000)));
+    p.feedLine(stop(11));
+    p.feedLine(stop(10));
+    p.feedLine(result(2, NixProgress::resProgress, progress(1, 2)));
+    s = p.snapshot();
+    CHECK_EQ(s.downloadDone, qint64(1250000));
+    CHECK_EQ(s.pathsDone, qint64(1));
+    CHECK_EQ(s.pathsExpected, qint64(2));
+
+    p.feedLine(result(21, NixProgress::resProgress, progress(2000000, 2000000)));
+    p.feedLine(stop(21));
+    p.feedLine(stop(20));
+    p.feedLine(result(2, NixProgress::resProgress, progress(2, 2)));
+    s = p.snapshot();
+    CHECK_EQ(s.downloadDone, qint64(3000000));
+    CHECK_EQ(s.downloadExpected, qint64(3000000));
+    CHECK_EQ(s.pathsDone, qint64(2));
+    CHECK_EQ(s.fraction(), 1.0);
+    CHECK(s.summary().contains("2/2 paths fetched"));
+    CHECK(s.summary().contains("2.9/2.9 MiB downloaded"));
+    CHECK_EQ(s.linesParsed, qint64(20));
+
+    // Path verification starts end in type 107 as well
+    p.feedLine(start(30, NixProgress::actVerifyPaths, 0, "checking paths"));
+    CHECK(p.snapshot().currentActivity == "checking paths");
+
+    // Errors and info messages reach the log; talkative ones do not
+    const QByteArray error = "@nix {\"action\":\"msg\",\"level\":0,\"msg\":\"\\u001b[31;1merror:\\u001b[0m build failed\"}";
+    p.feedLine(error);
+    CHECK_EQ(p.snapshot().lastError, QString("\x1b[31;1merror:\x1b[0m build failed"));
+    CHECK_EQ(NixProgress::messageText(error), QString("error: build failed"));
+    CHECK(NixProgress::messageText("@nix {\"action\":\"msg\",\"level\":4,\"msg\":\"evaluating\"}").isEmpty());
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Builds an old store in a scratch directory with nix-store --add, damages
+// one of its paths, and imports both into a second scratch store the way the
+// store-reuse step does on a drive about to be wiped.
+
+#include "storereuse.h"
+#include "testing.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QUuid>
+
+namespace {
+
+// Adds a file with unique content to the store under `root`; empty on failure
+QString addToStore(const QString &root, const QString &dir, const QString &name)
+{
+    const QString file = dir + "/" + name;
+    QFile f(file);
+    if (!f.open(QIODevice::WriteOnly)) return QString();
+    f.write(QUuid::createUuid().toByteArray());
+    f.close();
+    QProcess p;
+    p.start("nix-store", { "--store", root, "--add", file });
+    if (!p.waitForFinished(120000) || p.exitStatus() != QProcess::NormalExit || p.exitCode() != 0) return QString();
+    return QString::fromUtf8(p.readAllStandardOutput()).trimmed();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    if (QStandardPaths::findExecutable("nix").isEmpty() || QStandardPaths::findExecutable("nix-store").isEmpty())
+        SKIP("needs nix and nix-store");
+
+    QTemporaryDir tmp;
+    CHECK(tmp.isValid());
+    const QString oldRoot = tmp.path() + "/old";
+    const QString newRoot = tmp.path() + "/new";
+    const QString good = addToStore(oldRoot, tmp.path(), "good");
+    const QString bad = addToStore(oldRoot, tmp.path(), "bad");
+    if (good.isEmpty() || bad.isEmpty()) SKIP("nix-store cannot create a store under %s", qPrintable(oldRoot));
+    CHECK(good.startsWith("/nix/store/"));
+
+    // Damage one path after its hash was recorded
+    QFile damaged(oldRoot + bad);
+    damaged.setPermissions(damaged.permissions() | QFileDevice::WriteOwner);
+    CHECK(damaged.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    damaged.write("not what was added");
+    damaged.close();
+
+    StoreReuse::Found found;
+    found.partition = "scratch";
+    found.nixDir = oldRoot + "/nix";
+    const QString missing = "/nix/store/00000000000000000000000000000000-not-in-the-old-store";
+    QString error;
+    StoreReuse::Result r = StoreReuse::import(found, { good, bad, missing }, newRoot, {}, &error);
+    CHECK_EQ(r.candidates, 2);
+    CHECK_EQ(r.paths, 1);
+    CHECK_EQ(r.imported, QStringList { good });
+    CHECK(r.bytes > 0);
+    CHECK(QFileInfo::exists(newRoot + good));
+    // nix refused the damaged path against its recorded hash
+    CHECK(!QFileInfo::exists(newRoot + bad));
+    CHECK(!error.isEmpty());
+
+    // What arrived is not a candidate again
+    error.clear();
+    r = StoreReuse::import(found, { good }, newRoot, {}, &error);
+    CHECK_EQ(r.candidates, 0);
+    CHECK_EQ(r.paths, 0);
+
+    // Store files are read-only; let QTemporaryDir remove them
+    QProcess::execute("chmod", { "-R", "u+w", tmp.path() });
+    return 0;
+}
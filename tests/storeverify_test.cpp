@@ -0,0 +1,85 @@
+// Hashes a scratch tree (nested directories, an executable, a symlink, an
+// empty file and one larger than a read block) as a NAR and compares the
+// result with Nix's own: `nix-store --dump | sha256sum` for the digest and
+// size, `nix-hash --type sha256 --base32` for the base-32 form.
+
+#include "storeverify.h"
+#include "testing.h"
+
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+
+namespace {
+
+bool writeFile(const QString &path, const QByteArray &data, bool executable = false)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) return false;
+    if (f.write(data) != data.size()) return false;
+    if (executable) f.setPermissions(f.permissions() | QFileDevice::ExeOwner);
+    return true;
+}
+
+QByteArray output(const QString &program, const QStringList &args, const QByteArray &input = {})
+{
+    QProcess p;
+    p.start(program, args);
+    if (!p.waitForStarted()) return QByteArray();
+    p.write(input);
+    p.closeWriteChannel();
+    if (!p.waitForFinished(60000) || p.exitStatus() != QProcess::NormalExit || p.exitCode() != 0) return QByteArray();
+    return p.readAllStandardOutput();
+}
+
+int compare(const QString &path)
+{
+    Sha256::Digest digest;
+    qint64 narSize = 0;
+    QString error;
+    CHECK(StoreVerifier::narHash(QFile::encodeName(path), &digest, &narSize, &error));
+    CHECK(error.isEmpty());
+    const QByteArray hex = QByteArray(reinterpret_cast<const char*>(digest.data()), int(digest.size())).toHex();
+
+    // nix-store --dump <path> | sha256sum
+    const QByteArray nar = output("nix-store", { "--dump", path });
+    CHECK(!nar.isEmpty());
+    CHECK_EQ(narSize, qint64(nar.size()));
+    CHECK_EQ(hex, output("sha256sum", {}, nar).left(64));
+    const QString base32 = QString::fromUtf8(output("nix-hash", { "--type", "sha256", "--base32", path })).trimmed();
+    CHECK_EQ(StoreVerifier::nixBase32(digest), base32);
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    for (const char *tool : { "nix-store", "nix-hash", "sha256sum" }) {
+        if (QStandardPaths::findExecutable(tool).isEmpty()) SKIP("%s is not installed", tool);
+    }
+
+    QTemporaryDir tmp;
+    CHECK(tmp.isValid());
+    const QString tree = tmp.path() + "/tree";
+    CHECK(QDir().mkpath(tree + "/share/doc"));
+    CHECK(QDir().mkpath(tree + "/bin"));
+    CHECK(QDir().mkpath(tree + "/empty-dir"));
+    CHECK(writeFile(tree + "/bin/hello", "#!/bin/sh\necho hello\n", true));
+    CHECK(writeFile(tree + "/share/doc/README", "not a multiple of eight"));
+    CHECK(writeFile(tree + "/share/empty", QByteArray()));
+    QByteArray big;
+    for (int i = 0; big.size() < (3 << 20) + 13; ++i) big += QByteArray::number(i) + '\n';
+    CHECK(writeFile(tree + "/share/big", big));
+    CHECK(QFile::link("../share/doc/README", tree + "/bin/readme"));
+
+    // The tree, each kind of entry on its own, and the portable SHA-256
+    for (const QString &path : { tree, tree + "/bin/hello", tree + "/share/big", tree + "/share/empty", tree + "/bin/readme" })
+        CHECK_EQ(compare(path), 0);
+    Sha256::forcePortable(true);
+    CHECK_EQ(compare(tree), 0);
+    return 0;
+}
@@ -0,0 +1,153 @@
+// SubstituterProxy against a stand-in upstream cache on localhost: misses are
+// fetched once, concurrent requests share a fetch, upstream 404s are
+// remembered and the list of them stays bounded.
+
+#include "substituterproxy.h"
+#include "testing.h"
+
+#include <QHash>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <memory>
+
+namespace {
+
+// Serves `files` after `delayMs`, 404 for anything else, counting requests per path
+class StandInUpstream : public QObject
+{
+public:
+    QHash<QString, QByteArray> files;
+    QHash<QString, int> requests;
+    int delayMs = 0;
+
+    bool listen()
+    {
+        QObject::connect(&server_, &QTcpServer::newConnection, this, [this]() {
+            while (server_.hasPendingConnections()) accept(server_.nextPendingConnection());
+        });
+        return server_.listen(QHostAddress::LocalHost, 0);
+    }
+    QUrl url() const { return QUrl(QString("http://127.0.0.1:%1").arg(server_.serverPort())); }
+
+private:
+    void accept(QTcpSocket *sock)
+    {
+        auto buffer = std::make_shared<QByteArray>();
+        QObject::connect(sock, &QTcpSocket::disconnected, sock, &QObject::deleteLater);
+        QObject::connect(sock, &QTcpSocket::readyRead, this, [this, sock, buffer]() {
+            *buffer += sock->readAll();
+            const int end = buffer->indexOf("\r\n\r\n");
+            if (end < 0) return;
+            const QString path = QString::fromLatin1(buffer->left(end).split(' ').value(1).mid(1));
+            buffer->clear();
+            ++requests[path];
+            QTimer::singleShot(delayMs, sock, [this, sock, path]() {
+                const bool found = files.contains(path);
+                const QByteArray body = files.value(path);
+                sock->write((found ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n")
+                            + QByteArray("Connection: close\r\nContent-Length: ") + QByteArray::number(body.size())
+                            + "\r\n\r\n" + body);
+                sock->disconnectFromHost();
+            });
+        });
+    }
+
+    QTcpServer server_;
+};
+
+struct Response {
+    bool done = false;
+    int status = 0;
+    QByteArray body;
+};
+
+std::shared_ptr<Response> get(QNetworkAccessManager &net, const QString &url, const QByteArray &range = QByteArray())
+{
+    auto response = std::make_shared<Response>();
+    QNetworkRequest req { QUrl(url) };
+    if (!range.isEmpty()) req.setRawHeader("Range", range);
+    QNetworkReply *reply = net.get(req);
+    QObject::connect(reply, &QNetworkReply::finished, reply, [reply, response]() {
+        response->status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        response->body = reply->readAll();
+        response->done = true;
+        reply->deleteLater();
+    });
+    return response;
+}
+
+std::shared_ptr<Response> getAndWait(QNetworkAccessManager &net, const QString &url, const QByteArray &range = QByteArray())
+{
+    auto response = get(net, url, range);
+    waitUntil([response]() { return response->done; });
+    return response;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTemporaryDir cacheDir;
+    CHECK(cacheDir.isValid());
+
+    StandInUpstream upstream;
+    const QByteArray narinfo = "StorePath: /nix/store/aaaa-hello\nURL: nar/aaaa.nar.xz\n";
+    const QByteArray nar = QByteArray(300 * 1024, 'n') + "end";
+    upstream.files.insert("aaaa.narinfo", narinfo);
+    upstream.files.insert("nar/aaaa.nar.xz", nar);
+    CHECK(upstream.listen());
+
+    SubstituterProxy proxy(cacheDir.path(), upstream.url());
+    CHECK(proxy.listen(QString("127.0.0.1:0")));
+    const QString base = QUrl(proxy.substituterUrl()).toString(QUrl::RemoveQuery);
+    QNetworkAccessManager net;
+
+    // A miss is fetched and kept; the repeat is served from disk
+    auto first = getAndWait(net, base + "/aaaa.narinfo");
+    CHECK_EQ(first->status, 200);
+    CHECK_EQ(first->body, narinfo);
+    auto again = getAndWait(net, base + "/aaaa.narinfo");
+    CHECK_EQ(again->body, narinfo);
+    CHECK_EQ(upstream.requests.value("aaaa.narinfo"), 1);
+    CHECK_EQ(proxy.stats().hits, 1);
+
+    // Two clients asking for the same NAR while it is being fetched share one fetch
+    upstream.delayMs = 200;
+    auto a = get(net, base + "/nar/aaaa.nar.xz");
+    auto b = get(net, base + "/nar/aaaa.nar.xz");
+    CHECK(waitUntil([a, b]() { return a->done && b->done; }));
+    CHECK_EQ(a->status, 200);
+    CHECK_EQ(b->body, nar);
+    CHECK_EQ(upstream.requests.value("nar/aaaa.nar.xz"), 1);
+    CHECK_EQ(proxy.stats().coalesced, 1);
+    upstream.delayMs = 0;
+
+    // Resumed downloads
+    auto part = getAndWait(net, base + "/nar/aaaa.nar.xz", "bytes=-3");
+    CHECK_EQ(part->status, 206);
+    CHECK_EQ(part->body, QByteArray("end"));
+
+    // An upstream 404 is remembered
+    CHECK_EQ(getAndWait(net, base + "/missing0.narinfo")->status, 404);
+    CHECK_EQ(getAndWait(net, base + "/missing0.narinfo")->status, 404);
+    CHECK_EQ(upstream.requests.value("missing0.narinfo"), 1);
+
+    // ... but only the most recent ones: the oldest is asked for again
+    proxy.maxNegativeEntries = 4;
+    for (int i = 1; i <= 4; ++i)
+        CHECK_EQ(getAndWait(net, base + QString("/missing%1.narinfo").arg(i))->status, 404);
+    CHECK_EQ(getAndWait(net, base + "/missing0.narinfo")->status, 404);
+    CHECK_EQ(upstream.requests.value("missing0.narinfo"), 2);
+    CHECK_EQ(getAndWait(net, base + "/missing4.narinfo")->status, 404);
+    CHECK_EQ(upstream.requests.value("missing4.narinfo"), 1);
+
+    // Paths outside the cache layout never reach upstream
+    CHECK_EQ(getAndWait(net, base + "/nar/../../etc/passwd")->status, 404);
+    return 0;
+}
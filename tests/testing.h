@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QCoreApplication>
+#include <QDeadlineTimer>
+#include <QDebug>
+#include <QEventLoop>
+#include <QTimer>
+#include <cstdio>
+#include <functional>
+
+// Every test is a small program run by `meson test`: exit code 0 passes, 1
+// fails and 77 skips, for checks that need root, loop devices or tools only
+// the live ISO has.
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            return 1; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        const auto a_ = (actual); \
+        const auto e_ = (expected); \
+        if (!(a_ == e_)) { \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed\n", __FILE__, __LINE__, #actual, #expected); \
+            qCritical().noquote() << "  actual:  " << a_ << "\n  expected:" << e_; \
+            return 1; \
+        } \
+    } while (0)
+
+#define SKIP(...) \
+    do { \
+        fprintf(stderr, "SKIP: " __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        return 77; \
+    } while (0)
+
+// Runs the event loop until `done` holds; false once `timeoutMs` passed
+inline bool waitUntil(const std::function<bool()> &done, int timeoutMs = 10000)
+{
+    if (done()) return true;
+    const QDeadlineTimer deadline(timeoutMs);
+    QEventLoop loop;
+    QTimer poll;
+    QObject::connect(&poll, &QTimer::timeout, &loop, [&]() {
+        if (done() || deadline.hasExpired()) loop.quit();
+    });
+    poll.start(5);
+    loop.exec();
+    return done();
+}